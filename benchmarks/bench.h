@@ -0,0 +1,114 @@
+/**
+ * bench.h
+ *
+ * Minimal timing helpers shared by the benchmark suites.
+ *
+ * Every measurement goes through bench_report(): printed as a table while running in text mode, or
+ * collected and emitted as JSON/CSV at the end so results can be diffed between releases.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef struct {
+  const char* name;
+  uint64_t iterations;
+  double nsPerOp;
+} bench_result_t;
+
+typedef enum {
+  BENCH_FORMAT_TEXT,
+  BENCH_FORMAT_JSON,
+  BENCH_FORMAT_CSV,
+} bench_format_t;
+
+static inline uint64_t bench_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief Keeps the compiler from discarding a value computed by the benchmarked code
+ */
+template <typename T>
+static inline void bench_do_not_optimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief Forces pending writes to memory to be considered observable
+ */
+static inline void bench_clobber(void) {
+  asm volatile("" : : : "memory");
+}
+
+/**
+ * @brief Calls op(i) `iterations` times and reports the average cost of a call
+ */
+template <typename Op>
+static inline bench_result_t bench_run(const char* name, uint64_t iterations, Op op) {
+  bench_result_t result;
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; i++) {
+    op(i);
+  }
+  result.name = name;
+  result.iterations = iterations;
+  result.nsPerOp = (double)(bench_now_ns() - start) / iterations;
+  return result;
+}
+
+void bench_set_format(bench_format_t format);
+
+/**
+ * @brief Starts a suite: the following results are reported under its name
+ */
+void bench_print_header(const char* suite);
+
+/**
+ * @brief Reports a bench_run() result in ns/op
+ */
+void bench_print(const bench_result_t& result);
+
+/**
+ * @brief Reports any measurement, e.g. bytes/s or a latency percentile
+ */
+void bench_report(const char* name, uint64_t iterations, double value, const char* unit);
+
+/**
+ * @brief Reports the process peak resident set size (getrusage ru_maxrss) under the current suite
+ */
+void bench_report_max_rss(void);
+
+/**
+ * @brief Emits the collected results in JSON/CSV, nothing in text mode (already printed)
+ */
+void bench_flush(FILE* out);
+
+/**
+ * @brief Benchmark suites, one per bench_<suite>.cpp
+ */
+void bench_codec(uint64_t iterations);
+void bench_yapi(uint64_t iterations);
+void bench_log(uint64_t iterations);
+void bench_memory(uint64_t iterations);
+void bench_observer(uint64_t iterations);
+void bench_telemetry(uint64_t iterations);
+void bench_window(uint64_t iterations);
+void bench_array(uint64_t iterations);
+void bench_rand(uint64_t iterations);
+void bench_metrics(uint64_t iterations);
+
+/**
+ * @brief End-to-end suite against the device simulator, skipped when simPath can not be started
+ */
+void bench_link(const char* simPath, uint64_t iterations);
+
+#endif // BENCH_H
@@ -0,0 +1,75 @@
+/**
+ * bench_array.cpp
+ *
+ * gz_array reductions over a buffer that stays in cache, against the loop gzarray_max_u16 was before: an
+ * element at a time, a branch per element
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <vector>
+
+#include "bench.h"
+#include "gz_array.h"
+
+#define ARRAY_ELEMENTS  4096
+
+static std::vector<uint8_t> _u8;
+static std::vector<uint16_t> _u16;
+static std::vector<int16_t> _i16;
+static std::vector<uint32_t> _u32;
+
+__attribute__((noinline)) static uint16_t _bench_array_loop_max_u16(const uint16_t* a, size_t count) {
+  uint16_t max = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (a[i] > max) {
+      max = a[i];
+    }
+  }
+  return max;
+}
+
+/**
+ * @brief Reports GB/s read by a reduction, its result kept so that it runs
+ */
+template <typename T, typename Reduce>
+static void _bench_array_run(const char* name, uint64_t iterations, const std::vector<T>& data, Reduce reduce) {
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; i++) {
+    bench_do_not_optimize(reduce(data.data(), data.size()));
+    bench_clobber();
+  }
+  double ns = (double)(bench_now_ns() - start);
+  bench_report(name, iterations, ns ? (double)iterations * data.size() * sizeof(T) / ns : 0, "GB/s");
+}
+
+void bench_array(uint64_t iterations) {
+  bench_print_header("gz_array");
+  bench_report(gzarray_simd_name(), 1, 1, "simd");
+  _u8.resize(ARRAY_ELEMENTS);
+  _u16.resize(ARRAY_ELEMENTS);
+  _i16.resize(ARRAY_ELEMENTS);
+  _u32.resize(ARRAY_ELEMENTS);
+  for (uint32_t i = 0; i < ARRAY_ELEMENTS; i++) {
+    uint32_t value = i * 2654435761u;
+    _u8[i] = value >> 24;
+    _u16[i] = value >> 16;
+    _i16[i] = (int16_t)(value >> 16);
+    _u32[i] = value;
+  }
+  iterations = iterations / 100 ? iterations / 100 : 1;
+
+  _bench_array_run("loop max u16, 4096", iterations, _u16, _bench_array_loop_max_u16);
+  _bench_array_run("gzarray_max_u16, 4096", iterations, _u16, gzarray_max_u16);
+  _bench_array_run("gzarray_min_u16, 4096", iterations, _u16, gzarray_min_u16);
+  _bench_array_run("gzarray_sum_u16, 4096", iterations, _u16, gzarray_sum_u16);
+  _bench_array_run("gzarray_argmax_u16, 4096", iterations, _u16, gzarray_argmax_u16);
+  _bench_array_run("gzarray_max_u8, 4096", iterations, _u8, gzarray_max_u8);
+  _bench_array_run("gzarray_sum_u8, 4096", iterations, _u8, gzarray_sum_u8);
+  _bench_array_run("gzarray_argmax_u8, 4096", iterations, _u8, gzarray_argmax_u8);
+  _bench_array_run("gzarray_max_i16, 4096", iterations, _i16, gzarray_max_i16);
+  _bench_array_run("gzarray_sum_i16, 4096", iterations, _i16, gzarray_sum_i16);
+  _bench_array_run("gzarray_max_u32, 4096", iterations, _u32, gzarray_max_u32);
+  _bench_array_run("gzarray_sum_u32, 4096", iterations, _u32, gzarray_sum_u32);
+  _bench_array_run("gzarray_argmax_u32, 4096", iterations, _u32, gzarray_argmax_u32);
+}
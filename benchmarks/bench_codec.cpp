@@ -0,0 +1,109 @@
+/**
+ * bench_codec.cpp
+ *
+ * yapi_codec encode/decode against the hand written memcpy and byte packing it replaced
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <string.h>
+
+#include "bench.h"
+#include "yapi_codec.h"
+
+static yapi_packet_t _packet_of(yapi_command_enum_t command, uint8_t length) {
+  yapi_packet_t packet;
+  memset(&packet, 0, sizeof(packet));
+  packet.command = command;
+  packet.length = length;
+  for (uint8_t i = 0; i < length; i++) {
+    packet.data[i] = i;
+  }
+  return packet;
+}
+
+static void _bench_decode(uint64_t iterations) {
+  yapi_packet_t summary = _packet_of(YAPI_CMD_PCU_SUMMARY_STATUS, sizeof(yapi_y6g_pcu_summary_status_t));
+  yapi_packet_t serial = _packet_of(YAPI_CMD_SERIAL_READ, sizeof(yapi_serial_number_read_response_t));
+
+  bench_print(bench_run("decode pcu_summary raw memcpy", iterations, [&](uint64_t i) {
+    yapi_y6g_pcu_summary_status_t status;
+    summary.data[0] = (uint8_t)i;
+    memcpy(&status, summary.data, summary.length);
+    bench_do_not_optimize(status);
+  }));
+  bench_print(bench_run("decode pcu_summary yapi_codec", iterations, [&](uint64_t i) {
+    yapi_y6g_pcu_summary_status_t status;
+    summary.data[0] = (uint8_t)i;
+    yapi_codec_decode_response<YAPI_CMD_PCU_SUMMARY_STATUS>(&summary, &status);
+    bench_do_not_optimize(status);
+  }));
+  bench_print(bench_run("decode serial_read raw memcpy", iterations, [&](uint64_t i) {
+    yapi_serial_number_read_response_t readId;
+    serial.data[0] = (uint8_t)i;
+    memcpy(&readId, serial.data, serial.length);
+    bench_do_not_optimize(readId);
+  }));
+  bench_print(bench_run("decode serial_read yapi_codec", iterations, [&](uint64_t i) {
+    yapi_serial_number_read_response_t readId;
+    serial.data[0] = (uint8_t)i;
+    yapi_codec_decode_response<YAPI_CMD_SERIAL_READ>(&serial, &readId);
+    bench_do_not_optimize(readId);
+  }));
+}
+
+static void _bench_encode(uint64_t iterations) {
+  uint8_t data[YAPI_DATA_SIZE];
+  uint8_t content[128];
+  memset(content, 0xA5, sizeof(content));
+
+  bench_print(bench_run("encode flash_read byte packing", iterations, [&](uint64_t i) {
+    uint32_t addressOffset = (uint32_t)i;
+    uint8_t index = 0;
+    data[index++] = (uint8_t)addressOffset;
+    data[index++] = (uint8_t)(addressOffset >> 8);
+    data[index++] = (uint8_t)(addressOffset >> 16);
+    data[index++] = (uint8_t)(addressOffset >> 24);
+    data[index++] = 32;
+    bench_do_not_optimize(index);
+    bench_do_not_optimize(data);
+    bench_clobber();
+  }));
+  bench_print(bench_run("encode flash_read yapi_codec", iterations, [&](uint64_t i) {
+    yapi_flash_read_request_t request;
+    request.addressOffset = (uint32_t)i;
+    request.readSize = 32;
+    uint8_t length = yapi_codec_encode_as(request, data);
+    bench_do_not_optimize(length);
+    bench_do_not_optimize(data);
+    bench_clobber();
+  }));
+  bench_print(bench_run("encode flash_write 128B byte packing", iterations, [&](uint64_t i) {
+    uint32_t addressOffset = (uint32_t)i;
+    uint8_t index = 0;
+    content[0] = (uint8_t)i;
+    data[index++] = (uint8_t)addressOffset;
+    data[index++] = (uint8_t)(addressOffset >> 8);
+    data[index++] = (uint8_t)(addressOffset >> 16);
+    data[index++] = (uint8_t)(addressOffset >> 24);
+    memcpy(data + index, content, sizeof(content));
+    bench_do_not_optimize(index);
+    bench_do_not_optimize(data);
+    bench_clobber();
+  }));
+  bench_print(bench_run("encode flash_write 128B yapi_codec", iterations, [&](uint64_t i) {
+    yapi_flash_write_request_t request;
+    request.addressOffset = (uint32_t)i;
+    content[0] = (uint8_t)i;
+    uint8_t length = yapi_codec_encode_as(request, data, content, sizeof(content));
+    bench_do_not_optimize(length);
+    bench_do_not_optimize(data);
+    bench_clobber();
+  }));
+}
+
+void bench_codec(uint64_t iterations) {
+  bench_print_header("yapi_codec");
+  _bench_decode(iterations);
+  _bench_encode(iterations);
+}
@@ -0,0 +1,224 @@
+/**
+ * bench_link.cpp
+ *
+ * End-to-end over a pseudo-terminal: the host stack (uart, yapi_service_driver, yapi_client) against the
+ * yapi_sim device simulator started as a child process. Measures OTA upload throughput to the simulated
+ * MPPT bootloader and request round-trip latency percentiles.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include "yapi_client.h" // C++ API, must stay outside of the extern "C" block
+#include "yapi_codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "uart.h"
+#include "yapi_service_driver.h"
+#include "gz_hash.h"
+#include "gz_rand.h"
+#include "gz_log.h"
+
+#define OTA_IMAGE_SIZE            (16 * 1024)
+#define OTA_CHUNK_SIZE            128         // same as ota_host flash_upload
+#define OTA_PAGE_SIZE             2048        // yapi_sim MPPT page
+#define OTA_TIMEOUT_MS            2000
+#define RTT_MIN_REQUESTS          100
+#define SIM_BAUD_RATE             "115200"
+
+typedef struct {
+  pid_t pid;
+  FILE* output;
+  char device[64];
+} _Bench_Sim_t;
+
+static std::atomic<bool> _isLoopRunning(false);
+
+/**
+ * @brief Starts yapi_sim with the given arguments and reads the device it opened from its first line
+ */
+static bool _bench_sim_start(const char* simPath, const char* baudRate, _Bench_Sim_t* sim) {
+  int pipeFds[2];
+  if (access(simPath, X_OK) || pipe(pipeFds)) {
+    return false;
+  }
+  sim->pid = fork();
+  if (sim->pid == 0) {
+    dup2(pipeFds[1], STDOUT_FILENO);
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    if (baudRate) {
+      execl(simPath, simPath, "-b", baudRate, (char*)NULL);
+    } else {
+      execl(simPath, simPath, (char*)NULL);
+    }
+    _exit(1);
+  }
+  close(pipeFds[1]);
+  sim->output = fdopen(pipeFds[0], "r");
+  char line[256];
+  sim->device[0] = '\0';
+  if (sim->pid > 0 && sim->output && fgets(line, sizeof(line), sim->output)) {
+    const char* start = strchr(line, '(');
+    const char* end = start ? strchr(start, ')') : NULL;
+    if (end && end - start - 1 < (int)sizeof(sim->device)) {
+      memcpy(sim->device, start + 1, end - start - 1);
+      sim->device[end - start - 1] = '\0';
+    }
+  }
+  return sim->device[0] != '\0';
+}
+
+static void _bench_sim_stop(_Bench_Sim_t* sim) {
+  if (sim->pid > 0) {
+    kill(sim->pid, SIGINT);
+    char line[256];
+    while (sim->output && fgets(line, sizeof(line), sim->output)) {
+      // drain the exit statistics so the simulator does not block on a full pipe
+    }
+    waitpid(sim->pid, NULL, 0);
+  }
+  if (sim->output) {
+    fclose(sim->output);
+  }
+}
+
+/**
+ * @brief The host main loop, as in ota_host_app/main.cpp
+ */
+static void _bench_host_loop(void) {
+  uint8_t buffer[64];
+  while (_isLoopRunning) {
+    if (yapi_service_driver_poll(1) & POLLIN) {
+      uart_read(uart_get_connected_device(), buffer, sizeof(buffer));
+    }
+    yapi_service_driver_10ms(NULL);
+    yapi_client_task();
+  }
+}
+
+static bool _bench_request_ok(std::future<yapi_client_result_t> future) {
+  return future.get().status == YAPI_CLIENT_STATUS_OK;
+}
+
+/**
+ * @brief Erase, stop-and-wait 128B writes, verify: what ota_host flash_upload does
+ */
+static void _bench_ota(const char* name) {
+  std::vector<uint8_t> image(OTA_IMAGE_SIZE);
+  gzrand_seed_uint(1);
+  gzrand_fill(image.data(), image.size());
+  yapi_client_options_t options = yapi_client_default_options();
+  options.timeout_ms = OTA_TIMEOUT_MS;
+  options.retries = 0;
+  uint8_t data[YAPI_DATA_SIZE];
+
+  uint64_t start = bench_now_ns();
+  yapi_flash_erase_request_t erase;
+  erase.addressOffset = 0;
+  erase.numberOfPages = (OTA_IMAGE_SIZE + OTA_PAGE_SIZE - 1) / OTA_PAGE_SIZE;
+  bool isOk = _bench_request_ok(yapi_client_set(YAPI_DEVICE_MPPT, YAPI_CMD_FLASH_ERASE, data,
+                                                yapi_codec_encode_as(erase, data), &options));
+  uint16_t crc = 0;
+  for (uint32_t offset = 0; isOk && offset < OTA_IMAGE_SIZE; offset += OTA_CHUNK_SIZE) {
+    yapi_flash_write_request_t write;
+    write.addressOffset = offset;
+    uint8_t length = yapi_codec_encode_as(write, data, &image[offset], OTA_CHUNK_SIZE);
+    isOk = _bench_request_ok(yapi_client_set(YAPI_DEVICE_MPPT, YAPI_CMD_FLASH_WRITE, data, length, &options));
+    crc = gz_crc16_seeded(&image[offset], OTA_CHUNK_SIZE, crc);
+  }
+  yapi_flash_verify_request_t verify;
+  verify.startAddressOffset = 0;
+  verify.endAddressOffset = OTA_IMAGE_SIZE;
+  verify.crc16 = crc;
+  isOk = isOk && _bench_request_ok(yapi_client_get(YAPI_DEVICE_MPPT, YAPI_CMD_FLASH_VERIFY, data,
+                                                   yapi_codec_encode_as(verify, data), &options));
+  uint64_t elapsed = bench_now_ns() - start;
+  if (!isOk) {
+    fprintf(stderr, "bench_link: %s failed\n", name);
+    return;
+  }
+  bench_report(name, OTA_IMAGE_SIZE, OTA_IMAGE_SIZE * 1e9 / elapsed, "bytes/s");
+}
+
+/**
+ * @brief Sequential HELLO requests to the PCU, one in flight
+ */
+static void _bench_rtt(uint64_t requests) {
+  std::vector<uint64_t> rtt_ns;
+  rtt_ns.reserve(requests);
+  yapi_client_options_t options = yapi_client_default_options();
+  options.retries = 0;
+  for (uint64_t i = 0; i < requests; i++) {
+    uint64_t start = bench_now_ns();
+    if (_bench_request_ok(yapi_client_get(YAPI_DEVICE_PCU, YAPI_CMD_HELLO, NULL, 0, &options))) {
+      rtt_ns.push_back(bench_now_ns() - start);
+    }
+  }
+  if (rtt_ns.empty()) {
+    fprintf(stderr, "bench_link: no HELLO response\n");
+    return;
+  }
+  std::sort(rtt_ns.begin(), rtt_ns.end());
+  const struct { const char* name; double percentile; } percentiles[] = {
+    { "request rtt p50", 0.50 },
+    { "request rtt p90", 0.90 },
+    { "request rtt p99", 0.99 },
+    { "request rtt max", 1.00 },
+  };
+  for (uint8_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+    size_t index = (size_t)(percentiles[i].percentile * (rtt_ns.size() - 1));
+    bench_report(percentiles[i].name, rtt_ns.size(), rtt_ns[index] / 1e3, "us");
+  }
+}
+
+/**
+ * @brief Connects the host stack to a fresh simulator, runs `body`, tears everything down
+ */
+template <typename Body>
+static void _bench_with_sim(const char* simPath, const char* baudRate, Body body) {
+  _Bench_Sim_t sim;
+  memset(&sim, 0, sizeof(sim));
+  if (!_bench_sim_start(simPath, baudRate, &sim)) {
+    fprintf(stderr, "bench_link: cannot start (%s), skipped\n", simPath);
+    _bench_sim_stop(&sim);
+    return;
+  }
+  int fd = uart_connect(sim.device, 115200);
+  if (fd >= 0) {
+    _isLoopRunning = true;
+    std::thread loop(_bench_host_loop);
+    body();
+    _isLoopRunning = false;
+    loop.join();
+    uart_disconnect(fd);
+  }
+  _bench_sim_stop(&sim);
+}
+
+void bench_link(const char* simPath, uint64_t iterations) {
+  bench_print_header("link (pty + yapi_sim)");
+  gz_log_set_level(GZ_LOG_LEVEL_ERROR); // uart_connect is chatty
+  yapi_service_driver_init();
+  yapi_client_init();
+  uint64_t requests = std::max<uint64_t>(iterations / 10000, RTT_MIN_REQUESTS);
+  _bench_with_sim(simPath, NULL, [&]() {
+    _bench_ota("ota upload 16KiB, unpaced");
+    _bench_rtt(requests);
+  });
+  _bench_with_sim(simPath, SIM_BAUD_RATE, [&]() {
+    _bench_ota("ota upload 16KiB, " SIM_BAUD_RATE " baud");
+  });
+  bench_report_max_rss();
+}
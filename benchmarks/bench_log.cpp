@@ -0,0 +1,77 @@
+/**
+ * bench_log.cpp
+ *
+ * gz_log cost for the caller: nothing for a disabled level, formatted and written on the calling thread, or
+ * captured into the async rings
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "gz_log.h"
+
+#define LOG_NULL_DEVICE "/dev/null"
+#define LOG_BURST       256 // messages that fit in a ring, the writer is out of the measure
+
+#if GZ_LOG_COMPILE_LEVEL > 1
+#define GZ_LOG_COMPILE_NOTE ", compiled out"
+#else
+#define GZ_LOG_COMPILE_NOTE " at run time"
+#endif
+
+static uint64_t _bench_log_argument(uint64_t i) {
+  bench_clobber(); // an argument with a cost, evaluated only when the level is enabled
+  return i * 3;
+}
+
+static void _bench_log_line(uint64_t i) {
+  GZ_LOG_INFO("frame %u from %s, crc %04X\n", (unsigned)i, "uart", (unsigned)(i & 0xFFFF));
+}
+
+void bench_log(uint64_t iterations) {
+  FILE* output = fopen(LOG_NULL_DEVICE, "w");
+  if (!output) {
+    return;
+  }
+  bench_print_header("gz_log");
+  gz_log_set_level(GZ_LOG_LEVEL_INFO);
+  gz_log_set_output(output);
+  bench_print(bench_run("GZ_LOG_DEBUG disabled" GZ_LOG_COMPILE_NOTE, iterations, [](uint64_t i) {
+    GZ_LOG_DEBUG("frame %u from %s, crc %04X\n", (unsigned)_bench_log_argument(i), "uart", (unsigned)(i & 0xFFFF));
+  }));
+  gz_log_set_level(GZ_LOG_LEVEL_ERROR);
+  bench_print(bench_run("GZ_LOG_INFO disabled at run time", iterations, [](uint64_t i) {
+    GZ_LOG_INFO("frame %u from %s, crc %04X\n", (unsigned)_bench_log_argument(i), "uart", (unsigned)(i & 0xFFFF));
+  }));
+  gz_log_set_level(GZ_LOG_LEVEL_INFO);
+  bench_print(bench_run("GZ_LOG_INFO 3 args, sync, buffered", iterations, _bench_log_line));
+  // What a terminal costs: one write() per line
+  setvbuf(output, NULL, _IOLBF, BUFSIZ);
+  bench_print(bench_run("GZ_LOG_INFO 3 args, sync, line buffered", iterations, _bench_log_line));
+  setvbuf(output, NULL, _IOFBF, BUFSIZ);
+
+  gz_log_async_start(GZ_LOG_FULL_BLOCK);
+  uint64_t elapsed = 0;
+  for (uint64_t i = 0; i < iterations; i += LOG_BURST) {
+    uint64_t start = bench_now_ns();
+    for (uint64_t j = i; j < i + LOG_BURST; j++) {
+      _bench_log_line(j);
+    }
+    elapsed += bench_now_ns() - start;
+    gz_log_flush();
+  }
+  bench_report("GZ_LOG_INFO 3 args, async (caller)", iterations, (double)elapsed / iterations, "ns/op");
+
+  // Bounded by the writer thread once the ring is full
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; i++) {
+    _bench_log_line(i);
+  }
+  gz_log_flush();
+  bench_report("GZ_LOG_INFO 3 args, async (written)", iterations, (double)(bench_now_ns() - start) / iterations, "ns/op");
+  gz_log_async_stop();
+  gz_log_set_output(NULL);
+  fclose(output);
+}
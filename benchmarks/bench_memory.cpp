@@ -0,0 +1,95 @@
+/**
+ * bench_memory.cpp
+ *
+ * What DEBUG_MEMORY_LEAKS adds to an allocation: the gz_memory tracker against plain malloc/free, with few
+ * and with many live blocks (the cost must not depend on it). Then the gz_pool blocks and arena that replace
+ * malloc on the hot paths
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdlib.h>
+#include <vector>
+
+#include "bench.h"
+#include "gz_memory_private.h"
+#include "gz_pool.h"
+
+#define MEMORY_BLOCK_SIZE   64
+#define MEMORY_LIVE_BLOCKS  100000
+#define MEMORY_POOL_BLOCKS  1024
+#define MEMORY_ARENA_SIZE   (64 * 1024)
+
+static void _bench_memory_round(uint64_t iterations, const char* name) {
+  bench_print(bench_run(name, iterations, [](uint64_t i) {
+    void* pointer = gz_memory_malloc(MEMORY_BLOCK_SIZE, (char*)__FILE__, __LINE__, (char*)__FUNCTION__);
+    bench_do_not_optimize(pointer);
+    gz_memory_free(pointer);
+  }));
+}
+
+static void _bench_memory_pool(uint64_t iterations) {
+  static gz_pool_t pool;
+  gz_pool_init(&pool, MEMORY_BLOCK_SIZE, MEMORY_POOL_BLOCKS, NULL, GZ_POOL_FLAG_NONE);
+  bench_print(bench_run("gz_pool alloc/free 64B", iterations, [](uint64_t i) {
+    void* pointer = gz_pool_alloc(&pool);
+    bench_do_not_optimize(pointer);
+    gz_pool_free(&pool, pointer);
+  }));
+  gz_pool_destroy(&pool);
+  gz_pool_init(&pool, MEMORY_BLOCK_SIZE, MEMORY_POOL_BLOCKS, NULL, GZ_POOL_FLAG_THREAD_CACHE);
+  bench_print(bench_run("gz_pool alloc/free 64B, thread cache", iterations, [](uint64_t i) {
+    void* pointer = gz_pool_alloc(&pool);
+    bench_do_not_optimize(pointer);
+    gz_pool_free(&pool, pointer);
+  }));
+  gz_pool_destroy(&pool);
+
+  static gz_arena_t arena;
+  gz_arena_init(&arena, NULL, MEMORY_ARENA_SIZE);
+  bench_print(bench_run("gz_arena alloc 64B, reset when full", iterations, [](uint64_t i) {
+    void* pointer = gz_arena_alloc(&arena, MEMORY_BLOCK_SIZE);
+    if (!pointer) {
+      gz_arena_reset(&arena);
+      pointer = gz_arena_alloc(&arena, MEMORY_BLOCK_SIZE);
+    }
+    bench_do_not_optimize(pointer);
+  }));
+  gz_arena_destroy(&arena);
+}
+
+void bench_memory(uint64_t iterations) {
+  bench_print_header("gz_memory");
+  bench_print(bench_run("malloc/free 64B, untracked", iterations, [](uint64_t i) {
+    void* pointer = malloc(MEMORY_BLOCK_SIZE);
+    bench_do_not_optimize(pointer);
+    free(pointer);
+  }));
+  _bench_memory_round(iterations, "gz_memory malloc/free 64B, no live block");
+
+  std::vector<void*> blocks(MEMORY_LIVE_BLOCKS);
+  uint64_t start = bench_now_ns();
+  for (uint32_t i = 0; i < MEMORY_LIVE_BLOCKS; i++) {
+    blocks[i] = gz_memory_malloc(MEMORY_BLOCK_SIZE, (char*)__FILE__, __LINE__, (char*)__FUNCTION__);
+  }
+  bench_report("gz_memory malloc 64B, up to 100000 live", MEMORY_LIVE_BLOCKS,
+               (double)(bench_now_ns() - start) / MEMORY_LIVE_BLOCKS, "ns/op");
+  _bench_memory_round(iterations, "gz_memory malloc/free 64B, 100000 live");
+  bench_print(bench_run("gz_memory realloc 64B <-> 128B, 100000 live", iterations, [&](uint64_t i) {
+    uint32_t index = i % MEMORY_LIVE_BLOCKS;
+    blocks[index] = gz_memory_realloc(blocks[index], (i & 1) ? MEMORY_BLOCK_SIZE : 2 * MEMORY_BLOCK_SIZE,
+                                      (char*)__FILE__, __LINE__, (char*)__FUNCTION__);
+  }));
+
+  gz_memory_stats_t stats;
+  gz_memory_get_stats(&stats);
+  bench_report("tracked blocks", 1, stats.count, "blocks");
+  bench_report("table slots", 1, stats.capacity, "slots");
+  start = bench_now_ns();
+  for (uint32_t i = 0; i < MEMORY_LIVE_BLOCKS; i++) {
+    gz_memory_free(blocks[i]);
+  }
+  bench_report("gz_memory free 64B, down from 100000 live", MEMORY_LIVE_BLOCKS,
+               (double)(bench_now_ns() - start) / MEMORY_LIVE_BLOCKS, "ns/op");
+  _bench_memory_pool(iterations);
+}
@@ -0,0 +1,82 @@
+/**
+ * bench_metrics.cpp
+ *
+ * What the gz_metrics instrumentation costs the hot paths: a counter, a family entry and a histogram record
+ * against the atomic add on a shared counter they replace, then both with 4 threads updating at once (the
+ * shared counter bounces its cache line between them). Last, a full dump
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "gz_metrics.h"
+
+#define METRICS_BENCH_THREADS 4
+
+static uint64_t _sharedCounter = 0;
+
+static void _bench_metrics_threads(const char* name, uint64_t iterations, void (*update)(uint64_t)) {
+  uint64_t perThread = iterations / METRICS_BENCH_THREADS;
+  uint64_t start = bench_now_ns();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < METRICS_BENCH_THREADS; t++) {
+    threads.push_back(std::thread([perThread, update]() {
+      for (uint64_t i = 0; i < perThread; i++) {
+        update(i);
+      }
+    }));
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  double ns = (double)(bench_now_ns() - start);
+  bench_report(name, perThread * METRICS_BENCH_THREADS, ns / (perThread * METRICS_BENCH_THREADS), "ns/op");
+}
+
+static void _bench_metrics_discard(void* context, const char* text, size_t length) {
+  *(uint64_t*)context += length;
+}
+
+void bench_metrics(uint64_t iterations) {
+  bench_print_header("metrics");
+  static int counter = gz_metrics_counter("bench_counter_total", NULL);
+  static int family = gz_metrics_counter_family("bench_family_total", NULL, "command", 256, NULL);
+  static int histogram = gz_metrics_histogram("bench_latency_ns", NULL);
+
+  bench_print(bench_run("shared counter, atomic add (baseline)", iterations, [](uint64_t i) {
+    __atomic_fetch_add(&_sharedCounter, 1, __ATOMIC_RELAXED);
+  }));
+  bench_print(bench_run("gz_metrics_inc", iterations, [](uint64_t i) {
+    gz_metrics_inc(counter);
+  }));
+  bench_print(bench_run("gz_metrics_add_at, 256 entries", iterations, [](uint64_t i) {
+    gz_metrics_add_at(family, i & 0xFF, 1);
+  }));
+  bench_print(bench_run("gz_metrics_record", iterations, [](uint64_t i) {
+    gz_metrics_record(histogram, i & 0xFFFFF);
+  }));
+  bench_print(bench_run("gz_metrics_now_ns", iterations, [](uint64_t i) {
+    bench_do_not_optimize(gz_metrics_now_ns());
+  }));
+
+  _bench_metrics_threads("shared counter, 4 threads", iterations, [](uint64_t i) {
+    __atomic_fetch_add(&_sharedCounter, 1, __ATOMIC_RELAXED);
+  });
+  _bench_metrics_threads("gz_metrics_inc, 4 threads", iterations, [](uint64_t i) {
+    gz_metrics_inc(counter);
+  });
+  _bench_metrics_threads("gz_metrics_record, 4 threads", iterations, [](uint64_t i) {
+    gz_metrics_record(histogram, i & 0xFFFFF);
+  });
+  bench_do_not_optimize(_sharedCounter);
+
+  static uint64_t dumped = 0;
+  uint64_t dumps = iterations / 10000 ? iterations / 10000 : 1;
+  bench_print(bench_run("gz_metrics_dump prometheus", dumps, [](uint64_t i) {
+    gz_metrics_dump(GZ_METRICS_FORMAT_PROMETHEUS, _bench_metrics_discard, &dumped);
+  }));
+  bench_report("prometheus dump size", 1, (double)dumped / dumps, "bytes");
+}
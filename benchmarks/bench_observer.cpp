@@ -0,0 +1,112 @@
+/**
+ * bench_observer.cpp
+ *
+ * Notify cost of the gz_observer linked list against the contiguous registry, with 1 to 1000 observers,
+ * and what the registry pays instead on add/remove (a new snapshot each time). Then what the notifying thread
+ * pays with a slow observer, inline against gz_observer_async
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <sched.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "gz_observer.h"
+
+#define OBSERVER_SLOW_NS    2000  // a console or file write
+#define OBSERVER_EVENT_SIZE 64
+
+static uint64_t _notified;
+
+static void _bench_observer_cb(void* data) {
+  _notified++;
+}
+
+static void _bench_observer_slow_cb(void* data) {
+  uint64_t start = bench_now_ns();
+  while (bench_now_ns() - start < OBSERVER_SLOW_NS) {
+  }
+  _notified++;
+}
+
+static void _bench_observer_async(uint64_t iterations) {
+  static uint8_t event[OBSERVER_EVENT_SIZE];
+  static gz_observer_registry_t registry = GZ_OBSERVER_REGISTRY_INITIALIZER;
+  gz_observer_registry_add(&registry, _bench_observer_slow_cb, 0);
+  bench_print(bench_run("registry notify, 1 slow observer (2 us)", iterations, [](uint64_t i) {
+    gz_observer_registry_notify(&registry, event);
+  }));
+  gz_observer_registry_destroy(&registry);
+
+  static gz_observer_async_t* async = gz_observer_async_create(OBSERVER_EVENT_SIZE, 256, 2);
+  gz_observer_async_add(async, _bench_observer_slow_cb, 1);
+  bench_print(bench_run("async notify 64B, 1 slow observer (2 us)", iterations, [](uint64_t i) {
+    gz_observer_async_notify(async, event, sizeof(event));
+  }));
+  gz_observer_async_flush(async);
+  gz_observer_async_stats_t stats;
+  gz_observer_async_get_stats(async, &stats);
+  bench_report("async dropped, queue full", 1, stats.dropped, "events");
+  gz_observer_async_remove(async, _bench_observer_slow_cb);
+  gz_observer_async_add(async, _bench_observer_cb, GZ_OBSERVER_ASYNC_MAX_DEPTH);
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; i++) {
+    while (gz_observer_async_notify(async, event, sizeof(event)) != 0) {
+      sched_yield(); // full, let the workers run
+    }
+  }
+  gz_observer_async_flush(async);
+  bench_report("async notify 64B until delivered, 1 observer", iterations,
+               (double)(bench_now_ns() - start) / iterations, "ns/op");
+
+  gz_observer_async_lag_t lag;
+  gz_observer_async_get_stats(async, &stats);
+  gz_observer_async_get_lags(async, &lag, 1);
+  bench_report("async coalesced, total", 1, stats.coalesced, "events");
+  bench_report("async queue high water", 1, stats.queueHighWater, "events");
+  bench_report("async average lag, last observer", lag.delivered, lag.delivered ? lag.totalLag_ns / lag.delivered : 0,
+               "ns");
+  gz_observer_async_destroy(async);
+}
+
+static void _bench_observer_notify(uint64_t iterations, uint32_t observers) {
+  char name[64];
+  gz_observer_node_t* list = NULL;
+  static gz_observer_registry_t registry = GZ_OBSERVER_REGISTRY_INITIALIZER;
+  for (uint32_t i = 0; i < observers; i++) {
+    gz_observer_add_to_list(&list, _bench_observer_cb);
+    gz_observer_registry_add(&registry, _bench_observer_cb, 0);
+  }
+  // same number of callbacks run whatever the count of observers
+  iterations = iterations / observers + 1;
+  snprintf(name, sizeof(name), "list notify, %u observers", (unsigned)observers);
+  bench_print(bench_run(name, iterations, [&](uint64_t i) {
+    gz_observer_notify(list, NULL);
+  }));
+  snprintf(name, sizeof(name), "registry notify, %u observers", (unsigned)observers);
+  bench_print(bench_run(name, iterations, [](uint64_t i) {
+    gz_observer_registry_notify(&registry, NULL);
+  }));
+  gz_observer_destroy(&list);
+  gz_observer_registry_destroy(&registry);
+}
+
+void bench_observer(uint64_t iterations) {
+  bench_print_header("gz_observer");
+  for (uint32_t observers = 1; observers <= 1000; observers *= 10) {
+    _bench_observer_notify(iterations, observers);
+  }
+
+  static gz_observer_registry_t registry = GZ_OBSERVER_REGISTRY_INITIALIZER;
+  for (uint32_t i = 0; i < 10; i++) {
+    gz_observer_registry_add(&registry, _bench_observer_cb, 0);
+  }
+  bench_print(bench_run("registry add/remove, 10 observers", iterations / 10, [](uint64_t i) {
+    gz_observer_registry_add(&registry, _bench_observer_cb, 1);
+    gz_observer_registry_remove(&registry, _bench_observer_cb);
+  }));
+  gz_observer_registry_destroy(&registry);
+  _bench_observer_async(iterations / 100);
+  bench_do_not_optimize(_notified);
+}
@@ -0,0 +1,80 @@
+/**
+ * bench_rand.cpp
+ *
+ * gz_rand generators: a number from an explicit state, through the per-thread default state, bounded, and
+ * bulk fills in GB/s. The LCG gz_rand was before is the baseline
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <vector>
+
+#include "bench.h"
+#include "gz_rand.h"
+
+#define RAND_FILL_SIZE  65536
+
+static unsigned long int _lcgNext = 1;
+
+static int _bench_rand_lcg(void) {
+  _lcgNext = _lcgNext * 1103515245 + 12345;
+  return (unsigned int)(_lcgNext / 65536) % 32768;
+}
+
+static void _bench_rand_fill(const char* name, uint64_t iterations, void (*fill)(void*, size_t)) {
+  static std::vector<uint8_t> buffer(RAND_FILL_SIZE);
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; i++) {
+    fill(buffer.data(), buffer.size());
+    bench_clobber();
+  }
+  double ns = (double)(bench_now_ns() - start);
+  bench_report(name, iterations, ns ? (double)iterations * buffer.size() / ns : 0, "GB/s");
+}
+
+void bench_rand(uint64_t iterations) {
+  bench_print_header("gz_rand");
+  static uint64_t sink = 0;
+  bench_print(bench_run("LCG, 15 bits (before)", iterations, [](uint64_t i) {
+    sink += _bench_rand_lcg();
+  }));
+
+  static gz_xoshiro256_t xoshiro;
+  gz_xoshiro256_seed(&xoshiro, 1);
+  bench_print(bench_run("gz_xoshiro256_next, 64 bits", iterations, [](uint64_t i) {
+    sink += gz_xoshiro256_next(&xoshiro);
+  }));
+  bench_print(bench_run("gz_xoshiro256_bounded(1000)", iterations, [](uint64_t i) {
+    sink += gz_xoshiro256_bounded(&xoshiro, 1000);
+  }));
+  static gz_pcg32_t pcg;
+  gz_pcg32_seed(&pcg, 1, 1);
+  bench_print(bench_run("gz_pcg32_next, 32 bits", iterations, [](uint64_t i) {
+    sink += gz_pcg32_next(&pcg);
+  }));
+  bench_print(bench_run("gz_pcg32_bounded(1000)", iterations, [](uint64_t i) {
+    sink += gz_pcg32_bounded(&pcg, 1000);
+  }));
+
+  gzrand_seed_uint(1);
+  bench_print(bench_run("gzrand, thread default state", iterations, [](uint64_t i) {
+    sink += gzrand();
+  }));
+  bench_print(bench_run("gzrand_in_range(-300, 300)", iterations, [](uint64_t i) {
+    sink += gzrand_in_range(-300, 300);
+  }));
+  bench_do_not_optimize(sink);
+
+  uint64_t fills = iterations / 1000 ? iterations / 1000 : 1;
+  _bench_rand_fill("LCG fill 64 KiB (before)", fills, [](void* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      ((uint8_t*)buffer)[i] = (uint8_t)_bench_rand_lcg();
+    }
+  });
+  _bench_rand_fill("gz_xoshiro256_fill 64 KiB", fills, [](void* buffer, size_t size) {
+    gz_xoshiro256_fill(&xoshiro, buffer, size);
+  });
+  _bench_rand_fill("gz_pcg32_fill 64 KiB", fills, [](void* buffer, size_t size) {
+    gz_pcg32_fill(&pcg, buffer, size);
+  });
+}
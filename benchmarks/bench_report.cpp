@@ -0,0 +1,104 @@
+/**
+ * bench_report.cpp
+ *
+ * Collects the benchmark results and writes them as a table, JSON or CSV
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include "bench.h"
+
+typedef struct {
+  std::string suite;
+  std::string name;
+  uint64_t iterations;
+  double value;
+  std::string unit;
+} _Bench_Record_t;
+
+static bench_format_t _format = BENCH_FORMAT_TEXT;
+static std::string _suite;
+static std::vector<_Bench_Record_t> _records;
+
+/**
+ * @brief Names are ours, only quotes and backslashes would need escaping
+ */
+static std::string _bench_json_string(const std::string& value) {
+  std::string escaped;
+  for (size_t i = 0; i < value.size(); i++) {
+    if (value[i] == '"' || value[i] == '\\') {
+      escaped += '\\';
+    }
+    escaped += value[i];
+  }
+  return "\"" + escaped + "\"";
+}
+
+/**
+ * @brief Names contain commas, always quoted
+ */
+static std::string _bench_csv_string(const std::string& value) {
+  std::string escaped;
+  for (size_t i = 0; i < value.size(); i++) {
+    if (value[i] == '"') {
+      escaped += '"';
+    }
+    escaped += value[i];
+  }
+  return "\"" + escaped + "\"";
+}
+
+void bench_set_format(bench_format_t format) {
+  _format = format;
+}
+
+void bench_print_header(const char* suite) {
+  _suite = suite;
+  if (_format == BENCH_FORMAT_TEXT) {
+    printf("\n%-44s %14s %14s %-8s\n", suite, "iterations", "value", "unit");
+  }
+}
+
+void bench_print(const bench_result_t& result) {
+  bench_report(result.name, result.iterations, result.nsPerOp, "ns/op");
+}
+
+void bench_report(const char* name, uint64_t iterations, double value, const char* unit) {
+  _Bench_Record_t record = { _suite, name, iterations, value, unit };
+  _records.push_back(record);
+  if (_format == BENCH_FORMAT_TEXT) {
+    printf("%-44s %14llu %14.2f %-8s\n", name, (unsigned long long)iterations, value, unit);
+    fflush(stdout);
+  }
+}
+
+void bench_report_max_rss(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  bench_report("max_rss", 1, (double)usage.ru_maxrss, "KiB"); // kilobytes on Linux
+}
+
+void bench_flush(FILE* out) {
+  if (_format == BENCH_FORMAT_JSON) {
+    fprintf(out, "{\n  \"results\": [\n");
+    for (size_t i = 0; i < _records.size(); i++) {
+      const _Bench_Record_t& record = _records[i];
+      fprintf(out, "    {\"suite\": %s, \"name\": %s, \"iterations\": %llu, \"value\": %.3f, \"unit\": %s}%s\n",
+              _bench_json_string(record.suite).c_str(), _bench_json_string(record.name).c_str(),
+              (unsigned long long)record.iterations, record.value, _bench_json_string(record.unit).c_str(),
+              i + 1 < _records.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+  } else if (_format == BENCH_FORMAT_CSV) {
+    fprintf(out, "suite,name,iterations,value,unit\n");
+    for (size_t i = 0; i < _records.size(); i++) {
+      const _Bench_Record_t& record = _records[i];
+      fprintf(out, "%s,%s,%llu,%.3f,%s\n", _bench_csv_string(record.suite).c_str(), _bench_csv_string(record.name).c_str(),
+              (unsigned long long)record.iterations, record.value, _bench_csv_string(record.unit).c_str());
+    }
+  }
+}
@@ -0,0 +1,151 @@
+/**
+ * bench_telemetry.cpp
+ *
+ * gz_telemetry with the PCU summary stream of yapi_telemetry: ingest rate of records sampled every second,
+ * what a sample takes on file against the raw record, then range queries of one column, recent and full.
+ * Last the gz_rollup aggregation of a 10 Hz power series, sample by sample and in batches
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.h"
+#include "yapi_telemetry.h"
+#include "gz_rollup.h"
+
+#define TELEMETRY_PERIOD_NS     1000000000LL
+#define TELEMETRY_QUERY_SAMPLES 3600
+#define TELEMETRY_QUERIES       100
+#define ROLLUP_PERIOD_NS        100000000LL
+#define ROLLUP_BATCH            1024
+#define ROLLUP_HISTORY          64
+
+/**
+ * @brief A discharging battery with a noisy AC load, the other fields mostly constant as on a device
+ */
+static void _bench_telemetry_fill(yapi_y6g_pcu_summary_status_t* status, uint64_t i) {
+  uint16_t noise = (uint32_t)(i * 2654435761u) >> 28;
+  status->soc = 100 - (i / 3600) % 100;
+  status->battery_voltage_mV = 52000 - status->soc * 10 + noise;
+  status->outputs.outputAc.power_dW = 4000 + noise * 8;
+  status->outputs.outputAc.current_dA = status->outputs.outputAc.power_dW / 120;
+  status->outputs.outputAc.voltage_dV = 1200 + (noise & 3);
+  status->net_watts_w = -(int16_t)(status->outputs.outputAc.power_dW / 10);
+  status->average_net_watts_w = -400;
+  status->wh_out_lifetime += status->outputs.outputAc.power_dW / 36000;
+  status->battery_temp_C = 25 + (i / 600) % 4;
+}
+
+static void _bench_telemetry_sum(void* context, const int64_t* timestamps, const int64_t* values, uint32_t count) {
+  int64_t* sum = (int64_t*)context;
+  for (uint32_t i = 0; i < count; i++) {
+    *sum += values[i];
+  }
+}
+
+static void _bench_telemetry_rollup(uint64_t iterations) {
+  std::vector<int64_t> timestamps(iterations);
+  std::vector<int64_t> values(iterations);
+  for (uint64_t i = 0; i < iterations; i++) {
+    timestamps[i] = (int64_t)i * ROLLUP_PERIOD_NS;
+    values[i] = 4000 + ((uint32_t)(i * 2654435761u) >> 24);
+  }
+  static gz_rollup_bucket_t history[GZ_ROLLUP_LEVELS * ROLLUP_HISTORY];
+  static gz_rollup_t rollup;
+  gz_rollup_init(&rollup, history, ROLLUP_HISTORY, 0, NULL, NULL);
+  bench_print(bench_run("gz_rollup add sample, 10 Hz", iterations, [&](uint64_t i) {
+    gz_rollup_add_sample(&rollup, timestamps[i], values[i]);
+  }));
+  gz_rollup_bucket_t bucket;
+  gz_rollup_get_closed(&rollup, GZ_ROLLUP_1H, 0, &bucket);
+  bench_do_not_optimize(bucket);
+
+  gz_rollup_init(&rollup, history, ROLLUP_HISTORY, 0, NULL, NULL);
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; i += ROLLUP_BATCH) {
+    uint32_t count = iterations - i < ROLLUP_BATCH ? iterations - i : ROLLUP_BATCH;
+    gz_rollup_add_samples(&rollup, &timestamps[i], &values[i], count);
+  }
+  bench_report("gz_rollup add samples, 10 Hz by 1024", iterations, (double)(bench_now_ns() - start) / iterations,
+               "ns/sample");
+  gz_rollup_get_closed(&rollup, GZ_ROLLUP_1H, 0, &bucket);
+  bench_do_not_optimize(bucket);
+  bench_report("gz_rollup memory", 1, sizeof(rollup) + sizeof(history), "bytes");
+}
+
+void bench_telemetry(uint64_t iterations) {
+  bench_print_header("gz_telemetry");
+  char directory[] = "/tmp/bench_telemetry_XXXXXX";
+  if (!mkdtemp(directory)) {
+    return;
+  }
+  char path[sizeof(directory) + 16];
+  snprintf(path, sizeof(path), "%s/pcu_summary", directory);
+
+  uint8_t streamCount;
+  const yapi_telemetry_stream_t* stream = yapi_telemetry_get_streams(&streamCount);
+  static gz_telemetry_t* store;
+  store = gz_telemetry_open(path, stream->columns, stream->columnCount, 0);
+  if (!store) {
+    return;
+  }
+  static yapi_y6g_pcu_summary_status_t status;
+  memset(&status, 0, sizeof(status));
+  bench_print(bench_run("append PCU summary record", iterations, [](uint64_t i) {
+    _bench_telemetry_fill(&status, i);
+    gz_telemetry_append(store, (int64_t)i * TELEMETRY_PERIOD_NS, &status);
+  }));
+  gz_telemetry_flush(store);
+
+  gz_telemetry_stats_t stats;
+  gz_telemetry_get_stats(store, &stats);
+  bench_report("raw record", stats.samples, (double)stats.rawBytes / stats.samples, "B/sample");
+  bench_report("stored", stats.samples, (double)stats.storedBytes / stats.samples, "B/sample");
+  bench_report("compression", stats.samples, (double)stats.rawBytes / stats.storedBytes, "x");
+
+  int column = gz_telemetry_column_index(store, "outputs.outputAc.power_dW");
+  int64_t last_ns = (int64_t)(iterations - 1) * TELEMETRY_PERIOD_NS;
+  int64_t sum = 0;
+  uint64_t start = bench_now_ns();
+  for (uint32_t i = 0; i < TELEMETRY_QUERIES; i++) {
+    gz_telemetry_scan(store, column, last_ns - TELEMETRY_QUERY_SAMPLES * TELEMETRY_PERIOD_NS, last_ns,
+                      _bench_telemetry_sum, &sum);
+  }
+  bench_report("scan last hour of one column", TELEMETRY_QUERIES,
+               (double)(bench_now_ns() - start) / TELEMETRY_QUERIES, "ns/op");
+  start = bench_now_ns();
+  int64_t count = gz_telemetry_scan(store, column, INT64_MIN, INT64_MAX, _bench_telemetry_sum, &sum);
+  bench_report("scan all of one column", count, (double)(bench_now_ns() - start) / count, "ns/sample");
+  bench_do_not_optimize(sum);
+
+  std::vector<int64_t> timestamps(TELEMETRY_QUERY_SAMPLES);
+  std::vector<int64_t> values(TELEMETRY_QUERY_SAMPLES);
+  start = bench_now_ns();
+  for (uint32_t i = 0; i < TELEMETRY_QUERIES; i++) {
+    gz_telemetry_query(store, column, last_ns - TELEMETRY_QUERY_SAMPLES * TELEMETRY_PERIOD_NS, last_ns,
+                       timestamps.data(), values.data(), TELEMETRY_QUERY_SAMPLES);
+  }
+  bench_report("query last hour of one column", TELEMETRY_QUERIES,
+               (double)(bench_now_ns() - start) / TELEMETRY_QUERIES, "ns/op");
+  gz_telemetry_close(store);
+
+  // What a reader pays: index the segments again
+  start = bench_now_ns();
+  store = gz_telemetry_open(path, NULL, 0, 0);
+  bench_report("open for reading", 1, (double)(bench_now_ns() - start), "ns/op");
+  if (store) {
+    gz_telemetry_get_stats(store, &stats);
+    bench_report("chunks indexed", 1, stats.chunks, "chunks");
+    gz_telemetry_close(store);
+  }
+  for (uint16_t segment = 0; segment < stats.segments + 1; segment++) {
+    snprintf(path, sizeof(path), "%s/pcu_summary.%u", directory, segment);
+    unlink(path);
+  }
+  rmdir(directory);
+  _bench_telemetry_rollup(iterations);
+}
@@ -0,0 +1,81 @@
+/**
+ * bench_window.cpp
+ *
+ * Cost of a sample in the gz_window statistics against the gzarray_moving_avg_* C objects they replace, one
+ * by one and in batches of a replayed capture
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <vector>
+
+#include "bench.h"
+#include "gz_array.h"
+#include "gz_window.h"
+
+#define WINDOW_BATCH   1024
+
+static std::vector<int16_t> _samples;
+
+static void _bench_window_batches(const char* name, uint64_t iterations, void (*add)(const int16_t*, size_t)) {
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; i += WINDOW_BATCH) {
+    add(_samples.data(), WINDOW_BATCH);
+  }
+  bench_report(name, iterations, (double)(bench_now_ns() - start) / iterations, "ns/sample");
+}
+
+void bench_window(uint64_t iterations) {
+  bench_print_header("gz_window");
+  _samples.resize(WINDOW_BATCH);
+  for (uint32_t i = 0; i < WINDOW_BATCH; i++) {
+    _samples[i] = (int16_t)((i * 2654435761u) >> 20);
+  }
+
+  static TD_DATA_MVG_AVG_INT_16 legacy;
+  gzarray_moving_avg_obj_init(&legacy, 16);
+  bench_print(bench_run("gzarray_moving_avg_add_sample_i16, 16", iterations, [](uint64_t i) {
+    gzarray_moving_avg_add_sample_i16(&legacy, _samples[i & (WINDOW_BATCH - 1)]);
+  }));
+  bench_do_not_optimize(legacy.avg);
+
+  static gz_window_avg_t<int16_t, 16> average;
+  gz_window_clear(average);
+  bench_print(bench_run("gz_window_avg_t<int16_t, 16> add", iterations, [](uint64_t i) {
+    gz_window_add_sample(average, _samples[i & (WINDOW_BATCH - 1)]);
+  }));
+  _bench_window_batches("gz_window_avg_t<int16_t, 16> add 1024", iterations, [](const int16_t* samples, size_t count) {
+    gz_window_add_samples(average, samples, count);
+  });
+  static gz_window_avg_t<float, 256> averageFloat;
+  static std::vector<float> floats(_samples.begin(), _samples.end());
+  gz_window_clear(averageFloat);
+  bench_print(bench_run("gz_window_avg_t<float, 256> add", iterations, [](uint64_t i) {
+    gz_window_add_sample(averageFloat, floats[i & (WINDOW_BATCH - 1)]);
+  }));
+  bench_do_not_optimize(gz_window_mean(average) + gz_window_mean(averageFloat));
+
+  static gz_window_minmax_t<int16_t, 64> minmax;
+  gz_window_clear(minmax);
+  bench_print(bench_run("gz_window_minmax_t<int16_t, 64> add", iterations, [](uint64_t i) {
+    gz_window_add_sample(minmax, _samples[i & (WINDOW_BATCH - 1)]);
+  }));
+  bench_do_not_optimize(gz_window_min(minmax));
+
+  static gz_welford_t welford;
+  gz_welford_clear(welford);
+  bench_print(bench_run("gz_welford add", iterations, [](uint64_t i) {
+    gz_welford_add_sample(welford, _samples[i & (WINDOW_BATCH - 1)]);
+  }));
+  _bench_window_batches("gz_welford add 1024", iterations, [](const int16_t* samples, size_t count) {
+    gz_welford_add_samples(welford, samples, count);
+  });
+  bench_do_not_optimize(gz_welford_variance(welford));
+
+  static gz_ema_t ema;
+  gz_ema_init(ema, gz_ema_alpha(16));
+  bench_print(bench_run("gz_ema add", iterations, [](uint64_t i) {
+    gz_ema_add_sample(ema, _samples[i & (WINDOW_BATCH - 1)]);
+  }));
+  bench_do_not_optimize(ema.value);
+}
@@ -0,0 +1,205 @@
+/**
+ * bench_yapi.cpp
+ *
+ * yapi_service frame build/CRC, parse and dispatch rates, in process without any port
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.h"
+#include "yapi_service.h"
+#include "yapi_capture.h"
+#include "gz_hash.h"
+#include "gz_observer.h"
+
+#define PARSE_FRAME_LENGTHS     { 0, 16, 64, 128, 238 }
+#define MAX_OBSERVERS           4
+
+static v_fp_u8_t _rxByteCb = NULL;
+static uint64_t _framesDispatched = 0;
+
+static void _bench_register_rx_byte(v_fp_u8_t cb) {
+  _rxByteCb = cb;
+}
+
+static void _bench_frame_cb(yapi_packet_t* yapiPkt) {
+  _framesDispatched++;
+}
+
+static void _bench_observer_cb(void* yapiPkt) {
+  bench_clobber();
+}
+
+static void _bench_feed(const uint8_t* data, int size) {
+  for (int i = 0; i < size; i++) {
+    _rxByteCb(data[i]);
+  }
+}
+
+static void _bench_pump(void) {
+  yapi_service_task_10ms(NULL);
+}
+
+/**
+ * @brief Serialized HELLO frames of the PARSE_FRAME_LENGTHS payload sizes, back to back
+ */
+static std::vector<std::vector<uint8_t> > _bench_build_frames(void) {
+  const uint8_t lengths[] = PARSE_FRAME_LENGTHS;
+  std::vector<std::vector<uint8_t> > frames;
+  uint8_t data[YAPI_DATA_SIZE];
+  for (uint16_t i = 0; i < sizeof(data); i++) {
+    data[i] = (uint8_t)i;
+  }
+  for (uint8_t i = 0; i < sizeof(lengths); i++) {
+    yapi_packet_t packet;
+    yapi_service_build_pkt(&packet, YAPI_DEVICE_PCU, YAPI_DEVICE_EXTERNAL_PC, YAPI_CMD_HELLO, YAPI_MSG_GET_RESP_OK,
+                           YAPI_PRIORITY_LOW, NULL, data, lengths[i]);
+    const uint8_t* bytes = (const uint8_t*)&packet;
+    frames.push_back(std::vector<uint8_t>(bytes, bytes + YAPI_HEADER_LENGTH + lengths[i] + sizeof(packet.crc)));
+  }
+  return frames;
+}
+
+static void _bench_build(uint64_t iterations) {
+  uint8_t data[YAPI_DATA_SIZE];
+  memset(data, 0x5A, sizeof(data));
+  yapi_packet_t packet;
+
+  bench_print(bench_run("build_pkt 16B payload (header + CRC)", iterations, [&](uint64_t i) {
+    data[0] = (uint8_t)i;
+    yapi_service_build_pkt(&packet, YAPI_DEVICE_EXTERNAL_PC, YAPI_DEVICE_PCU, YAPI_CMD_HELLO, YAPI_MSG_GET_RQST,
+                           YAPI_PRIORITY_LOW, NULL, data, 16);
+    bench_do_not_optimize(packet);
+  }));
+  bench_print(bench_run("build_pkt 238B payload (header + CRC)", iterations, [&](uint64_t i) {
+    data[0] = (uint8_t)i;
+    yapi_service_build_pkt(&packet, YAPI_DEVICE_EXTERNAL_PC, YAPI_DEVICE_PCU, YAPI_CMD_HELLO, YAPI_MSG_GET_RQST,
+                           YAPI_PRIORITY_LOW, NULL, data, YAPI_DATA_SIZE);
+    bench_do_not_optimize(packet);
+  }));
+  // The port is not connected, yapi_platform_transmit() refuses the frame right away
+  bench_print(bench_run("send 238B payload (no port)", iterations, [&](uint64_t i) {
+    packet.data[0] = (uint8_t)i;
+    bench_do_not_optimize(yapi_service_send(&packet));
+  }));
+  uint16_t crc = 0;
+  bench_result_t crcResult = bench_run("gz_crc16 256B", iterations, [&](uint64_t i) {
+    ((uint8_t*)&packet)[0] = (uint8_t)i;
+    crc = gz_crc16((const uint8_t*)&packet, sizeof(packet));
+    bench_do_not_optimize(crc);
+  });
+  bench_print(crcResult);
+  bench_report("gz_crc16 throughput", iterations, sizeof(packet) * 1e3 / crcResult.nsPerOp, "MB/s");
+}
+
+static void _bench_parse(uint64_t iterations) {
+  std::vector<std::vector<uint8_t> > frames = _bench_build_frames();
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    bytes += frames[i].size();
+  }
+  const char* names[MAX_OBSERVERS + 1] = {
+    "parse + dispatch, 0 rx observers",
+    "parse + dispatch, 1 rx observer",
+    NULL,
+    NULL,
+    "parse + dispatch, 4 rx observers",
+  };
+  // The observer list only holds distinct callbacks
+  yapi_rx_observer_cb_t observers[MAX_OBSERVERS] = {
+    _bench_observer_cb,
+    [](void* yapiPkt) { bench_clobber(); },
+    [](void* yapiPkt) { bench_clobber(); },
+    [](void* yapiPkt) { bench_clobber(); },
+  };
+
+  for (uint8_t observerCount = 0; observerCount <= MAX_OBSERVERS; observerCount++) {
+    if (observerCount) {
+      yapi_service_add_rx_observer(observers[observerCount - 1]);
+    }
+    if (!names[observerCount]) {
+      continue;
+    }
+    _framesDispatched = 0;
+    bench_result_t result = bench_run(names[observerCount], iterations, [&](uint64_t i) {
+      const std::vector<uint8_t>& frame = frames[i % frames.size()];
+      _bench_feed(frame.data(), frame.size());
+      yapi_service_task_10ms(NULL);
+    });
+    if (_framesDispatched != iterations) {
+      fprintf(stderr, "bench_yapi: %llu of %llu frames dispatched\n",
+              (unsigned long long)_framesDispatched, (unsigned long long)iterations);
+    }
+    bench_print(result);
+    if (!observerCount) {
+      bench_report("parse throughput", iterations, (double)bytes / frames.size() * 1e3 / result.nsPerOp, "MB/s");
+    }
+  }
+  for (uint8_t i = 0; i < MAX_OBSERVERS; i++) {
+    yapi_service_remove_rx_observer(observers[i]);
+  }
+
+  // The parser only queues a copy, a worker thread runs the observer
+  yapi_service_add_rx_observer_async(observers[1], GZ_OBSERVER_ASYNC_MAX_DEPTH);
+  bench_print(bench_run("parse + dispatch, 1 async rx observer", iterations, [&](uint64_t i) {
+    const std::vector<uint8_t>& frame = frames[i % frames.size()];
+    _bench_feed(frame.data(), frame.size());
+    yapi_service_task_10ms(NULL);
+  }));
+  gz_observer_async_flush(yapi_service_get_rx_async());
+  gz_observer_async_stats_t stats;
+  gz_observer_async_get_stats(yapi_service_get_rx_async(), &stats);
+  bench_report("async rx delivered", stats.posted, stats.delivered, "frames");
+  bench_report("async rx dropped, queue full", stats.posted, stats.dropped, "frames");
+  yapi_service_remove_rx_observer_async(observers[1]);
+}
+
+/**
+ * @brief Replays a synthetic capture of `frameCount` frames through the parser
+ */
+static void _bench_replay(uint64_t frameCount) {
+  char fileName[] = "/tmp/bench_replay_XXXXXX";
+  int fd = mkstemp(fileName);
+  if (fd < 0) {
+    return;
+  }
+  std::vector<std::vector<uint8_t> > frames = _bench_build_frames();
+  yapi_capture_file_header_t header;
+  memcpy(header.magic, YAPI_CAPTURE_MAGIC, sizeof(header.magic));
+  header.version = YAPI_CAPTURE_VERSION;
+  header.headerSize = sizeof(header);
+  header.startRealtime_ns = 0;
+  header.startMonotonic_ns = 0;
+  std::vector<uint8_t> content((const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+  for (uint64_t i = 0; i < frameCount; i++) {
+    const std::vector<uint8_t>& frame = frames[i % frames.size()];
+    yapi_capture_record_header_t record = { i * 1000, 0, UART_DIRECTION_RX, (uint16_t)frame.size() };
+    content.insert(content.end(), (const uint8_t*)&record, (const uint8_t*)&record + sizeof(record));
+    content.insert(content.end(), frame.begin(), frame.end());
+  }
+  bool isWritten = write(fd, content.data(), content.size()) == (ssize_t)content.size();
+  close(fd);
+
+  yapi_replay_stats_t stats;
+  _framesDispatched = 0;
+  if (isWritten && !yapi_replay_run(fileName, YAPI_REPLAY_FAST, YAPI_REPLAY_DIRECTION_RX, _bench_feed, _bench_pump, &stats)) {
+    bench_report("replay fast, frames", _framesDispatched, _framesDispatched * 1e9 / stats.elapsed_ns, "frames/s");
+    bench_report("replay fast, bytes", stats.bytes, stats.bytes * 1e3 / stats.elapsed_ns, "MB/s");
+  }
+  unlink(fileName);
+}
+
+void bench_yapi(uint64_t iterations) {
+  bench_print_header("yapi_service");
+  yapi_service_init(YAPI_DEVICE_EXTERNAL_PC, _bench_register_rx_byte);
+  yapi_service_register_cmd_cb(_bench_frame_cb, YAPI_CMD_HELLO);
+  _bench_build(iterations / 10);
+  _bench_parse(iterations / 100);
+  _bench_replay(iterations / 100);
+  bench_report_max_rss();
+}
@@ -0,0 +1,110 @@
+/**
+ * main.cpp
+ *
+ * Runs the benchmark suites:
+ *   bench [-n iterations] [-f text|json|csv] [-o output file] [-s suite] [-S path to yapi_sim] [iterations]
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define DEFAULT_ITERATIONS 10000000ULL
+#define DEFAULT_SIM_PATH   "./yapi_sim"
+
+static bool _is_selected(const char* selected, const char* suite) {
+  return !selected || strcmp(selected, suite) == 0;
+}
+
+int main(int argNum, char **arg) {
+  int option;
+  uint64_t iterations = DEFAULT_ITERATIONS;
+  const char* suite = NULL;
+  const char* simPath = DEFAULT_SIM_PATH;
+  const char* outputName = NULL;
+  bench_format_t format = BENCH_FORMAT_TEXT;
+
+  while ((option = getopt(argNum, arg, "n:f:o:s:S:")) != -1) {
+    switch (option) {
+      case 'n':
+        iterations = strtoull(optarg, NULL, 10);
+        break;
+      case 'f':
+        format = strcmp(optarg, "json") == 0 ? BENCH_FORMAT_JSON : (strcmp(optarg, "csv") == 0 ? BENCH_FORMAT_CSV : BENCH_FORMAT_TEXT);
+        break;
+      case 'o':
+        outputName = optarg;
+        break;
+      case 's':
+        suite = optarg;
+        break;
+      case 'S':
+        simPath = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n iterations] [-f text|json|csv] [-o file] [-s codec|yapi|log|memory|observer|telemetry|window|array|rand|metrics|link] [-S yapi_sim path]\n", arg[0]);
+        return 1;
+    }
+  }
+  if (optind < argNum) {
+    iterations = strtoull(arg[optind], NULL, 10);
+  }
+  if (!iterations) {
+    iterations = DEFAULT_ITERATIONS;
+  }
+
+  FILE* output = stdout;
+  if (outputName) {
+    output = fopen(outputName, "w");
+    if (!output) {
+      perror(outputName);
+      return 1;
+    }
+  } else if (format != BENCH_FORMAT_TEXT) {
+    // The drivers print on stdout, keep it for the results only
+    output = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+  }
+
+  bench_set_format(format);
+  if (_is_selected(suite, "codec")) {
+    bench_codec(iterations);
+  }
+  if (_is_selected(suite, "yapi")) {
+    bench_yapi(iterations);
+  }
+  if (_is_selected(suite, "log")) {
+    bench_log(iterations / 10);
+  }
+  if (_is_selected(suite, "memory")) {
+    bench_memory(iterations / 10);
+  }
+  if (_is_selected(suite, "observer")) {
+    bench_observer(iterations);
+  }
+  if (_is_selected(suite, "telemetry")) {
+    bench_telemetry(iterations / 10);
+  }
+  if (_is_selected(suite, "window")) {
+    bench_window(iterations);
+  }
+  if (_is_selected(suite, "array")) {
+    bench_array(iterations);
+  }
+  if (_is_selected(suite, "rand")) {
+    bench_rand(iterations);
+  }
+  if (_is_selected(suite, "metrics")) {
+    bench_metrics(iterations);
+  }
+  if (_is_selected(suite, "link")) {
+    bench_link(simPath, iterations);
+  }
+  bench_flush(output);
+  fclose(output);
+  return 0;
+}
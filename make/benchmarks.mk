@@ -0,0 +1,35 @@
+TARGET := bench
+BUILD_DIR := build
+# Its own copy of the drivers and libraries, compiled with the flags below
+BENCH_BUILD_DIR := $(BUILD_DIR)/bench
+LIBS := $(BENCH_BUILD_DIR)/libemb_apps_drivers.a
+
+INCLUDE_PATH := benchmarks \
+								./shared_drivers \
+								$(GZ_SHARED_LIBS_DIR)/gz_log/ \
+								$(GZ_SHARED_LIBS_DIR)/gz_array/ \
+								$(GZ_SHARED_LIBS_DIR)/gz_math \
+								$(GZ_SHARED_LIBS_DIR)/gz_hash \
+								$(GZ_SHARED_LIBS_DIR)/gz_memory \
+								$(GZ_SHARED_LIBS_DIR)/gz_metrics \
+								$(GZ_SHARED_LIBS_DIR)/gz_observer \
+								$(GZ_SHARED_LIBS_DIR)/gz_rand \
+								$(GZ_SHARED_LIBS_DIR)/gz_telemetry \
+								$(GZ_SHARED_LIBS_DIR) \
+								$(YAPI_SERVICE_DIR)/
+
+INCLUDE=$(foreach d, $(INCLUDE_PATH), -I$d)
+
+SOURCES := 	benchmarks/*.cpp
+
+# Measured code must be optimized the way it would ship, whatever DEBUG says. Exported to the archive build
+CFLAGS += -O2
+LDFLAGS += -lpthread
+
+.PHONY: FORCE
+
+$(TARGET) : $(SOURCES) $(LIBS) 
+	${XX} $(CFLAGS) $(LDFLAGS) $(INCLUDE) $^ -o $@
+
+$(LIBS) : FORCE
+	@$(MAKE) -f make/emb_apps_drivers.mk BUILD_DIR=$(BENCH_BUILD_DIR)
@@ -9,6 +9,11 @@ INCLUDE_PATH := ../Header_Files/ \
 								$(GZ_SHARED_LIBS_DIR)/gz_array \
 								$(GZ_SHARED_LIBS_DIR)/gz_hash \
 								$(GZ_SHARED_LIBS_DIR)/gz_log \
+								$(GZ_SHARED_LIBS_DIR)/gz_memory \
+								$(GZ_SHARED_LIBS_DIR)/gz_metrics \
+								$(GZ_SHARED_LIBS_DIR)/gz_observer \
+								$(GZ_SHARED_LIBS_DIR)/gz_rand \
+								$(GZ_SHARED_LIBS_DIR)/gz_telemetry \
 								$(GZ_SHARED_LIBS_DIR) \
 								$(YAPI_SERVICE_DIR)
 
@@ -24,7 +29,12 @@ DRIVERS_SOURCES := 	shared_drivers/*.cpp
 LIB_SOURCES := $(GZ_SHARED_LIBS_DIR)/gz_math/*.c \
 							$(GZ_SHARED_LIBS_DIR)/gz_array/*.c \
 							$(GZ_SHARED_LIBS_DIR)/gz_log/*.c \
+							$(GZ_SHARED_LIBS_DIR)/gz_memory/*.c \
+							$(GZ_SHARED_LIBS_DIR)/gz_metrics/*.c \
 							$(GZ_SHARED_LIBS_DIR)/gz_hash/*.c \
+							$(GZ_SHARED_LIBS_DIR)/gz_observer/*.c \
+							$(GZ_SHARED_LIBS_DIR)/gz_rand/*.c \
+							$(GZ_SHARED_LIBS_DIR)/gz_telemetry/*.c \
 							$(YAPI_SERVICE_DIR)/*.c
 
 OBJ_FILES_APP := $(patsubst %.cpp, $(BUILD_DIR)/%.o, $(notdir $(wildcard $(SOURCES_APP))) )
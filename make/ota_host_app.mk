@@ -8,6 +8,8 @@ INCLUDE_PATH := ota_host_app \
 								$(GZ_SHARED_LIBS_DIR)/gz_array/ \
 								$(GZ_SHARED_LIBS_DIR)/gz_math \
 								$(GZ_SHARED_LIBS_DIR)/gz_hash \
+								$(GZ_SHARED_LIBS_DIR)/gz_metrics \
+								$(GZ_SHARED_LIBS_DIR)/gz_telemetry \
 								$(YAPI_SERVICE_DIR)/ \
 								../Header_Files/
 
@@ -7,12 +7,23 @@ INCLUDE_PATH := ../shared_lib_test/ \
 								$(GZ_SHARED_LIBS_DIR)/gz_array/ \
 								$(GZ_SHARED_LIBS_DIR)/gz_math \
 								$(GZ_SHARED_LIBS_DIR)/gz_observer \
+								$(GZ_SHARED_LIBS_DIR)/gz_memory \
+								$(GZ_SHARED_LIBS_DIR)/gz_metrics \
+								$(GZ_SHARED_LIBS_DIR)/gz_rand \
+								$(GZ_SHARED_LIBS_DIR)/gz_telemetry \
 								../Header_Files/
 
 INCLUDE=$(foreach d, $(INCLUDE_PATH), -I$d)
 
 SOURCES := 	shared_lib_test/*.cpp \
-						$(GZ_SHARED_LIBS_DIR)/gz_observer/*.c
+						$(GZ_SHARED_LIBS_DIR)/gz_observer/*.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_array/*.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_memory/gz_pool.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_metrics/gz_metrics.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_rand/gz_rand.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_telemetry/gz_telemetry.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_telemetry/gz_rollup.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_log/gz_log.c
 						
 LDFLAGS += -lpthread
 
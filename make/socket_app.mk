@@ -8,6 +8,7 @@ INCLUDE_PATH := socket_app \
 								$(GZ_SHARED_LIBS_DIR)/gz_array/ \
 								$(GZ_SHARED_LIBS_DIR)/gz_math \
 								$(GZ_SHARED_LIBS_DIR)/gz_hash \
+								$(GZ_SHARED_LIBS_DIR)/gz_memory \
 								$(YAPI_SERVICE_DIR)/
 
 INCLUDE=$(foreach d, $(INCLUDE_PATH), -I$d)
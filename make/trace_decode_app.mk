@@ -0,0 +1,15 @@
+TARGET := trace_decode
+BUILD_DIR := build
+LIBS := $(BUILD_DIR)/libemb_apps_drivers.a
+
+INCLUDE_PATH := trace_decode_app \
+								$(GZ_SHARED_LIBS_DIR)/gz_log/ \
+								$(GZ_SHARED_LIBS_DIR) \
+								$(YAPI_SERVICE_DIR)/
+
+INCLUDE=$(foreach d, $(INCLUDE_PATH), -I$d)
+
+SOURCES := 	trace_decode_app/*.cpp
+
+$(TARGET) : $(SOURCES) $(LIBS) 
+	${XX} $(CFLAGS) $(LDFLAGS) $(INCLUDE) $^ -o $@
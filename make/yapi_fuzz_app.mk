@@ -0,0 +1,41 @@
+TARGET := yapi_fuzz
+
+# standalone: gcc, main.cpp drives the target. libfuzzer: clang with its coverage guided engine
+FUZZ_ENGINE ?= standalone
+
+INCLUDE_PATH := yapi_fuzz_app \
+								./shared_drivers \
+								$(GZ_SHARED_LIBS_DIR)/gz_log/ \
+								$(GZ_SHARED_LIBS_DIR)/gz_hash \
+								$(GZ_SHARED_LIBS_DIR)/gz_math \
+								$(GZ_SHARED_LIBS_DIR)/gz_memory \
+								$(GZ_SHARED_LIBS_DIR)/gz_observer \
+								$(GZ_SHARED_LIBS_DIR)/gz_rand \
+								$(GZ_SHARED_LIBS_DIR) \
+								$(YAPI_SERVICE_DIR)/
+
+INCLUDE=$(foreach d, $(INCLUDE_PATH), -I$d)
+
+# The receive path is compiled here with the sanitizers, not taken from libemb_apps_drivers.a.
+# yapi_fuzz.cpp provides the yapi_platform_* functions
+SOURCES := 	yapi_fuzz_app/yapi_fuzz.cpp \
+						$(YAPI_SERVICE_DIR)/*.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_hash/*.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_math/*.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_memory/gz_pool.c \
+						$(GZ_SHARED_LIBS_DIR)/gz_observer/*.c
+
+SANITIZE_FLAGS := -g -O1 -fno-omit-frame-pointer -fsanitize=address,undefined -fno-sanitize-recover=undefined
+
+ifeq (libfuzzer,$(FUZZ_ENGINE))
+		XX := clang++
+		SANITIZE_FLAGS += -fsanitize=fuzzer
+else
+		SOURCES += yapi_fuzz_app/main.cpp \
+							 $(GZ_SHARED_LIBS_DIR)/gz_rand/*.c
+endif
+
+LDFLAGS += -lpthread
+
+$(TARGET) : $(SOURCES)
+	${XX} $(CFLAGS) $(SANITIZE_FLAGS) $(LDFLAGS) $(INCLUDE) $^ -o $@
@@ -0,0 +1,21 @@
+TARGET := yapi_sim
+BUILD_DIR := build
+LIBS := $(BUILD_DIR)/libemb_apps_drivers.a
+
+INCLUDE_PATH := yapi_sim_app \
+								./shared_drivers \
+								$(GZ_SHARED_LIBS_DIR)/gz_log/ \
+								$(GZ_SHARED_LIBS_DIR)/gz_hash \
+								$(GZ_SHARED_LIBS_DIR)/gz_rand \
+								$(GZ_SHARED_LIBS_DIR) \
+								$(YAPI_SERVICE_DIR)/
+
+INCLUDE=$(foreach d, $(INCLUDE_PATH), -I$d)
+
+# yapi_sim_link.cpp provides the yapi_platform_* functions: yapi_service_driver is not linked
+SOURCES := 	yapi_sim_app/*.cpp
+
+LDFLAGS += -lpthread
+
+$(TARGET) : $(SOURCES) $(LIBS) 
+	${XX} $(CFLAGS) $(LDFLAGS) $(INCLUDE) $^ -o $@
@@ -13,15 +13,25 @@
 #include <string.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <time.h>
 #include <dirent.h> 
 #include <fcntl.h> // Contains file controls like O_RDWR
 #include <unistd.h> // read/write/close/sleep
 
 #include "cli.h"
 #include "uart.h"
+#define GZ_LOG_MODULE "cli"
 #include "gz_log.h"
 #include "yapi_flash.h"
 #include "yapi_modbus.h"
+#include "yapi_subscription.h"
+#include "yapi_capture.h"
+#include "yapi_service_driver.h"
+#include "gz_trace.h"
+#include "yapi_telemetry.h"
+#include "gz_rollup.h"
+#include "gz_metrics.h"
+#include "metrics_exporter.h"
 
 #define BACK_SPACE              8
 #define NEW_LINE                '\n'
@@ -86,6 +96,18 @@ static bool _cli_flash_verify(_Cli_Command_Args_t);
 static bool _cli_modbus_silence(_Cli_Command_Args_t);
 static bool _cli_modbus_enter_bootloader(_Cli_Command_Args_t);
 static bool _cli_modbus_get_boot_info(_Cli_Command_Args_t);
+static bool _cli_sub(_Cli_Command_Args_t);
+static bool _cli_unsub(_Cli_Command_Args_t);
+static bool _cli_capture_start(_Cli_Command_Args_t);
+static bool _cli_capture_stop(_Cli_Command_Args_t);
+static bool _cli_trace_start(_Cli_Command_Args_t);
+static bool _cli_trace_stop(_Cli_Command_Args_t);
+static bool _cli_telemetry_start(_Cli_Command_Args_t);
+static bool _cli_telemetry_stop(_Cli_Command_Args_t);
+static bool _cli_telemetry_query(_Cli_Command_Args_t);
+static bool _cli_telemetry_rollup(_Cli_Command_Args_t);
+static bool _cli_replay(_Cli_Command_Args_t);
+static bool _cli_stats(_Cli_Command_Args_t);
 
 _Cli_Command_t _cli_commands[] = {
   {
@@ -163,6 +185,66 @@ _Cli_Command_t _cli_commands[] = {
     .description = "modbus_get_boot_info <deviceId>",
     .executer = _cli_modbus_get_boot_info
   },
+  {
+    .command = "sub",
+    .description = "sub <deviceId> <command> <interval ms> <max prints per second>",
+    .executer = _cli_sub
+  },
+  {
+    .command = "unsub",
+    .description = "unsub <deviceId> <command>",
+    .executer = _cli_unsub
+  },
+  {
+    .command = "capture_start",
+    .description = "capture_start <file_name>",
+    .executer = _cli_capture_start
+  },
+  {
+    .command = "capture_stop",
+    .description = "capture_stop",
+    .executer = _cli_capture_stop
+  },
+  {
+    .command = "trace_start",
+    .description = "trace_start <file_name> [hash] - binary frame trace, decode with trace_decode",
+    .executer = _cli_trace_start
+  },
+  {
+    .command = "trace_stop",
+    .description = "trace_stop",
+    .executer = _cli_trace_stop
+  },
+  {
+    .command = "telemetry_start",
+    .description = "telemetry_start <directory> [interval ms] - record the status streams",
+    .executer = _cli_telemetry_start
+  },
+  {
+    .command = "telemetry_stop",
+    .description = "telemetry_stop",
+    .executer = _cli_telemetry_stop
+  },
+  {
+    .command = "telemetry_query",
+    .description = "telemetry_query <directory> <stream> <column> [last seconds]",
+    .executer = _cli_telemetry_query
+  },
+  {
+    .command = "telemetry_rollup",
+    .description = "telemetry_rollup <directory> <stream> <column> <1s/1min/1h> [last seconds]",
+    .executer = _cli_telemetry_rollup
+  },
+  {
+    .command = "replay",
+    .description = "replay <file_name> <fast/realtime>",
+    .executer = _cli_replay
+  },
+  {
+    .command = "stats",
+    .description = "stats [reset/prometheus/serve [port]/stop]",
+    .executer = _cli_stats
+  },
   {
     .command = "exit",
     .description = "exit",
@@ -200,7 +282,7 @@ static _Cli_Command_Args_t _cli_string_parser(const char* line, const char* deli
   do {
     command_arg.command_args[command_arg.args_count] = strtok(NULL, delimiter);
     GZ_LOG_DEBUG("DEBUG - command_arg[%d]: %s\n", command_arg.args_count, command_arg.command_args[command_arg.args_count]);
-  } while(command_arg.command_args[command_arg.args_count] && command_arg.args_count++ < MAX_CMD_ARGUMENTS);
+  } while(command_arg.command_args[command_arg.args_count] && ++command_arg.args_count < MAX_CMD_ARGUMENTS);
   return command_arg;
 }
 
@@ -217,6 +299,8 @@ static _Cli_Command_Args_t _cli_json_parser(const char* line) {
 #endif
 
 static bool _exit(_Cli_Command_Args_t command_arguments) {
+  // The samples of the open chunks are only in memory
+  yapi_telemetry_stop();
   exit(0);
   return true;
 }
@@ -307,7 +391,9 @@ static bool _cli_connect_serial_port(_Cli_Command_Args_t command_arguments) {
   }
   char deviceName[32] = "/dev/";
   if (strstr(command_arguments.command_args[0], "/dev/") == NULL) {
-    strcat(deviceName, (const char*)command_arguments.command_args[0]);
+    strncat(deviceName, (const char*)command_arguments.command_args[0], sizeof(deviceName) - strlen(deviceName) - 1);
+  } else {
+    snprintf(deviceName, sizeof(deviceName), "%s", command_arguments.command_args[0]);
   }
   _uartFd = uart_connect(deviceName, atoi(command_arguments.command_args[1]));
   if (_uartFd == -1) {
@@ -546,4 +632,299 @@ static bool _cli_modbus_get_boot_info(_Cli_Command_Args_t command_arguments) {
   return true;
 }
 
+/**
+ * @brief Prints the fields that changed, integers up to 4 bytes as numbers, anything else as hex
+ */
+static void _cli_sub_print_changes(const yapi_subscription_update_t* update, void* context) {
+  printf("SUB device[%d] command[%d] coalesced[%d]\n", update->deviceId, update->command, update->coalesced);
+  for (uint8_t i = 0; i < update->fieldCount; i++) {
+    if (!(update->changedMask & ((uint64_t)1 << i))) {
+      continue;
+    }
+    const yapi_subscription_field_t* field = &update->fields[i];
+    printf("\t%s:\t", field->name);
+    if (field->size <= sizeof(uint32_t)) {
+      uint32_t value = 0;
+      memcpy(&value, update->current + field->offset, field->size);
+      printf("%u\n", value);
+    } else {
+      for (uint16_t byte = 0; byte < field->size; byte++) {
+        printf("%02x", update->current[field->offset + byte]);
+      }
+      printf("\n");
+    }
+  }
+}
+
+static bool _cli_sub(_Cli_Command_Args_t command_arguments) {
+  if (!command_arguments.command_args[0] || !command_arguments.command_args[1] ||
+      !command_arguments.command_args[2] || !command_arguments.command_args[3]) {
+    GZ_LOG_ERROR("Missing argument!\n");
+    return false;
+  }
+  if (!_uartFd) {
+    GZ_LOG_ERROR("Port has not been opened\n");
+    return false;
+  }
+  int handle = yapi_subscription_open((yapi_device_id_enum_t)atoi(command_arguments.command_args[0]),
+                                      (yapi_command_enum_t)atoi(command_arguments.command_args[1]),
+                                      atoi(command_arguments.command_args[2]));
+  if (handle == YAPI_SUBSCRIPTION_INVALID_HANDLE) {
+    return false;
+  }
+  yapi_subscription_remove_consumer(handle, _cli_sub_print_changes, NULL);
+  return yapi_subscription_add_consumer(handle, _cli_sub_print_changes, NULL, atoi(command_arguments.command_args[3])) > 0;
+}
+
+static bool _cli_unsub(_Cli_Command_Args_t command_arguments) {
+  if (!command_arguments.command_args[0] || !command_arguments.command_args[1]) {
+    GZ_LOG_ERROR("Missing argument!\n");
+    return false;
+  }
+  int handle = yapi_subscription_find((yapi_device_id_enum_t)atoi(command_arguments.command_args[0]),
+                                      (yapi_command_enum_t)atoi(command_arguments.command_args[1]));
+  if (handle == YAPI_SUBSCRIPTION_INVALID_HANDLE) {
+    GZ_LOG_ERROR("Not subscribed\n");
+    return false;
+  }
+  yapi_subscription_stats_t stats;
+  yapi_subscription_get_stats(handle, &stats);
+  GZ_LOG_INFO("received[%u] delivered[%u] coalesced[%u] unchanged[%u] refreshes[%u]\n",
+              stats.packetsReceived, stats.deliveries, stats.coalesced, stats.unchanged, stats.refreshes);
+  yapi_subscription_close(handle);
+  return true;
+}
+
+static bool _cli_capture_start(_Cli_Command_Args_t command_arguments) {
+  if (!command_arguments.command_args[0]) {
+    GZ_LOG_ERROR("Missing argument!\n");
+    return false;
+  }
+  return yapi_capture_start(command_arguments.command_args[0]) == 0;
+}
+
+static bool _cli_capture_stop(_Cli_Command_Args_t command_arguments) {
+  if (!yapi_capture_is_running()) {
+    GZ_LOG_ERROR("No capture running\n");
+    return false;
+  }
+  yapi_capture_stop();
+  yapi_capture_stats_t stats;
+  yapi_capture_get_stats(&stats);
+  GZ_LOG_INFO("records[%u] bytes[%llu] dropped[%u] writes[%u]\n",
+              stats.records, (unsigned long long)stats.bytes, stats.droppedRecords, stats.writes);
+  return true;
+}
+
+static bool _cli_trace_start(_Cli_Command_Args_t command_arguments) {
+  if (!command_arguments.command_args[0]) {
+    GZ_LOG_ERROR("Missing argument!\n");
+    return false;
+  }
+  gz_trace_set_payload_hash(command_arguments.command_args[1] && !strcmp(command_arguments.command_args[1], "hash"));
+  if (gz_trace_open(command_arguments.command_args[0], GZ_TRACE_DEFAULT_RECORDS, GZ_TRACE_DEFAULT_FILES) < 0) {
+    return false;
+  }
+  yapi_service_driver_set_tracing(true);
+  return true;
+}
+
+static bool _cli_trace_stop(_Cli_Command_Args_t command_arguments) {
+  if (!gz_trace_is_open()) {
+    GZ_LOG_ERROR("No trace running\n");
+    return false;
+  }
+  yapi_service_driver_set_tracing(false);
+  gz_trace_close();
+  gz_trace_stats_t stats;
+  gz_trace_get_stats(&stats);
+  GZ_LOG_INFO("records[%llu] rotations[%u] failures[%u]\n", (unsigned long long)stats.records, stats.rotations,
+              stats.failures);
+  return true;
+}
+
+static bool _cli_telemetry_start(_Cli_Command_Args_t command_arguments) {
+  if (!command_arguments.command_args[0]) {
+    GZ_LOG_ERROR("Missing argument!\n");
+    return false;
+  }
+  if (!_uartFd) {
+    GZ_LOG_ERROR("Port has not been opened\n");
+    return false;
+  }
+  uint16_t interval_ms = command_arguments.command_args[1] ? atoi(command_arguments.command_args[1]) : 0;
+  return yapi_telemetry_start(command_arguments.command_args[0], interval_ms) == 0;
+}
+
+static bool _cli_telemetry_stop(_Cli_Command_Args_t command_arguments) {
+  if (!yapi_telemetry_is_running()) {
+    GZ_LOG_ERROR("No telemetry running\n");
+    return false;
+  }
+  uint8_t streamCount;
+  const yapi_telemetry_stream_t* streams = yapi_telemetry_get_streams(&streamCount);
+  yapi_telemetry_stop();
+  for (uint8_t i = 0; i < streamCount; i++) {
+    gz_telemetry_stats_t stats;
+    if (!yapi_telemetry_get_stats(streams[i].name, &stats)) {
+      continue;
+    }
+    GZ_LOG_INFO("%s: samples[%llu] chunks[%u] bytes/sample[%.1f] raw bytes/sample[%.1f]\n", streams[i].name,
+                (unsigned long long)stats.samples, stats.chunks,
+                stats.samples ? (double)stats.storedBytes / stats.samples : 0.0,
+                stats.samples ? (double)stats.rawBytes / stats.samples : 0.0);
+  }
+  return true;
+}
+
+static void _cli_telemetry_print(void* context, const int64_t* timestamps, const int64_t* values, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    printf("%lld.%03lld\t%lld\n", (long long)(timestamps[i] / 1000000000LL),
+           (long long)(timestamps[i] / 1000000LL % 1000), (long long)values[i]);
+  }
+}
+
+static bool _cli_telemetry_query(_Cli_Command_Args_t command_arguments) {
+  if (!command_arguments.command_args[0] || !command_arguments.command_args[1] ||
+      !command_arguments.command_args[2]) {
+    GZ_LOG_ERROR("Missing argument!\n");
+    return false;
+  }
+  int64_t from_ns = INT64_MIN;
+  if (command_arguments.command_args[3]) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    from_ns = ((int64_t)now.tv_sec - atoi(command_arguments.command_args[3])) * 1000000000LL;
+  }
+  int64_t count = yapi_telemetry_scan(command_arguments.command_args[0], command_arguments.command_args[1],
+                                      command_arguments.command_args[2], from_ns, INT64_MAX,
+                                      _cli_telemetry_print, NULL);
+  if (count < 0) {
+    return false;
+  }
+  GZ_LOG_INFO("%lld samples\n", (long long)count);
+  return true;
+}
+
+typedef struct {
+  gz_rollup_t rollup;
+  gz_rollup_level_t level;
+  double unit_W;                  // 0 when the column is not a power
+} _Cli_Telemetry_Rollup_t;
+
+static void _cli_telemetry_rollup_print(void* context, gz_rollup_level_t level, const gz_rollup_bucket_t* bucket) {
+  _Cli_Telemetry_Rollup_t* rollup = (_Cli_Telemetry_Rollup_t*)context;
+  if (level != rollup->level) {
+    return;
+  }
+  printf("%lld\tcount[%u] min[%lld] max[%lld] mean[%.1f] last[%lld]", (long long)(bucket->start_ns / 1000000000LL),
+         bucket->count, (long long)bucket->min, (long long)bucket->max, gz_rollup_mean(bucket), (long long)bucket->last);
+  if (rollup->unit_W) {
+    printf(" energy[%.3f Wh]", gz_rollup_energy_Wh(bucket, rollup->unit_W));
+  }
+  printf("\n");
+}
+
+static void _cli_telemetry_rollup_add(void* context, const int64_t* timestamps, const int64_t* values, uint32_t count) {
+  gz_rollup_add_samples(&((_Cli_Telemetry_Rollup_t*)context)->rollup, timestamps, values, count);
+}
+
+/**
+ * @brief Aggregates a recorded column, the buckets of the level are printed as they close
+ */
+static bool _cli_telemetry_rollup(_Cli_Command_Args_t command_arguments) {
+  static const char* levels[GZ_ROLLUP_LEVELS] = { "1s", "1min", "1h" };
+  if (!command_arguments.command_args[0] || !command_arguments.command_args[1] ||
+      !command_arguments.command_args[2] || !command_arguments.command_args[3]) {
+    GZ_LOG_ERROR("Missing argument!\n");
+    return false;
+  }
+  int level = 0;
+  while (level < GZ_ROLLUP_LEVELS && strcmp(command_arguments.command_args[3], levels[level]) != 0) {
+    level++;
+  }
+  if (level == GZ_ROLLUP_LEVELS) {
+    GZ_LOG_ERROR("Level must be 1s, 1min or 1h\n");
+    return false;
+  }
+  _Cli_Telemetry_Rollup_t rollup;
+  rollup.level = (gz_rollup_level_t)level;
+  rollup.unit_W = yapi_telemetry_column_unit_W(command_arguments.command_args[2]);
+  gz_rollup_init(&rollup.rollup, NULL, 0, 0, _cli_telemetry_rollup_print, &rollup);
+  int64_t from_ns = INT64_MIN;
+  if (command_arguments.command_args[4]) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    from_ns = ((int64_t)now.tv_sec - atoi(command_arguments.command_args[4])) * 1000000000LL;
+  }
+  int64_t count = yapi_telemetry_scan(command_arguments.command_args[0], command_arguments.command_args[1],
+                                      command_arguments.command_args[2], from_ns, INT64_MAX,
+                                      _cli_telemetry_rollup_add, &rollup);
+  if (count < 0) {
+    return false;
+  }
+  gz_rollup_flush(&rollup.rollup, rollup.rollup.previous_ns);
+  GZ_LOG_INFO("%lld samples\n", (long long)count);
+  return true;
+}
+
+/**
+ * @brief Replays the RX side of a capture through yapi_service, the YAPI callbacks print as if the device answered
+ */
+static bool _cli_replay(_Cli_Command_Args_t command_arguments) {
+  if (!command_arguments.command_args[0]) {
+    GZ_LOG_ERROR("Missing argument!\n");
+    return false;
+  }
+  yapi_replay_mode_t mode = YAPI_REPLAY_FAST;
+  if (command_arguments.command_args[1] && strcmp(command_arguments.command_args[1], "realtime") == 0) {
+    mode = YAPI_REPLAY_REALTIME;
+  }
+  return yapi_replay_start(command_arguments.command_args[0], mode, YAPI_REPLAY_DIRECTION_RX) == 0;
+}
+
+static void _cli_stats_print(void* context, const char* text, size_t length) {
+  fwrite(text, 1, length, stdout);
+}
+
+/**
+ * @brief Dumps the gz_metrics registry: uart, YAPI parser, dispatch and TX queue counters and histograms
+ */
+static bool _cli_stats(_Cli_Command_Args_t command_arguments) {
+  const char* action = command_arguments.command_args[0];
+  if (!action) {
+    gz_metrics_dump(GZ_METRICS_FORMAT_TEXT, _cli_stats_print, NULL);
+    return true;
+  }
+  if (strcmp(action, "reset") == 0) {
+    gz_metrics_reset();
+    return true;
+  }
+  if (strcmp(action, "prometheus") == 0) {
+    gz_metrics_dump(GZ_METRICS_FORMAT_PROMETHEUS, _cli_stats_print, NULL);
+    return true;
+  }
+  if (strcmp(action, "serve") == 0) {
+    int port = command_arguments.command_args[1] ? atoi(command_arguments.command_args[1])
+                                                 : METRICS_EXPORTER_DEFAULT_PORT;
+    port = metrics_exporter_start(port);
+    if (port < 0) {
+      return false;
+    }
+    GZ_LOG_INFO("Serving http://127.0.0.1:%d/metrics\n", port);
+    return true;
+  }
+  if (strcmp(action, "stop") == 0) {
+    if (!metrics_exporter_is_running()) {
+      GZ_LOG_ERROR("Not serving\n");
+      return false;
+    }
+    metrics_exporter_stop();
+    GZ_LOG_INFO("scrapes[%u]\n", metrics_exporter_get_scrapes());
+    return true;
+  }
+  GZ_LOG_ERROR("Unknown argument (%s)\n", action);
+  return false;
+}
+
 #undef _Cli_Command_t
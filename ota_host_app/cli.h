@@ -2,8 +2,8 @@
 #define _H_CLI
 
 #include <pthread.h>
-#define MAX_CMD_ARGUMENTS       4
-#define CLI_BUFFER_SIZE         64
+#define MAX_CMD_ARGUMENTS       5
+#define CLI_BUFFER_SIZE         128
 
 
 ///\todo cli_init taking in an iostream perhaps
@@ -3,14 +3,18 @@
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <poll.h>
 
 #include "cli.h"
 #include "gz_log.h"
 #include "uart.h"
 #include "yapi_manager.h"
+#include "yapi_service_driver.h"
 
 #define CENTI_SECOND_IN_USEC 1000
+#define CENTI_SECOND_IN_MSEC (CENTI_SECOND_IN_USEC / 1000)
 #define DEMO_UART 0
+#define UART_READ_CHUNK_SIZE 64
 int main(int argNum, char **arg) {
 #if DEBUG
   gz_log_set_level(GZ_LOG_LEVEL_DEBUG);
@@ -20,15 +24,19 @@ int main(int argNum, char **arg) {
   pthread_t cliThreadId = cli_thread_start(NULL);
   yapi_init();
   while (1) {
-    usleep(CENTI_SECOND_IN_USEC);
     int fd = uart_get_connected_device();
-    uint8_t buffer = 0;
-    if (fd != UART_UNCONNECTED) {
-      // For faster development, pooling directly from main
-      ///\todo could do read blocking for improving cpu usage
-      if (uart_read(fd, &buffer, 1)) {
+    uint8_t buffer[UART_READ_CHUNK_SIZE];
+    int readCount = 0;
+    if (fd == UART_UNCONNECTED) {
+      usleep(CENTI_SECOND_IN_USEC);
+    } else if (yapi_service_driver_poll(CENTI_SECOND_IN_MSEC) & POLLIN) {
+      // Waits for RX data or, while frames are queued, for the port to drain them (POLLOUT)
+      // Drains a chunk per wake-up, the tap/capture sees it as one record
+      if ((readCount = uart_read(fd, buffer, sizeof(buffer))) > 0) {
 #if DEMO_UART
-        printf("rev - %02x\t%c\n", buffer, buffer);
+        for (int i = 0; i < readCount; i++) {
+          printf("rev - %02x\t%c\n", buffer[i], buffer[i]);
+        }
 #endif
       }
     }
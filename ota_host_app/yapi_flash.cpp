@@ -14,6 +14,8 @@
 
 #include "yapi_flash.h"
 #include "yapi_service.h"
+#include "yapi_codec.h"
+#define GZ_LOG_MODULE "flash"
 #include "gz_log.h"
 #include "gz_hash.h"
 
@@ -24,6 +26,7 @@ extern "C" {
 #define TARGET_DEVICE YAPI_DEVICE_MPPT
 
 #define FLASH_UPLOAD_CHUNK_SIZE_BYTE      128
+#define FLASH_DUMP_LINE_BYTES             16
 static bool _uploadStarted = false;
 static uint32_t _uploadAddressOffset = 0;
 static uint32_t _uploadCrcFirstByteOffset = 0;
@@ -45,60 +48,34 @@ typedef enum {
 } GZM_PLATFORM_SKU;
 
 void yapi_flash_read_request(uint32_t addressOffset, int readSize) {
-  uint8_t data[YAPI_DATA_SIZE] = { 0 };
-  uint8_t index = 0;
-  data[index++] = (uint8_t)addressOffset;
-  data[index++] = (uint8_t)(addressOffset >> 8);
-  data[index++] = (uint8_t)(addressOffset >> 16);
-  data[index++] = (uint8_t)(addressOffset >> 24);
-  data[index++] = readSize;
-  yapi_service_build_send(TARGET_DEVICE,
-                          YAPI_CMD_FLASH_READ,
-                          YAPI_MSG_GET_RQST,
-                          YAPI_PRIORITY_LOW,
-                          NULL,
-                          data,
-                          index);
+  yapi_flash_read_request_t request;
+  request.addressOffset = addressOffset;
+  request.readSize = readSize;
+  yapi_codec_send_request<YAPI_CMD_FLASH_READ>(TARGET_DEVICE, YAPI_MSG_GET_RQST, YAPI_PRIORITY_LOW, request);
 }
 
 int yapi_flash_write_request(uint32_t addressOffset, const char* content, int wordsLength) {
-  uint8_t payloadData[YAPI_DATA_SIZE] = { 0 };
-  uint8_t index = 0;
-  if (!content) {
+  if (!content || wordsLength * sizeof(uint32_t) > YAPI_DATA_SIZE - sizeof(yapi_flash_write_request_t)) {
     return 0;
   }
-  payloadData[index++] = (uint8_t)addressOffset;
-  payloadData[index++] = (uint8_t)(addressOffset >> 8);
-  payloadData[index++] = (uint8_t)(addressOffset >> 16);
-  payloadData[index++] = (uint8_t)(addressOffset >> 24);
-  memcpy(payloadData + index, content, wordsLength * sizeof(uint32_t));
-  GZ_LOG_INFO("yapi_flash_write_request: addressOffset[%d], dataLength_byte[%d]\n", addressOffset, index + wordsLength * sizeof(uint32_t));
-  yapi_ops_status_t status = yapi_service_build_send( TARGET_DEVICE,
-                                                      YAPI_CMD_FLASH_WRITE,
-                                                      YAPI_MSG_SET_RQST,
-                                                      YAPI_PRIORITY_LOW,
-                                                      NULL,
-                                                      payloadData,
-                                                      index + wordsLength * sizeof(uint32_t));
+  yapi_flash_write_request_t request;
+  request.addressOffset = addressOffset;
+  uint8_t contentLength = wordsLength * sizeof(uint32_t);
+  GZ_LOG_INFO("yapi_flash_write_request: addressOffset[%u], dataLength_byte[%zu]\n", addressOffset, sizeof(request) + contentLength);
+  yapi_ops_status_t status = yapi_codec_send_request<YAPI_CMD_FLASH_WRITE>(TARGET_DEVICE,
+                                                                           YAPI_MSG_SET_RQST,
+                                                                           YAPI_PRIORITY_LOW,
+                                                                           request,
+                                                                           content,
+                                                                           contentLength);
   return status == YAPI_OPS_SUCCESS ? wordsLength : 0;
 }
 
 int yapi_flash_erase_request(uint32_t addressOffset, int numberOfPages) {
-  uint8_t payloadData[YAPI_DATA_SIZE] = { 0 };
-  uint8_t index = 0;
-  payloadData[index++] = (uint8_t)addressOffset;
-  payloadData[index++] = (uint8_t)(addressOffset >> 8);
-  payloadData[index++] = (uint8_t)(addressOffset >> 16);
-  payloadData[index++] = (uint8_t)(addressOffset >> 24);
-  payloadData[index++] = numberOfPages;
-  yapi_ops_status_t status = yapi_service_build_send( TARGET_DEVICE,
-                                                      YAPI_CMD_FLASH_ERASE,
-                                                      YAPI_MSG_SET_RQST,
-                                                      YAPI_PRIORITY_LOW,
-                                                      NULL,
-                                                      payloadData,
-                                                      index);
-  return status;
+  yapi_flash_erase_request_t request;
+  request.addressOffset = addressOffset;
+  request.numberOfPages = numberOfPages;
+  return yapi_codec_send_request<YAPI_CMD_FLASH_ERASE>(TARGET_DEVICE, YAPI_MSG_SET_RQST, YAPI_PRIORITY_LOW, request);
 }
 
 int yapi_flash_upload_request(uint32_t addressOffset, const char* fileName) {
@@ -127,27 +104,11 @@ int yapi_flash_upload_request(uint32_t addressOffset, const char* fileName) {
 
 int yapi_flash_verify_request(uint32_t startAddressOffset, uint32_t endAddressOffset, uint16_t* crc16) {
   GZ_LOG_INFO("yapi_flash_verify_request: crcBin[0x%04X]\n", _uploadFileCRC);
-  uint8_t payloadData[YAPI_DATA_SIZE] = { 0 };
-  uint8_t index = 0;
-  payloadData[index++] = (uint8_t)startAddressOffset;
-  payloadData[index++] = (uint8_t)(startAddressOffset >> 8);
-  payloadData[index++] = (uint8_t)(startAddressOffset >> 16);
-  payloadData[index++] = (uint8_t)(startAddressOffset >> 24);
-
-  payloadData[index++] = (uint8_t)endAddressOffset;
-  payloadData[index++] = (uint8_t)(endAddressOffset >> 8);
-  payloadData[index++] = (uint8_t)(endAddressOffset >> 16);
-  payloadData[index++] = (uint8_t)(endAddressOffset >> 24);
-
-  payloadData[index++] = (uint8_t)(*crc16);
-  payloadData[index++] = (uint8_t)(*crc16 >> 8);
-  yapi_service_build_send( TARGET_DEVICE,
-                            YAPI_CMD_FLASH_VERIFY,
-                            YAPI_MSG_GET_RQST,
-                            YAPI_PRIORITY_LOW,
-                            NULL,
-                            payloadData,
-                            index);
+  yapi_flash_verify_request_t request;
+  request.startAddressOffset = startAddressOffset;
+  request.endAddressOffset = endAddressOffset;
+  request.crc16 = *crc16;
+  yapi_codec_send_request<YAPI_CMD_FLASH_VERIFY>(TARGET_DEVICE, YAPI_MSG_GET_RQST, YAPI_PRIORITY_LOW, request);
 
   return 0;
 }
@@ -156,18 +117,24 @@ void _yapi_flash_read_resp_cb(yapi_packet_t* yapi_pkt) {
   GZ_LOG_INFO("_yapi_flash_read_resp_cb: type(%d)\n", yapi_pkt->messageData.type);
   GZ_LOG_INFO("_yapi_flash_read_resp_cb: package_length(%d)\n", yapi_pkt->length);
   if (yapi_pkt->messageData.type == YAPI_MSG_GET_RESP_OK) {
-    uint8_t readSize = 0;
-    GZ_LOG_INFO("Flash_read response data:\n");
-    while (readSize < yapi_pkt->length) {
-      printf("%02x\t'%c'\n", yapi_pkt->data[readSize], yapi_pkt->data[readSize++]);
+    // One line per 16 bytes, compiled out of release builds: the frame itself is in the trace (trace_start)
+    for (uint8_t offset = 0; offset < yapi_pkt->length; offset += FLASH_DUMP_LINE_BYTES) {
+      char line[FLASH_DUMP_LINE_BYTES * 3 + 1];
+      uint8_t count = yapi_pkt->length - offset < FLASH_DUMP_LINE_BYTES ? yapi_pkt->length - offset : FLASH_DUMP_LINE_BYTES;
+      for (uint8_t i = 0; i < count; i++) {
+        snprintf(line + i * 3, sizeof(line) - i * 3, "%02x ", yapi_pkt->data[offset + i]);
+      }
+      GZ_LOG_DEBUG("Flash_read %04x: %s\n", offset, line);
     }
   }
 }
 
 void _yapi_flash_write_resp_cb(yapi_packet_t* yapi_pkt) {
   if (yapi_pkt->messageData.type == YAPI_MSG_SET_RESP_OK) {
-    GZ_LOG_INFO("_yapi_flash_write_resp_cb: writtenWords[%d]\n", yapi_pkt->data[0]);
-    int16_t writtenWords = yapi_pkt->data[0] | (yapi_pkt->data[1] << 8);
+    yapi_flash_write_response_t response;
+    yapi_codec_decode_response<YAPI_CMD_FLASH_WRITE>(yapi_pkt, &response);
+    GZ_LOG_INFO("_yapi_flash_write_resp_cb: writtenWords[%d]\n", response.writtenWords);
+    int16_t writtenWords = response.writtenWords;
     uint32_t sku = GZM_SKU_Y6G_2000_120V;
     if (_uploadStarted && writtenWords) {
       uint8_t buffer[FLASH_UPLOAD_CHUNK_SIZE_BYTE] = { 0 };
@@ -221,12 +188,14 @@ void _yapi_flash_erase_resp_cb(yapi_packet_t* yapi_pkt) {
 }
 
 void _yapi_flash_verify_resp_cb(yapi_packet_t* yapi_pkt) {
+  yapi_flash_verify_response_t response;
+  yapi_codec_decode_response<YAPI_CMD_FLASH_VERIFY>(yapi_pkt, &response);
   if (yapi_pkt->messageData.type == YAPI_MSG_GET_RESP_OK) {
     GZ_LOG_INFO("_yapi_flash_verify_resp_cb: crcMatch[SUCCESS]\n");
   } else if (yapi_pkt->messageData.type == YAPI_MSG_UNSOLICITED) {
-    GZ_LOG_INFO("_yapi_flash_verify_resp_cb YAPI_MSG_UNSOLICITED: crcBLResp[0x%02X%02X]\n", yapi_pkt->data[1], yapi_pkt->data[0]);
+    GZ_LOG_INFO("_yapi_flash_verify_resp_cb YAPI_MSG_UNSOLICITED: crcBLResp[0x%04X]\n", response.crc16);
   } else {
-    GZ_LOG_INFO("_yapi_flash_verify_resp_cb: crcMatch[FAIL] crcBLResp[0x%02X%02X]\n", yapi_pkt->data[1], yapi_pkt->data[0]);
+    GZ_LOG_INFO("_yapi_flash_verify_resp_cb: crcMatch[FAIL] crcBLResp[0x%04X]\n", response.crc16);
   }
 }
 
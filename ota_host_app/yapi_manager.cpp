@@ -5,6 +5,8 @@
  *      Author: zacharygarrard
  */
 
+#include "yapi_client.h" // C++ API, must stay outside of the extern "C" block
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,10 +25,14 @@ extern "C" {
 #include "yapi_flash.h"
 #include "yapi_service_driver.h"
 #include "yapi_modbus.h"
+#include "yapi_subscription.h"
+#include "yapi_capture.h"
 #include "gz_log.h"
 
 void yapi_init(void) {
   yapi_service_driver_init();
+  yapi_client_init();
+  yapi_subscription_init();
   
   yapi_service_register_cmd_cb(_yapi_flash_read_resp_cb, YAPI_CMD_FLASH_READ);
   yapi_service_register_cmd_cb(_yapi_flash_write_resp_cb, YAPI_CMD_FLASH_WRITE);
@@ -36,7 +42,10 @@ void yapi_init(void) {
 }
 
 void yapi_task_10ms(void* params) {
+  yapi_replay_task(); // replayed bytes are parsed below, on this thread
   yapi_service_driver_10ms(params);
+  yapi_client_task();
+  yapi_subscription_task();
 }
 
 #ifdef __cplusplus
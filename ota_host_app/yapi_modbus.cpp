@@ -15,6 +15,8 @@
 
 #include "yapi_modbus.h"
 #include "yapi_service.h"
+#include "yapi_codec.h"
+#define GZ_LOG_MODULE "modbus"
 #include "gz_log.h"
 #include "gz_hash.h"
 
@@ -59,14 +61,9 @@ static void _yapi_modbus_enter_bootloader_resp_cb(yapi_packet_t* yapiPkt);
 /*****************************************************/
 
 void yapi_modbus_silence(bool isSilenced) {
-  uint8_t data = isSilenced;
-  yapi_service_build_send(YAPI_DEVICE_PCU, 
-                        YAPI_CMD_MODBUS_SILENCE,
-                        YAPI_MSG_SET_RQST,
-                        YAPI_PRIORITY_LOW,
-                        NULL,
-                        &data,
-                        1);
+  yapi_modbus_silence_request_t request;
+  request.isSilenced = isSilenced;
+  yapi_codec_send_request<YAPI_CMD_MODBUS_SILENCE>(YAPI_DEVICE_PCU, YAPI_MSG_SET_RQST, YAPI_PRIORITY_LOW, request);
 }
 
 void yapi_modbus_enter_bootloader(yapi_device_id_enum_t yapiDeviceId) {
@@ -125,7 +122,9 @@ static void _yapi_modbus_response_handler(yapi_packet_t* yapiPkt) {
       if (yapiPkt->messageData.type != YAPI_MSG_GET_RESP_OK) {
         GZ_LOG_INFO("_yapi_modbus_get_boot_info_resp_cb: [ERROR]\n");
       } else {
-        GZ_LOG_INFO("_yapi_modbus_get_boot_info_resp_cb: appUpdateState[0x%02X]\n", yapiPkt->data[0]);
+        yapi_modbus_boot_info_response_t bootInfo;
+        yapi_codec_decode_response<YAPI_CMD_MOBUS_GET_BOOTINFO>(yapiPkt, &bootInfo);
+        GZ_LOG_INFO("_yapi_modbus_get_boot_info_resp_cb: appUpdateState[0x%02X]\n", bootInfo.appUpdateState);
       }
       break;
   }
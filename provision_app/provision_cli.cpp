@@ -19,6 +19,7 @@
 
 #include "provision_cli.h"
 #include "uart.h"
+#define GZ_LOG_MODULE "cli"
 #include "gz_log.h"
 #include "yapi_provision.h"
 
@@ -26,8 +27,6 @@
 #define NEW_LINE                '\n'
 #define CARRIAGE_RETURN         '\r'
 #define CLI_PROMPT              "> "
-#define YAPI_RESP_TIMEOUT_S     5
-#define YAPI_RESP_1S_US         1000000    
 #define ANSI_COLOR_RED          "\x1b[31m"
 #define ANSI_COLOR_GREEN        "\x1b[32m"
 #define ANSI_COLOR_YELLOW       "\x1b[33m"
@@ -135,7 +134,7 @@ static _Cli_Command_Args_t _cli_string_parser(const char* line, const char* deli
   do {
     command_arg.command_args[command_arg.args_count] = strtok(NULL, delimiter);
     GZ_LOG_DEBUG("DEBUG - command_arg[%d]: %s\n", command_arg.args_count, command_arg.command_args[command_arg.args_count]);
-  } while(command_arg.command_args[command_arg.args_count] && command_arg.args_count++ < MAX_CMD_ARGUMENTS);
+  } while(command_arg.command_args[command_arg.args_count] && ++command_arg.args_count < MAX_CMD_ARGUMENTS);
   return command_arg;
 }
 
@@ -244,35 +243,19 @@ static bool _cli_start_provision(_Cli_Command_Args_t command_arguments) {
     return false;
   }
   printf("serial number scanned: [%s]\n\r", serialNumber);
-  yapi_provision_send_serial_number(serialNumber, sizeof(serialNumber));
-  uint16_t timeout_s = 0;
-  while(timeout_s++ < YAPI_RESP_TIMEOUT_S) {
-    if (yapi_provision_get_serial_write_respond_status() == YAPI_SERIAL_RESPONSE_OK) {
-      break;
-    }
-    usleep(YAPI_RESP_1S_US);
-  }
-  if (yapi_provision_get_serial_write_respond_status() == YAPI_SERIAL_RESPONSE_OK) {
-    _Cli_Command_Args_t command_arguments;
-    _cli_read_id(command_arguments);
-  } else {
-    GZ_LOG_ERROR(ANSI_COLOR_RED "Serial write error [%s]" ANSI_COLOR_RESET, yapi_provision_serial_response_status_string(yapi_provision_get_serial_write_respond_status()));
+  // Completes as soon as the PCU answers, the device info is printed by the SERIAL_READ callback
+  yapi_client_result_t result = yapi_provision_write_serial_number(serialNumber, sizeof(serialNumber)).get();
+  if (result.status != YAPI_CLIENT_STATUS_OK) {
+    GZ_LOG_ERROR(ANSI_COLOR_RED "Serial write error [%s]" ANSI_COLOR_RESET, yapi_client_status_string(result.status));
     return false;
   }
-  return true;
+  return _cli_read_id(command_arguments);
 }
 
 static bool _cli_read_id(_Cli_Command_Args_t command_arguments) {
-  yapi_provision_send_serial_read_request();
-  uint16_t timeout_s = 0;
-  while(timeout_s++ < YAPI_RESP_TIMEOUT_S) {
-    if (yapi_provision_get_serial_read_respond_status() == YAPI_SERIAL_RESPONSE_OK) {
-      break;
-    }
-    usleep(YAPI_RESP_1S_US);
-  }
-  if (yapi_provision_get_serial_read_respond_status() != YAPI_SERIAL_RESPONSE_OK) {
-    GZ_LOG_ERROR(ANSI_COLOR_RED "Serial read error [%d]" ANSI_COLOR_RESET, yapi_provision_serial_response_status_string(yapi_provision_get_serial_read_respond_status()));
+  yapi_client_result_t result = yapi_provision_read_serial().get();
+  if (result.status != YAPI_CLIENT_STATUS_OK) {
+    GZ_LOG_ERROR(ANSI_COLOR_RED "Serial read error [%s]" ANSI_COLOR_RESET, yapi_client_status_string(result.status));
     return false;
   }
   printf(ANSI_COLOR_GREEN "\r\n******* Provision SUCCESS *******" ANSI_COLOR_RESET);
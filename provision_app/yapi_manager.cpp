@@ -5,6 +5,8 @@
  *      Author: zacharygarrard
  */
 
+#include "yapi_client.h" // C++ API, must stay outside of the extern "C" block
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,11 +28,13 @@ extern "C" {
 
 void yapi_init(void) {
   yapi_service_driver_init();
+  yapi_client_init();
   yapi_provision_callbacks_init();
 }
 
 void yapi_task_10ms(void* params) {
   yapi_service_driver_10ms(params);
+  yapi_client_task();
 }
 
 #ifdef __cplusplus
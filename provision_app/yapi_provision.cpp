@@ -12,6 +12,7 @@
 
 #include "yapi_provision.h"
 #include "yapi_service.h"
+#include "yapi_codec.h"
 #include "gz_log.h"
 
 #ifdef __cplusplus
@@ -24,10 +25,9 @@ extern "C" {
 
 #define MAX_RESPONSE_CB                   4
 #define INVALID_CB_ID                     0xFF
+#define YAPI_PROVISION_RESP_TIMEOUT_MS    5000
+#define YAPI_PROVISION_READ_ATTEMPTS      5
 
-static char _serialNumber[25] = {0};
-static Yapi_Serial_Respons_e _serialWriteRespStatus = YAPI_SERIAL_RESPONSE_UNKNOWN;
-static Yapi_Serial_Respons_e _serialReadRespStatus = YAPI_SERIAL_RESPONSE_UNKNOWN;
 /*****************************************************/
 /* Section: Private function declarations            */
 /*****************************************************/
@@ -47,9 +47,8 @@ static void _yapi_provision_serial_read_resp_cb(yapi_packet_t* yapiPkt);
 /*****************************************************/
 static void _yapi_provision_serial_read_resp_cb(yapi_packet_t* yapiPkt) {
   if (yapiPkt->senderId == YAPI_DEVICE_PCU && yapiPkt->messageData.type == YAPI_MSG_GET_RESP_OK) {
-    _serialReadRespStatus = YAPI_SERIAL_RESPONSE_OK;
     yapi_serial_number_read_response_t readId;
-    memcpy(&readId, yapiPkt->data, yapiPkt->length);
+    yapi_codec_decode_response<YAPI_CMD_SERIAL_READ>(yapiPkt, &readId);
     printf("\n\r#########\tDevice Info\t#########\n\r");
     printf("\tMAC Address:\t\t%s\n\r", readId.macAddress);
     printf("\tSerial Number:\t\t%s\n\r", readId.serialNumberString);
@@ -64,52 +63,17 @@ static void _yapi_provision_serial_read_resp_cb(yapi_packet_t* yapiPkt) {
     printf("\tHardware MPPT:\t\t%d\n\r", readId.hwVersion_MPPT);
     printf("\tHardware INV:\t\t%d\n\r", readId.hwVersion_INV);
     printf("\n\r#########\tDevice Info\t#########\n\r");
-  } else {
-    _serialReadRespStatus = YAPI_SERIAL_RESPONSE_ERR;
   }
 }
 
 static void _yapi_provision_serial_write_resp_cb(yapi_packet_t* yapiPkt) {
-  if (yapiPkt->senderId == YAPI_DEVICE_PCU && yapiPkt->messageData.type == YAPI_MSG_SET_RESP_OK) {
-    _serialWriteRespStatus = YAPI_SERIAL_RESPONSE_OK;
-  } else {
-    _serialWriteRespStatus = YAPI_SERIAL_RESPONSE_ERR;
-    uint8_t factoryResp = yapiPkt->data[0];
-    printf("(!) Factory write error code [%d]", factoryResp);
+  if (yapiPkt->senderId != YAPI_DEVICE_PCU || yapiPkt->messageData.type != YAPI_MSG_SET_RESP_OK) {
+    yapi_serial_number_write_response_t factoryResp;
+    yapi_codec_decode_response<YAPI_CMD_SERIAL_WRITE>(yapiPkt, &factoryResp);
+    printf("(!) Factory write error code [%d]", factoryResp.code);
   }
 }
 
-const char* yapi_provision_serial_response_status_string(Yapi_Serial_Respons_e respond) {
-  switch (respond) {
-  case YAPI_SERIAL_RESPONSE_WAITING:
-    return "YAPI_SERIAL_RESPONSE_WAITING";
-  case YAPI_SERIAL_RESPONSE_OK:
-    return "YAPI_SERIAL_RESPONSE_OK";
-  case YAPI_SERIAL_RESPONSE_ERR:
-    return "YAPI_SERIAL_RESPONSE_ERR";
-  default:
-    return "YAPI_SERIAL_RESPONSE_UNKNOWN";
-  }
-}
-Yapi_Serial_Respons_e yapi_provision_get_serial_write_respond_status() {
-  return _serialWriteRespStatus;
-}
-
-Yapi_Serial_Respons_e yapi_provision_get_serial_read_respond_status() {
-  return _serialReadRespStatus;
-}
-
-void yapi_provision_send_serial_read_request() {
-  yapi_service_build_send(YAPI_DEVICE_PCU, YAPI_CMD_SERIAL_READ, YAPI_MSG_GET_RQST, YAPI_PRIORITY_HIGH, NULL, NULL, 0);
-  _serialReadRespStatus = YAPI_SERIAL_RESPONSE_WAITING;
-}
-
-void yapi_provision_send_serial_number(char* serialNumber, uint8_t size) {
-  memcpy(_serialNumber, serialNumber, size);
-  yapi_service_build_send(YAPI_DEVICE_PCU, YAPI_CMD_SERIAL_WRITE, YAPI_MSG_SET_RQST, YAPI_PRIORITY_HIGH, NULL, (uint8_t*)serialNumber, size);
-  _serialWriteRespStatus = YAPI_SERIAL_RESPONSE_WAITING;
-}
-
 void yapi_provision_callbacks_init() {
   yapi_service_register_cmd_cb(_yapi_provision_serial_read_resp_cb, YAPI_CMD_SERIAL_READ);
   yapi_service_register_cmd_cb(_yapi_provision_serial_write_resp_cb, YAPI_CMD_SERIAL_WRITE);
@@ -117,4 +81,20 @@ void yapi_provision_callbacks_init() {
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
+
+std::future<yapi_client_result_t> yapi_provision_write_serial_number(char* serialNumber, uint8_t size) {
+  yapi_client_options_t options = yapi_client_default_options();
+  options.timeout_ms = YAPI_PROVISION_RESP_TIMEOUT_MS;
+  options.retries = 0;
+  options.priority = YAPI_PRIORITY_HIGH;
+  return yapi_client_set(YAPI_DEVICE_PCU, YAPI_CMD_SERIAL_WRITE, (uint8_t*)serialNumber, size, &options);
+}
+
+std::future<yapi_client_result_t> yapi_provision_read_serial() {
+  yapi_client_options_t options = yapi_client_default_options();
+  options.timeout_ms = YAPI_PROVISION_RESP_TIMEOUT_MS / YAPI_PROVISION_READ_ATTEMPTS;
+  options.retries = YAPI_PROVISION_READ_ATTEMPTS - 1;
+  options.priority = YAPI_PRIORITY_HIGH;
+  return yapi_client_get(YAPI_DEVICE_PCU, YAPI_CMD_SERIAL_READ, NULL, 0, &options);
+}
\ No newline at end of file
@@ -18,41 +18,26 @@ extern "C" {
 #define YAPI_MODBUS_FAIL       1
 #define YAPI_MODBUS_SUCCESS    0
 
-typedef enum {
-  YAPI_SERIAL_RESPONSE_UNKNOWN,
-  YAPI_SERIAL_RESPONSE_WAITING,
-  YAPI_SERIAL_RESPONSE_OK,
-  YAPI_SERIAL_RESPONSE_ERR
-} Yapi_Serial_Respons_e;
 /**
- * @brief Send serial number YAPI SET request
+ * @brief initialize the callbacks for yapi provision
  * **/
-void yapi_provision_send_serial_number(char*, uint8_t);
+void yapi_provision_callbacks_init();
 
-/**
- * @brief
- * **/
-Yapi_Serial_Respons_e yapi_provision_get_serial_write_respond_status();
+#ifdef __cplusplus
+}
 
-/**
- * @brief
- * **/
-Yapi_Serial_Respons_e yapi_provision_get_serial_read_respond_status();
+#include "yapi_client.h"
 
 /**
- * @brief
+ * @brief Sends the serial number, the future completes with the SERIAL_WRITE response.
+ * The request is not retried since the PCU refuses a second write once the serial is set.
  * **/
-void yapi_provision_send_serial_read_request();
+std::future<yapi_client_result_t> yapi_provision_write_serial_number(char*, uint8_t);
 
 /**
- * @brief initialize the callbacks for yapi provision
+ * @brief Requests the device IDs, the future completes with the SERIAL_READ response
  * **/
-void yapi_provision_callbacks_init();
-
-const char* yapi_provision_serial_response_status_string(Yapi_Serial_Respons_e);
-
-#ifdef __cplusplus
-}
+std::future<yapi_client_result_t> yapi_provision_read_serial();
 #endif
 
 #endif //OTA_YAPI_PROVISION_H
\ No newline at end of file
@@ -0,0 +1,213 @@
+/**
+ * metrics_exporter.cpp
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics_exporter.h"
+#include "gz_metrics.h"
+#define GZ_LOG_MODULE "metrics_exporter"
+#include "gz_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_EXPORTER_POLL_MS          100   // how soon metrics_exporter_stop() is noticed
+#define METRICS_EXPORTER_REQUEST_LENGTH   1024
+#define METRICS_EXPORTER_PAGE_LENGTH      16384 // first allocation of the page, doubled as needed
+
+typedef struct {
+  char* data;
+  size_t size;
+  size_t capacity;
+  bool isTruncated;             // out of memory, the rest of the dump was dropped
+} _Metrics_Exporter_Page_t;
+
+static pthread_mutex_t _exporterLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t _exporterThreadId;
+static int _listenFd = -1;
+static bool _isRunning = false;
+static volatile bool _isStopping = false;
+static uint32_t _scrapes = 0;
+static _Metrics_Exporter_Page_t _page;  // the dump, kept between scrapes by the exporter thread
+
+/**
+ * @brief gz_metrics_dump() output straight to the connection, stops writing once the scraper is gone
+ */
+static void _metrics_exporter_send(void* context, const char* text, size_t length) {
+  int* fd = (int*)context;
+  while (*fd >= 0 && length) {
+    ssize_t sent = send(*fd, text, length, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      *fd = -1;
+      return;
+    }
+    text += sent;
+    length -= sent;
+  }
+}
+
+/**
+ * @brief gz_metrics_dump() output into the page: the dump holds the registry lock, the scraper is only written
+ * to once it is released
+ */
+static void _metrics_exporter_render(void* context, const char* text, size_t length) {
+  _Metrics_Exporter_Page_t* page = (_Metrics_Exporter_Page_t*)context;
+  if (page->isTruncated) {
+    return;
+  }
+  if (page->size + length > page->capacity) {
+    size_t capacity = page->capacity ? page->capacity : METRICS_EXPORTER_PAGE_LENGTH;
+    while (capacity < page->size + length) {
+      capacity *= 2;
+    }
+    char* data = (char*)realloc(page->data, capacity);
+    if (!data) {
+      page->isTruncated = true;
+      return;
+    }
+    page->data = data;
+    page->capacity = capacity;
+  }
+  memcpy(page->data + page->size, text, length);
+  page->size += length;
+}
+
+static void _metrics_exporter_serve(int fd) {
+  struct timeval timeout = { METRICS_EXPORTER_IO_TIMEOUT_MS / 1000, (METRICS_EXPORTER_IO_TIMEOUT_MS % 1000) * 1000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // The request line is all we look at, the rest of the headers are read and ignored
+  char request[METRICS_EXPORTER_REQUEST_LENGTH];
+  size_t received = 0;
+  while (received < sizeof(request) - 1) {
+    ssize_t count = recv(fd, request + received, sizeof(request) - 1 - received, 0);
+    if (count <= 0) {
+      return;
+    }
+    received += count;
+    request[received] = '\0';
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+      break;
+    }
+  }
+  request[received] = '\0';
+  int out = fd;
+  if (strncmp(request, "GET /metrics ", 13) != 0 && strncmp(request, "GET / ", 6) != 0) {
+    static const char notFound[] = "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n\r\nGET /metrics\n";
+    _metrics_exporter_send(&out, notFound, sizeof(notFound) - 1);
+    return;
+  }
+  _page.size = 0;
+  _page.isTruncated = false;
+  gz_metrics_dump(GZ_METRICS_FORMAT_PROMETHEUS, _metrics_exporter_render, &_page);
+  if (_page.isTruncated) {
+    static const char unavailable[] =
+      "HTTP/1.0 503 Service Unavailable\r\nContent-Type: text/plain\r\n\r\nOut of memory\n";
+    _metrics_exporter_send(&out, unavailable, sizeof(unavailable) - 1);
+    return;
+  }
+  static const char header[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n";
+  _metrics_exporter_send(&out, header, sizeof(header) - 1);
+  _metrics_exporter_send(&out, _page.data, _page.size);
+  __atomic_add_fetch(&_scrapes, 1, __ATOMIC_RELAXED);
+}
+
+static void* _metrics_exporter_thread(void* params) {
+  while (!_isStopping) {
+    struct pollfd pfd = { .fd = _listenFd, .events = POLLIN, .revents = 0 };
+    if (poll(&pfd, 1, METRICS_EXPORTER_POLL_MS) <= 0) {
+      continue;
+    }
+    int fd = accept(_listenFd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    _metrics_exporter_serve(fd);
+    close(fd); // HTTP/1.0: the end of the dump is the end of the connection
+  }
+  return NULL;
+}
+
+int metrics_exporter_start(uint16_t port) {
+  pthread_mutex_lock(&_exporterLock);
+  if (_isRunning) {
+    pthread_mutex_unlock(&_exporterLock);
+    GZ_LOG_ERROR("Already serving\n");
+    return -1;
+  }
+  _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_listenFd < 0) {
+    pthread_mutex_unlock(&_exporterLock);
+    GZ_LOG_ERROR("Socket creation failed\n");
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in sockaddr_v4;
+  memset(&sockaddr_v4, 0, sizeof(sockaddr_v4));
+  sockaddr_v4.sin_family = AF_INET;
+  sockaddr_v4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sockaddr_v4.sin_port = htons(port);
+  socklen_t length = sizeof(sockaddr_v4);
+  if (bind(_listenFd, (struct sockaddr*)&sockaddr_v4, sizeof(sockaddr_v4)) < 0 || listen(_listenFd, 4) < 0 ||
+      getsockname(_listenFd, (struct sockaddr*)&sockaddr_v4, &length) < 0) {
+    GZ_LOG_ERROR("Socket bind failed port[%d] errno[%d]\n", port, errno);
+    close(_listenFd);
+    _listenFd = -1;
+    pthread_mutex_unlock(&_exporterLock);
+    return -1;
+  }
+  _isStopping = false;
+  _scrapes = 0;
+  _isRunning = true;
+  pthread_create(&_exporterThreadId, NULL, _metrics_exporter_thread, NULL);
+  pthread_mutex_unlock(&_exporterLock);
+  return ntohs(sockaddr_v4.sin_port);
+}
+
+void metrics_exporter_stop(void) {
+  pthread_mutex_lock(&_exporterLock);
+  if (!_isRunning) {
+    pthread_mutex_unlock(&_exporterLock);
+    return;
+  }
+  _isStopping = true;
+  pthread_join(_exporterThreadId, NULL);
+  close(_listenFd);
+  _listenFd = -1;
+  free(_page.data);
+  memset(&_page, 0, sizeof(_page));
+  _isRunning = false;
+  pthread_mutex_unlock(&_exporterLock);
+}
+
+bool metrics_exporter_is_running(void) {
+  pthread_mutex_lock(&_exporterLock);
+  bool isRunning = _isRunning;
+  pthread_mutex_unlock(&_exporterLock);
+  return isRunning;
+}
+
+uint32_t metrics_exporter_get_scrapes(void) {
+  return __atomic_load_n(&_scrapes, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
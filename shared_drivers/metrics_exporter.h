@@ -0,0 +1,47 @@
+/**
+ * metrics_exporter.h
+ *
+ * Serves the gz_metrics registry in the Prometheus text format on a local port: a thread answers
+ * GET /metrics (or /) with a fresh dump, one connection at a time. The dump is rendered in memory and sent
+ * after, so a slow scraper never holds the registry lock. Bound to 127.0.0.1 only, scrape remotely through an
+ * ssh tunnel.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_EXPORTER_DEFAULT_PORT     9464
+#define METRICS_EXPORTER_IO_TIMEOUT_MS    1000  // a scraper slower than that is dropped
+
+/**
+ * @param port 0 for any free port
+ * @return the port listened on, -1 if already running or the port cannot be bound
+ */
+int metrics_exporter_start(uint16_t port);
+
+/**
+ * @brief Stops serving, waits for the scrape in progress
+ */
+void metrics_exporter_stop(void);
+
+bool metrics_exporter_is_running(void);
+
+/**
+ * @return scrapes answered since start
+ */
+uint32_t metrics_exporter_get_scrapes(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_EXPORTER_H
@@ -21,6 +21,8 @@
 
 #include "uart.h"
 #include "gz_array.h"
+#include "gz_metrics.h"
+#define GZ_LOG_MODULE "uart"
 #include "gz_log.h"
 
 
@@ -40,10 +42,49 @@ typedef struct {
 } _Uart_Info_t;
 
 static _Uart_Info_t _uart_port_info[MAX_SERIAL_PORT_COUNT] = { {0} };
-static int _uart_getc(int fd, unsigned char *c);
-static pthread_mutex_t _lock;
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
 
 v_fp_u8_t _uart_read_one_byte_cb;
+static uart_tap_cb_t _uart_tap_cb = NULL;
+
+/**
+ * @brief gz_metrics families indexed by uart_direction_t, registered by uart_connect
+ */
+typedef struct {
+  int bytes;
+  int syscalls;
+  int eagain;                     // read found nothing, write found the kernel buffer full
+  int errors;
+} _Uart_Metrics_t;
+
+static _Uart_Metrics_t _metrics = { -1, -1, -1, -1 };
+
+static void _uart_direction_label(uint16_t index, char* label, size_t size) {
+  snprintf(label, size, "%s", index == UART_DIRECTION_RX ? "rx" : "tx");
+}
+
+static void _uart_metrics_init(void) {
+  _metrics.bytes = gz_metrics_counter_family("uart_bytes_total", "Bytes through the serial port", "direction", 2,
+                                             _uart_direction_label);
+  _metrics.syscalls = gz_metrics_counter_family("uart_syscalls_total", "read/write/writev calls on the serial port",
+                                                "direction", 2, _uart_direction_label);
+  _metrics.eagain = gz_metrics_counter_family("uart_eagain_total", "Serial port calls that would have blocked",
+                                              "direction", 2, _uart_direction_label);
+  _metrics.errors = gz_metrics_counter_family("uart_errors_total", "Serial port calls that failed", "direction",
+                                              2, _uart_direction_label);
+}
+
+/**
+ * @brief Counts a read or write syscall from what it returned, errno untouched
+ */
+static void _uart_metrics_count(uart_direction_t direction, int result) {
+  gz_metrics_add_at(_metrics.syscalls, direction, 1);
+  if (result > 0) {
+    gz_metrics_add_at(_metrics.bytes, direction, result);
+  } else if (result < 0) {
+    gz_metrics_add_at(errno == EAGAIN || errno == EWOULDBLOCK ? _metrics.eagain : _metrics.errors, direction, 1);
+  }
+}
 /**
  * Open uart port
  * 
@@ -56,6 +97,7 @@ int uart_connect(char* device_name, int baud_rate) {
   int available_port = 0;
   GZ_LOG_INFO("device name: (%s)\n", device_name);
   GZ_LOG_INFO("baud rate: (%d)\n", baud_rate);
+  _uart_metrics_init();
   for (available_port = 0; available_port < MAX_SERIAL_PORT_COUNT; available_port++) {
     printf("available port: %d\n", available_port);
     if (_uart_port_info[available_port].fd) {
@@ -64,7 +106,8 @@ int uart_connect(char* device_name, int baud_rate) {
     _uart_port_info[available_port].baud = baud_rate;
     memcpy(_uart_port_info[available_port].name, device_name, MAX_DEVICE_NAME_LENGTH);
     GZ_LOG_INFO("opening devices: (%s)\n", device_name);
-    _uart_port_info[available_port].fd = open(device_name, O_RDWR | O_NOCTTY);
+    // Non blocking so a full kernel tty buffer never stalls the writer, see uart_writev()
+    _uart_port_info[available_port].fd = open(device_name, O_RDWR | O_NOCTTY | O_NONBLOCK);
     if (_uart_port_info[available_port].fd == -1) {
       GZ_LOG_ERROR("unable to open serial port. Exiting...\n");
       return -1;
@@ -118,11 +161,6 @@ int uart_connect(char* device_name, int baud_rate) {
   if (available_port == MAX_SERIAL_PORT_COUNT) {
     return -1;
   }
-  if (pthread_mutex_init(&_lock, NULL) != 0) {
-      GZ_LOG_ERROR("\n mutex init has failed\n");
-      return 1;
-  }
-
   return _uart_port_info[available_port].fd;
 }
 
@@ -151,6 +189,20 @@ void uart_list(const char* devDelimiter) {
   }
 }
 
+/**
+ * @brief Index of the opened port of fd in _uart_port_info
+ * @return -1, logged, when fd is not an opened port
+ */
+static int _uart_port_id(int fd) {
+  for (size_t portId = 0; portId < arrayLength(_uart_port_info); portId++) {
+    if (_uart_port_info[portId].fd == fd) {
+      return (int)portId;
+    }
+  }
+  GZ_LOG_ERROR("Port has not been opened (%d)\n", fd);
+  return -1;
+}
+
 /**
  * @brief Read incoming data from host serial device (non blocking)
  * Should not be called from ISR
@@ -160,37 +212,27 @@ void uart_list(const char* devDelimiter) {
  * @return int number of character read
  */
 int uart_read(int fd, unsigned char *buffer, int size) {
-  int portId = 0;
   int readCount = 0;
-  unsigned char c = 0;
-  for (portId = 0; portId < arrayLength(_uart_port_info); portId++) {
-    if (_uart_port_info[portId].fd == fd) {
-      break;
-    }
-  }
-  if (portId == arrayLength(_uart_port_info)) {
-    GZ_LOG_ERROR("Port has not been opened (%d)\n", fd);
+  int portId = _uart_port_id(fd);
+  if (portId < 0) {
     return -1;
   }
   pthread_mutex_lock(&_lock);
-  while(readCount < size && _uart_getc(fd, &c)) {
-    buffer[readCount++] = c;
+  readCount = read(fd, buffer, size); // whatever is available in one syscall, -1/EAGAIN when nothing is
+  _uart_metrics_count(UART_DIRECTION_RX, readCount);
+  if (readCount < 0) {
+    readCount = 0;
   }
-  pthread_mutex_unlock(&_lock);
-  return readCount;
-}
-
-/**
- * Not async
-*/
-static int _uart_getc(int fd, unsigned char *c) {
-  if (read(fd, c, 1)) {
-    if (_uart_read_one_byte_cb) {
-      _uart_read_one_byte_cb(*c);
+  if (_uart_read_one_byte_cb) {
+    for (int i = 0; i < readCount; i++) {
+      _uart_read_one_byte_cb(buffer[i]);
     }
-    return 1;
   }
-  return 0;
+  if (_uart_tap_cb && readCount) {
+    _uart_tap_cb(portId, UART_DIRECTION_RX, buffer, readCount);
+  }
+  pthread_mutex_unlock(&_lock);
+  return readCount;
 }
 
 /**
@@ -202,22 +244,55 @@ static int _uart_getc(int fd, unsigned char *c) {
  * @return int number of character written
  */
 int uart_write(int fd, unsigned char *buffer, int size) {
-  int port_id = 0;
-  for (port_id = 0; port_id < arrayLength(_uart_port_info); port_id++) {
-    if (_uart_port_info[port_id].fd == fd) {
-      break;
-    }
-  }
-  if (port_id == arrayLength(_uart_port_info)) {
-    GZ_LOG_ERROR("Port has not been opened (%d)\n", fd);
+  int port_id = _uart_port_id(fd);
+  if (port_id < 0) {
     return -1;
   }
   pthread_mutex_lock(&_lock);
   int readSize = write(fd, buffer, size);
+  _uart_metrics_count(UART_DIRECTION_TX, readSize);
+  if (_uart_tap_cb && readSize > 0) {
+    _uart_tap_cb(port_id, UART_DIRECTION_TX, buffer, readSize);
+  }
   pthread_mutex_unlock(&_lock);
   return readSize;
 }
 
+int uart_writev(int fd, const struct iovec *iov, int iovcnt) {
+  int port_id = _uart_port_id(fd);
+  if (port_id < 0) {
+    return -1;
+  }
+  pthread_mutex_lock(&_lock);
+  int writtenSize = writev(fd, iov, iovcnt);
+  _uart_metrics_count(UART_DIRECTION_TX, writtenSize);
+  if (_uart_tap_cb && writtenSize > 0) {
+    int tapped = 0;
+    for (int i = 0; i < iovcnt && tapped < writtenSize; i++) { // Only what reached the kernel
+      int size = (int)iov[i].iov_len < writtenSize - tapped ? (int)iov[i].iov_len : writtenSize - tapped;
+      _uart_tap_cb(port_id, UART_DIRECTION_TX, (const uint8_t*)iov[i].iov_base, size);
+      tapped += size;
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+  return writtenSize;
+}
+
+void uart_register_tap(uart_tap_cb_t cb) {
+  pthread_mutex_lock(&_lock);
+  _uart_tap_cb = cb;
+  pthread_mutex_unlock(&_lock);
+}
+
+void uart_inject_rx(const unsigned char *buffer, int size) {
+  if (!_uart_read_one_byte_cb) {
+    return;
+  }
+  for (int i = 0; i < size; i++) {
+    _uart_read_one_byte_cb(buffer[i]);
+  }
+}
+
 void uart_register_read_one_byte_callback(v_fp_u8_t cb) {
   _uart_read_one_byte_cb = cb;
 }
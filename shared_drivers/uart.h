@@ -7,9 +7,21 @@ extern "C" {
 
 #define UART_UNCONNECTED        0
 #include <stdint.h>
+#include <sys/uio.h>
 
 typedef void (*v_fp_u8_t)(uint8_t);
 
+typedef enum {
+  UART_DIRECTION_RX = 0,
+  UART_DIRECTION_TX = 1,
+} uart_direction_t;
+
+/**
+ * @brief Sees every chunk of bytes read from or written to a port, see uart_register_tap()
+ * @param portId index of the port, not its file descriptor
+ */
+typedef void (*uart_tap_cb_t)(uint8_t portId, uart_direction_t direction, const uint8_t *data, int size);
+
 /**
  * Open uart port
  * 
@@ -45,6 +57,16 @@ int uart_read(int fd, unsigned char *buffer, int size);
  */
 int uart_write(int fd, unsigned char *buffer, int size);
 
+/**
+ * @brief Gather write several buffers to host with a single syscall (non blocking)
+ * Should not be called from ISR
+ *
+ * @param iov Array of buffers to be sent, in order
+ * @param iovcnt Number of entries in iov
+ * @return int number of character written, -1 on error (errno is preserved, EAGAIN when the tty buffer is full)
+ */
+int uart_writev(int fd, const struct iovec *iov, int iovcnt);
+
 /**
  * List devices under /dev/ directory
  * @param: delimiter of device name (tty/cu...)
@@ -56,6 +78,21 @@ void uart_list(const char*);
 */
 void uart_register_read_one_byte_callback(v_fp_u8_t cb);
 
+/**
+ * @brief: register a tap called with the bytes each read/write moved, NULL to remove it.
+ * Called with the port lock held: it must be quick and must not call back into uart_*
+*/
+void uart_register_tap(uart_tap_cb_t cb);
+
+/**
+ * @brief Feeds bytes to the read callback as if they had been received, used to replay captures.
+ * Must be called from the thread that normally calls uart_read()
+ *
+ * @param buffer bytes to feed
+ * @param size number of bytes
+ */
+void uart_inject_rx(const unsigned char *buffer, int size);
+
 /**
  * @brief: get File descriptor of a connected device after calling `uart_connect`
  * Caller need to sanity the return value with UART_UNCONNECTED
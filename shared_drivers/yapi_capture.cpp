@@ -0,0 +1,414 @@
+/**
+ * yapi_capture.cpp
+ *
+ * Wire capture and replay for YAPI links, see yapi_capture.h
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "yapi_capture.h"
+#define GZ_LOG_MODULE "capture"
+#include "gz_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************/
+/* Section: Defines & Typedefs                       */
+/*****************************************************/
+
+#define NSEC_PER_SEC                      1000000000ULL
+#define NSEC_PER_MSEC                     1000000ULL
+#define REPLAY_IDLE_SLEEP_NS              1000000ULL
+
+typedef struct {
+  FILE* file;
+  yapi_replay_mode_t mode;
+  uint8_t directions;
+  yapi_capture_record_header_t record;
+  uint8_t data[UINT16_MAX];
+  uint16_t offset;              // bytes of the current record already fed
+  bool hasRecord;
+  bool isDone;
+  uint64_t firstRecord_ns;
+  uint64_t lastRecord_ns;
+  uint64_t start_ns;
+  yapi_replay_stats_t stats;
+} _Yapi_Replay_t;
+
+/*****************************************************/
+/* Section: Private variables                        */
+/*****************************************************/
+
+static pthread_mutex_t _captureLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _captureCond = PTHREAD_COND_INITIALIZER;
+static pthread_t _writerThreadId;
+static bool _captureRunning = false;
+static bool _captureStopping = false;
+static int _captureFd = -1;
+static uint8_t* _ring = NULL;
+static uint32_t _ringHead = 0;
+static uint32_t _ringTail = 0;
+static uint32_t _ringFill = 0;
+static yapi_capture_stats_t _captureStats;
+
+static pthread_mutex_t _replayLock = PTHREAD_MUTEX_INITIALIZER;
+static _Yapi_Replay_t* _replay = NULL;
+static yapi_replay_stats_t _lastReplayStats;
+
+/*****************************************************/
+/* Section: Capture                                  */
+/*****************************************************/
+
+static uint64_t _now_ns(clockid_t clock) {
+  struct timespec now;
+  clock_gettime(clock, &now);
+  return (uint64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/**
+ * @brief Must be called with _captureLock held and enough room in the ring
+ */
+static void _ring_put(const void* data, uint32_t size) {
+  uint32_t first = YAPI_CAPTURE_BUFFER_SIZE - _ringHead < size ? YAPI_CAPTURE_BUFFER_SIZE - _ringHead : size;
+  memcpy(_ring + _ringHead, data, first);
+  memcpy(_ring, (const uint8_t*)data + first, size - first);
+  _ringHead = (_ringHead + size) % YAPI_CAPTURE_BUFFER_SIZE;
+  _ringFill += size;
+}
+
+/**
+ * @brief uart tap: runs on the reading/writing thread, only copies into the ring
+ */
+static void _yapi_capture_tap(uint8_t portId, uart_direction_t direction, const uint8_t *data, int size) {
+  yapi_capture_record_header_t record;
+  record.timestamp_ns = _now_ns(CLOCK_MONOTONIC);
+  record.portId = portId;
+  record.direction = direction;
+  record.length = size;
+  pthread_mutex_lock(&_captureLock);
+  if (!_captureRunning || size > UINT16_MAX || _ringFill + sizeof(record) + size > YAPI_CAPTURE_BUFFER_SIZE) {
+    _captureStats.droppedRecords += _captureRunning;
+    pthread_mutex_unlock(&_captureLock);
+    return;
+  }
+  _ring_put(&record, sizeof(record));
+  _ring_put(data, size);
+  _captureStats.records++;
+  _captureStats.bytes += size;
+  if (_ringFill > YAPI_CAPTURE_BUFFER_SIZE / 4) {
+    pthread_cond_signal(&_captureCond);
+  }
+  pthread_mutex_unlock(&_captureLock);
+}
+
+static void _write_all(int fd, const uint8_t* data, uint32_t size) {
+  while (size) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      GZ_LOG_ERROR("yapi_capture: write failed (%s)\n", strerror(errno));
+      return;
+    }
+    data += written;
+    size -= written;
+  }
+}
+
+static void *_yapi_capture_writer_thread(void *params) {
+  pthread_mutex_lock(&_captureLock);
+  while (1) {
+    if (!_ringFill && !_captureStopping) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      uint64_t wake_ns = (uint64_t)deadline.tv_nsec + YAPI_CAPTURE_FLUSH_INTERVAL_MS * NSEC_PER_MSEC;
+      deadline.tv_sec += wake_ns / NSEC_PER_SEC;
+      deadline.tv_nsec = wake_ns % NSEC_PER_SEC;
+      pthread_cond_timedwait(&_captureCond, &_captureLock, &deadline);
+    }
+    if (!_ringFill) {
+      if (_captureStopping) {
+        break;
+      }
+      continue;
+    }
+    // Only the writer moves the tail, so the filled region is stable once the lock is released
+    uint32_t tail = _ringTail;
+    uint32_t fill = _ringFill;
+    pthread_mutex_unlock(&_captureLock);
+    uint32_t first = YAPI_CAPTURE_BUFFER_SIZE - tail < fill ? YAPI_CAPTURE_BUFFER_SIZE - tail : fill;
+    _write_all(_captureFd, _ring + tail, first);
+    _write_all(_captureFd, _ring, fill - first);
+    pthread_mutex_lock(&_captureLock);
+    _ringTail = (tail + fill) % YAPI_CAPTURE_BUFFER_SIZE;
+    _ringFill -= fill;
+    _captureStats.writes++;
+  }
+  pthread_mutex_unlock(&_captureLock);
+  return NULL;
+}
+
+int yapi_capture_start(const char *fileName) {
+  pthread_mutex_lock(&_captureLock);
+  if (_captureRunning) {
+    pthread_mutex_unlock(&_captureLock);
+    GZ_LOG_ERROR("yapi_capture: already running\n");
+    return -1;
+  }
+  _captureFd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  _ring = _captureFd < 0 ? NULL : (uint8_t*)malloc(YAPI_CAPTURE_BUFFER_SIZE);
+  if (!_ring) {
+    if (_captureFd >= 0) {
+      close(_captureFd);
+    }
+    pthread_mutex_unlock(&_captureLock);
+    GZ_LOG_ERROR("yapi_capture: cannot create (%s)\n", fileName);
+    return -1;
+  }
+  yapi_capture_file_header_t header;
+  memcpy(header.magic, YAPI_CAPTURE_MAGIC, sizeof(header.magic));
+  header.version = YAPI_CAPTURE_VERSION;
+  header.headerSize = sizeof(header);
+  header.startRealtime_ns = _now_ns(CLOCK_REALTIME);
+  header.startMonotonic_ns = _now_ns(CLOCK_MONOTONIC);
+  _write_all(_captureFd, (const uint8_t*)&header, sizeof(header));
+
+  _ringHead = _ringTail = _ringFill = 0;
+  memset(&_captureStats, 0, sizeof(_captureStats));
+  _captureStopping = false;
+  _captureRunning = true;
+  pthread_create(&_writerThreadId, NULL, _yapi_capture_writer_thread, NULL);
+  pthread_mutex_unlock(&_captureLock);
+  uart_register_tap(_yapi_capture_tap);
+  return 0;
+}
+
+void yapi_capture_stop(void) {
+  pthread_mutex_lock(&_captureLock);
+  if (!_captureRunning) {
+    pthread_mutex_unlock(&_captureLock);
+    return;
+  }
+  _captureRunning = false; // the tap ignores new chunks from now on
+  _captureStopping = true;
+  pthread_cond_signal(&_captureCond);
+  pthread_mutex_unlock(&_captureLock);
+  uart_register_tap(NULL);
+  pthread_join(_writerThreadId, NULL);
+  close(_captureFd);
+  _captureFd = -1;
+  free(_ring);
+  _ring = NULL;
+}
+
+bool yapi_capture_is_running(void) {
+  return _captureRunning;
+}
+
+void yapi_capture_get_stats(yapi_capture_stats_t *stats) {
+  pthread_mutex_lock(&_captureLock);
+  memcpy(stats, &_captureStats, sizeof(yapi_capture_stats_t));
+  pthread_mutex_unlock(&_captureLock);
+}
+
+/*****************************************************/
+/* Section: Replay                                   */
+/*****************************************************/
+
+static _Yapi_Replay_t* _replay_open(const char *fileName, yapi_replay_mode_t mode, uint8_t directions) {
+  FILE* file = fopen(fileName, "rb");
+  if (!file) {
+    GZ_LOG_ERROR("yapi_replay: cannot open (%s)\n", fileName);
+    return NULL;
+  }
+  yapi_capture_file_header_t header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, YAPI_CAPTURE_MAGIC, sizeof(header.magic)) ||
+      header.version != YAPI_CAPTURE_VERSION || fseek(file, header.headerSize, SEEK_SET)) {
+    GZ_LOG_ERROR("yapi_replay: (%s) is not a capture\n", fileName);
+    fclose(file);
+    return NULL;
+  }
+  _Yapi_Replay_t* replay = (_Yapi_Replay_t*)calloc(1, sizeof(_Yapi_Replay_t));
+  if (!replay) {
+    fclose(file);
+    return NULL;
+  }
+  replay->file = file;
+  replay->mode = mode;
+  replay->directions = directions;
+  replay->start_ns = _now_ns(CLOCK_MONOTONIC);
+  return replay;
+}
+
+static void _replay_close(_Yapi_Replay_t* replay) {
+  replay->stats.elapsed_ns = _now_ns(CLOCK_MONOTONIC) - replay->start_ns;
+  replay->stats.captureDuration_ns = replay->lastRecord_ns - replay->firstRecord_ns;
+  fclose(replay->file);
+}
+
+/**
+ * @brief Loads the next record of a replayed direction
+ * @return false at the end of the file (or on a truncated or corrupt record)
+ */
+static bool _replay_load_record(_Yapi_Replay_t* replay) {
+  while (fread(&replay->record, sizeof(replay->record), 1, replay->file) == 1) {
+    if (replay->record.length && fread(replay->data, replay->record.length, 1, replay->file) != 1) {
+      break;
+    }
+    if (replay->record.direction != UART_DIRECTION_RX && replay->record.direction != UART_DIRECTION_TX) {
+      GZ_LOG_ERROR("yapi_replay: corrupt record, direction (%u)\n", replay->record.direction);
+      break;
+    }
+    if (!(replay->directions & (1 << replay->record.direction))) {
+      replay->stats.skipped++;
+      continue;
+    }
+    if (!replay->stats.records && !replay->hasRecord && !replay->firstRecord_ns) {
+      replay->firstRecord_ns = replay->record.timestamp_ns;
+    }
+    replay->lastRecord_ns = replay->record.timestamp_ns;
+    replay->offset = 0;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Feeds up to maxBytes of what is due
+ * @param nextDue_ns set to the time the next record becomes due when nothing more can be fed now
+ * @return bytes fed
+ */
+static int _replay_step(_Yapi_Replay_t* replay, yapi_replay_feed_cb_t feed, int maxBytes, uint64_t* nextDue_ns) {
+  int fed = 0;
+  while (fed < maxBytes && !replay->isDone) {
+    if (!replay->hasRecord) {
+      replay->hasRecord = _replay_load_record(replay);
+      if (!replay->hasRecord) {
+        replay->isDone = true;
+        break;
+      }
+    }
+    if (replay->mode == YAPI_REPLAY_REALTIME) {
+      uint64_t due_ns = replay->start_ns + (replay->record.timestamp_ns - replay->firstRecord_ns);
+      if (_now_ns(CLOCK_MONOTONIC) < due_ns) {
+        if (nextDue_ns) {
+          *nextDue_ns = due_ns;
+        }
+        break;
+      }
+    }
+    int size = replay->record.length - replay->offset;
+    size = size < maxBytes - fed ? size : maxBytes - fed;
+    feed(replay->data + replay->offset, size);
+    replay->offset += size;
+    replay->stats.bytes += size;
+    fed += size;
+    if (replay->offset == replay->record.length) {
+      replay->hasRecord = false;
+      replay->stats.records++;
+    }
+  }
+  return fed;
+}
+
+static void _replay_feed_uart(const uint8_t *data, int size) {
+  uart_inject_rx(data, size);
+}
+
+int yapi_replay_start(const char *fileName, yapi_replay_mode_t mode, uint8_t directions) {
+  pthread_mutex_lock(&_replayLock);
+  if (_replay) {
+    pthread_mutex_unlock(&_replayLock);
+    GZ_LOG_ERROR("yapi_replay: already running\n");
+    return -1;
+  }
+  _replay = _replay_open(fileName, mode, directions);
+  pthread_mutex_unlock(&_replayLock);
+  return _replay ? 0 : -1;
+}
+
+void yapi_replay_task(void) {
+  pthread_mutex_lock(&_replayLock);
+  if (_replay) {
+    _replay_step(_replay, _replay_feed_uart, YAPI_REPLAY_MAX_FEED_BYTES, NULL);
+    if (_replay->isDone) {
+      _replay_close(_replay);
+      _lastReplayStats = _replay->stats;
+      GZ_LOG_INFO("yapi_replay: done, records[%u] bytes[%llu] in [%llu] ms\n", _lastReplayStats.records,
+                  (unsigned long long)_lastReplayStats.bytes, (unsigned long long)(_lastReplayStats.elapsed_ns / NSEC_PER_MSEC));
+      free(_replay);
+      _replay = NULL;
+    }
+  }
+  pthread_mutex_unlock(&_replayLock);
+}
+
+void yapi_replay_stop(void) {
+  pthread_mutex_lock(&_replayLock);
+  if (_replay) {
+    _replay_close(_replay);
+    _lastReplayStats = _replay->stats;
+    free(_replay);
+    _replay = NULL;
+  }
+  pthread_mutex_unlock(&_replayLock);
+}
+
+bool yapi_replay_is_running(void) {
+  return _replay != NULL;
+}
+
+void yapi_replay_get_stats(yapi_replay_stats_t *stats) {
+  pthread_mutex_lock(&_replayLock);
+  memcpy(stats, _replay ? &_replay->stats : &_lastReplayStats, sizeof(yapi_replay_stats_t));
+  pthread_mutex_unlock(&_replayLock);
+}
+
+int yapi_replay_run(const char *fileName,
+                    yapi_replay_mode_t mode,
+                    uint8_t directions,
+                    yapi_replay_feed_cb_t feed,
+                    void (*pump)(void),
+                    yapi_replay_stats_t *stats) {
+  _Yapi_Replay_t* replay = _replay_open(fileName, mode, directions);
+  if (!replay) {
+    return -1;
+  }
+  while (!replay->isDone) {
+    uint64_t nextDue_ns = 0;
+    if (_replay_step(replay, feed, YAPI_REPLAY_MAX_FEED_BYTES, &nextDue_ns)) {
+      if (pump) {
+        pump();
+      }
+    } else if (nextDue_ns) {
+      uint64_t now_ns = _now_ns(CLOCK_MONOTONIC);
+      uint64_t sleep_ns = nextDue_ns > now_ns ? nextDue_ns - now_ns : 0;
+      struct timespec duration;
+      duration.tv_sec = sleep_ns / NSEC_PER_SEC;
+      duration.tv_nsec = sleep_ns % NSEC_PER_SEC;
+      nanosleep(&duration, NULL);
+    }
+  }
+  _replay_close(replay);
+  if (stats) {
+    memcpy(stats, &replay->stats, sizeof(yapi_replay_stats_t));
+  }
+  free(replay);
+  return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
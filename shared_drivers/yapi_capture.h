@@ -0,0 +1,132 @@
+/**
+ * yapi_capture.h
+ *
+ * Wire capture and replay for YAPI links.
+ *
+ * Capture taps the UART layer and records every RX/TX chunk with a monotonic nanosecond timestamp and its
+ * port index into an append-only file. The tap only copies into a memory ring; a writer thread flushes it.
+ *
+ * File layout (little endian):
+ *   yapi_capture_file_header_t
+ *   { yapi_capture_record_header_t, `length` bytes } repeated
+ *
+ * Replay feeds the recorded bytes back through the UART read callback, hence through yapi_service,
+ * either as fast as the parser accepts them or respecting the recorded timing.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_CAPTURE_H
+#define YAPI_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "uart.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YAPI_CAPTURE_MAGIC                "YCAP"
+#define YAPI_CAPTURE_VERSION              1
+#define YAPI_CAPTURE_BUFFER_SIZE          (1024 * 1024) // bytes of records buffered before the writer catches up
+#define YAPI_CAPTURE_FLUSH_INTERVAL_MS    100
+#define YAPI_REPLAY_MAX_FEED_BYTES        256           // per step, below the yapi_service receive ring size
+
+#define YAPI_REPLAY_DIRECTION_RX          (1 << UART_DIRECTION_RX)
+#define YAPI_REPLAY_DIRECTION_TX          (1 << UART_DIRECTION_TX)
+
+typedef struct __attribute__ ((packed)) {
+  char magic[4];                  // YAPI_CAPTURE_MAGIC
+  uint16_t version;
+  uint16_t headerSize;            // sizeof(yapi_capture_file_header_t), records start right after
+  uint64_t startRealtime_ns;      // wall clock when the capture started, for humans
+  uint64_t startMonotonic_ns;     // monotonic clock when the capture started, records are relative to the same clock
+} yapi_capture_file_header_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint64_t timestamp_ns;          // CLOCK_MONOTONIC
+  uint8_t portId;
+  uint8_t direction;              // uart_direction_t
+  uint16_t length;
+} yapi_capture_record_header_t;
+
+typedef struct {
+  uint32_t records;
+  uint64_t bytes;                 // payload bytes recorded
+  uint32_t droppedRecords;        // the writer could not keep up
+  uint32_t writes;                // write() calls of the writer thread
+} yapi_capture_stats_t;
+
+typedef enum {
+  YAPI_REPLAY_FAST,               // as fast as the parser consumes
+  YAPI_REPLAY_REALTIME,           // respecting the recorded inter-record timing
+} yapi_replay_mode_t;
+
+typedef struct {
+  uint32_t records;               // records fed
+  uint64_t bytes;                 // bytes fed
+  uint32_t skipped;               // records of a direction not replayed
+  uint64_t elapsed_ns;            // replay duration
+  uint64_t captureDuration_ns;    // from the first to the last replayed record, as captured
+} yapi_replay_stats_t;
+
+/**
+ * @brief Feeds replayed bytes, e.g. uart_inject_rx()
+ */
+typedef void (*yapi_replay_feed_cb_t)(const uint8_t *data, int size);
+
+/**
+ * @brief Opens (truncates) the capture file and starts recording all ports
+ * @return 0 on success, -1 if the file can not be created or a capture is running
+ */
+int yapi_capture_start(const char *fileName);
+
+/**
+ * @brief Stops recording and flushes everything buffered to the file
+ */
+void yapi_capture_stop(void);
+
+bool yapi_capture_is_running(void);
+
+void yapi_capture_get_stats(yapi_capture_stats_t *stats);
+
+/**
+ * @brief Starts replaying a capture into uart_inject_rx(), driven by yapi_replay_task()
+ * @param directions YAPI_REPLAY_DIRECTION_* mask, usually RX only since TX is what we sent
+ * @return 0 on success, -1 if the file is not a capture or a replay is running
+ */
+int yapi_replay_start(const char *fileName, yapi_replay_mode_t mode, uint8_t directions);
+
+/**
+ * @brief Feeds the bytes that are due, at most YAPI_REPLAY_MAX_FEED_BYTES.
+ * Call from the YAPI parser thread before yapi_service_driver_10ms()
+ */
+void yapi_replay_task(void);
+
+void yapi_replay_stop(void);
+
+bool yapi_replay_is_running(void);
+
+/**
+ * @brief Stats of the current or last replay started with yapi_replay_start()
+ */
+void yapi_replay_get_stats(yapi_replay_stats_t *stats);
+
+/**
+ * @brief Replays a whole capture synchronously: feed() gets at most YAPI_REPLAY_MAX_FEED_BYTES at a time and
+ * pump() is called after each feed so the consumer can process them. Used by tests and benchmarks.
+ * @return 0 on success, -1 if the file is not a capture
+ */
+int yapi_replay_run(const char *fileName,
+                    yapi_replay_mode_t mode,
+                    uint8_t directions,
+                    yapi_replay_feed_cb_t feed,
+                    void (*pump)(void),
+                    yapi_replay_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YAPI_CAPTURE_H
@@ -0,0 +1,281 @@
+/**
+ * yapi_client.cpp
+ *
+ * Request/response layer on top of yapi_service, see yapi_client.h
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <string.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <chrono>
+
+#include "yapi_client.h"
+#define GZ_LOG_MODULE "yapi_client"
+#include "gz_log.h"
+
+/*****************************************************/
+/* Section: Defines & Typedefs                       */
+/*****************************************************/
+
+#define YAPI_MSG_CLASS_MASK     0x0F // GET/SET/SUB
+#define YAPI_MSG_RESP_OK_BIT    0x10
+#define YAPI_MSG_RESP_ERR_BIT   0x20
+
+typedef std::chrono::steady_clock _Clock_t;
+
+typedef struct {
+  yapi_client_request_id_t id;
+  yapi_packet_t request;
+  yapi_client_options_t options;
+  uint8_t attempts;
+  _Clock_t::time_point started;
+  _Clock_t::time_point deadline;
+  yapi_client_continuation_t then;
+} _Yapi_Client_Pending_t;
+
+typedef struct {
+  yapi_client_result_t result;
+  yapi_client_continuation_t then;
+} _Yapi_Client_Completion_t;
+
+static std::mutex _lock;
+static std::list<_Yapi_Client_Pending_t> _pending;
+static yapi_client_request_id_t _nextRequestId = YAPI_CLIENT_INVALID_REQUEST_ID + 1;
+static bool _initialized = false;
+
+/*****************************************************/
+/* Section: Private function definitions             */
+/*****************************************************/
+
+static uint32_t _elapsed_ms(const _Yapi_Client_Pending_t& pending) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(_Clock_t::now() - pending.started).count();
+}
+
+static _Yapi_Client_Completion_t _completion(const _Yapi_Client_Pending_t& pending, yapi_client_status_t status) {
+  _Yapi_Client_Completion_t completion;
+  memset(&completion.result, 0, sizeof(completion.result));
+  completion.result.status = status;
+  completion.result.attempts = pending.attempts;
+  completion.result.elapsed_ms = _elapsed_ms(pending);
+  completion.then = pending.then;
+  return completion;
+}
+
+/**
+ * @brief Runs continuations without holding the lock so they can issue or cancel requests
+ */
+static void _run_completions(std::list<_Yapi_Client_Completion_t>& completions) {
+  for (std::list<_Yapi_Client_Completion_t>::iterator it = completions.begin(); it != completions.end(); ++it) {
+    if (it->then) {
+      it->then(it->result);
+    }
+  }
+}
+
+static bool _is_response_to(const yapi_packet_t* response, const yapi_packet_t* request) {
+  uint8_t type = response->messageData.type;
+  if (!(type & (YAPI_MSG_RESP_OK_BIT | YAPI_MSG_RESP_ERR_BIT)) || type == YAPI_MSG_UNSOLICITED) {
+    return false;
+  }
+  return response->senderId == request->targetId &&
+         response->command == request->command &&
+         (type & YAPI_MSG_CLASS_MASK) == (request->messageData.type & YAPI_MSG_CLASS_MASK);
+}
+
+/**
+ * @brief yapi_service rx observer, completes the oldest request the packet answers
+ */
+static void _yapi_client_rx_observer(void* yapi_pkt) {
+  const yapi_packet_t* response = (const yapi_packet_t*)yapi_pkt;
+  std::list<_Yapi_Client_Completion_t> completions;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    for (std::list<_Yapi_Client_Pending_t>::iterator it = _pending.begin(); it != _pending.end(); ++it) {
+      if (_is_response_to(response, &it->request)) {
+        bool isError = (response->messageData.type & YAPI_MSG_RESP_ERR_BIT) != 0;
+        completions.push_back(_completion(*it, isError ? YAPI_CLIENT_STATUS_RESP_ERR : YAPI_CLIENT_STATUS_OK));
+        memcpy(&completions.back().result.packet, response, sizeof(yapi_packet_t));
+        _pending.erase(it);
+        break;
+      }
+    }
+  }
+  _run_completions(completions);
+}
+
+static std::future<yapi_client_result_t> _request_future(yapi_device_id_enum_t targetId,
+                                                         yapi_command_enum_t command,
+                                                         yapi_message_type_enum_t messageType,
+                                                         const uint8_t* data,
+                                                         uint8_t length,
+                                                         const yapi_client_options_t* options,
+                                                         yapi_client_request_id_t* requestId) {
+  // std::function needs a copyable callable, hence the shared promise
+  std::shared_ptr<std::promise<yapi_client_result_t> > promise = std::make_shared<std::promise<yapi_client_result_t> >();
+  std::future<yapi_client_result_t> future = promise->get_future();
+  yapi_client_request_id_t id = yapi_client_request_async(targetId, command, messageType, data, length, options,
+    [promise](const yapi_client_result_t& result) {
+      promise->set_value(result);
+    });
+  if (requestId) {
+    *requestId = id;
+  }
+  return future;
+}
+
+/*****************************************************/
+/* Section: Public function definitions              */
+/*****************************************************/
+
+yapi_client_options_t yapi_client_default_options(void) {
+  yapi_client_options_t options;
+  options.timeout_ms = YAPI_CLIENT_DEFAULT_TIMEOUT_MS;
+  options.retries = YAPI_CLIENT_DEFAULT_RETRIES;
+  options.priority = YAPI_PRIORITY_LOW;
+  return options;
+}
+
+void yapi_client_init(void) {
+  if (!_initialized) {
+    _initialized = yapi_service_add_rx_observer(_yapi_client_rx_observer) > 0;
+  }
+}
+
+void yapi_client_task(void) {
+  std::list<_Yapi_Client_Completion_t> completions;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _Clock_t::time_point now = _Clock_t::now();
+    std::list<_Yapi_Client_Pending_t>::iterator it = _pending.begin();
+    while (it != _pending.end()) {
+      if (now < it->deadline) {
+        ++it;
+        continue;
+      }
+      if (it->attempts <= it->options.retries) {
+        it->attempts++;
+        it->deadline = now + std::chrono::milliseconds(it->options.timeout_ms);
+        GZ_LOG_DEBUG("yapi_client: retry command[%d] attempt[%d]\n", it->request.command, it->attempts);
+        // A failed resend is left to the next deadline, the queue may just be full
+        yapi_service_send(&it->request);
+        ++it;
+      } else {
+        completions.push_back(_completion(*it, YAPI_CLIENT_STATUS_TIMEOUT));
+        it = _pending.erase(it);
+      }
+    }
+  }
+  _run_completions(completions);
+}
+
+yapi_client_request_id_t yapi_client_request_async(yapi_device_id_enum_t targetId,
+                                                   yapi_command_enum_t command,
+                                                   yapi_message_type_enum_t messageType,
+                                                   const uint8_t* data,
+                                                   uint8_t length,
+                                                   const yapi_client_options_t* options,
+                                                   yapi_client_continuation_t then) {
+  _Yapi_Client_Pending_t pending;
+  pending.options = options ? *options : yapi_client_default_options();
+  pending.attempts = 1;
+  pending.started = _Clock_t::now();
+  pending.deadline = pending.started + std::chrono::milliseconds(pending.options.timeout_ms);
+  pending.then = then;
+
+  yapi_ops_status_t status = yapi_service_build_pkt(&pending.request,
+                                                    yapi_service_get_self_device_id(),
+                                                    targetId,
+                                                    command,
+                                                    messageType,
+                                                    pending.options.priority,
+                                                    NULL,
+                                                    (uint8_t*)data,
+                                                    length);
+  if (status == YAPI_OPS_SUCCESS) {
+    std::lock_guard<std::mutex> guard(_lock);
+    pending.id = _nextRequestId++;
+    if (_nextRequestId == YAPI_CLIENT_INVALID_REQUEST_ID) {
+      _nextRequestId++;
+    }
+    // Registered before sending so a fast response can not overtake the bookkeeping
+    _pending.push_back(pending);
+    status = yapi_service_send(&pending.request);
+    if (status != YAPI_OPS_SUCCESS) {
+      _pending.pop_back();
+    }
+  }
+  if (status != YAPI_OPS_SUCCESS) {
+    GZ_LOG_ERROR("yapi_client: failed sending command[%d] to device[%d]\n", command, targetId);
+    if (then) {
+      then(_completion(pending, YAPI_CLIENT_STATUS_SEND_FAIL).result);
+    }
+    return YAPI_CLIENT_INVALID_REQUEST_ID;
+  }
+  return pending.id;
+}
+
+std::future<yapi_client_result_t> yapi_client_get(yapi_device_id_enum_t targetId,
+                                                  yapi_command_enum_t command,
+                                                  const uint8_t* data,
+                                                  uint8_t length,
+                                                  const yapi_client_options_t* options,
+                                                  yapi_client_request_id_t* requestId) {
+  return _request_future(targetId, command, YAPI_MSG_GET_RQST, data, length, options, requestId);
+}
+
+std::future<yapi_client_result_t> yapi_client_set(yapi_device_id_enum_t targetId,
+                                                  yapi_command_enum_t command,
+                                                  const uint8_t* data,
+                                                  uint8_t length,
+                                                  const yapi_client_options_t* options,
+                                                  yapi_client_request_id_t* requestId) {
+  return _request_future(targetId, command, YAPI_MSG_SET_RQST, data, length, options, requestId);
+}
+
+std::future<yapi_client_result_t> yapi_client_sub(yapi_device_id_enum_t targetId,
+                                                  yapi_command_enum_t command,
+                                                  const uint8_t* data,
+                                                  uint8_t length,
+                                                  const yapi_client_options_t* options,
+                                                  yapi_client_request_id_t* requestId) {
+  return _request_future(targetId, command, YAPI_MSG_SUB_RQST, data, length, options, requestId);
+}
+
+bool yapi_client_cancel(yapi_client_request_id_t requestId) {
+  std::list<_Yapi_Client_Completion_t> completions;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    for (std::list<_Yapi_Client_Pending_t>::iterator it = _pending.begin(); it != _pending.end(); ++it) {
+      if (it->id == requestId) {
+        completions.push_back(_completion(*it, YAPI_CLIENT_STATUS_CANCELLED));
+        _pending.erase(it);
+        break;
+      }
+    }
+  }
+  _run_completions(completions);
+  return !completions.empty();
+}
+
+uint32_t yapi_client_pending_count(void) {
+  std::lock_guard<std::mutex> guard(_lock);
+  return (uint32_t)_pending.size();
+}
+
+const char* yapi_client_status_string(yapi_client_status_t status) {
+  switch (status) {
+  case YAPI_CLIENT_STATUS_OK:
+    return "YAPI_CLIENT_STATUS_OK";
+  case YAPI_CLIENT_STATUS_RESP_ERR:
+    return "YAPI_CLIENT_STATUS_RESP_ERR";
+  case YAPI_CLIENT_STATUS_TIMEOUT:
+    return "YAPI_CLIENT_STATUS_TIMEOUT";
+  case YAPI_CLIENT_STATUS_CANCELLED:
+    return "YAPI_CLIENT_STATUS_CANCELLED";
+  default:
+    return "YAPI_CLIENT_STATUS_SEND_FAIL";
+  }
+}
@@ -0,0 +1,127 @@
+/**
+ * yapi_client.h
+ *
+ * Request/response layer on top of yapi_service for host applications.
+ * Every GET/SET/SUB request returns a std::future (or invokes a continuation) that completes when the
+ * matching response arrives, when its deadline expires after all retries, or when it is cancelled.
+ * No caller has to poll a static status or sleep anymore.
+ *
+ * Responses are matched by (senderId == request targetId, command, GET/SET/SUB class), oldest request first.
+ * yapi_client_task() must be called periodically from the thread running the YAPI parser (yapi_task_10ms)
+ * to expire deadlines and schedule retries.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_CLIENT_H
+#define YAPI_CLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <future>
+#include <functional>
+#include "yapi_service.h"
+
+#define YAPI_CLIENT_DEFAULT_TIMEOUT_MS    1000
+#define YAPI_CLIENT_DEFAULT_RETRIES       2
+#define YAPI_CLIENT_INVALID_REQUEST_ID    0
+
+typedef enum {
+  YAPI_CLIENT_STATUS_OK,            // device answered with *_RESP_OK
+  YAPI_CLIENT_STATUS_RESP_ERR,      // device answered with *_RESP_ERR, see packet.options/data for the error code
+  YAPI_CLIENT_STATUS_TIMEOUT,       // no response after all attempts
+  YAPI_CLIENT_STATUS_CANCELLED,
+  YAPI_CLIENT_STATUS_SEND_FAIL,     // the request could not be built or queued
+} yapi_client_status_t;
+
+typedef uint32_t yapi_client_request_id_t;
+
+typedef struct {
+  uint32_t timeout_ms;              // deadline of each attempt
+  uint8_t retries;                  // extra attempts after the first one timed out, 0 for non idempotent requests
+  yapi_message_priority_enum_t priority;
+} yapi_client_options_t;
+
+typedef struct {
+  yapi_client_status_t status;
+  uint8_t attempts;
+  uint32_t elapsed_ms;              // from the first send to completion
+  yapi_packet_t packet;             // the response, valid for YAPI_CLIENT_STATUS_OK and YAPI_CLIENT_STATUS_RESP_ERR
+} yapi_client_result_t;
+
+/**
+ * @brief Continuation invoked once with the result, from the thread that completed the request
+ * (the YAPI parser thread for responses and timeouts, the caller of yapi_client_cancel otherwise).
+ * It may issue further requests, which is how calls are chained without blocking the parser.
+ */
+typedef std::function<void(const yapi_client_result_t&)> yapi_client_continuation_t;
+
+/**
+ * @brief Returns the options used when NULL is passed to a request
+ */
+yapi_client_options_t yapi_client_default_options(void);
+
+/**
+ * @brief Hooks the client to the YAPI receive path, call once after yapi_service_driver_init()
+ */
+void yapi_client_init(void);
+
+/**
+ * @brief Expires deadlines and resends timed out requests, call from yapi_task_10ms
+ */
+void yapi_client_task(void);
+
+/**
+ * @brief Sends a request and calls `then` on completion
+ * @param messageType one of YAPI_MSG_GET_RQST, YAPI_MSG_SET_RQST, YAPI_MSG_SUB_RQST
+ * @return the id to use with yapi_client_cancel(), YAPI_CLIENT_INVALID_REQUEST_ID if `then` was already
+ * called with YAPI_CLIENT_STATUS_SEND_FAIL
+ */
+yapi_client_request_id_t yapi_client_request_async(yapi_device_id_enum_t targetId,
+                                                   yapi_command_enum_t command,
+                                                   yapi_message_type_enum_t messageType,
+                                                   const uint8_t* data,
+                                                   uint8_t length,
+                                                   const yapi_client_options_t* options,
+                                                   yapi_client_continuation_t then);
+
+/**
+ * @brief Future flavors of yapi_client_request_async(). Never wait on the returned future from the
+ * YAPI parser thread (callbacks, continuations), it would dead lock; use a continuation there.
+ * @param requestId optional, receives the id to use with yapi_client_cancel()
+ */
+std::future<yapi_client_result_t> yapi_client_get(yapi_device_id_enum_t targetId,
+                                                  yapi_command_enum_t command,
+                                                  const uint8_t* data = NULL,
+                                                  uint8_t length = 0,
+                                                  const yapi_client_options_t* options = NULL,
+                                                  yapi_client_request_id_t* requestId = NULL);
+
+std::future<yapi_client_result_t> yapi_client_set(yapi_device_id_enum_t targetId,
+                                                  yapi_command_enum_t command,
+                                                  const uint8_t* data,
+                                                  uint8_t length,
+                                                  const yapi_client_options_t* options = NULL,
+                                                  yapi_client_request_id_t* requestId = NULL);
+
+std::future<yapi_client_result_t> yapi_client_sub(yapi_device_id_enum_t targetId,
+                                                  yapi_command_enum_t command,
+                                                  const uint8_t* data,
+                                                  uint8_t length,
+                                                  const yapi_client_options_t* options = NULL,
+                                                  yapi_client_request_id_t* requestId = NULL);
+
+/**
+ * @brief Completes a pending request with YAPI_CLIENT_STATUS_CANCELLED, a late response is then ignored
+ * @return false if the request already completed
+ */
+bool yapi_client_cancel(yapi_client_request_id_t requestId);
+
+/**
+ * @brief Number of requests waiting for a response
+ */
+uint32_t yapi_client_pending_count(void);
+
+const char* yapi_client_status_string(yapi_client_status_t status);
+
+#endif // YAPI_CLIENT_H
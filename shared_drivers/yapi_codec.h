@@ -0,0 +1,265 @@
+/**
+ * yapi_codec.h
+ *
+ * Header-only, compile-time mapping of each yapi_command_enum_t to its request and response payload types,
+ * with bounds-checked encode/decode. A command without a mapping does not compile.
+ *
+ *   yapi_serial_number_read_response_t readId;
+ *   yapi_codec_decode_response<YAPI_CMD_SERIAL_READ>(yapiPkt, &readId);
+ *
+ *   yapi_flash_read_request_t request = { addressOffset, readSize };
+ *   yapi_codec_send_request<YAPI_CMD_FLASH_READ>(YAPI_DEVICE_MPPT, YAPI_MSG_GET_RQST, YAPI_PRIORITY_LOW, request);
+ *
+ * Everything is inlined down to a memcpy of sizeof(T) (see benchmarks/), payloads being packed little endian
+ * structs that match the host layout.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_CODEC_H
+#define YAPI_CODEC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include "yapi_service.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "YAPI payloads are little endian packed structs");
+
+/*****************************************************/
+/* Section: Payloads without a struct in yapi_service */
+/*****************************************************/
+
+/**
+ * @brief No payload, encodes to 0 bytes
+ */
+typedef struct {} yapi_codec_empty_t;
+
+/**
+ * @brief Payload without a fixed layout, decoded as-is
+ */
+typedef struct __attribute__ ((packed)) {
+  uint8_t bytes[YAPI_DATA_SIZE];
+} yapi_codec_raw_t;
+
+/**
+ * @brief Bootloader flash payloads, layouts mirror the MPPT bootloader parser
+ */
+typedef struct __attribute__ ((packed)) {
+  uint32_t addressOffset;
+  uint8_t readSize;
+} yapi_flash_read_request_t;
+
+/**
+ * @brief Followed by the words to program, passed as the tail of the request
+ */
+typedef struct __attribute__ ((packed)) {
+  uint32_t addressOffset;
+} yapi_flash_write_request_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint16_t writtenWords;
+} yapi_flash_write_response_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint32_t addressOffset;
+  uint8_t numberOfPages;
+} yapi_flash_erase_request_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint32_t startAddressOffset;
+  uint32_t endAddressOffset;
+  uint16_t crc16;
+} yapi_flash_verify_request_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint16_t crc16; // computed by the bootloader
+} yapi_flash_verify_response_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint8_t isSilenced;
+} yapi_modbus_silence_request_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint8_t appUpdateState;
+} yapi_modbus_boot_info_response_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint8_t code; // YAPI_SERIAL_RESPONSE_CODE_t
+} yapi_serial_number_write_response_t;
+
+/*****************************************************/
+/* Section: Command to payload mapping               */
+/*****************************************************/
+
+template <typename T>
+struct yapi_codec_payload_size {
+  static const uint8_t value = sizeof(T);
+};
+
+template <>
+struct yapi_codec_payload_size<yapi_codec_empty_t> {
+  static const uint8_t value = 0;
+};
+
+/**
+ * @brief Specialized for every supported command by YAPI_CODEC_MAP, left undefined otherwise
+ */
+template <yapi_command_enum_t Command>
+struct yapi_codec_traits;
+
+#define YAPI_CODEC_MAP(command, requestType, responseType) \
+template <> \
+struct yapi_codec_traits<command> { \
+  typedef requestType request_t; \
+  typedef responseType response_t; \
+  static_assert(sizeof(requestType) <= YAPI_DATA_SIZE, #requestType " does not fit in a YAPI packet"); \
+  static_assert(sizeof(responseType) <= YAPI_DATA_SIZE, #responseType " does not fit in a YAPI packet"); \
+  static_assert(std::is_trivially_copyable<requestType>::value, #requestType " must be trivially copyable"); \
+  static_assert(std::is_trivially_copyable<responseType>::value, #responseType " must be trivially copyable"); \
+};
+
+YAPI_CODEC_MAP(YAPI_CMD_HELLO, yapi_codec_empty_t, yapi_codec_empty_t)
+YAPI_CODEC_MAP(YAPI_CMD_PCU_OUTPUTS_STATUS, yapi_codec_empty_t, yapi_y6g_pcu_outputs_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_PCU_INPUTS_STATUS, yapi_codec_empty_t, yapi_y6g_pcu_inputs_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_PCU_SUMMARY_STATUS_FLAGS, yapi_codec_empty_t, yapi_y6g_pcu_summary_status_flags_t)
+YAPI_CODEC_MAP(YAPI_CMD_PCU_SUMMARY_STATUS, yapi_codec_empty_t, yapi_y6g_pcu_summary_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_PCU_CONFIGS, yapi_y6g_pcu_config_t, yapi_y6g_pcu_config_t)
+YAPI_CODEC_MAP(YAPI_CMD_PCU_PMICS_STATUS, yapi_codec_empty_t, yapi_y6g_pcu_pmics_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_PCU_DEVICE, yapi_codec_empty_t, yapi_y6g_pcu_device_t)
+YAPI_CODEC_MAP(YAPI_CMD_PCU_PMICS_ACCUMULATED_ENERGY, yapi_codec_empty_t, yapi_y6g_pcu_pmics_accumulated_energy_t)
+YAPI_CODEC_MAP(YAPI_CMD_WMU_SUMMARY_STATUS, yapi_codec_empty_t, yapi_y6g_wmu_summary_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_WMU_CONFIGS, yapi_y6g_wmu_config_t, yapi_y6g_wmu_config_t)
+YAPI_CODEC_MAP(YAPI_CMD_WMU_POWER, yapi_y6g_wmu_power_t, yapi_y6g_wmu_power_t)
+YAPI_CODEC_MAP(YAP_CMD_INVERTER_SUMMARY_STATUS, yapi_codec_empty_t, yapi_y6g_inverter_summary_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_BMS_SUMMARY_STATUS, yapi_codec_empty_t, yapi_y6g_bms_summary_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_TANK_SUMMARY_STATUS, yapi_codec_empty_t, yapi_y6g_tank_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_RVES_SUMMARY_STATUS, yapi_codec_empty_t, yapi_y6g_rves_summary_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_FLASH_READ, yapi_flash_read_request_t, yapi_codec_raw_t)
+YAPI_CODEC_MAP(YAPI_CMD_FLASH_WRITE, yapi_flash_write_request_t, yapi_flash_write_response_t)
+YAPI_CODEC_MAP(YAPI_CMD_FLASH_ERASE, yapi_flash_erase_request_t, yapi_codec_raw_t)
+YAPI_CODEC_MAP(YAPI_CMD_FLASH_VERIFY, yapi_flash_verify_request_t, yapi_flash_verify_response_t)
+YAPI_CODEC_MAP(YAPI_CMD_MODBUS_ENTER_BOOTLOADER, yapi_codec_empty_t, yapi_codec_empty_t)
+YAPI_CODEC_MAP(YAPI_CMD_MODBUS_SILENCE, yapi_modbus_silence_request_t, yapi_codec_empty_t)
+YAPI_CODEC_MAP(YAPI_CMD_MOBUS_GET_BOOTINFO, yapi_codec_empty_t, yapi_modbus_boot_info_response_t)
+YAPI_CODEC_MAP(YAPI_CMD_COMBINER_SUMMARY_STATUS, yapi_codec_empty_t, yapi_y6g_combiner_summary_status_t)
+YAPI_CODEC_MAP(YAPI_CMD_SERIAL_WRITE, yapi_serial_number_write_request_t, yapi_serial_number_write_response_t)
+YAPI_CODEC_MAP(YAPI_CMD_SERIAL_READ, yapi_codec_empty_t, yapi_serial_number_read_response_t)
+YAPI_CODEC_MAP(YAPI_CMD_WMU_SYSTEM_ID, yapi_system_id_t, yapi_system_id_t)
+
+#undef YAPI_CODEC_MAP
+
+/*****************************************************/
+/* Section: Encode / decode                          */
+/*****************************************************/
+
+/**
+ * @brief Copies at most sizeof(T) bytes of the payload into `payload`, zero filling what the sender did not send
+ * (older firmware) and ignoring what it sent beyond sizeof(T) (newer firmware)
+ * @return number of bytes taken from `data`
+ */
+template <typename T>
+inline uint8_t yapi_codec_decode_as(const uint8_t* data, uint8_t length, T* payload) {
+  static_assert(sizeof(T) <= YAPI_DATA_SIZE, "payload does not fit in a YAPI packet");
+  uint8_t copied = length < sizeof(T) ? length : sizeof(T);
+  memcpy(payload, data, copied);
+  if (copied < sizeof(T)) {
+    memset((uint8_t*)payload + copied, 0, sizeof(T) - copied);
+  }
+  return copied;
+}
+
+/**
+ * @brief Serializes `payload` followed by `tailLength` bytes of `tail` into `data` (YAPI_DATA_SIZE bytes)
+ * @return the payload length, 0 with nothing written when the tail does not fit
+ */
+template <typename T>
+inline uint8_t yapi_codec_encode_as(const T& payload, uint8_t* data, const void* tail = NULL, uint8_t tailLength = 0) {
+  const uint8_t size = yapi_codec_payload_size<T>::value;
+  static_assert(sizeof(T) <= YAPI_DATA_SIZE, "payload does not fit in a YAPI packet");
+  if (tailLength > YAPI_DATA_SIZE - size) {
+    return 0;
+  }
+  memcpy(data, &payload, size);
+  if (tailLength) {
+    memcpy(data + size, tail, tailLength);
+  }
+  return size + tailLength;
+}
+
+/**
+ * @brief Decodes the response payload of `Command`
+ * @return false if the packet is not a `Command` packet
+ */
+template <yapi_command_enum_t Command>
+inline bool yapi_codec_decode_response(const yapi_packet_t* packet, typename yapi_codec_traits<Command>::response_t* payload) {
+  if (packet->command != Command) {
+    return false;
+  }
+  yapi_codec_decode_as(packet->data, packet->length, payload);
+  return true;
+}
+
+/**
+ * @brief Decodes the request payload of `Command`, for the device side
+ * @return false if the packet is not a `Command` packet
+ */
+template <yapi_command_enum_t Command>
+inline bool yapi_codec_decode_request(const yapi_packet_t* packet, typename yapi_codec_traits<Command>::request_t* payload) {
+  if (packet->command != Command) {
+    return false;
+  }
+  yapi_codec_decode_as(packet->data, packet->length, payload);
+  return true;
+}
+
+template <yapi_command_enum_t Command>
+inline yapi_ops_status_t yapi_codec_send_request(yapi_device_id_enum_t targetId,
+                                                 yapi_message_type_enum_t messageType,
+                                                 yapi_message_priority_enum_t priority,
+                                                 const typename yapi_codec_traits<Command>::request_t& payload,
+                                                 const void* tail = NULL,
+                                                 uint8_t tailLength = 0) {
+  uint8_t data[YAPI_DATA_SIZE];
+  uint8_t length = yapi_codec_encode_as(payload, data, tail, tailLength);
+  if (!length && (yapi_codec_payload_size<typename yapi_codec_traits<Command>::request_t>::value || tailLength)) {
+    return YAPI_OPS_FAIL;
+  }
+  return yapi_service_build_send(targetId, Command, messageType, priority, NULL, data, length);
+}
+
+template <yapi_command_enum_t Command>
+inline yapi_ops_status_t yapi_codec_send_response(yapi_device_id_enum_t targetId,
+                                                  yapi_message_type_enum_t messageType,
+                                                  yapi_message_priority_enum_t priority,
+                                                  const typename yapi_codec_traits<Command>::response_t& payload,
+                                                  const void* tail = NULL,
+                                                  uint8_t tailLength = 0) {
+  uint8_t data[YAPI_DATA_SIZE];
+  uint8_t length = yapi_codec_encode_as(payload, data, tail, tailLength);
+  if (!length && (yapi_codec_payload_size<typename yapi_codec_traits<Command>::response_t>::value || tailLength)) {
+    return YAPI_OPS_FAIL;
+  }
+  return yapi_service_build_send(targetId, Command, messageType, priority, NULL, data, length);
+}
+
+/**
+ * @brief Same as yapi_codec_send_response() on behalf of `senderId`, for simulators answering as several devices
+ */
+template <yapi_command_enum_t Command>
+inline yapi_ops_status_t yapi_codec_send_response_from(yapi_device_id_enum_t senderId,
+                                                       yapi_device_id_enum_t targetId,
+                                                       yapi_message_type_enum_t messageType,
+                                                       yapi_message_priority_enum_t priority,
+                                                       const typename yapi_codec_traits<Command>::response_t& payload,
+                                                       const void* tail = NULL,
+                                                       uint8_t tailLength = 0) {
+  uint8_t data[YAPI_DATA_SIZE];
+  uint8_t length = yapi_codec_encode_as(payload, data, tail, tailLength);
+  if (!length && (yapi_codec_payload_size<typename yapi_codec_traits<Command>::response_t>::value || tailLength)) {
+    return YAPI_OPS_FAIL;
+  }
+  return yapi_service_build_send_ID(senderId, targetId, Command, messageType, priority, NULL, data, length);
+}
+
+#endif // YAPI_CODEC_H
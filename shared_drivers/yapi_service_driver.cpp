@@ -16,18 +16,150 @@ extern "C" {
  * We will need to use macros in here specific to each platform to avoid platform specific
  * function calls from being used in the wrong platform.
  */
+#include <stddef.h>
+#include <stdio.h>
 #include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/uio.h>
 
 #include "yapi_service_driver.h"
 #include "yapi_service.h"
 #include "uart.h"
+#include "gz_trace.h"
+#include "gz_metrics.h"
 
 #ifndef UNUSED
 #define UNUSED(x) (void)(x)
 #endif
 
+/**
+ * @brief A frame waiting in the TX queue. offset tracks how much of it already reached the kernel
+ * so a partial writev() resumes where it stopped.
+ */
+typedef struct {
+  uint8_t data[sizeof(yapi_packet_t)];
+  uint16_t length;
+  uint16_t offset;
+  uint64_t enqueued_us;
+} _Yapi_Tx_Frame_t;
+
+static _Yapi_Tx_Frame_t _txQueue[YAPI_TX_QUEUE_DEPTH];
+static uint8_t _txHead = 0;
+static uint8_t _txCount = 0;
+static pthread_mutex_t _txLock = PTHREAD_MUTEX_INITIALIZER;
+static yapi_service_driver_tx_stats_t _txStats;
+static yapi_tx_latency_cb_t _txLatencyCb = NULL;
+
+/**
+ * @brief gz_metrics ids, registered by yapi_service_driver_init. The per-command families keep a call count
+ * and a time total, the dispatch time distribution is over every command
+ */
+typedef struct {
+  int txQueueDepth;               // frames already queued at each enqueue
+  int txLatency;                  // enqueue-to-wire
+  int dispatchCalls;
+  int dispatchTime;
+  int dispatch;
+} _Yapi_Driver_Metrics_t;
+
+static _Yapi_Driver_Metrics_t _metrics = { -1, -1, -1, -1, -1 };
+
+/**
+ * @brief A uint32_t counter of the yapi_service rx stats or of _txStats, exported as is
+ */
+typedef struct {
+  const char* name;
+  const char* help;
+  size_t offset;
+} _Yapi_Stat_Metric_t;
+
+static const _Yapi_Stat_Metric_t _rxStatMetrics[] = {
+  { "yapi_rx_frames_total", "Frames received with a valid CRC", offsetof(yapi_service_rx_stats_t, frames) },
+  { "yapi_rx_crc_errors_total", "Frames received with a CRC mismatch", offsetof(yapi_service_rx_stats_t, crcErrors) },
+  { "yapi_rx_resyncs_total", "Start signals that were no frame", offsetof(yapi_service_rx_stats_t, resyncs) },
+  { "yapi_rx_bytes_skipped_total", "Bytes received outside of frames",
+    offsetof(yapi_service_rx_stats_t, bytesSkipped) },
+  { "yapi_rx_overruns_total", "Bytes lost to a full receive buffer", offsetof(yapi_service_rx_stats_t, overruns) },
+};
+
+static const _Yapi_Stat_Metric_t _txStatMetrics[] = {
+  { "yapi_tx_frames_queued_total", "Frames accepted by the TX queue",
+    offsetof(yapi_service_driver_tx_stats_t, framesQueued) },
+  { "yapi_tx_frames_sent_total", "Frames written to the port", offsetof(yapi_service_driver_tx_stats_t, framesSent) },
+  { "yapi_tx_frames_dropped_total", "Frames refused by a full TX queue or lost with the port",
+    offsetof(yapi_service_driver_tx_stats_t, framesDropped) },
+  { "yapi_tx_bytes_total", "Bytes written to the port", offsetof(yapi_service_driver_tx_stats_t, bytesSent) },
+  { "yapi_tx_writev_total", "writev calls of the TX queue", offsetof(yapi_service_driver_tx_stats_t, writevCalls) },
+  { "yapi_tx_eagain_total", "writev calls that found the port full",
+    offsetof(yapi_service_driver_tx_stats_t, eagainCount) },
+};
+
+static uint64_t _yapi_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t _yapi_rx_stat(void* offset) {
+  yapi_service_rx_stats_t stats;
+  yapi_service_get_rx_stats(&stats);
+  uint32_t value;
+  memcpy(&value, (const uint8_t*)&stats + (uintptr_t)offset, sizeof(value));
+  return value;
+}
+
+static int64_t _yapi_tx_stat(void* offset) {
+  yapi_service_driver_tx_stats_t stats;
+  yapi_service_driver_get_tx_stats(&stats);
+  uint32_t value;
+  memcpy(&value, (const uint8_t*)&stats + (uintptr_t)offset, sizeof(value));
+  return value;
+}
+
+static int64_t _yapi_tx_queued(void* context) {
+  pthread_mutex_lock(&_txLock);
+  int64_t count = _txCount;
+  pthread_mutex_unlock(&_txLock);
+  return count;
+}
+
+static void _yapi_command_label(uint16_t index, char* label, size_t size) {
+  snprintf(label, size, "0x%02x", index);
+}
+
+static void _yapi_dispatch_timing(const yapi_packet_t* pkt, uint64_t elapsed_ns) {
+  gz_metrics_add_at(_metrics.dispatchCalls, pkt->command, 1);
+  gz_metrics_add_at(_metrics.dispatchTime, pkt->command, elapsed_ns);
+  gz_metrics_record(_metrics.dispatch, elapsed_ns);
+}
+
+static void _yapi_service_driver_metrics_init(void) {
+  for (size_t i = 0; i < sizeof(_rxStatMetrics) / sizeof(_rxStatMetrics[0]); i++) {
+    gz_metrics_collector(_rxStatMetrics[i].name, _rxStatMetrics[i].help, GZ_METRIC_COUNTER, _yapi_rx_stat,
+                         (void*)(uintptr_t)_rxStatMetrics[i].offset);
+  }
+  for (size_t i = 0; i < sizeof(_txStatMetrics) / sizeof(_txStatMetrics[0]); i++) {
+    gz_metrics_collector(_txStatMetrics[i].name, _txStatMetrics[i].help, GZ_METRIC_COUNTER, _yapi_tx_stat,
+                         (void*)(uintptr_t)_txStatMetrics[i].offset);
+  }
+  gz_metrics_collector("yapi_tx_queued", "Frames waiting in the TX queue", GZ_METRIC_GAUGE, _yapi_tx_queued, NULL);
+  _metrics.txQueueDepth = gz_metrics_histogram("yapi_tx_queue_depth", "Frames already queued at each enqueue");
+  _metrics.txLatency = gz_metrics_histogram("yapi_tx_latency_us", "Enqueue-to-wire time of the frames sent");
+  _metrics.dispatchCalls = gz_metrics_counter_family("yapi_dispatch_calls_total", "Frames dispatched by command",
+                                                     "command", 256, _yapi_command_label);
+  _metrics.dispatchTime = gz_metrics_counter_family("yapi_dispatch_ns_total", "Time dispatching frames by command",
+                                                    "command", 256, _yapi_command_label);
+  _metrics.dispatch = gz_metrics_histogram("yapi_dispatch_ns", "Time in the command callback and rx observers");
+  yapi_service_set_dispatch_timing_cb(gz_metrics_now_ns, _yapi_dispatch_timing);
+}
+
 void yapi_service_driver_init() {
   yapi_service_init(YAPI_DEVICE_EXTERNAL_PC, &uart_register_read_one_byte_callback);
+  _yapi_service_driver_metrics_init();
 }
 
 void yapi_service_driver_10ms(void* params) {
@@ -51,36 +183,197 @@ void yapi_platform_log_error(const char *fmt, ...) {
 }
 
 uint16_t yapi_platform_transmit(uint8_t* data, uint16_t len) {
-  uint8_t* transmitIdx = data;
-  uint16_t bytesSent = 0;
-  uint16_t bytesAddedToBuff = 0;
-  uint8_t timeout_ms = 0;
+  int fd = uart_get_connected_device();
+  if (fd == UART_UNCONNECTED || len > sizeof(_txQueue[0].data)) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&_txLock);
+  if (_txCount == YAPI_TX_QUEUE_DEPTH) {
+    _txStats.framesDropped++;
+    pthread_mutex_unlock(&_txLock);
+    return 0;
+  }
+  _Yapi_Tx_Frame_t* frame = &_txQueue[(_txHead + _txCount) % YAPI_TX_QUEUE_DEPTH];
+  memcpy(frame->data, data, len);
+  frame->length = len;
+  frame->offset = 0;
+  frame->enqueued_us = _yapi_now_us();
+  uint8_t depth = _txCount++;
+  _txStats.framesQueued++;
+  pthread_mutex_unlock(&_txLock);
+  gz_metrics_record(_metrics.txQueueDepth, depth);
+
+  // Opportunistic write: the common case is an idle port, the frame leaves right away.
+  // Whatever the kernel does not take now is drained by the event loop on POLLOUT.
+  yapi_service_driver_tx_drain();
+  return len;
+}
+
+uint16_t yapi_platform_transmit_blocking(uint8_t* data, uint16_t len) {
   int fd = uart_get_connected_device();
   if (fd == UART_UNCONNECTED) {
     return 0;
   }
+  if (yapi_platform_transmit(data, len) != len) {
+    return 0;
+  }
+  // Frames leave in order, so this one is on the wire once the queue is empty
+  uint64_t deadline_us = _yapi_now_us() + YAPI_RECOMMENDED_SEND_TIMEOUT_MS * 1000;
+  while (yapi_service_driver_tx_pending() && _yapi_now_us() < deadline_us) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+    poll(&pfd, 1, 1);
+    yapi_service_driver_tx_drain();
+  }
+  return yapi_service_driver_tx_pending() ? 0 : len;
+}
+
+bool yapi_service_driver_tx_pending(void) {
+  pthread_mutex_lock(&_txLock);
+  bool pending = _txCount > 0;
+  pthread_mutex_unlock(&_txLock);
+  return pending;
+}
+
+int yapi_service_driver_tx_drain(void) {
+  int fd = uart_get_connected_device();
+  if (fd == UART_UNCONNECTED) {
+    // Port went away, frames queued for it are stale
+    pthread_mutex_lock(&_txLock);
+    _txStats.framesDropped += _txCount;
+    _txHead = 0;
+    _txCount = 0;
+    pthread_mutex_unlock(&_txLock);
+    return -1;
+  }
+  uint32_t latencies_us[YAPI_TX_QUEUE_DEPTH];
+  uint16_t lengths[YAPI_TX_QUEUE_DEPTH];
+  uint8_t completed = 0;
+  int rv = 0;
 
-  // TODO: Make sure this isn't too aggressive trying to add bytes to the buffer.
-  while (bytesSent < len && timeout_ms < YAPI_RECOMMENDED_SEND_TIMEOUT_MS) {
-    bytesAddedToBuff = uart_write(fd, transmitIdx, len - bytesSent);
-    transmitIdx += bytesAddedToBuff; // advance the data pointer by the number of bytes sent.
-    bytesSent += bytesAddedToBuff;
-    if (bytesSent < len) {
-      usleep(1000);
-      timeout_ms++;
+  pthread_mutex_lock(&_txLock);
+  while (_txCount) {
+    struct iovec iov[YAPI_TX_MAX_BATCH_FRAMES];
+    uint8_t batch = _txCount < YAPI_TX_MAX_BATCH_FRAMES ? _txCount : YAPI_TX_MAX_BATCH_FRAMES;
+    int requested = 0;
+    for (uint8_t i = 0; i < batch; i++) {
+      _Yapi_Tx_Frame_t* frame = &_txQueue[(_txHead + i) % YAPI_TX_QUEUE_DEPTH];
+      iov[i].iov_base = frame->data + frame->offset;
+      iov[i].iov_len = frame->length - frame->offset;
+      requested += iov[i].iov_len;
+    }
+    int written = uart_writev(fd, iov, batch);
+    _txStats.writevCalls++;
+    if (written < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        _txStats.eagainCount++; // kernel buffer full, wait for POLLOUT
+      } else {
+        rv = -1;
+      }
+      break;
+    }
+    _txStats.bytesSent += written;
+    bool shortWrite = written < requested;
+    uint64_t now_us = _yapi_now_us();
+    while (_txCount && written > 0) {
+      _Yapi_Tx_Frame_t* frame = &_txQueue[_txHead];
+      uint16_t remaining = frame->length - frame->offset;
+      if (written < remaining) {
+        frame->offset += written; // partial frame, resumes at offset on the next drain
+        written = 0;
+        break;
+      }
+      written -= remaining;
+      uint32_t latency_us = (uint32_t)(now_us - frame->enqueued_us);
+      _txStats.framesSent++;
+      _txStats.lastLatency_us = latency_us;
+      _txStats.totalLatency_us += latency_us;
+      if (latency_us > _txStats.maxLatency_us) {
+        _txStats.maxLatency_us = latency_us;
+      }
+      latencies_us[completed] = latency_us;
+      lengths[completed++] = frame->length;
+      _txHead = (_txHead + 1) % YAPI_TX_QUEUE_DEPTH;
+      _txCount--;
+    }
+    if (shortWrite) {
+      break; // the kernel buffer is full
+    }
+    if (completed >= YAPI_TX_QUEUE_DEPTH - YAPI_TX_MAX_BATCH_FRAMES) {
+      break; // report what we have, the rest goes on the next drain
     }
   }
+  if (rv == 0) {
+    rv = _txCount;
+  }
+  yapi_tx_latency_cb_t latencyCb = _txLatencyCb;
+  pthread_mutex_unlock(&_txLock);
 
-  return bytesSent;
+  // Reported outside the lock so the callback may queue new frames
+  for (uint8_t i = 0; i < completed; i++) {
+    gz_metrics_record(_metrics.txLatency, latencies_us[i]);
+    if (latencyCb) {
+      latencyCb(lengths[i], latencies_us[i]);
+    }
+  }
+  return rv;
 }
 
-uint16_t yapi_platform_transmit_blocking(uint8_t* data, uint16_t len) {
+int yapi_service_driver_poll(int timeoutMs) {
   int fd = uart_get_connected_device();
   if (fd == UART_UNCONNECTED) {
     return 0;
   }
-  // Lets not block for now
-  return uart_write(fd, data, len);
+  struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+  if (yapi_service_driver_tx_pending()) {
+    pfd.events |= POLLOUT;
+  }
+  if (poll(&pfd, 1, timeoutMs) <= 0) {
+    return 0;
+  }
+  if (pfd.revents & POLLOUT) {
+    yapi_service_driver_tx_drain();
+  }
+  return pfd.revents;
+}
+
+void yapi_service_driver_get_tx_stats(yapi_service_driver_tx_stats_t* stats) {
+  if (stats == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&_txLock);
+  *stats = _txStats;
+  pthread_mutex_unlock(&_txLock);
+}
+
+void yapi_service_driver_set_tx_latency_cb(yapi_tx_latency_cb_t cb) {
+  pthread_mutex_lock(&_txLock);
+  _txLatencyCb = cb;
+  pthread_mutex_unlock(&_txLock);
+}
+
+void yapi_service_driver_trace_frame(yapi_trace_event_t event, uint16_t port, const yapi_packet_t* pkt) {
+  gz_trace_record_t record;
+  memset(&record, 0, sizeof(record));
+  record.eventId = event;
+  record.port = port;
+  record.command = pkt->command;
+  record.messageType = pkt->messageData.type;
+  record.senderId = pkt->senderId;
+  record.targetId = pkt->targetId;
+  record.length = pkt->length <= YAPI_DATA_SIZE ? pkt->length : YAPI_DATA_SIZE;
+  record.crc = pkt->data[record.length] | (pkt->data[record.length + 1] << 8);
+  record.flags = event == YAPI_TRACE_RX_CRC_ERROR ? 0 : GZ_TRACE_FLAG_CRC_OK;
+  gz_trace_emit(&record, pkt->data);
+}
+
+static void _yapi_service_driver_trace(yapi_trace_event_t event, const yapi_packet_t* pkt) {
+  int fd = uart_get_connected_device();
+  yapi_service_driver_trace_frame(event, fd == UART_UNCONNECTED ? 0xFFFF : (uint16_t)fd, pkt);
+}
+
+void yapi_service_driver_set_tracing(bool isEnabled) {
+  yapi_service_set_trace_cb(isEnabled ? _yapi_service_driver_trace : NULL);
 }
 
 #ifdef __cplusplus
@@ -12,16 +12,81 @@
 #ifndef INCLUDES_YAPI_SERVICE_DRIVER_H_
 #define INCLUDES_YAPI_SERVICE_DRIVER_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "yapi_service.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define PCU_YAPI_DEVICE_ID YAPI_DEVICE_PCU
 
+/**
+ * @brief Number of frames yapi_platform_transmit() can hold before reporting a failure to the caller
+ */
+#define YAPI_TX_QUEUE_DEPTH               16
+
+/**
+ * @brief Maximum number of queued frames coalesced into a single writev()
+ */
+#define YAPI_TX_MAX_BATCH_FRAMES          8
+
+typedef struct {
+  uint32_t framesQueued;    // frames accepted by yapi_platform_transmit
+  uint32_t framesSent;      // frames completely handed to the kernel
+  uint32_t framesDropped;   // frames refused because the queue was full
+  uint32_t bytesSent;
+  uint32_t writevCalls;
+  uint32_t eagainCount;     // writev found the kernel tty buffer full
+  uint32_t lastLatency_us;  // enqueue-to-wire time of the last completed frame
+  uint32_t maxLatency_us;
+  uint64_t totalLatency_us; // divide by framesSent for the average
+} yapi_service_driver_tx_stats_t;
+
+/**
+ * @brief Called once per frame when its last byte has been written to the port
+ * @param frameLength total frame length in bytes
+ * @param latency_us time between yapi_platform_transmit() and the frame reaching the kernel
+ */
+typedef void (*yapi_tx_latency_cb_t)(uint16_t frameLength, uint32_t latency_us);
+
 void yapi_service_driver_init(void);
 void yapi_service_driver_10ms(void* params);
 void yapi_service_driver_set_uart_instance(void*);
 
+/**
+ * @brief true when frames are waiting for the port to become writable.
+ * The event loop should then wait for POLLOUT and call @ref yapi_service_driver_tx_drain
+ */
+bool yapi_service_driver_tx_pending(void);
+
+/**
+ * @brief Write as many queued frames as the port accepts without blocking,
+ * coalescing up to YAPI_TX_MAX_BATCH_FRAMES frames per writev()
+ * @return number of frames still queued, -1 if the port is not connected or failed
+ */
+int yapi_service_driver_tx_drain(void);
+
+/**
+ * @brief Wait up to timeoutMs for the connected port, draining the TX queue on POLLOUT
+ * @return the poll() revents of the port (POLLIN means there is data to read), 0 on timeout
+ */
+int yapi_service_driver_poll(int timeoutMs);
+
+void yapi_service_driver_get_tx_stats(yapi_service_driver_tx_stats_t* stats);
+void yapi_service_driver_set_tx_latency_cb(yapi_tx_latency_cb_t cb);
+
+/**
+ * @brief Writes a gz_trace record of a frame. port: file descriptor or connection it went through
+ */
+void yapi_service_driver_trace_frame(yapi_trace_event_t event, uint16_t port, const yapi_packet_t* pkt);
+
+/**
+ * @brief Traces every frame yapi_service sends or receives on the connected port, once gz_trace is open
+ */
+void yapi_service_driver_set_tracing(bool isEnabled);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,608 @@
+/**
+ * yapi_subscription.cpp
+ *
+ * SUB stream manager with per consumer change coalescing, see yapi_subscription.h
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include "yapi_client.h" // C++ API, must stay outside of the extern "C" block
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "yapi_subscription.h"
+#define GZ_LOG_MODULE "subscription"
+#include "gz_log.h"
+
+/*****************************************************/
+/* Section: Defines & Typedefs                       */
+/*****************************************************/
+
+#define MAX_FIELD_TABLES                  16
+#define MIN_STALE_RETRY_MS                1000
+#define DELIVERY_IDLE_WAIT_MS             1000
+
+typedef struct {
+  yapi_subscription_cb_t cb;
+  void* context;
+  uint32_t minInterval_ms;
+  uint64_t nextDue_ms;
+  uint32_t seenSequence;
+  uint8_t seen[YAPI_DATA_SIZE];
+} _Yapi_Subscription_Consumer_t;
+
+typedef struct {
+  bool isOpen;
+  bool isSubscribed;
+  yapi_device_id_enum_t deviceId;
+  yapi_command_enum_t command;
+  uint16_t interval_ms;
+  uint64_t lastRefresh_ms;
+  uint64_t lastData_ms;
+  uint32_t sequence;
+  uint8_t length;
+  uint8_t latest[YAPI_DATA_SIZE];
+  const yapi_subscription_field_t* fields;
+  uint8_t fieldCount;
+  uint8_t statusLength;   // a RESP_OK this short is an acknowledgement, not a snapshot
+  _Yapi_Subscription_Consumer_t consumers[YAPI_SUBSCRIPTION_MAX_CONSUMERS];
+  uint8_t consumerCount;
+  yapi_subscription_stats_t stats;
+} _Yapi_Subscription_t;
+
+typedef struct {
+  yapi_command_enum_t command;
+  const yapi_subscription_field_t* fields;
+  uint8_t fieldCount;
+} _Yapi_Subscription_Field_Table_t;
+
+/*****************************************************/
+/* Section: Built-in field tables                    */
+/*****************************************************/
+
+static const yapi_subscription_field_t _pcuSummaryFields[] = {
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, battery_cycles_lifetime),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, battery_cycles_user),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, soh),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, soc),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, capacity_wh),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, capacity_remaining_wh),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, battery_voltage_mV),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, average_net_amps_dA),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, net_amps_dA),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, battery_temp_C),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, ttef),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, average_net_watts_w),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, net_watts_w),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, relative_humidity_pct),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, temp_sense_C),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, wh_in_user),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, wh_out_user),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, wh_in_lifetime),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, wh_out_lifetime),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, outputs.outputAc),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, outputs.outputUsb),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, outputs.output12v),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, outputs.outputAux),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, inputs.inputAc),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, inputs.inputLvDc),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, inputs.inputHvDc),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, inputs.inputAux),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, flags),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, factory_mode_exit_code),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, inverter_temp_C),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, port_12v_temp_C),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, input_status_codes),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_summary_status_t, power_btn_state),
+};
+
+static const yapi_subscription_field_t _pcuOutputsFields[] = {
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_outputs_status_t, outputAc),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_outputs_status_t, outputUsb),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_outputs_status_t, output12v),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_outputs_status_t, outputAux),
+};
+
+static const yapi_subscription_field_t _pcuInputsFields[] = {
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_inputs_status_t, inputAc),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_inputs_status_t, inputLvDc),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_inputs_status_t, inputHvDc),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_inputs_status_t, inputAux),
+};
+
+static const yapi_subscription_field_t _pcuPmicsFields[] = {
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, numPmics),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[0]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[1]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[2]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[3]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[4]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[5]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[6]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[7]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[8]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[9]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[10]),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_pcu_pmics_status_t, pmicStatuses[11]),
+};
+
+static const yapi_subscription_field_t _inverterSummaryFields[] = {
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, lvFirmwareVersion),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, hvFirmwareVersion),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, upsState),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, parallelState),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, frequency_hz),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, powerIn_cW),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, currentIn_dW),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, voltageIn_mV),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, invVoltage_dV),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, invCurrent_cA),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, invPowerRMS_cW),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, invFrequency_dHz),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, pfcCurrent_cA),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, pfcPowerRMS_cW),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, upsPFSR_pct),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, gridVoltage_dV),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, gridCurrent_cA),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, gridPowerRMS_cW),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, gridFrequency_dHz),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_inverter_summary_status_t, batteryVoltage_cV),
+};
+
+static const yapi_subscription_field_t _bmsSummaryFields[] = {
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, uvpCount),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, ovpCount),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, otpCount),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, ocpCount),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, utpCount),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, mhtCount),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, mltCount),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, mlvCount),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, cTmpMax),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, cTmpMin),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, packMfgDate),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, packMfgName),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, packSerial),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, otp),
+  YAPI_SUBSCRIPTION_FIELD(yapi_y6g_bms_summary_status_t, utp),
+};
+
+#define FIELD_COUNT(table) (sizeof(table) / sizeof(yapi_subscription_field_t))
+
+/**
+ * @brief Used for commands without a registered table: the whole payload is one field
+ */
+static const yapi_subscription_field_t _payloadField[] = {
+  { "payload", 0, YAPI_DATA_SIZE },
+};
+
+/*****************************************************/
+/* Section: Private variables                        */
+/*****************************************************/
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _updatedCond = PTHREAD_COND_INITIALIZER;   // new data or new consumer
+static pthread_cond_t _deliveredCond = PTHREAD_COND_INITIALIZER; // a consumer callback returned
+static pthread_t _deliveryThreadId;
+static bool _initialized = false;
+static _Yapi_Subscription_t _subscriptions[YAPI_SUBSCRIPTION_MAX];
+static _Yapi_Subscription_Field_Table_t _fieldTables[MAX_FIELD_TABLES];
+static uint8_t _fieldTableCount = 0;
+static yapi_subscription_cb_t _deliveringCb = NULL; // consumer whose callback is running
+static void* _deliveringContext = NULL;
+
+/*****************************************************/
+/* Section: Private function definitions             */
+/*****************************************************/
+
+static uint64_t _yapi_subscription_now_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static bool _is_valid_handle(int handle) {
+  return handle >= 0 && handle < YAPI_SUBSCRIPTION_MAX && _subscriptions[handle].isOpen;
+}
+
+/**
+ * @brief Must be called with _lock held
+ */
+static void _lookup_fields(yapi_command_enum_t command, const yapi_subscription_field_t** fields, uint8_t* fieldCount) {
+  *fields = _payloadField;
+  *fieldCount = FIELD_COUNT(_payloadField);
+  for (uint8_t i = 0; i < _fieldTableCount; i++) {
+    if (_fieldTables[i].command == command) {
+      *fields = _fieldTables[i].fields;
+      *fieldCount = _fieldTables[i].fieldCount;
+    }
+  }
+}
+
+/**
+ * @brief Bytes of the status payload the fields describe, 1 (any payload) for a command without a table
+ */
+static uint8_t _status_length(const yapi_subscription_field_t* fields, uint8_t fieldCount) {
+  if (fields == _payloadField) {
+    return 1;
+  }
+  uint16_t length = 0;
+  for (uint8_t i = 0; i < fieldCount && i < YAPI_SUBSCRIPTION_MAX_FIELDS; i++) {
+    uint16_t end = fields[i].offset + fields[i].size;
+    length = end <= YAPI_DATA_SIZE && end > length ? end : length;
+  }
+  return length;
+}
+
+static uint64_t _diff_fields(const yapi_subscription_field_t* fields, uint8_t fieldCount, const uint8_t* previous, const uint8_t* current) {
+  uint64_t changedMask = 0;
+  for (uint8_t i = 0; i < fieldCount && i < YAPI_SUBSCRIPTION_MAX_FIELDS; i++) {
+    if (fields[i].offset + fields[i].size > YAPI_DATA_SIZE) {
+      continue;
+    }
+    if (memcmp(previous + fields[i].offset, current + fields[i].offset, fields[i].size)) {
+      changedMask |= (uint64_t)1 << i;
+    }
+  }
+  return changedMask;
+}
+
+static void _send_sub_request(int handle, yapi_device_id_enum_t deviceId, yapi_command_enum_t command, uint16_t interval_ms, bool enable) {
+  yapi_subscription_request_t request;
+  request.enable = enable;
+  request.interval_ms = interval_ms;
+  yapi_client_options_t options = yapi_client_default_options();
+  if (!enable) {
+    yapi_client_request_async(deviceId, command, YAPI_MSG_SUB_RQST, (const uint8_t*)&request, sizeof(request), &options, NULL);
+    return;
+  }
+  yapi_client_request_async(deviceId, command, YAPI_MSG_SUB_RQST, (const uint8_t*)&request, sizeof(request), &options,
+    [handle, deviceId, command](const yapi_client_result_t& result) {
+      pthread_mutex_lock(&_lock);
+      _Yapi_Subscription_t* subscription = &_subscriptions[handle];
+      if (subscription->isOpen && subscription->deviceId == deviceId && subscription->command == command) {
+        subscription->isSubscribed = result.status == YAPI_CLIENT_STATUS_OK;
+      }
+      pthread_mutex_unlock(&_lock);
+      if (result.status != YAPI_CLIENT_STATUS_OK) {
+        GZ_LOG_ERROR("yapi_subscription: SUB device[%d] command[%d] failed [%s]\n", deviceId, command, yapi_client_status_string(result.status));
+      }
+    });
+}
+
+/**
+ * @brief yapi_service rx observer: runs on the parser thread, only copies the payload and wakes the delivery thread
+ */
+static void _yapi_subscription_rx_observer(void* yapi_pkt) {
+  const yapi_packet_t* packet = (const yapi_packet_t*)yapi_pkt;
+  uint8_t type = packet->messageData.type;
+  if (type != YAPI_MSG_SUB_RESP_OK && type != YAPI_MSG_GET_RESP_OK && type != YAPI_MSG_UNSOLICITED) {
+    return;
+  }
+  pthread_mutex_lock(&_lock);
+  for (int handle = 0; handle < YAPI_SUBSCRIPTION_MAX; handle++) {
+    _Yapi_Subscription_t* subscription = &_subscriptions[handle];
+    if (!subscription->isOpen || subscription->deviceId != packet->senderId || subscription->command != packet->command) {
+      continue;
+    }
+    if (type != YAPI_MSG_UNSOLICITED && packet->length < subscription->statusLength) {
+      continue; // a GET or SUB acknowledged without the status
+    }
+    subscription->length = packet->length < YAPI_DATA_SIZE ? packet->length : YAPI_DATA_SIZE;
+    memset(subscription->latest, 0, sizeof(subscription->latest));
+    memcpy(subscription->latest, packet->data, subscription->length);
+    subscription->sequence++;
+    subscription->lastData_ms = _yapi_subscription_now_ms();
+    subscription->stats.packetsReceived++;
+    pthread_cond_signal(&_updatedCond);
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+/**
+ * @brief Delivers the next due update, must be called with _lock held (released during the callback)
+ * @return true if a consumer was called, the tables may have changed meanwhile
+ * @param nextDue_ms lowered to the time the next rate limited update becomes due
+ */
+static bool _deliver_next(uint64_t now_ms, uint64_t* nextDue_ms) {
+  static uint8_t current[YAPI_DATA_SIZE];
+  static uint8_t previous[YAPI_DATA_SIZE];
+  for (int handle = 0; handle < YAPI_SUBSCRIPTION_MAX; handle++) {
+    _Yapi_Subscription_t* subscription = &_subscriptions[handle];
+    if (!subscription->isOpen) {
+      continue;
+    }
+    for (uint8_t i = 0; i < subscription->consumerCount; i++) {
+      _Yapi_Subscription_Consumer_t* consumer = &subscription->consumers[i];
+      if (consumer->seenSequence == subscription->sequence) {
+        continue;
+      }
+      if (now_ms < consumer->nextDue_ms) {
+        *nextDue_ms = consumer->nextDue_ms < *nextDue_ms ? consumer->nextDue_ms : *nextDue_ms;
+        continue;
+      }
+      yapi_subscription_update_t update;
+      update.deviceId = subscription->deviceId;
+      update.command = subscription->command;
+      update.current = current;
+      update.previous = previous;
+      update.length = subscription->length;
+      update.fields = subscription->fields;
+      update.fieldCount = subscription->fieldCount;
+      update.changedMask = _diff_fields(subscription->fields, subscription->fieldCount, consumer->seen, subscription->latest);
+      update.coalesced = subscription->sequence - consumer->seenSequence - 1;
+      memcpy(current, subscription->latest, sizeof(current));
+      memcpy(previous, consumer->seen, sizeof(previous));
+      memcpy(consumer->seen, subscription->latest, sizeof(consumer->seen));
+      consumer->seenSequence = subscription->sequence;
+      subscription->stats.coalesced += update.coalesced;
+      if (!update.changedMask) {
+        subscription->stats.unchanged++;
+        continue;
+      }
+      subscription->stats.deliveries++;
+      consumer->nextDue_ms = now_ms + consumer->minInterval_ms;
+      yapi_subscription_cb_t cb = consumer->cb;
+      void* context = consumer->context;
+      _deliveringCb = cb;
+      _deliveringContext = context;
+      pthread_mutex_unlock(&_lock);
+      cb(&update, context);
+      pthread_mutex_lock(&_lock);
+      _deliveringCb = NULL;
+      _deliveringContext = NULL;
+      pthread_cond_broadcast(&_deliveredCond);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void *_yapi_subscription_delivery_thread(void *params) {
+  pthread_mutex_lock(&_lock);
+  while (1) {
+    uint64_t now_ms = _yapi_subscription_now_ms();
+    uint64_t nextDue_ms = now_ms + DELIVERY_IDLE_WAIT_MS;
+    if (_deliver_next(now_ms, &nextDue_ms)) {
+      continue;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    uint64_t wait_ns = (nextDue_ms - now_ms) * 1000000 + deadline.tv_nsec;
+    deadline.tv_sec += wait_ns / 1000000000;
+    deadline.tv_nsec = wait_ns % 1000000000;
+    pthread_cond_timedwait(&_updatedCond, &_lock, &deadline);
+  }
+  pthread_mutex_unlock(&_lock);
+  return NULL;
+}
+
+/**
+ * @brief Waits until no callback of the given consumer is running, must be called with _lock held
+ */
+static void _wait_delivered(yapi_subscription_cb_t cb, void* context) {
+  if (pthread_equal(pthread_self(), _deliveryThreadId)) {
+    return; // called from a consumer callback
+  }
+  while (_deliveringCb == cb && _deliveringContext == context) {
+    pthread_cond_wait(&_deliveredCond, &_lock);
+  }
+}
+
+/*****************************************************/
+/* Section: Public function definitions              */
+/*****************************************************/
+
+void yapi_subscription_init(void) {
+  if (_initialized) {
+    return;
+  }
+  yapi_subscription_register_fields(YAPI_CMD_PCU_SUMMARY_STATUS, _pcuSummaryFields, FIELD_COUNT(_pcuSummaryFields));
+  yapi_subscription_register_fields(YAPI_CMD_PCU_OUTPUTS_STATUS, _pcuOutputsFields, FIELD_COUNT(_pcuOutputsFields));
+  yapi_subscription_register_fields(YAPI_CMD_PCU_INPUTS_STATUS, _pcuInputsFields, FIELD_COUNT(_pcuInputsFields));
+  yapi_subscription_register_fields(YAPI_CMD_PCU_PMICS_STATUS, _pcuPmicsFields, FIELD_COUNT(_pcuPmicsFields));
+  yapi_subscription_register_fields(YAP_CMD_INVERTER_SUMMARY_STATUS, _inverterSummaryFields, FIELD_COUNT(_inverterSummaryFields));
+  yapi_subscription_register_fields(YAPI_CMD_BMS_SUMMARY_STATUS, _bmsSummaryFields, FIELD_COUNT(_bmsSummaryFields));
+
+  pthread_condattr_t condAttr;
+  pthread_condattr_init(&condAttr);
+  pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+  pthread_cond_init(&_updatedCond, &condAttr);
+  pthread_condattr_destroy(&condAttr);
+
+  yapi_service_add_rx_observer(_yapi_subscription_rx_observer);
+  pthread_create(&_deliveryThreadId, NULL, _yapi_subscription_delivery_thread, NULL);
+  _initialized = true;
+}
+
+void yapi_subscription_task(void) {
+  struct {
+    int handle;
+    yapi_device_id_enum_t deviceId;
+    yapi_command_enum_t command;
+    uint16_t interval_ms;
+  } due[YAPI_SUBSCRIPTION_MAX];
+  int dueCount = 0;
+  uint64_t now_ms = _yapi_subscription_now_ms();
+  pthread_mutex_lock(&_lock);
+  for (int handle = 0; handle < YAPI_SUBSCRIPTION_MAX; handle++) {
+    _Yapi_Subscription_t* subscription = &_subscriptions[handle];
+    if (!subscription->isOpen) {
+      continue;
+    }
+    uint64_t lastActivity_ms = subscription->lastData_ms > subscription->lastRefresh_ms ? subscription->lastData_ms : subscription->lastRefresh_ms;
+    bool isStale = now_ms - lastActivity_ms >= (uint64_t)YAPI_SUBSCRIPTION_STALE_INTERVALS * subscription->interval_ms + MIN_STALE_RETRY_MS;
+    if (isStale || now_ms - subscription->lastRefresh_ms >= YAPI_SUBSCRIPTION_REFRESH_MS) {
+      subscription->lastRefresh_ms = now_ms;
+      subscription->stats.refreshes++;
+      due[dueCount].handle = handle;
+      due[dueCount].deviceId = subscription->deviceId;
+      due[dueCount].command = subscription->command;
+      due[dueCount++].interval_ms = subscription->interval_ms;
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+  // Sent without the lock, the completion may run synchronously and take it
+  for (int i = 0; i < dueCount; i++) {
+    _send_sub_request(due[i].handle, due[i].deviceId, due[i].command, due[i].interval_ms, true);
+  }
+}
+
+int yapi_subscription_open(yapi_device_id_enum_t deviceId, yapi_command_enum_t command, uint16_t interval_ms) {
+  int handle = YAPI_SUBSCRIPTION_INVALID_HANDLE;
+  pthread_mutex_lock(&_lock);
+  for (int i = 0; i < YAPI_SUBSCRIPTION_MAX; i++) {
+    if (_subscriptions[i].isOpen && _subscriptions[i].deviceId == deviceId && _subscriptions[i].command == command) {
+      pthread_mutex_unlock(&_lock);
+      return i;
+    }
+    if (!_subscriptions[i].isOpen && handle == YAPI_SUBSCRIPTION_INVALID_HANDLE) {
+      handle = i;
+    }
+  }
+  if (handle != YAPI_SUBSCRIPTION_INVALID_HANDLE) {
+    _Yapi_Subscription_t* subscription = &_subscriptions[handle];
+    memset(subscription, 0, sizeof(_Yapi_Subscription_t));
+    subscription->isOpen = true;
+    subscription->deviceId = deviceId;
+    subscription->command = command;
+    subscription->interval_ms = interval_ms;
+    subscription->lastRefresh_ms = _yapi_subscription_now_ms();
+    subscription->stats.refreshes = 1;
+    _lookup_fields(command, &subscription->fields, &subscription->fieldCount);
+    subscription->statusLength = _status_length(subscription->fields, subscription->fieldCount);
+  }
+  pthread_mutex_unlock(&_lock);
+  if (handle == YAPI_SUBSCRIPTION_INVALID_HANDLE) {
+    GZ_LOG_ERROR("yapi_subscription: no room for device[%d] command[%d]\n", deviceId, command);
+    return handle;
+  }
+  _send_sub_request(handle, deviceId, command, interval_ms, true);
+  return handle;
+}
+
+int yapi_subscription_find(yapi_device_id_enum_t deviceId, yapi_command_enum_t command) {
+  int handle = YAPI_SUBSCRIPTION_INVALID_HANDLE;
+  pthread_mutex_lock(&_lock);
+  for (int i = 0; i < YAPI_SUBSCRIPTION_MAX; i++) {
+    if (_subscriptions[i].isOpen && _subscriptions[i].deviceId == deviceId && _subscriptions[i].command == command) {
+      handle = i;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+  return handle;
+}
+
+void yapi_subscription_close(int handle) {
+  pthread_mutex_lock(&_lock);
+  if (!_is_valid_handle(handle)) {
+    pthread_mutex_unlock(&_lock);
+    return;
+  }
+  _Yapi_Subscription_t* subscription = &_subscriptions[handle];
+  // Closed before waiting: _wait_delivered() releases the lock and the delivery thread must not pick any of
+  // these consumers again meanwhile
+  yapi_subscription_cb_t cbs[YAPI_SUBSCRIPTION_MAX_CONSUMERS];
+  void* contexts[YAPI_SUBSCRIPTION_MAX_CONSUMERS];
+  uint8_t consumerCount = subscription->consumerCount;
+  for (uint8_t i = 0; i < consumerCount; i++) {
+    cbs[i] = subscription->consumers[i].cb;
+    contexts[i] = subscription->consumers[i].context;
+  }
+  yapi_device_id_enum_t deviceId = subscription->deviceId;
+  yapi_command_enum_t command = subscription->command;
+  subscription->isOpen = false;
+  subscription->consumerCount = 0;
+  for (uint8_t i = 0; i < consumerCount; i++) {
+    _wait_delivered(cbs[i], contexts[i]);
+  }
+  pthread_mutex_unlock(&_lock);
+  _send_sub_request(handle, deviceId, command, 0, false);
+}
+
+int yapi_subscription_add_consumer(int handle, yapi_subscription_cb_t cb, void* context, uint16_t maxRate_hz) {
+  int consumerCount = -1;
+  if (!cb) {
+    return consumerCount;
+  }
+  pthread_mutex_lock(&_lock);
+  if (_is_valid_handle(handle) && _subscriptions[handle].consumerCount < YAPI_SUBSCRIPTION_MAX_CONSUMERS) {
+    _Yapi_Subscription_t* subscription = &_subscriptions[handle];
+    _Yapi_Subscription_Consumer_t* consumer = &subscription->consumers[subscription->consumerCount++];
+    memset(consumer, 0, sizeof(_Yapi_Subscription_Consumer_t));
+    consumer->cb = cb;
+    consumer->context = context;
+    consumer->minInterval_ms = maxRate_hz ? 1000 / maxRate_hz : 0;
+    consumerCount = subscription->consumerCount;
+    pthread_cond_signal(&_updatedCond); // deliver the current snapshot right away
+  }
+  pthread_mutex_unlock(&_lock);
+  return consumerCount;
+}
+
+void yapi_subscription_remove_consumer(int handle, yapi_subscription_cb_t cb, void* context) {
+  pthread_mutex_lock(&_lock);
+  if (_is_valid_handle(handle)) {
+    _Yapi_Subscription_t* subscription = &_subscriptions[handle];
+    for (uint8_t i = 0; i < subscription->consumerCount; i++) {
+      if (subscription->consumers[i].cb == cb && subscription->consumers[i].context == context) {
+        memmove(&subscription->consumers[i], &subscription->consumers[i + 1], (subscription->consumerCount - i - 1) * sizeof(_Yapi_Subscription_Consumer_t));
+        subscription->consumerCount--;
+        _wait_delivered(cb, context); // removed first, so it cannot be picked again while we wait
+        break;
+      }
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+uint8_t yapi_subscription_get_snapshot(int handle, void* snapshot, uint8_t size) {
+  uint8_t length = 0;
+  pthread_mutex_lock(&_lock);
+  if (_is_valid_handle(handle) && _subscriptions[handle].sequence) {
+    length = size < _subscriptions[handle].length ? size : _subscriptions[handle].length;
+    memcpy(snapshot, _subscriptions[handle].latest, length);
+  }
+  pthread_mutex_unlock(&_lock);
+  return length;
+}
+
+void yapi_subscription_register_fields(yapi_command_enum_t command, const yapi_subscription_field_t* fields, uint8_t fieldCount) {
+  pthread_mutex_lock(&_lock);
+  uint8_t index = 0;
+  while (index < _fieldTableCount && _fieldTables[index].command != command) {
+    index++;
+  }
+  if (index < MAX_FIELD_TABLES) {
+    _fieldTables[index].command = command;
+    _fieldTables[index].fields = fields;
+    _fieldTables[index].fieldCount = fieldCount < YAPI_SUBSCRIPTION_MAX_FIELDS ? fieldCount : YAPI_SUBSCRIPTION_MAX_FIELDS;
+    if (index == _fieldTableCount) {
+      _fieldTableCount++;
+    }
+  } else {
+    GZ_LOG_ERROR("yapi_subscription: no room for the fields of command[%d]\n", command);
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+void yapi_subscription_get_stats(int handle, yapi_subscription_stats_t* stats) {
+  pthread_mutex_lock(&_lock);
+  if (_is_valid_handle(handle)) {
+    memcpy(stats, &_subscriptions[handle].stats, sizeof(yapi_subscription_stats_t));
+  } else {
+    memset(stats, 0, sizeof(yapi_subscription_stats_t));
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,136 @@
+/**
+ * yapi_subscription.h
+ *
+ * Opens and refreshes YAPI SUB streams per (device, command), keeps the latest snapshot of each stream and
+ * delivers to consumers only the fields that changed since what they last saw.
+ *
+ * The parser thread only copies the payload into the snapshot; consumers are called from a dedicated delivery
+ * thread, at most at their configured rate. Updates arriving faster than a consumer accepts them are coalesced:
+ * the consumer gets the latest values and the union of the fields that changed in between.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_SUBSCRIPTION_H
+#define YAPI_SUBSCRIPTION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "yapi_service.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YAPI_SUBSCRIPTION_MAX                   8
+#define YAPI_SUBSCRIPTION_MAX_CONSUMERS         8
+#define YAPI_SUBSCRIPTION_MAX_FIELDS            64    // bits of yapi_subscription_update_t.changedMask
+#define YAPI_SUBSCRIPTION_REFRESH_MS            30000 // SUB is re-sent this often so a rebooted device resumes streaming
+#define YAPI_SUBSCRIPTION_STALE_INTERVALS       3     // SUB is re-sent after this many intervals without data
+#define YAPI_SUBSCRIPTION_INVALID_HANDLE        -1
+
+/**
+ * @brief Payload of a YAPI_MSG_SUB_RQST
+ */
+typedef struct __attribute__ ((packed)) {
+  uint8_t enable;
+  uint16_t interval_ms;
+} yapi_subscription_request_t;
+
+/**
+ * @brief Describes one field of a packed status struct, used to diff two snapshots
+ */
+typedef struct {
+  const char* name;
+  uint16_t offset;
+  uint16_t size;
+} yapi_subscription_field_t;
+
+#define YAPI_SUBSCRIPTION_FIELD(type, member) { #member, offsetof(type, member), sizeof(((type*)0)->member) }
+
+typedef struct {
+  yapi_device_id_enum_t deviceId;
+  yapi_command_enum_t command;
+  const uint8_t* current;     // latest payload, YAPI_DATA_SIZE bytes, zero padded
+  const uint8_t* previous;    // payload of the consumer's previous delivery, all zero on the first one
+  uint8_t length;             // bytes received in the latest packet
+  const yapi_subscription_field_t* fields;
+  uint8_t fieldCount;
+  uint64_t changedMask;       // bit i set when fields[i] differs between previous and current
+  uint32_t coalesced;         // packets received since the previous delivery minus one
+} yapi_subscription_update_t;
+
+/**
+ * @brief Consumer callback, called from the delivery thread. The update is only valid during the call.
+ */
+typedef void (*yapi_subscription_cb_t)(const yapi_subscription_update_t* update, void* context);
+
+typedef struct {
+  uint32_t packetsReceived;
+  uint32_t deliveries;
+  uint32_t coalesced;         // packets a consumer never saw individually
+  uint32_t unchanged;         // packets that changed no field for a consumer
+  uint32_t refreshes;         // SUB requests sent
+} yapi_subscription_stats_t;
+
+/**
+ * @brief Hooks the manager to the YAPI receive path and starts the delivery thread.
+ * Call once after yapi_service_driver_init() and yapi_client_init().
+ */
+void yapi_subscription_init(void);
+
+/**
+ * @brief Refreshes subscriptions, call from yapi_task_10ms
+ */
+void yapi_subscription_task(void);
+
+/**
+ * @brief Subscribes to a (device, command) stream. Opening an already open stream returns its handle.
+ * @param interval_ms requested publish period of the device
+ * @return handle, YAPI_SUBSCRIPTION_INVALID_HANDLE when the table is full
+ */
+int yapi_subscription_open(yapi_device_id_enum_t deviceId, yapi_command_enum_t command, uint16_t interval_ms);
+
+/**
+ * @brief Returns the handle of an open stream, YAPI_SUBSCRIPTION_INVALID_HANDLE if not open
+ */
+int yapi_subscription_find(yapi_device_id_enum_t deviceId, yapi_command_enum_t command);
+
+/**
+ * @brief Unsubscribes and removes the consumers of the stream
+ */
+void yapi_subscription_close(int handle);
+
+/**
+ * @brief Adds a consumer to a stream
+ * @param maxRate_hz maximum number of deliveries per second, 0 for unlimited
+ * @return consumer count of the stream, -1 on failure
+ */
+int yapi_subscription_add_consumer(int handle, yapi_subscription_cb_t cb, void* context, uint16_t maxRate_hz);
+
+/**
+ * @brief Removes a consumer, waits for an ongoing delivery to it to finish
+ */
+void yapi_subscription_remove_consumer(int handle, yapi_subscription_cb_t cb, void* context);
+
+/**
+ * @brief Copies the latest payload of a stream
+ * @return number of bytes copied, 0 when nothing has been received yet
+ */
+uint8_t yapi_subscription_get_snapshot(int handle, void* snapshot, uint8_t size);
+
+/**
+ * @brief Registers the field table used to diff a command, commands without one are diffed as a single field.
+ * A GET or SUB RESP_OK shorter than the table is an acknowledgement and does not update the snapshot.
+ * Tables for the PCU summary, outputs, inputs, PMICs, inverter and BMS status are built in.
+ */
+void yapi_subscription_register_fields(yapi_command_enum_t command, const yapi_subscription_field_t* fields, uint8_t fieldCount);
+
+void yapi_subscription_get_stats(int handle, yapi_subscription_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YAPI_SUBSCRIPTION_H
@@ -0,0 +1,366 @@
+/**
+ * yapi_telemetry.cpp
+ *
+ * Status stream recorder, see yapi_telemetry.h
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <type_traits>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "yapi_telemetry.h"
+#include "yapi_subscription.h"
+#define GZ_LOG_MODULE "telemetry"
+#include "gz_log.h"
+
+/*****************************************************/
+/* Section: Defines & Typedefs                       */
+/*****************************************************/
+
+#define PATH_MAX_LENGTH                   256
+
+#define YAPI_TELEMETRY_COLUMN(type, member) \
+  { #member, offsetof(type, member), sizeof(((type*)0)->member), std::is_signed<decltype(((type*)0)->member)>::value }
+
+#define COLUMN_COUNT(table) (sizeof(table) / sizeof(gz_telemetry_column_t))
+
+typedef struct {
+  gz_telemetry_t* store;
+  int handle;                     // subscription
+  bool isSubscriptionOwner;       // opened by the recorder, closed when it stops
+  bool hasStats;
+  gz_telemetry_stats_t stats;     // of the last run, taken once sealed
+} _Yapi_Telemetry_Recorder_t;
+
+/*****************************************************/
+/* Section: Column tables                            */
+/*****************************************************/
+
+#define PCU_OUTPUT_COLUMNS(port) \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, outputs.port.current_dA), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, outputs.port.power_dW), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, outputs.port.voltage_dV), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, outputs.port.status), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, outputs.port.flags)
+
+#define PCU_INPUT_COLUMNS(port) \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, inputs.port.current_dA), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, inputs.port.power_dW), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, inputs.port.voltage_dV), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, inputs.port.fast_charge), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, inputs.port.flags)
+
+static const gz_telemetry_column_t _pcuSummaryColumns[] = {
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, battery_cycles_lifetime),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, battery_cycles_user),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, soh),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, soc),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, capacity_wh),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, capacity_remaining_wh),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, battery_voltage_mV),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, average_net_amps_dA),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, net_amps_dA),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, battery_temp_C),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, ttef),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, average_net_watts_w),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, net_watts_w),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, relative_humidity_pct),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, temp_sense_C),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, wh_in_user),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, wh_out_user),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, wh_in_lifetime),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, wh_out_lifetime),
+  PCU_OUTPUT_COLUMNS(outputAc),
+  PCU_OUTPUT_COLUMNS(outputUsb),
+  PCU_OUTPUT_COLUMNS(output12v),
+  PCU_OUTPUT_COLUMNS(outputAux),
+  PCU_INPUT_COLUMNS(inputAc),
+  PCU_INPUT_COLUMNS(inputLvDc),
+  PCU_INPUT_COLUMNS(inputHvDc),
+  PCU_INPUT_COLUMNS(inputAux),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, flags),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, factory_mode_exit_code),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, inverter_temp_C),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, port_12v_temp_C),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, input_status_codes.inputAc),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, input_status_codes.inputLvDc),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, input_status_codes.inputHvDc),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, input_status_codes.inputAux),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_summary_status_t, power_btn_state),
+};
+
+#define PMIC_COLUMNS(index) \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_pmics_status_t, pmicStatuses[index].channelStatus), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_pmics_status_t, pmicStatuses[index].rmsVoltage_mV), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_pmics_status_t, pmicStatuses[index].rmsCurrent_mA), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_pmics_status_t, pmicStatuses[index].lineFrequency_dHz), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_pmics_status_t, pmicStatuses[index].activePower_W), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_pmics_status_t, pmicStatuses[index].reactivePower_W), \
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_pmics_status_t, pmicStatuses[index].apparentPower_W)
+
+static const gz_telemetry_column_t _pcuPmicsColumns[] = {
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_pcu_pmics_status_t, numPmics),
+  PMIC_COLUMNS(0), PMIC_COLUMNS(1), PMIC_COLUMNS(2), PMIC_COLUMNS(3), PMIC_COLUMNS(4), PMIC_COLUMNS(5),
+  PMIC_COLUMNS(6), PMIC_COLUMNS(7), PMIC_COLUMNS(8), PMIC_COLUMNS(9), PMIC_COLUMNS(10), PMIC_COLUMNS(11),
+};
+
+static const gz_telemetry_column_t _inverterSummaryColumns[] = {
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, lvFirmwareVersion),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, hvFirmwareVersion),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, upsState),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, parallelState),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, frequency_hz),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, powerIn_cW),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, currentIn_dW),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, voltageIn_mV),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, invVoltage_dV),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, invCurrent_cA),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, invPowerRMS_cW),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, invFrequency_dHz),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, pfcCurrent_cA),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, pfcPowerRMS_cW),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, upsPFSR_pct),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, gridVoltage_dV),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, gridCurrent_cA),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, gridPowerRMS_cW),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, gridFrequency_dHz),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_inverter_summary_status_t, batteryVoltage_cV),
+};
+
+// The pack strings are not telemetry
+static const gz_telemetry_column_t _bmsSummaryColumns[] = {
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, uvpCount),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, ovpCount),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, otpCount),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, ocpCount),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, utpCount),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, mhtCount),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, mltCount),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, mlvCount),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, cTmpMax),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, cTmpMin),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, otp),
+  YAPI_TELEMETRY_COLUMN(yapi_y6g_bms_summary_status_t, utp),
+};
+
+static const yapi_telemetry_stream_t _streams[] = {
+  { "pcu_summary", YAPI_DEVICE_PCU, YAPI_CMD_PCU_SUMMARY_STATUS, _pcuSummaryColumns, COLUMN_COUNT(_pcuSummaryColumns) },
+  { "pcu_pmics", YAPI_DEVICE_PCU, YAPI_CMD_PCU_PMICS_STATUS, _pcuPmicsColumns, COLUMN_COUNT(_pcuPmicsColumns) },
+  { "inverter_summary", YAPI_DEVICE_INVERTER, YAP_CMD_INVERTER_SUMMARY_STATUS, _inverterSummaryColumns,
+    COLUMN_COUNT(_inverterSummaryColumns) },
+  { "bms_summary", YAPI_DEVICE_BMS, YAPI_CMD_BMS_SUMMARY_STATUS, _bmsSummaryColumns, COLUMN_COUNT(_bmsSummaryColumns) },
+};
+
+#define STREAM_COUNT (sizeof(_streams) / sizeof(_streams[0]))
+
+/*****************************************************/
+/* Section: Private variables                        */
+/*****************************************************/
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static bool _isRunning = false;
+static char _directory[PATH_MAX_LENGTH];
+static _Yapi_Telemetry_Recorder_t _recorders[STREAM_COUNT];
+
+/*****************************************************/
+/* Section: Private function definitions             */
+/*****************************************************/
+
+static int64_t _yapi_telemetry_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int _yapi_telemetry_find_stream(const char* name) {
+  for (size_t i = 0; i < STREAM_COUNT; i++) {
+    if (strcmp(_streams[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int _yapi_telemetry_append(size_t stream, int64_t timestamp_ns, const void* payload) {
+  int rv = -1;
+  pthread_mutex_lock(&_lock);
+  if (_isRunning && _recorders[stream].store) {
+    rv = gz_telemetry_append(_recorders[stream].store, timestamp_ns, payload);
+  }
+  pthread_mutex_unlock(&_lock);
+  return rv;
+}
+
+/**
+ * @brief yapi_subscription consumer, context is the index of the stream
+ */
+static void _yapi_telemetry_consumer(const yapi_subscription_update_t* update, void* context) {
+  _yapi_telemetry_append((uintptr_t)context, _yapi_telemetry_now_ns(), update->current);
+}
+
+/*****************************************************/
+/* Section: Public function definitions              */
+/*****************************************************/
+
+const yapi_telemetry_stream_t* yapi_telemetry_get_streams(uint8_t* count) {
+  *count = STREAM_COUNT;
+  return _streams;
+}
+
+int yapi_telemetry_start(const char* directory, uint16_t interval_ms) {
+  char path[PATH_MAX_LENGTH + 32];
+  if (!directory || strlen(directory) >= PATH_MAX_LENGTH) {
+    return -1;
+  }
+  yapi_telemetry_stop();
+  if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+    GZ_LOG_ERROR("Cannot create %s\n", directory);
+    return -1;
+  }
+  pthread_mutex_lock(&_lock);
+  strcpy(_directory, directory);
+  memset(_recorders, 0, sizeof(_recorders));
+  for (size_t i = 0; i < STREAM_COUNT; i++) {
+    snprintf(path, sizeof(path), "%s/%s", directory, _streams[i].name);
+    _recorders[i].store = gz_telemetry_open(path, _streams[i].columns, _streams[i].columnCount, 0);
+    if (!_recorders[i].store) {
+      GZ_LOG_ERROR("Cannot open the %s store\n", _streams[i].name);
+    }
+  }
+  _isRunning = true;
+  pthread_mutex_unlock(&_lock);
+
+  // Consumers are called with the subscription lock held, so not with _lock
+  for (size_t i = 0; i < STREAM_COUNT; i++) {
+    if (!_recorders[i].store) {
+      continue;
+    }
+    _recorders[i].isSubscriptionOwner = yapi_subscription_find(_streams[i].deviceId, _streams[i].command) ==
+                                        YAPI_SUBSCRIPTION_INVALID_HANDLE;
+    _recorders[i].handle = yapi_subscription_open(_streams[i].deviceId, _streams[i].command,
+                                                  interval_ms ? interval_ms : YAPI_TELEMETRY_DEFAULT_INTERVAL_MS);
+    if (_recorders[i].handle != YAPI_SUBSCRIPTION_INVALID_HANDLE) {
+      yapi_subscription_add_consumer(_recorders[i].handle, _yapi_telemetry_consumer, (void*)i, 0);
+    }
+  }
+  return 0;
+}
+
+void yapi_telemetry_stop(void) {
+  pthread_mutex_lock(&_lock);
+  bool wasRunning = _isRunning;
+  _isRunning = false;
+  pthread_mutex_unlock(&_lock);
+  if (!wasRunning) {
+    return;
+  }
+  for (size_t i = 0; i < STREAM_COUNT; i++) {
+    if (!_recorders[i].store || _recorders[i].handle == YAPI_SUBSCRIPTION_INVALID_HANDLE) {
+      continue;
+    }
+    if (_recorders[i].isSubscriptionOwner) {
+      yapi_subscription_close(_recorders[i].handle);
+    } else {
+      yapi_subscription_remove_consumer(_recorders[i].handle, _yapi_telemetry_consumer, (void*)i);
+    }
+  }
+  pthread_mutex_lock(&_lock);
+  for (size_t i = 0; i < STREAM_COUNT; i++) {
+    _recorders[i].hasStats = _recorders[i].store && gz_telemetry_flush(_recorders[i].store) == 0;
+    if (_recorders[i].hasStats) {
+      gz_telemetry_get_stats(_recorders[i].store, &_recorders[i].stats);
+    }
+    gz_telemetry_close(_recorders[i].store);
+    _recorders[i].store = NULL;
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+bool yapi_telemetry_is_running(void) {
+  pthread_mutex_lock(&_lock);
+  bool isRunning = _isRunning;
+  pthread_mutex_unlock(&_lock);
+  return isRunning;
+}
+
+int yapi_telemetry_record(yapi_command_enum_t command, int64_t timestamp_ns, const void* payload) {
+  for (size_t i = 0; i < STREAM_COUNT; i++) {
+    if (_streams[i].command == command) {
+      return _yapi_telemetry_append(i, timestamp_ns, payload);
+    }
+  }
+  return -1;
+}
+
+int64_t yapi_telemetry_scan(const char* directory, const char* stream, const char* column, int64_t from_ns,
+                            int64_t to_ns, gz_telemetry_scan_cb_t cb, void* context) {
+  char path[PATH_MAX_LENGTH + 32];
+  int index = _yapi_telemetry_find_stream(stream);
+  if (index < 0) {
+    GZ_LOG_ERROR("Unknown stream %s\n", stream);
+    return -1;
+  }
+  pthread_mutex_lock(&_lock);
+  if (_isRunning && _recorders[index].store && strcmp(directory, _directory) == 0) {
+    gz_telemetry_t* store = _recorders[index].store;
+    int64_t rv = gz_telemetry_scan(store, gz_telemetry_column_index(store, column), from_ns, to_ns, cb, context);
+    pthread_mutex_unlock(&_lock);
+    return rv;
+  }
+  pthread_mutex_unlock(&_lock);
+  snprintf(path, sizeof(path), "%s/%s", directory, stream);
+  gz_telemetry_t* store = gz_telemetry_open(path, NULL, 0, 0);
+  if (!store) {
+    GZ_LOG_ERROR("Nothing recorded in %s\n", path);
+    return -1;
+  }
+  int64_t rv = gz_telemetry_scan(store, gz_telemetry_column_index(store, column), from_ns, to_ns, cb, context);
+  gz_telemetry_close(store);
+  return rv;
+}
+
+double yapi_telemetry_column_unit_W(const char* column) {
+  static const struct {
+    const char* suffix;
+    double unit_W;
+  } units[] = { { "_dW", 0.1 }, { "_cW", 0.01 }, { "_W", 1.0 }, { "_w", 1.0 } };
+  size_t length = strlen(column);
+  for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+    size_t suffixLength = strlen(units[i].suffix);
+    if (length > suffixLength && strcmp(column + length - suffixLength, units[i].suffix) == 0) {
+      return units[i].unit_W;
+    }
+  }
+  return 0;
+}
+
+bool yapi_telemetry_get_stats(const char* stream, gz_telemetry_stats_t* stats) {
+  int index = _yapi_telemetry_find_stream(stream);
+  bool isRecorded = false;
+  pthread_mutex_lock(&_lock);
+  if (index >= 0 && _isRunning && _recorders[index].store) {
+    gz_telemetry_get_stats(_recorders[index].store, stats);
+    isRecorded = true;
+  } else if (index >= 0 && !_isRunning && _recorders[index].hasStats) {
+    *stats = _recorders[index].stats;
+    isRecorded = true;
+  }
+  pthread_mutex_unlock(&_lock);
+  return isRecorded;
+}
+
+#ifdef __cplusplus
+}
+#endif
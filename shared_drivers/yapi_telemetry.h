@@ -0,0 +1,88 @@
+/**
+ * yapi_telemetry.h
+ *
+ * Records the decoded status streams of a device into gz_telemetry stores, one per stream: every numeric
+ * field of the packed status struct becomes a column (PCU summary, PMICs, inverter and BMS summaries).
+ * Samples come from yapi_subscription consumers, stamped with the wall clock when they are delivered.
+ *
+ * A directory holds the segments of every stream, <directory>/<stream>.<n>. Recording again into the same
+ * directory appends to what is there.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_TELEMETRY_H
+#define YAPI_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "yapi_service.h"
+#include "gz_telemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YAPI_TELEMETRY_DEFAULT_INTERVAL_MS      1000
+
+typedef struct {
+  const char* name;               // file name of its store
+  yapi_device_id_enum_t deviceId;
+  yapi_command_enum_t command;
+  const gz_telemetry_column_t* columns;
+  uint16_t columnCount;
+} yapi_telemetry_stream_t;
+
+/**
+ * @brief The streams recorded, the column tables are built in
+ */
+const yapi_telemetry_stream_t* yapi_telemetry_get_streams(uint8_t* count);
+
+/**
+ * @brief Subscribes to every stream and records it into directory, created if needed
+ * @param interval_ms requested publish period, 0 for YAPI_TELEMETRY_DEFAULT_INTERVAL_MS
+ * @return 0 on success, -1 otherwise
+ */
+int yapi_telemetry_start(const char* directory, uint16_t interval_ms);
+
+/**
+ * @brief Stops recording, the stores are sealed and closed
+ */
+void yapi_telemetry_stop(void);
+
+bool yapi_telemetry_is_running(void);
+
+/**
+ * @brief Appends a status payload to the store of its command, what the subscription consumer does.
+ * Also used to import captures
+ * @param payload zero padded to the size of the status struct
+ * @return 0 on success, -1 if the command is not recorded or not running
+ */
+int yapi_telemetry_record(yapi_command_enum_t command, int64_t timestamp_ns, const void* payload);
+
+/**
+ * @brief Passes the samples of a column to cb, from the store being recorded when it is this one, from
+ * the files otherwise
+ * @return samples passed, -1 on failure
+ */
+int64_t yapi_telemetry_scan(const char* directory, const char* stream, const char* column, int64_t from_ns,
+                            int64_t to_ns, gz_telemetry_scan_cb_t cb, void* context);
+
+/**
+ * @brief Watts per unit of a power column, from the unit suffix of its name (_dW, _cW, _W)
+ * @return 0 when it is not a power
+ */
+double yapi_telemetry_column_unit_W(const char* column);
+
+/**
+ * @brief Statistics of the store of a stream being recorded, or as it was closed by the last stop
+ * @return false when it is not recorded
+ */
+bool yapi_telemetry_get_stats(const char* stream, gz_telemetry_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YAPI_TELEMETRY_H
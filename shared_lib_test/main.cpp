@@ -1,6 +1,30 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include "gz_observer.h"
+#include "gz_array.h"
+#include "gz_window.h"
+#include "gz_rand.h"
+#include "gz_metrics.h"
+#include "gz_pool.h"
+#include "gz_telemetry.h"
+#include "gz_rollup.h"
+
+#define REGISTRY_THREAD_NOTIFICATIONS 100000
+#define METRICS_THREADS               4
+#define METRICS_THREAD_ADDS           100000
+#define POOL_BLOCKS                   64
+#define TELEMETRY_SAMPLES             200000      // two 64 bit random columns: past one 4 MiB segment
+#define TELEMETRY_COLUMNS             5
+#define ROLLUP_SAMPLES                300000      // about 50 min at 10 ms, buckets of every level
+#define ROLLUP_HISTORY                16
 
 static gz_observer_node_t* _observer = NULL;
 static void _cb_1(void *data) {
@@ -15,6 +39,285 @@ static void _cb_3(void *data) {
 static void _cb_4(void *data) {
   printf("Notify 4 [%s]\n", (char*)data);
 }
+static void _ctx_cb(void *context, void *data) {
+  printf("Notify ctx [%s] [%s]\n", (const char*)context, (char*)data);
+}
+
+static void* _rand_thread(void* arg) {
+  *(uint64_t*)arg = gzrand_u64();
+  return NULL;
+}
+
+static void* _metrics_thread(void* arg) {
+  for (int i = 0; i < METRICS_THREAD_ADDS; i++) {
+    gz_metrics_inc(*(int*)arg);
+  }
+  return NULL;
+}
+
+typedef struct {
+  gz_pool_t* pool;
+  void** blocks;
+  int count;
+} _Pool_Free_Args_t;
+
+/**
+ * @brief Frees blocks another thread allocated, its thread cache goes back to the pool when it exits
+ */
+static void* _pool_free_thread(void* arg) {
+  _Pool_Free_Args_t* args = (_Pool_Free_Args_t*)arg;
+  for (int i = 0; i < args->count; i++) {
+    gz_pool_free(args->pool, args->blocks[i]);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Allocates until the pool is empty, every block distinct and from the pool
+ * @return blocks allocated, -1 if one is wrong
+ */
+static int _pool_drain(gz_pool_t* pool, void** blocks) {
+  int count = 0;
+  while (count <= POOL_BLOCKS && (blocks[count] = gz_pool_alloc(pool)) != NULL) {
+    for (int i = 0; i < count; i++) {
+      if (blocks[i] == blocks[count]) {
+        return -1;
+      }
+    }
+    if (!gz_pool_owns(pool, blocks[count])) {
+      return -1;
+    }
+    memset(blocks[count], 0xA5, pool->block_size);
+    count++;
+  }
+  return count;
+}
+
+typedef struct __attribute__ ((packed)) {
+  int64_t s64;
+  uint64_t u64;
+  int8_t s8;
+  uint32_t u32;
+  int16_t s16;
+} _Telemetry_Record_t;
+
+static const gz_telemetry_column_t _telemetryColumns[TELEMETRY_COLUMNS] = {
+  { "s64", offsetof(_Telemetry_Record_t, s64), 8, true },
+  { "u64", offsetof(_Telemetry_Record_t, u64), 8, false },
+  { "s8", offsetof(_Telemetry_Record_t, s8), 1, true },
+  { "u32", offsetof(_Telemetry_Record_t, u32), 4, false },
+  { "s16", offsetof(_Telemetry_Record_t, s16), 2, true },
+};
+
+/**
+ * @brief The column values of a record as the store returns them: sign extended, unsigned 64 bit as its bits
+ */
+static void _telemetry_values(const _Telemetry_Record_t* record, int64_t* values) {
+  values[0] = record->s64;
+  values[1] = (int64_t)record->u64;
+  values[2] = record->s8;
+  values[3] = record->u32;
+  values[4] = record->s16;
+}
+
+/**
+ * @brief Writes records with the extremes of each type then random ones at irregular times, enough to fill
+ * more than one segment, and reads everything back from a read-only reopen
+ */
+static bool _telemetry_round_trip(const char* path) {
+  static _Telemetry_Record_t records[TELEMETRY_SAMPLES];
+  static int64_t times[TELEMETRY_SAMPLES];
+  static int64_t readTimes[TELEMETRY_SAMPLES];
+  static int64_t readValues[TELEMETRY_SAMPLES];
+  const _Telemetry_Record_t extremes[] = {
+    { INT64_MIN, 0, INT8_MIN, 0, INT16_MIN },
+    { INT64_MAX, UINT64_MAX, INT8_MAX, UINT32_MAX, INT16_MAX },
+    { INT64_MIN, UINT64_MAX, INT8_MIN, UINT32_MAX, INT16_MIN }, // deltas across the whole range
+    { -1, UINT64_MAX - 1, -1, UINT32_MAX - 1, -1 },
+    { 0, 0, 0, 0, 0 },
+  };
+  size_t extremeCount = sizeof(extremes) / sizeof(extremes[0]);
+  gz_xoshiro256_t rng;
+  gz_xoshiro256_seed(&rng, 44);
+  int64_t time = 1000000000LL;
+  for (int i = 0; i < TELEMETRY_SAMPLES; i++) {
+    if (i < (int)extremeCount) {
+      records[i] = extremes[i];
+    } else {
+      uint64_t r = gz_xoshiro256_next(&rng);
+      records[i].s64 = (int64_t)gz_xoshiro256_next(&rng);
+      records[i].u64 = gz_xoshiro256_next(&rng);
+      records[i].s8 = (int8_t)r;
+      records[i].u32 = (uint32_t)(r >> 8);
+      records[i].s16 = (int16_t)(r >> 40);
+    }
+    // Mostly about 10 ms apart, repeated timestamps and gaps of minutes in between
+    uint64_t jitter = gz_xoshiro256_next(&rng);
+    time += (jitter & 0xFF) == 0 ? (int64_t)(jitter >> 40) * 1000 : (jitter & 0x3F) == 1 ? 0 : 10000000 + (int64_t)(jitter >> 48);
+    times[i] = time;
+  }
+
+  gz_telemetry_t* store = gz_telemetry_open(path, _telemetryColumns, TELEMETRY_COLUMNS, 1000000000LL);
+  bool isOk = store != NULL;
+  for (int i = 0; isOk && i < TELEMETRY_SAMPLES; i++) {
+    isOk &= gz_telemetry_append(store, times[i], &records[i]) == 0;
+  }
+  isOk &= store && gz_telemetry_append(store, times[0], &records[0]) == -1; // older than the last one
+  gz_telemetry_stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  gz_telemetry_flush(store);
+  gz_telemetry_get_stats(store, &stats);
+  gz_telemetry_close(store);
+  printf("Telemetry: %llu samples in %u chunks, %u segments, %llu bytes\n", (unsigned long long)stats.samples,
+         stats.chunks, stats.segments, (unsigned long long)stats.storedBytes);
+  isOk &= stats.samples == TELEMETRY_SAMPLES && stats.rejected == 1 && stats.segments >= 2;
+
+  store = isOk ? gz_telemetry_open(path, NULL, 0, 0) : NULL;
+  isOk &= store != NULL;
+  int64_t first_ns = 0;
+  int64_t last_ns = 0;
+  isOk &= store && gz_telemetry_column_count(store) == TELEMETRY_COLUMNS && gz_telemetry_column_index(store, "s16") == 4 &&
+          gz_telemetry_get_range(store, &first_ns, &last_ns) && first_ns == times[0] &&
+          last_ns == times[TELEMETRY_SAMPLES - 1] && gz_telemetry_append(store, last_ns, &records[0]) == -1;
+  for (int column = 0; isOk && column < TELEMETRY_COLUMNS; column++) {
+    isOk &= gz_telemetry_query(store, column, INT64_MIN, INT64_MAX, readTimes, readValues, TELEMETRY_SAMPLES) ==
+            TELEMETRY_SAMPLES;
+    for (int i = 0; isOk && i < TELEMETRY_SAMPLES; i++) {
+      int64_t values[TELEMETRY_COLUMNS];
+      _telemetry_values(&records[i], values);
+      isOk &= readTimes[i] == times[i] && readValues[i] == values[column];
+    }
+  }
+  // A range inside the store: the samples with a time in it, whatever the chunks around them
+  int64_t expected = 0;
+  for (int i = 0; i < TELEMETRY_SAMPLES; i++) {
+    expected += times[i] >= times[1000] && times[i] <= times[150000];
+  }
+  isOk &= store && gz_telemetry_query(store, 0, times[1000], times[150000], readTimes, readValues, TELEMETRY_SAMPLES) ==
+          expected && readTimes[0] == times[1000];
+  gz_telemetry_close(store);
+
+  // A stream length past its chunk in a corrupt file: the scan fails instead of reading past the mapping
+  char firstSegment[300];
+  snprintf(firstSegment, sizeof(firstSegment), "%s.0", path);
+  uint32_t streamSize = 0xFFFFFFF0;
+  int fd = open(firstSegment, O_WRONLY);
+  isOk &= fd >= 0 && pwrite(fd, &streamSize, sizeof(streamSize), sizeof(gz_telemetry_segment_header_t) +
+                            TELEMETRY_COLUMNS * sizeof(gz_telemetry_column_desc_t) +
+                            sizeof(gz_telemetry_chunk_header_t)) == sizeof(streamSize);
+  if (fd >= 0) {
+    close(fd);
+  }
+  store = isOk ? gz_telemetry_open(path, NULL, 0, 0) : NULL;
+  isOk &= store && gz_telemetry_query(store, 1, INT64_MIN, INT64_MAX, readTimes, readValues, TELEMETRY_SAMPLES) == -1;
+  gz_telemetry_close(store);
+  gz_telemetry_stats_t noStats;
+  gz_telemetry_get_stats(NULL, &noStats);
+  isOk &= !gz_telemetry_get_range(NULL, &first_ns, &last_ns) && noStats.samples == 0 && noStats.chunks == 0;
+
+  for (uint16_t index = 0; index <= stats.segments; index++) {
+    char segment[300];
+    snprintf(segment, sizeof(segment), "%s.%u", path, index);
+    unlink(segment);
+  }
+  return isOk;
+}
+
+static void _rollup_closed_cb(void* context, gz_rollup_level_t level, const gz_rollup_bucket_t* bucket) {
+  ((std::vector<std::pair<int, gz_rollup_bucket_t> >*)context)->push_back(std::make_pair((int)level, *bucket));
+}
+
+static bool _rollup_bucket_equal(const gz_rollup_bucket_t* a, const gz_rollup_bucket_t* b) {
+  return a->start_ns == b->start_ns && a->count == b->count && a->min == b->min && a->max == b->max &&
+         a->sum == b->sum && a->last == b->last && a->integral_s == b->integral_s;
+}
+
+/**
+ * @brief The same series through gz_rollup_add_sample() one at a time and gz_rollup_add_samples() in batches
+ * of random sizes: every bucket closed, open and flushed must be the same, the integral to the bit
+ */
+static bool _rollup_batch_same(void) {
+  static int64_t times[ROLLUP_SAMPLES];
+  static int64_t values[ROLLUP_SAMPLES];
+  static gz_rollup_bucket_t historyOne[GZ_ROLLUP_LEVELS * ROLLUP_HISTORY];
+  static gz_rollup_bucket_t historyBatch[GZ_ROLLUP_LEVELS * ROLLUP_HISTORY];
+  const int64_t extremes[] = { INT64_MAX, INT64_MIN, 0, -1, 1, INT64_MAX, INT64_MAX, INT64_MAX }; // sums wrap
+  gz_xoshiro256_t rng;
+  gz_xoshiro256_seed(&rng, 45);
+  int64_t time = 999999999LL;
+  for (int i = 0; i < ROLLUP_SAMPLES; i++) {
+    uint64_t r = gz_xoshiro256_next(&rng);
+    values[i] = i < (int)(sizeof(extremes) / sizeof(extremes[0])) ? extremes[i] : (int32_t)r >> 8;
+    // About 10 ms apart, repeated timestamps, gaps past maxGap_ns and samples back in time now and then
+    uint64_t jitter = r >> 32;
+    time += (jitter & 0x3FF) == 0 ? 30000000000LL : (jitter & 0x3FF) == 1 ? -50000000LL :
+            (jitter & 0x3F) == 2 ? 0 : 10000000 + (int64_t)(jitter >> 16);
+    times[i] = time;
+  }
+
+  std::vector<std::pair<int, gz_rollup_bucket_t> > closedOne;
+  std::vector<std::pair<int, gz_rollup_bucket_t> > closedBatch;
+  gz_rollup_t one;
+  gz_rollup_t batch;
+  gz_rollup_init(&one, historyOne, ROLLUP_HISTORY, 0, _rollup_closed_cb, &closedOne);
+  gz_rollup_init(&batch, historyBatch, ROLLUP_HISTORY, 0, _rollup_closed_cb, &closedBatch);
+  uint32_t addedOne = 0;
+  uint32_t addedBatch = 0;
+  for (int i = 0; i < ROLLUP_SAMPLES; i++) {
+    addedOne += gz_rollup_add_sample(&one, times[i], values[i]);
+  }
+  for (uint32_t i = 0; i < ROLLUP_SAMPLES;) {
+    uint32_t count = 1 + gz_xoshiro256_bounded(&rng, 4096);
+    count = count < ROLLUP_SAMPLES - i ? count : ROLLUP_SAMPLES - i;
+    addedBatch += gz_rollup_add_samples(&batch, times + i, values + i, count);
+    i += count;
+  }
+  bool isOk = addedOne == addedBatch && one.rejected == batch.rejected && one.rejected > 0 &&
+              one.previous_ns == batch.previous_ns && one.previous == batch.previous;
+  for (int level = 0; level < GZ_ROLLUP_LEVELS; level++) {
+    gz_rollup_bucket_t a;
+    gz_rollup_bucket_t b;
+    bool hasOpen = gz_rollup_get_open(&one, (gz_rollup_level_t)level, &a);
+    isOk &= hasOpen == gz_rollup_get_open(&batch, (gz_rollup_level_t)level, &b) && (!hasOpen || _rollup_bucket_equal(&a, &b));
+  }
+  gz_rollup_flush(&one, time + 1000000000LL);
+  gz_rollup_flush(&batch, time + 1000000000LL);
+  isOk &= closedOne.size() == closedBatch.size() && closedOne.size() > ROLLUP_HISTORY;
+  for (size_t i = 0; isOk && i < closedOne.size(); i++) {
+    isOk &= closedOne[i].first == closedBatch[i].first &&
+            _rollup_bucket_equal(&closedOne[i].second, &closedBatch[i].second);
+  }
+  printf("Rollup: %u samples, %u rejected, %u buckets closed\n", addedOne, one.rejected, (unsigned)closedOne.size());
+  return isOk;
+}
+
+static void _metrics_append(void* context, const char* text, size_t length) {
+  ((std::string*)context)->append(text, length);
+}
+
+static void _count_cb(void *context, void *data) {
+  __atomic_add_fetch((uint64_t*)context, 1, __ATOMIC_RELAXED);
+}
+
+static gz_observer_registry_t _registry = GZ_OBSERVER_REGISTRY_INITIALIZER;
+static volatile bool _isNotifying = true;
+
+static void* _registry_notify_thread(void *arg) {
+  for (int i = 0; i < REGISTRY_THREAD_NOTIFICATIONS; i++) {
+    gz_observer_registry_notify(&_registry, NULL);
+  }
+  _isNotifying = false;
+  return NULL;
+}
+
+static void _async_ctx_cb(void *context, void *data) {
+  printf("Async notify [%s] event %d\n", (const char*)context, *(int*)data);
+}
+
+static void _async_slow_cb(void *data) {
+  usleep(1000);
+}
+
 uint8_t register_cb(void (*cb)(void *), const char *name) {
   printf("Registering callback [%s]\n\r", name);
   return gz_observer_add_to_list(&_observer, cb);
@@ -25,6 +328,42 @@ uint8_t unregister_cb(void (*cb)(void *), const char *name) {
   return gz_observer_remove_from_list(&_observer, cb);
 }
 
+/**
+ * @brief Every reduction of one type against a plain loop, over lengths up to 300 at unaligned offsets
+ */
+template <typename T, typename S>
+static bool _check_reductions(const char* name, T (*max)(const T*, size_t), T (*min)(const T*, size_t),
+                              S (*sum)(const T*, size_t), size_t (*argmax)(const T*, size_t), const T* data,
+                              size_t size) {
+  bool isOk = true;
+  for (size_t offset = 0; offset < 4; offset++) {
+    for (size_t count = 0; count + offset <= size && count <= 300; count++) {
+      const T* a = data + offset;
+      T expectMax = count ? a[0] : 0;
+      T expectMin = count ? a[0] : 0;
+      S expectSum = 0;
+      size_t expectArgmax = 0;
+      for (size_t i = 0; i < count; i++) {
+        if (a[i] > expectMax) {
+          expectMax = a[i];
+          expectArgmax = i;
+        }
+        expectMin = a[i] < expectMin ? a[i] : expectMin;
+        expectSum += a[i];
+      }
+      isOk &= max(a, count) == expectMax && min(a, count) == expectMin && sum(a, count) == expectSum &&
+              argmax(a, count) == expectArgmax;
+    }
+  }
+  S expectSum = 0;
+  for (size_t i = 0; i < size; i++) {
+    expectSum += data[i];
+  }
+  isOk &= sum(data, size) == expectSum;
+  printf("%s reductions: %s\n", name, isOk ? "OK" : "FAILED");
+  return isOk;
+}
+
 int main(int argc, char** argv) {
   printf("## CB registration and notify test ##\n\r");
   gz_observer_notify(_observer, NULL);
@@ -57,5 +396,286 @@ int main(int argc, char** argv) {
   printf("## Test NULL observer\r\n");
   gz_observer_add_to_list(NULL, NULL);
   printf("Test NULL observer: didn't crash\r\n");
-  return 0;
+
+  printf("## Registry priorities and contexts test ##\n\r");
+  gz_observer_registry_add(&_registry, _cb_1, 0);
+  gz_observer_registry_add(&_registry, _cb_2, 5);
+  gz_observer_registry_add_ctx(&_registry, _ctx_cb, (void*)"A", 0);
+  gz_observer_registry_add_ctx(&_registry, _ctx_cb, (void*)"B", -1);
+  printf("Total callbacks: %d (expect 2, 1, ctx A, ctx B)\n", gz_observer_registry_add(&_registry, _cb_3, 10) - 1);
+  gz_observer_registry_remove(&_registry, _cb_3);
+  gz_observer_registry_notify(&_registry, (void*)"data");
+  printf("Remove ctx A: %d left\n", gz_observer_registry_remove_ctx(&_registry, _ctx_cb, (void*)"A"));
+  printf("Remove unknown: %d left\n", gz_observer_registry_remove(&_registry, _cb_4));
+  gz_observer_registry_notify(&_registry, (void*)"data");
+  gz_observer_registry_destroy(&_registry);
+  printf("Registry destroyed: %d left\n", gz_observer_registry_count(&_registry));
+  gz_observer_registry_notify(&_registry, NULL);
+
+  printf("## Registry add/remove while another thread notifies ##\n\r");
+  uint64_t counts[2] = { 0, 0 };
+  pthread_t notifyThread;
+  gz_observer_registry_add_ctx(&_registry, _count_cb, &counts[0], 0);
+  pthread_create(&notifyThread, NULL, _registry_notify_thread, NULL);
+  int changes = 0;
+  while (_isNotifying) {
+    gz_observer_registry_add_ctx(&_registry, _count_cb, &counts[1], 0);
+    gz_observer_registry_remove_ctx(&_registry, _count_cb, &counts[1]);
+    changes++;
+  }
+  pthread_join(notifyThread, NULL);
+  printf("Permanent observer notified %llu times of %d, %d changes meanwhile\n", (unsigned long long)counts[0],
+         REGISTRY_THREAD_NOTIFICATIONS, changes);
+  gz_observer_registry_destroy(&_registry);
+
+  printf("## Async notify test ##\n\r");
+  gz_observer_async_t* async = gz_observer_async_create(sizeof(int), 16, 2);
+  gz_observer_async_add_ctx(async, _async_ctx_cb, (void*)"in order", 16);
+  printf("Total async observers: %d\n", gz_observer_async_add(async, _async_slow_cb, 1));
+  for (int event = 0; event < 10; event++) {
+    gz_observer_async_notify(async, &event, sizeof(event));
+  }
+  gz_observer_async_flush(async);
+  gz_observer_async_lag_t lags[2];
+  gz_observer_async_get_lags(async, lags, 2);
+  printf("Slow observer: %llu delivered + %llu coalesced (expect 10 total)\n", (unsigned long long)lags[1].delivered,
+         (unsigned long long)lags[1].coalesced);
+  printf("Remove slow: %d left\n", gz_observer_async_remove(async, _async_slow_cb));
+  printf("Oversized event: %d\n", gz_observer_async_notify(async, lags, sizeof(lags)));
+  gz_observer_async_destroy(async);
+  bool isAsyncOk = lags[0].delivered == 10 && lags[1].delivered + lags[1].coalesced == 10;
+
+  printf("## Window statistics test ##\n\r");
+  int16_t samples[20];
+  gz_window_avg_t<int16_t, 16> average, batchAverage;
+  gz_window_minmax_t<int16_t, 16> minmax, batchMinmax;
+  gz_welford_t welford, batchWelford;
+  gz_window_clear(average);
+  gz_window_clear(batchAverage);
+  gz_window_clear(minmax);
+  gz_window_clear(batchMinmax);
+  gz_welford_clear(welford);
+  gz_welford_clear(batchWelford);
+  for (int i = 0; i < 20; i++) {
+    samples[i] = (i % 2) ? 20 - i : i - 20;
+    gz_window_add_sample(average, samples[i]);
+    gz_window_add_sample(minmax, samples[i]);
+    gz_welford_add_sample(welford, samples[i]);
+  }
+  gz_window_add_samples(batchAverage, samples, 7);
+  gz_window_add_samples(batchAverage, samples + 7, 13);
+  gz_window_add_samples(batchMinmax, samples, 20);
+  gz_welford_add_samples(batchWelford, samples, 20);
+  printf("Last 16: mean %.2f/%.2f min %d/%d max %d/%d (expect -0.50 -16 15)\n", gz_window_mean(average),
+         gz_window_mean(batchAverage), gz_window_min(minmax), gz_window_min(batchMinmax), gz_window_max(minmax),
+         gz_window_max(batchMinmax));
+  printf("Variance %.3f/%.3f (expect 150.789)\n", gz_welford_variance(welford), gz_welford_variance(batchWelford));
+  TD_DATA_MVG_AVG_INT_16 legacy;
+  gzarray_moving_avg_obj_init(&legacy, 5);
+  for (int i = 0; i < 20; i++) {
+    gzarray_moving_avg_add_sample_i16(&legacy, samples[i]);
+  }
+  printf("gzarray 5 samples sum %d average %d (expect 3 0)\n", (int)legacy.sum, legacy.avg);
+  bool isLegacyOk = legacy.sum == 3 && legacy.avg == 0;
+  gzarray_moving_avg_clear(&legacy);
+  bool isLegacyCleared = true;
+  for (int i = 0; i < GZ_ARRAY_MVG_AVG_WINDOW_SIZE; i++) {
+    isLegacyCleared &= legacy.readings[i] == 0;
+  }
+  printf("gzarray clear: readings %s\n", isLegacyCleared ? "cleared" : "NOT cleared");
+  bool isWindowOk = gz_window_mean(average) == -0.5 && gz_window_mean(batchAverage) == -0.5 &&
+                    gz_window_min(minmax) == -16 && gz_window_min(batchMinmax) == -16 &&
+                    gz_window_max(minmax) == 15 && gz_window_max(batchMinmax) == 15 &&
+                    fabs(gz_welford_variance(batchWelford) - gz_welford_variance(welford)) < 1e-9 &&
+                    fabs(gz_welford_variance(welford) - 150.789) < 1e-3 && isLegacyOk && isLegacyCleared;
+  printf("## Array reductions test (%s) ##\n\r", gzarray_simd_name());
+  // Long enough for the 16 bit sums to flush their 32 bit lanes, extremes at both ends
+  const size_t reductionSize = 300000;
+  uint8_t* u8 = (uint8_t*)malloc(reductionSize);
+  uint16_t* u16 = (uint16_t*)malloc(reductionSize * sizeof(uint16_t));
+  int16_t* i16 = (int16_t*)malloc(reductionSize * sizeof(int16_t));
+  uint32_t* u32 = (uint32_t*)malloc(reductionSize * sizeof(uint32_t));
+  srand(47);
+  for (size_t i = 0; i < reductionSize; i++) {
+    uint32_t r = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    bool isExtreme = i > 300 && (r & 0x7);
+    u8[i] = isExtreme ? 0xFF : r;
+    u16[i] = isExtreme ? 0xFFFF : r;
+    i16[i] = isExtreme ? ((r & 0x8) ? INT16_MIN : INT16_MAX) : r;
+    u32[i] = isExtreme ? 0xFFFFFFFF : r;
+  }
+  bool isReduceOk = _check_reductions<uint8_t, uint64_t>("u8", gzarray_max_u8, gzarray_min_u8, gzarray_sum_u8,
+                                                         gzarray_argmax_u8, u8, reductionSize);
+  isReduceOk &= _check_reductions<uint16_t, uint64_t>("u16", gzarray_max_u16, gzarray_min_u16, gzarray_sum_u16,
+                                                      gzarray_argmax_u16, u16, reductionSize);
+  isReduceOk &= _check_reductions<int16_t, int64_t>("i16", gzarray_max_i16, gzarray_min_i16, gzarray_sum_i16,
+                                                    gzarray_argmax_i16, i16, reductionSize);
+  isReduceOk &= _check_reductions<uint32_t, uint64_t>("u32", gzarray_max_u32, gzarray_min_u32, gzarray_sum_u32,
+                                                      gzarray_argmax_u32, u32, reductionSize);
+  free(u8);
+  free(u16);
+  free(i16);
+  free(u32);
+  printf("## Random numbers test ##\n\r");
+  // Reference outputs: pcg32-demo seeded 42/54, xoshiro256** from the state {1, 2, 3, 4}
+  gz_pcg32_t pcg;
+  gz_pcg32_seed(&pcg, 42, 54);
+  const uint32_t pcgExpect[] = { 0xa15c02b7, 0x7b47f409, 0xba1d3330, 0x83d2f293, 0xbfa4784b, 0xcbed606e };
+  bool isRandOk = true;
+  for (size_t i = 0; i < arrayLength(pcgExpect); i++) {
+    isRandOk &= gz_pcg32_next(&pcg) == pcgExpect[i];
+  }
+  gz_xoshiro256_t xoshiro = { { 1, 2, 3, 4 } };
+  const uint64_t xoshiroExpect[] = { 11520, 0, 1509978240, 1215971899390074240ULL };
+  for (size_t i = 0; i < arrayLength(xoshiroExpect); i++) {
+    isRandOk &= gz_xoshiro256_next(&xoshiro) == xoshiroExpect[i];
+  }
+  printf("Reference sequences: %s\n", isRandOk ? "OK" : "FAILED");
+  // 3 out of 2^32 - 2^31 + 1 values is 1.5: a biased modulo makes 0 twice as likely as 2
+  uint32_t buckets[3] = { 0, 0, 0 };
+  for (int i = 0; i < 300000; i++) {
+    uint32_t value = gz_pcg32_bounded(&pcg, 3);
+    isRandOk &= value < 3;
+    buckets[value % 3]++;
+  }
+  for (int i = 0; i < 3; i++) {
+    isRandOk &= buckets[i] > 99000 && buckets[i] < 101000;
+  }
+  printf("Bounded [0, 3): %u %u %u\n", buckets[0], buckets[1], buckets[2]);
+  bool isRangeOk = gzrand_in_range(5, 5) == 5 && gzrand_in_range(6, 5) == 0;
+  for (int i = 0; i < 1000; i++) {
+    int value = gzrand_in_range(-3, 3);
+    isRangeOk &= value >= -3 && value <= 3 && gzrand() <= 32767;
+  }
+  gzrand_seed_uint(48);
+  uint64_t first = gzrand_u64();
+  uint64_t other = 0;
+  pthread_t randThread;
+  pthread_create(&randThread, NULL, _rand_thread, &other);
+  pthread_join(randThread, NULL);
+  gzrand_seed_uint(48);
+  isRangeOk &= gzrand_u64() == first && other != first;
+  printf("gzrand ranges, reseed, thread streams: %s\n", isRangeOk ? "OK" : "FAILED");
+  isRandOk &= isRangeOk;
+  printf("## Metrics test ##\n\r");
+  int counter = gz_metrics_counter("test_adds_total", "Adds of the test threads");
+  bool isMetricsOk = counter >= 0 && gz_metrics_counter("test_adds_total", NULL) == counter &&
+                     gz_metrics_gauge("test_adds_total", NULL) == -1;
+  pthread_t metricsThreads[METRICS_THREADS];
+  for (int i = 0; i < METRICS_THREADS; i++) {
+    pthread_create(&metricsThreads[i], NULL, _metrics_thread, &counter);
+  }
+  for (int i = 0; i < METRICS_THREADS; i++) {
+    pthread_join(metricsThreads[i], NULL);
+  }
+  gz_metrics_inc(-1);
+  printf("Counter over %d threads: %lld\n", METRICS_THREADS, (long long)gz_metrics_get(counter));
+  isMetricsOk &= gz_metrics_get(counter) == METRICS_THREADS * METRICS_THREAD_ADDS;
+  int family = gz_metrics_counter_family("test_family_total", NULL, "index", 4, NULL);
+  gz_metrics_add_at(family, 3, 7);
+  gz_metrics_add_at(family, 4, 7);
+  isMetricsOk &= gz_metrics_get_at(family, 3) == 7 && gz_metrics_get(family) == 7;
+  // Every value in its bucket: above the previous bucket, at most the bucket's upper bound
+  bool isBucketOk = true;
+  for (uint64_t value = 1; value < (1ULL << GZ_METRICS_HISTOGRAM_MAX_BITS); value = value * 3 / 2 + 1) {
+    uint16_t index = gz_metrics_histogram_index(value);
+    isBucketOk &= value <= gz_metrics_histogram_upper(index) && value > gz_metrics_histogram_upper(index - 1) &&
+                  gz_metrics_histogram_upper(index) - value <= value / 16;
+  }
+  // The largest value of the range is in the last bucket, the next one is the overflow
+  uint64_t top = (1ULL << GZ_METRICS_HISTOGRAM_MAX_BITS) - 1;
+  isBucketOk &= gz_metrics_histogram_index(top) == GZ_METRICS_HISTOGRAM_BUCKETS - 1 &&
+                gz_metrics_histogram_upper(GZ_METRICS_HISTOGRAM_BUCKETS - 1) == top &&
+                gz_metrics_histogram_index(top + 1) == GZ_METRICS_HISTOGRAM_BUCKETS;
+  int histogram = gz_metrics_histogram("test_latency_ns", "Values 1 to 1000");
+  for (uint64_t value = 1; value <= 1000; value++) {
+    gz_metrics_record(histogram, value);
+  }
+  static gz_metrics_histogram_t latencies;
+  gz_metrics_get_histogram(histogram, &latencies);
+  uint64_t p50 = gz_metrics_histogram_quantile(&latencies, 0.5);
+  uint64_t p99 = gz_metrics_histogram_quantile(&latencies, 0.99);
+  printf("Histogram: count[%llu] p50[%llu] p99[%llu] max[%llu], buckets %s\n", (unsigned long long)latencies.count,
+         (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)latencies.max,
+         isBucketOk ? "OK" : "FAILED");
+  isMetricsOk &= isBucketOk && latencies.count == 1000 && latencies.sum == 500500 && latencies.max == 1000 &&
+                 latencies.overflow == 0 && p50 >= 500 && p50 <= 500 + 500 / 16 && p99 >= 990 && p99 <= 1000;
+  int bounds = gz_metrics_histogram("test_bounds_ns", NULL);
+  gz_metrics_record(bounds, top);
+  gz_metrics_record(bounds, top + 1);
+  gz_metrics_get_histogram(bounds, &latencies);
+  isMetricsOk &= latencies.count == 2 && latencies.overflow == 1 && latencies.buckets[GZ_METRICS_HISTOGRAM_BUCKETS - 1] == 1 &&
+                 gz_metrics_histogram_quantile(&latencies, 0.5) == top;
+  std::string prometheus;
+  gz_metrics_dump(GZ_METRICS_FORMAT_PROMETHEUS, _metrics_append, &prometheus);
+  isMetricsOk &= prometheus.find("# TYPE test_latency_ns histogram\n") != std::string::npos &&
+                 prometheus.find("test_latency_ns_bucket{le=\"1023\"} 1000\n") != std::string::npos &&
+                 prometheus.find("test_family_total{index=\"3\"} 7\n") != std::string::npos &&
+                 prometheus.find("test_latency_ns_count 1000\n") != std::string::npos &&
+                 prometheus.find("test_bounds_ns_bucket{le=\"" + std::to_string(top) + "\"} 1\n") != std::string::npos &&
+                 prometheus.find("test_bounds_ns_bucket{le=\"+Inf\"} 2\n") != std::string::npos;
+  gz_metrics_reset();
+  gz_metrics_get_histogram(histogram, &latencies);
+  isMetricsOk &= gz_metrics_get(counter) == 0 && latencies.count == 0 && latencies.max == 0;
+  gz_metrics_inc(counter);
+  isMetricsOk &= gz_metrics_get(counter) == 1;
+  printf("Metrics: %s\n", isMetricsOk ? "OK" : "FAILED");
+
+  printf("## Block pool test ##\n\r");
+  static void* blocks[POOL_BLOCKS + 1];
+  static gz_pool_t pool;
+  gz_pool_stats_t poolStats;
+  gz_pool_init(&pool, 20, POOL_BLOCKS, NULL, GZ_POOL_FLAG_NONE);
+  int allocated = _pool_drain(&pool, blocks);
+  gz_pool_get_stats(&pool, &poolStats);
+  bool isPoolOk = pool.block_size == 24 && allocated == POOL_BLOCKS && poolStats.used == POOL_BLOCKS &&
+                  poolStats.failures == 1 && !gz_pool_owns(&pool, &pool);
+  gz_pool_free(&pool, blocks[5]);
+  isPoolOk &= gz_pool_alloc(&pool) == blocks[5]; // the last freed goes out first
+  for (int i = 0; i < POOL_BLOCKS; i++) {
+    gz_pool_free(&pool, blocks[i]);
+  }
+  gz_pool_get_stats(&pool, &poolStats);
+  isPoolOk &= poolStats.used == 0 && poolStats.high_water == POOL_BLOCKS && _pool_drain(&pool, blocks) == POOL_BLOCKS;
+  gz_pool_destroy(&pool);
+  printf("Free list: %s\n", isPoolOk ? "OK" : "FAILED");
+
+  gz_pool_init(&pool, 64, POOL_BLOCKS, NULL, GZ_POOL_FLAG_THREAD_CACHE);
+  void* cached = gz_pool_alloc(&pool);
+  gz_pool_get_stats(&pool, &poolStats);
+  bool isCacheOk = poolStats.used == GZ_POOL_THREAD_CACHE_BLOCKS / 2; // the refill is taken at once
+  gz_pool_free(&pool, cached);
+  isCacheOk &= gz_pool_alloc(&pool) == cached;
+  gz_pool_free(&pool, cached);
+  gz_pool_flush_thread_cache(&pool);
+  gz_pool_get_stats(&pool, &poolStats);
+  isCacheOk &= poolStats.used == 0;
+  // Every block through the cache, freed by another thread: they all come back to the pool
+  allocated = _pool_drain(&pool, blocks);
+  isCacheOk &= allocated == POOL_BLOCKS;
+  _Pool_Free_Args_t freeArgs = { &pool, blocks, allocated };
+  pthread_t poolThread;
+  pthread_create(&poolThread, NULL, _pool_free_thread, &freeArgs);
+  pthread_join(poolThread, NULL);
+  gz_pool_flush_thread_cache(&pool);
+  gz_pool_get_stats(&pool, &poolStats);
+  isCacheOk &= poolStats.used == 0 && _pool_drain(&pool, blocks) == POOL_BLOCKS;
+  gz_pool_destroy(&pool);
+  printf("Thread cache: %s\n", isCacheOk ? "OK" : "FAILED");
+
+  printf("## Telemetry store test ##\n\r");
+  char telemetryDir[] = "/tmp/gz_telemetry_test.XXXXXX";
+  bool isTelemetryOk = mkdtemp(telemetryDir) != NULL;
+  if (isTelemetryOk) {
+    std::string telemetryPath = std::string(telemetryDir) + "/store";
+    isTelemetryOk = _telemetry_round_trip(telemetryPath.c_str());
+    rmdir(telemetryDir);
+  }
+  printf("Telemetry round trip: %s\n", isTelemetryOk ? "OK" : "FAILED");
+
+  printf("## Rollup batch test ##\n\r");
+  bool isRollupOk = _rollup_batch_same();
+  printf("Rollup add_samples as add_sample: %s\n", isRollupOk ? "OK" : "FAILED");
+  return counts[0] == REGISTRY_THREAD_NOTIFICATIONS && isAsyncOk && isWindowOk && isReduceOk && isRandOk &&
+         isMetricsOk && isPoolOk && isCacheOk && isTelemetryOk && isRollupOk ? 0 : 1;
 }
\ No newline at end of file
@@ -6,18 +6,6 @@
 #pragma message "Using the default averaging window size of 16"
 #endif
 
-uint16_t gzarray_max_u16(uint16_t *a, uint8_t num_elements) {
-  uint8_t i;
-  uint16_t max = 0;
-
-  for (i = 0; i < num_elements; i++) {
-    if (a[i] > max) {
-      max = a[i];
-    }
-  }
-  return (max);
-}
-
 bool gzarray_moving_avg_clear(void* pMvgAvg) {
   if (pMvgAvg == NULL) {
     return false;
@@ -32,13 +20,13 @@ bool gzarray_moving_avg_clear(void* pMvgAvg) {
   temp->avg = 0;
   temp->pos = 0;
   temp->sum = 0;
-  memset(temp->readings, 0, sizeof(temp->usable_window_size));
+  memset(temp->readings, 0, sizeof(temp->readings));
 
   return true;
 }
 
 bool gzarray_moving_avg_obj_init(void* pMvgAvg, uint8_t windowSize) {
-  if (pMvgAvg == NULL || windowSize > GZ_ARRAY_MVG_AVG_WINDOW_SIZE) {
+  if (pMvgAvg == NULL || windowSize == 0 || windowSize > GZ_ARRAY_MVG_AVG_WINDOW_SIZE) {
     return false;
   }
 
@@ -63,8 +51,9 @@ bool gzarray_moving_avg_add_sample_i16(TD_DATA_MVG_AVG_INT_16* pMvgAvg, int16_t
   pMvgAvg->sum += datum;
   pMvgAvg->avg = pMvgAvg->sum / pMvgAvg->numValidSamples;
 
-  pMvgAvg->pos++;
-  pMvgAvg->pos %= pMvgAvg->usable_window_size;
+  if (++pMvgAvg->pos >= pMvgAvg->usable_window_size) {
+    pMvgAvg->pos = 0;
+  }
 
   return true;
 }
@@ -85,8 +74,9 @@ bool gzarray_moving_avg_add_sample_u16(TD_DATA_MVG_AVG_UINT_16* pMvgAvg, uint16_
   pMvgAvg->sum += datum;
   pMvgAvg->avg = pMvgAvg->sum / pMvgAvg->numValidSamples;
 
-  pMvgAvg->pos++;
-  pMvgAvg->pos %= pMvgAvg->usable_window_size;
+  if (++pMvgAvg->pos >= pMvgAvg->usable_window_size) {
+    pMvgAvg->pos = 0;
+  }
 
   return true;
 }
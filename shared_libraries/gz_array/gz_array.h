@@ -18,9 +18,16 @@ extern "C" {
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #define arrayLength(x) (sizeof(x)/sizeof(x[0]))
 
+/**
+ * Reductions over arrays of any length: max, min, sum and argmax (index of the first max).
+ * SSE2 on x86 (AVX2 when the CPU has it), NEON on aarch64, a portable loop elsewhere or with
+ * GZ_ARRAY_NO_SIMD defined. The max and min of an empty array are 0, so is its argmax.
+ */
+
 /**
  * @brief get the value of element with the max uint16_t value of the given array
  * 
@@ -28,7 +35,30 @@ extern "C" {
  * @param num_elements 
  * @return uint16_t 
  */
-uint16_t gzarray_max_u16(uint16_t *a, uint8_t num_elements);
+uint16_t gzarray_max_u16(const uint16_t *a, size_t num_elements);
+uint16_t gzarray_min_u16(const uint16_t *a, size_t num_elements);
+uint64_t gzarray_sum_u16(const uint16_t *a, size_t num_elements);
+size_t gzarray_argmax_u16(const uint16_t *a, size_t num_elements);
+
+uint8_t gzarray_max_u8(const uint8_t *a, size_t num_elements);
+uint8_t gzarray_min_u8(const uint8_t *a, size_t num_elements);
+uint64_t gzarray_sum_u8(const uint8_t *a, size_t num_elements);
+size_t gzarray_argmax_u8(const uint8_t *a, size_t num_elements);
+
+int16_t gzarray_max_i16(const int16_t *a, size_t num_elements);
+int16_t gzarray_min_i16(const int16_t *a, size_t num_elements);
+int64_t gzarray_sum_i16(const int16_t *a, size_t num_elements);
+size_t gzarray_argmax_i16(const int16_t *a, size_t num_elements);
+
+uint32_t gzarray_max_u32(const uint32_t *a, size_t num_elements);
+uint32_t gzarray_min_u32(const uint32_t *a, size_t num_elements);
+uint64_t gzarray_sum_u32(const uint32_t *a, size_t num_elements);
+size_t gzarray_argmax_u32(const uint32_t *a, size_t num_elements);
+
+/**
+ * @brief Instruction set the reductions run with on this machine: "avx2", "sse2", "neon" or "scalar"
+ */
+const char* gzarray_simd_name(void);
 
 // It is recommended that this is set by the project settings as a pre-defined macro
 // passed to the compiler so that this submodule remains portable
@@ -37,7 +67,8 @@ uint16_t gzarray_max_u16(uint16_t *a, uint8_t num_elements);
 #define GZ_ARRAY_MVG_AVG_WINDOW_SIZE  16
 #endif
 
-typedef struct __attribute__ ((packed)) {
+// Not packed: sum and readings are read and written on every sample
+typedef struct {
   uint8_t usable_window_size;
   uint8_t pos;
   uint8_t numValidSamples;
@@ -46,7 +77,7 @@ typedef struct __attribute__ ((packed)) {
   int16_t readings[GZ_ARRAY_MVG_AVG_WINDOW_SIZE];
 } TD_DATA_MVG_AVG_INT_16;
 
-typedef struct __attribute__ ((packed)) {
+typedef struct {
   uint8_t usable_window_size;
   uint8_t pos;
   uint8_t numValidSamples;
@@ -69,7 +100,7 @@ bool gzarray_moving_avg_clear(void* pMvgAvg);
  * allocated by the calling code.
  * 
  * @param pMvgAvg A pointer to the caller allocated averaging object.
- * @param windowSize Must be <= to the defined DATA_MVG_AVG_WINDOW_SIZE. This is the 
+ * @param windowSize Must be <= to the defined DATA_MVG_AVG_WINDOW_SIZE, and not 0. This is the
  * desired size of the averaging buffer.
  * @return Returns true if the operation was successful, false otherwise.
  */
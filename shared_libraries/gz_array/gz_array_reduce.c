@@ -0,0 +1,487 @@
+/**
+ * @file gz_array_reduce.c
+ * @brief Max/min/sum/argmax reductions of gz_array.h
+ *
+ * Every reduction has a portable loop, the reference, and vector kernels that run whole vectors and leave
+ * the tail to it. x86: SSE2 is always there on x86_64, the AVX2 kernels are compiled for that target only and
+ * picked at run time. SSE2 has no unsigned 16/32 bit max/min: the values are biased into signed ones.
+ * Sums widen as they go: 8 bit ones through sum of absolute differences, 16 bit ones as 32 bit pair sums
+ * (madd, pairwise add long) flushed to 64 bits before they can overflow.
+ *
+ * @copyright Copyright (c) Goal Zero | 2022
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "gz_array.h"
+
+#if !defined(GZ_ARRAY_NO_SIMD)
+#if defined(__SSE2__)
+#define GZ_ARRAY_SSE2
+#if defined(__GNUC__)
+#define GZ_ARRAY_AVX2
+#endif
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define GZ_ARRAY_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#ifdef GZ_ARRAY_AVX2
+#define GZ_ARRAY_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+// Vectors of 16 bit pair sums added into 32 bit lanes before they are flushed: |lane| < 2^31
+#define GZ_ARRAY_PAIR_SUM_BLOCK 16384
+
+/*****************************************************/
+/* Section: Portable loops                           */
+/*****************************************************/
+
+#define GZ_ARRAY_SCALAR_REDUCTIONS(suffix, type, sum_t) \
+static type _gzarray_max_##suffix##_scalar(const type* a, size_t count) { \
+  type max = count ? a[0] : 0; \
+  for (size_t i = 1; i < count; i++) { \
+    max = a[i] > max ? a[i] : max; \
+  } \
+  return max; \
+} \
+static type _gzarray_min_##suffix##_scalar(const type* a, size_t count) { \
+  type min = count ? a[0] : 0; \
+  for (size_t i = 1; i < count; i++) { \
+    min = a[i] < min ? a[i] : min; \
+  } \
+  return min; \
+} \
+static sum_t _gzarray_sum_##suffix##_scalar(const type* a, size_t count) { \
+  sum_t sum = 0; \
+  for (size_t i = 0; i < count; i++) { \
+    sum += a[i]; \
+  } \
+  return sum; \
+} \
+static size_t _gzarray_find_##suffix##_scalar(const type* a, size_t count, type value) { \
+  size_t i = 0; \
+  while (i < count && a[i] != value) { \
+    i++; \
+  } \
+  return i; \
+}
+
+GZ_ARRAY_SCALAR_REDUCTIONS(u8, uint8_t, uint64_t)
+GZ_ARRAY_SCALAR_REDUCTIONS(u16, uint16_t, uint64_t)
+GZ_ARRAY_SCALAR_REDUCTIONS(i16, int16_t, int64_t)
+GZ_ARRAY_SCALAR_REDUCTIONS(u32, uint32_t, uint64_t)
+
+/*****************************************************/
+/* Section: SSE2                                     */
+/*****************************************************/
+
+#ifdef GZ_ARRAY_SSE2
+
+static inline __m128i _gzarray_max_epi32_sse2(__m128i a, __m128i b) {
+  __m128i isGreater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(isGreater, a), _mm_andnot_si128(isGreater, b));
+}
+
+static inline __m128i _gzarray_min_epi32_sse2(__m128i a, __m128i b) {
+  __m128i isGreater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(isGreater, b), _mm_andnot_si128(isGreater, a));
+}
+
+/**
+ * @brief Max or min of the whole vectors, biased by `bias` (0 or the sign bit), then of the lanes and the tail
+ */
+#define GZ_ARRAY_SSE2_EXTREME(name, suffix, type, bias, pick, scalar, better) \
+static type name(const type* a, size_t count) { \
+  const size_t lanes = sizeof(__m128i) / sizeof(type); \
+  if (count < lanes) { \
+    return scalar(a, count); \
+  } \
+  const __m128i offset = bias; \
+  __m128i result = _mm_xor_si128(_mm_loadu_si128((const __m128i*)a), offset); \
+  size_t i = lanes; \
+  for (; i + lanes <= count; i += lanes) { \
+    result = pick(result, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), offset)); \
+  } \
+  type lane[sizeof(__m128i) / sizeof(type)]; \
+  _mm_storeu_si128((__m128i*)lane, _mm_xor_si128(result, offset)); \
+  type extreme = scalar(lane, lanes); \
+  if (i < count) { \
+    type tail = scalar(a + i, count - i); \
+    extreme = tail better extreme ? tail : extreme; \
+  } \
+  return extreme; \
+}
+
+GZ_ARRAY_SSE2_EXTREME(_gzarray_max_u8_sse2, u8, uint8_t, _mm_setzero_si128(), _mm_max_epu8,
+                      _gzarray_max_u8_scalar, >)
+GZ_ARRAY_SSE2_EXTREME(_gzarray_min_u8_sse2, u8, uint8_t, _mm_setzero_si128(), _mm_min_epu8,
+                      _gzarray_min_u8_scalar, <)
+GZ_ARRAY_SSE2_EXTREME(_gzarray_max_u16_sse2, u16, uint16_t, _mm_set1_epi16((short)0x8000), _mm_max_epi16,
+                      _gzarray_max_u16_scalar, >)
+GZ_ARRAY_SSE2_EXTREME(_gzarray_min_u16_sse2, u16, uint16_t, _mm_set1_epi16((short)0x8000), _mm_min_epi16,
+                      _gzarray_min_u16_scalar, <)
+GZ_ARRAY_SSE2_EXTREME(_gzarray_max_i16_sse2, i16, int16_t, _mm_setzero_si128(), _mm_max_epi16,
+                      _gzarray_max_i16_scalar, >)
+GZ_ARRAY_SSE2_EXTREME(_gzarray_min_i16_sse2, i16, int16_t, _mm_setzero_si128(), _mm_min_epi16,
+                      _gzarray_min_i16_scalar, <)
+GZ_ARRAY_SSE2_EXTREME(_gzarray_max_u32_sse2, u32, uint32_t, _mm_set1_epi32((int)0x80000000), _gzarray_max_epi32_sse2,
+                      _gzarray_max_u32_scalar, >)
+GZ_ARRAY_SSE2_EXTREME(_gzarray_min_u32_sse2, u32, uint32_t, _mm_set1_epi32((int)0x80000000), _gzarray_min_epi32_sse2,
+                      _gzarray_min_u32_scalar, <)
+
+static uint64_t _gzarray_sum_u8_sse2(const uint8_t* a, size_t count) {
+  __m128i sum = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_setzero_si128()));
+  }
+  uint64_t lane[2];
+  _mm_storeu_si128((__m128i*)lane, sum);
+  return lane[0] + lane[1] + _gzarray_sum_u8_scalar(a + i, count - i);
+}
+
+/**
+ * @brief Sum of 16 bit values, unsigned ones biased to signed: pair sums in 32 bit lanes, flushed every block
+ */
+static int64_t _gzarray_sum_16_sse2(const int16_t* a, size_t count, __m128i bias, size_t* summed) {
+  int64_t total = 0;
+  size_t i = 0;
+  while (i + 8 <= count) {
+    __m128i sum = _mm_setzero_si128();
+    for (size_t block = 0; block < GZ_ARRAY_PAIR_SUM_BLOCK && i + 8 <= count; block++, i += 8) {
+      __m128i values = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), bias);
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(values, _mm_set1_epi16(1)));
+    }
+    int32_t lane[4];
+    _mm_storeu_si128((__m128i*)lane, sum);
+    total += (int64_t)lane[0] + lane[1] + lane[2] + lane[3];
+  }
+  *summed = i;
+  return total;
+}
+
+static int64_t _gzarray_sum_i16_sse2(const int16_t* a, size_t count) {
+  size_t summed;
+  int64_t sum = _gzarray_sum_16_sse2(a, count, _mm_setzero_si128(), &summed);
+  return sum + _gzarray_sum_i16_scalar(a + summed, count - summed);
+}
+
+static uint64_t _gzarray_sum_u16_sse2(const uint16_t* a, size_t count) {
+  size_t summed;
+  int64_t sum = _gzarray_sum_16_sse2((const int16_t*)a, count, _mm_set1_epi16((short)0x8000), &summed);
+  return (uint64_t)(sum + 32768 * (int64_t)summed) + _gzarray_sum_u16_scalar(a + summed, count - summed);
+}
+
+static uint64_t _gzarray_sum_u32_sse2(const uint32_t* a, size_t count) {
+  __m128i sum = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i values = _mm_loadu_si128((const __m128i*)(a + i));
+    sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(values, _mm_setzero_si128()));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(values, _mm_setzero_si128()));
+  }
+  uint64_t lane[2];
+  _mm_storeu_si128((__m128i*)lane, sum);
+  return lane[0] + lane[1] + _gzarray_sum_u32_scalar(a + i, count - i);
+}
+
+/**
+ * @brief Index of the first element equal to value: compare a vector, the byte mask gives the element
+ */
+#define GZ_ARRAY_SSE2_FIND(suffix, type, set1, cmpeq) \
+static size_t _gzarray_find_##suffix##_sse2(const type* a, size_t count, type value) { \
+  const size_t lanes = sizeof(__m128i) / sizeof(type); \
+  const __m128i target = set1(value); \
+  size_t i = 0; \
+  for (; i + lanes <= count; i += lanes) { \
+    int mask = _mm_movemask_epi8(cmpeq(_mm_loadu_si128((const __m128i*)(a + i)), target)); \
+    if (mask) { \
+      return i + __builtin_ctz(mask) / sizeof(type); \
+    } \
+  } \
+  return i + _gzarray_find_##suffix##_scalar(a + i, count - i, value); \
+}
+
+GZ_ARRAY_SSE2_FIND(u8, uint8_t, _mm_set1_epi8, _mm_cmpeq_epi8)
+GZ_ARRAY_SSE2_FIND(u16, uint16_t, _mm_set1_epi16, _mm_cmpeq_epi16)
+GZ_ARRAY_SSE2_FIND(i16, int16_t, _mm_set1_epi16, _mm_cmpeq_epi16)
+GZ_ARRAY_SSE2_FIND(u32, uint32_t, _mm_set1_epi32, _mm_cmpeq_epi32)
+
+#endif // GZ_ARRAY_SSE2
+
+/*****************************************************/
+/* Section: AVX2                                     */
+/*****************************************************/
+
+#ifdef GZ_ARRAY_AVX2
+
+#define GZ_ARRAY_AVX2_EXTREME(name, type, pick, scalar, better) \
+GZ_ARRAY_AVX2_TARGET static type name(const type* a, size_t count) { \
+  const size_t lanes = sizeof(__m256i) / sizeof(type); \
+  if (count < lanes) { \
+    return scalar(a, count); \
+  } \
+  __m256i result = _mm256_loadu_si256((const __m256i*)a); \
+  size_t i = lanes; \
+  for (; i + lanes <= count; i += lanes) { \
+    result = pick(result, _mm256_loadu_si256((const __m256i*)(a + i))); \
+  } \
+  type lane[sizeof(__m256i) / sizeof(type)]; \
+  _mm256_storeu_si256((__m256i*)lane, result); \
+  type extreme = scalar(lane, lanes); \
+  if (i < count) { \
+    type tail = scalar(a + i, count - i); \
+    extreme = tail better extreme ? tail : extreme; \
+  } \
+  return extreme; \
+}
+
+GZ_ARRAY_AVX2_EXTREME(_gzarray_max_u8_avx2, uint8_t, _mm256_max_epu8, _gzarray_max_u8_scalar, >)
+GZ_ARRAY_AVX2_EXTREME(_gzarray_min_u8_avx2, uint8_t, _mm256_min_epu8, _gzarray_min_u8_scalar, <)
+GZ_ARRAY_AVX2_EXTREME(_gzarray_max_u16_avx2, uint16_t, _mm256_max_epu16, _gzarray_max_u16_scalar, >)
+GZ_ARRAY_AVX2_EXTREME(_gzarray_min_u16_avx2, uint16_t, _mm256_min_epu16, _gzarray_min_u16_scalar, <)
+GZ_ARRAY_AVX2_EXTREME(_gzarray_max_i16_avx2, int16_t, _mm256_max_epi16, _gzarray_max_i16_scalar, >)
+GZ_ARRAY_AVX2_EXTREME(_gzarray_min_i16_avx2, int16_t, _mm256_min_epi16, _gzarray_min_i16_scalar, <)
+GZ_ARRAY_AVX2_EXTREME(_gzarray_max_u32_avx2, uint32_t, _mm256_max_epu32, _gzarray_max_u32_scalar, >)
+GZ_ARRAY_AVX2_EXTREME(_gzarray_min_u32_avx2, uint32_t, _mm256_min_epu32, _gzarray_min_u32_scalar, <)
+
+GZ_ARRAY_AVX2_TARGET static uint64_t _gzarray_sum_u8_avx2(const uint8_t* a, size_t count) {
+  __m256i sum = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_setzero_si256()));
+  }
+  uint64_t lane[4];
+  _mm256_storeu_si256((__m256i*)lane, sum);
+  return lane[0] + lane[1] + lane[2] + lane[3] + _gzarray_sum_u8_scalar(a + i, count - i);
+}
+
+GZ_ARRAY_AVX2_TARGET static int64_t _gzarray_sum_16_avx2(const int16_t* a, size_t count, __m256i bias,
+                                                         size_t* summed) {
+  int64_t total = 0;
+  size_t i = 0;
+  while (i + 16 <= count) {
+    __m256i sum = _mm256_setzero_si256();
+    for (size_t block = 0; block < GZ_ARRAY_PAIR_SUM_BLOCK && i + 16 <= count; block++, i += 16) {
+      __m256i values = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)), bias);
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(values, _mm256_set1_epi16(1)));
+    }
+    __m256i wide = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(sum)),
+                                    _mm256_cvtepi32_epi64(_mm256_extracti128_si256(sum, 1)));
+    int64_t lane[4];
+    _mm256_storeu_si256((__m256i*)lane, wide);
+    total += lane[0] + lane[1] + lane[2] + lane[3];
+  }
+  *summed = i;
+  return total;
+}
+
+GZ_ARRAY_AVX2_TARGET static int64_t _gzarray_sum_i16_avx2(const int16_t* a, size_t count) {
+  size_t summed;
+  int64_t sum = _gzarray_sum_16_avx2(a, count, _mm256_setzero_si256(), &summed);
+  return sum + _gzarray_sum_i16_scalar(a + summed, count - summed);
+}
+
+GZ_ARRAY_AVX2_TARGET static uint64_t _gzarray_sum_u16_avx2(const uint16_t* a, size_t count) {
+  size_t summed;
+  int64_t sum = _gzarray_sum_16_avx2((const int16_t*)a, count, _mm256_set1_epi16((short)0x8000), &summed);
+  return (uint64_t)(sum + 32768 * (int64_t)summed) + _gzarray_sum_u16_scalar(a + summed, count - summed);
+}
+
+GZ_ARRAY_AVX2_TARGET static uint64_t _gzarray_sum_u32_avx2(const uint32_t* a, size_t count) {
+  __m256i sum = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i values = _mm256_loadu_si256((const __m256i*)(a + i));
+    sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(values)));
+    sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(values, 1)));
+  }
+  uint64_t lane[4];
+  _mm256_storeu_si256((__m256i*)lane, sum);
+  return lane[0] + lane[1] + lane[2] + lane[3] + _gzarray_sum_u32_scalar(a + i, count - i);
+}
+
+#define GZ_ARRAY_AVX2_FIND(suffix, type, set1, cmpeq) \
+GZ_ARRAY_AVX2_TARGET static size_t _gzarray_find_##suffix##_avx2(const type* a, size_t count, type value) { \
+  const size_t lanes = sizeof(__m256i) / sizeof(type); \
+  const __m256i target = set1(value); \
+  size_t i = 0; \
+  for (; i + lanes <= count; i += lanes) { \
+    uint32_t mask = _mm256_movemask_epi8(cmpeq(_mm256_loadu_si256((const __m256i*)(a + i)), target)); \
+    if (mask) { \
+      return i + __builtin_ctz(mask) / sizeof(type); \
+    } \
+  } \
+  return i + _gzarray_find_##suffix##_scalar(a + i, count - i, value); \
+}
+
+GZ_ARRAY_AVX2_FIND(u8, uint8_t, _mm256_set1_epi8, _mm256_cmpeq_epi8)
+GZ_ARRAY_AVX2_FIND(u16, uint16_t, _mm256_set1_epi16, _mm256_cmpeq_epi16)
+GZ_ARRAY_AVX2_FIND(i16, int16_t, _mm256_set1_epi16, _mm256_cmpeq_epi16)
+GZ_ARRAY_AVX2_FIND(u32, uint32_t, _mm256_set1_epi32, _mm256_cmpeq_epi32)
+
+static bool _gzarray_has_avx2(void) {
+  static int hasAvx2 = -1;
+  if (hasAvx2 < 0) {
+    __builtin_cpu_init();
+    hasAvx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  return hasAvx2;
+}
+
+#endif // GZ_ARRAY_AVX2
+
+/*****************************************************/
+/* Section: NEON                                     */
+/*****************************************************/
+
+#ifdef GZ_ARRAY_NEON
+
+#define GZ_ARRAY_NEON_EXTREME(name, type, vector_t, load, pick, across, scalar, better) \
+static type name(const type* a, size_t count) { \
+  const size_t lanes = 16 / sizeof(type); \
+  if (count < lanes) { \
+    return scalar(a, count); \
+  } \
+  vector_t result = load(a); \
+  size_t i = lanes; \
+  for (; i + lanes <= count; i += lanes) { \
+    result = pick(result, load(a + i)); \
+  } \
+  type extreme = across(result); \
+  if (i < count) { \
+    type tail = scalar(a + i, count - i); \
+    extreme = tail better extreme ? tail : extreme; \
+  } \
+  return extreme; \
+}
+
+GZ_ARRAY_NEON_EXTREME(_gzarray_max_u8_neon, uint8_t, uint8x16_t, vld1q_u8, vmaxq_u8, vmaxvq_u8,
+                      _gzarray_max_u8_scalar, >)
+GZ_ARRAY_NEON_EXTREME(_gzarray_min_u8_neon, uint8_t, uint8x16_t, vld1q_u8, vminq_u8, vminvq_u8,
+                      _gzarray_min_u8_scalar, <)
+GZ_ARRAY_NEON_EXTREME(_gzarray_max_u16_neon, uint16_t, uint16x8_t, vld1q_u16, vmaxq_u16, vmaxvq_u16,
+                      _gzarray_max_u16_scalar, >)
+GZ_ARRAY_NEON_EXTREME(_gzarray_min_u16_neon, uint16_t, uint16x8_t, vld1q_u16, vminq_u16, vminvq_u16,
+                      _gzarray_min_u16_scalar, <)
+GZ_ARRAY_NEON_EXTREME(_gzarray_max_i16_neon, int16_t, int16x8_t, vld1q_s16, vmaxq_s16, vmaxvq_s16,
+                      _gzarray_max_i16_scalar, >)
+GZ_ARRAY_NEON_EXTREME(_gzarray_min_i16_neon, int16_t, int16x8_t, vld1q_s16, vminq_s16, vminvq_s16,
+                      _gzarray_min_i16_scalar, <)
+GZ_ARRAY_NEON_EXTREME(_gzarray_max_u32_neon, uint32_t, uint32x4_t, vld1q_u32, vmaxq_u32, vmaxvq_u32,
+                      _gzarray_max_u32_scalar, >)
+GZ_ARRAY_NEON_EXTREME(_gzarray_min_u32_neon, uint32_t, uint32x4_t, vld1q_u32, vminq_u32, vminvq_u32,
+                      _gzarray_min_u32_scalar, <)
+
+// Pairwise add long into 16 bit lanes, at most 510 a vector
+#define GZ_ARRAY_NEON_U8_BLOCK 128
+
+static uint64_t _gzarray_sum_u8_neon(const uint8_t* a, size_t count) {
+  uint64_t total = 0;
+  size_t i = 0;
+  while (i + 16 <= count) {
+    uint16x8_t sum = vdupq_n_u16(0);
+    for (size_t block = 0; block < GZ_ARRAY_NEON_U8_BLOCK && i + 16 <= count; block++, i += 16) {
+      sum = vpadalq_u8(sum, vld1q_u8(a + i));
+    }
+    total += vaddlvq_u16(sum);
+  }
+  return total + _gzarray_sum_u8_scalar(a + i, count - i);
+}
+
+static uint64_t _gzarray_sum_u16_neon(const uint16_t* a, size_t count) {
+  uint64_t total = 0;
+  size_t i = 0;
+  while (i + 8 <= count) {
+    uint32x4_t sum = vdupq_n_u32(0);
+    for (size_t block = 0; block < GZ_ARRAY_PAIR_SUM_BLOCK && i + 8 <= count; block++, i += 8) {
+      sum = vpadalq_u16(sum, vld1q_u16(a + i));
+    }
+    total += vaddlvq_u32(sum);
+  }
+  return total + _gzarray_sum_u16_scalar(a + i, count - i);
+}
+
+static int64_t _gzarray_sum_i16_neon(const int16_t* a, size_t count) {
+  int64_t total = 0;
+  size_t i = 0;
+  while (i + 8 <= count) {
+    int32x4_t sum = vdupq_n_s32(0);
+    for (size_t block = 0; block < GZ_ARRAY_PAIR_SUM_BLOCK && i + 8 <= count; block++, i += 8) {
+      sum = vpadalq_s16(sum, vld1q_s16(a + i));
+    }
+    total += vaddlvq_s32(sum);
+  }
+  return total + _gzarray_sum_i16_scalar(a + i, count - i);
+}
+
+static uint64_t _gzarray_sum_u32_neon(const uint32_t* a, size_t count) {
+  uint64x2_t sum = vdupq_n_u64(0);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    sum = vpadalq_u32(sum, vld1q_u32(a + i));
+  }
+  return vaddvq_u64(sum) + _gzarray_sum_u32_scalar(a + i, count - i);
+}
+
+#endif // GZ_ARRAY_NEON
+
+/*****************************************************/
+/* Section: Public functions                         */
+/*****************************************************/
+
+#if defined(GZ_ARRAY_AVX2)
+#define GZ_ARRAY_DISPATCH(kernel, ...) \
+  return _gzarray_has_avx2() ? _gzarray_##kernel##_avx2(__VA_ARGS__) : _gzarray_##kernel##_sse2(__VA_ARGS__)
+#elif defined(GZ_ARRAY_SSE2)
+#define GZ_ARRAY_DISPATCH(kernel, ...) return _gzarray_##kernel##_sse2(__VA_ARGS__)
+#elif defined(GZ_ARRAY_NEON)
+#define GZ_ARRAY_DISPATCH(kernel, ...) return _gzarray_##kernel##_neon(__VA_ARGS__)
+#else
+#define GZ_ARRAY_DISPATCH(kernel, ...) return _gzarray_##kernel##_scalar(__VA_ARGS__)
+#endif
+
+// A NEON compare gives no byte mask to locate the element, the first max is searched with the loop there
+#if defined(GZ_ARRAY_NEON)
+#define GZ_ARRAY_DISPATCH_FIND(kernel, ...) return _gzarray_##kernel##_scalar(__VA_ARGS__)
+#else
+#define GZ_ARRAY_DISPATCH_FIND GZ_ARRAY_DISPATCH
+#endif
+
+#define GZ_ARRAY_REDUCTIONS(suffix, type, sum_t) \
+type gzarray_max_##suffix(const type *a, size_t num_elements) { \
+  GZ_ARRAY_DISPATCH(max_##suffix, a, num_elements); \
+} \
+type gzarray_min_##suffix(const type *a, size_t num_elements) { \
+  GZ_ARRAY_DISPATCH(min_##suffix, a, num_elements); \
+} \
+sum_t gzarray_sum_##suffix(const type *a, size_t num_elements) { \
+  GZ_ARRAY_DISPATCH(sum_##suffix, a, num_elements); \
+} \
+static size_t _gzarray_find_##suffix(const type *a, size_t num_elements, type value) { \
+  GZ_ARRAY_DISPATCH_FIND(find_##suffix, a, num_elements, value); \
+} \
+size_t gzarray_argmax_##suffix(const type *a, size_t num_elements) { \
+  return num_elements ? _gzarray_find_##suffix(a, num_elements, gzarray_max_##suffix(a, num_elements)) : 0; \
+}
+
+GZ_ARRAY_REDUCTIONS(u8, uint8_t, uint64_t)
+GZ_ARRAY_REDUCTIONS(u16, uint16_t, uint64_t)
+GZ_ARRAY_REDUCTIONS(i16, int16_t, int64_t)
+GZ_ARRAY_REDUCTIONS(u32, uint32_t, uint64_t)
+
+const char* gzarray_simd_name(void) {
+#if defined(GZ_ARRAY_AVX2)
+  return _gzarray_has_avx2() ? "avx2" : "sse2";
+#elif defined(GZ_ARRAY_SSE2)
+  return "sse2";
+#elif defined(GZ_ARRAY_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
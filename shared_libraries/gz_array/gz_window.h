@@ -0,0 +1,322 @@
+/**
+ * @file gz_window.h
+ * @brief Header-only window statistics for any arithmetic type (C++): moving average, moving min/max,
+ * mean/variance (Welford) and exponential moving average
+ *
+ *   gz_window_avg_t<int16_t, 16> current;
+ *   gz_window_clear(current);
+ *   gz_window_add_sample(current, sample);
+ *   gz_window_add_samples(current, samples, count); // same as count gz_window_add_sample() calls
+ *   double average = gz_window_mean(current);
+ *
+ * Window sizes are powers of two known at compile time: a slot is the sample counter masked, no modulo.
+ * The averages start running like gzarray_moving_avg_*: over the samples received until the window is full.
+ * The batch functions reduce contiguous runs of samples in plain loops the compiler vectorizes.
+ *
+ * The C objects of gz_array.h (TD_DATA_MVG_AVG_*) stay for the C code.
+ *
+ * @copyright Copyright (c) Goal Zero | 2022
+ */
+
+#ifndef GZ_WINDOW_H
+#define GZ_WINDOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <type_traits>
+
+/*****************************************************/
+/* Section: Reductions                               */
+/*****************************************************/
+
+/**
+ * @brief Type a window sum is kept in: 64 bit integers for integers, double for floating point
+ */
+template <typename T, bool IsFloating = std::is_floating_point<T>::value, bool IsSigned = std::is_signed<T>::value>
+struct gz_window_sum {
+  typedef int64_t type;
+};
+
+template <typename T>
+struct gz_window_sum<T, false, false> {
+  typedef uint64_t type;
+};
+
+template <typename T, bool IsSigned>
+struct gz_window_sum<T, true, IsSigned> {
+  typedef double type;
+};
+
+template <typename T>
+inline typename gz_window_sum<T>::type gz_window_reduce_sum(const T* data, size_t count) {
+  typename gz_window_sum<T>::type sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+/*****************************************************/
+/* Section: Moving average                           */
+/*****************************************************/
+
+template <typename T, uint16_t N>
+struct gz_window_avg_t {
+  static_assert(std::is_arithmetic<T>::value, "window samples must be numbers");
+  static_assert(N && !(N & (N - 1)), "window size must be a power of two");
+  typedef typename gz_window_sum<T>::type sum_t;
+
+  sum_t sum;
+  uint32_t added;                 // samples added, the next slot is added & (N - 1)
+  uint16_t count;                 // samples in the window, up to N
+  T readings[N];                  // zero past count
+};
+
+template <typename T, uint16_t N>
+inline void gz_window_clear(gz_window_avg_t<T, N>& window) {
+  memset(&window, 0, sizeof(window));
+}
+
+template <typename T, uint16_t N>
+inline void gz_window_add_sample(gz_window_avg_t<T, N>& window, T sample) {
+  uint32_t slot = window.added++ & (N - 1);
+  window.sum += sample;
+  window.sum -= window.readings[slot];
+  window.readings[slot] = sample;
+  if (window.count < N) {
+    window.count++;
+  }
+  if (std::is_floating_point<T>::value && slot == N - 1) {
+    // Once per window, so that the rounding errors of the running sum do not add up
+    window.sum = gz_window_reduce_sum(window.readings, N);
+  }
+}
+
+template <typename T, uint16_t N>
+inline void gz_window_add_samples(gz_window_avg_t<T, N>& window, const T* samples, size_t count) {
+  if (count >= N) {
+    // Only the last N stay, the ring is rewritten in slot order
+    window.added += count - N;
+    samples += count - N;
+    uint32_t slot = window.added & (N - 1);
+    memcpy(&window.readings[slot], samples, (N - slot) * sizeof(T));
+    memcpy(window.readings, samples + N - slot, slot * sizeof(T));
+    window.added += N;
+    window.count = N;
+    window.sum = gz_window_reduce_sum(window.readings, N);
+    return;
+  }
+  while (count) {
+    uint32_t slot = window.added & (N - 1);
+    size_t run = N - slot < count ? N - slot : count;
+    window.sum += gz_window_reduce_sum(samples, run);
+    window.sum -= gz_window_reduce_sum(&window.readings[slot], run);
+    memcpy(&window.readings[slot], samples, run * sizeof(T));
+    window.added += run;
+    window.count = window.count + run < N ? window.count + run : N;
+    if (std::is_floating_point<T>::value && slot + run == N) {
+      window.sum = gz_window_reduce_sum(window.readings, N);
+    }
+    samples += run;
+    count -= run;
+  }
+}
+
+template <typename T, uint16_t N>
+inline double gz_window_mean(const gz_window_avg_t<T, N>& window) {
+  return window.count ? (double)window.sum / window.count : 0.0;
+}
+
+/*****************************************************/
+/* Section: Moving min/max                           */
+/*****************************************************/
+
+template <typename T>
+struct gz_window_entry_t {
+  uint32_t index;
+  T value;
+};
+
+/**
+ * @brief Min and max of the last N samples, O(1) amortized per sample: each side keeps a monotonic deque of
+ * the samples that may still become the extreme
+ */
+template <typename T, uint16_t N>
+struct gz_window_minmax_t {
+  static_assert(std::is_arithmetic<T>::value, "window samples must be numbers");
+  static_assert(N && !(N & (N - 1)), "window size must be a power of two");
+
+  uint32_t added;
+  uint32_t minFront;              // deque positions, masked into the rings
+  uint32_t minBack;
+  uint32_t maxFront;
+  uint32_t maxBack;
+  gz_window_entry_t<T> mins[N];   // increasing values from front to back
+  gz_window_entry_t<T> maxs[N];   // decreasing values from front to back
+};
+
+template <typename T, uint16_t N>
+inline void gz_window_clear(gz_window_minmax_t<T, N>& window) {
+  window.added = 0;
+  window.minFront = window.minBack = 0;
+  window.maxFront = window.maxBack = 0;
+}
+
+template <typename T, uint16_t N>
+inline void gz_window_add_sample(gz_window_minmax_t<T, N>& window, T sample) {
+  uint32_t index = window.added++;
+  if (window.minFront != window.minBack && index - window.mins[window.minFront & (N - 1)].index >= N) {
+    window.minFront++;
+  }
+  while (window.minFront != window.minBack && !(window.mins[(window.minBack - 1) & (N - 1)].value < sample)) {
+    window.minBack--;
+  }
+  window.mins[window.minBack++ & (N - 1)] = { index, sample };
+
+  if (window.maxFront != window.maxBack && index - window.maxs[window.maxFront & (N - 1)].index >= N) {
+    window.maxFront++;
+  }
+  while (window.maxFront != window.maxBack && !(window.maxs[(window.maxBack - 1) & (N - 1)].value > sample)) {
+    window.maxBack--;
+  }
+  window.maxs[window.maxBack++ & (N - 1)] = { index, sample };
+}
+
+/**
+ * @brief The deques depend on every sample in turn, nothing to vectorize: samples older than the window are
+ * skipped, the rest goes one by one
+ */
+template <typename T, uint16_t N>
+inline void gz_window_add_samples(gz_window_minmax_t<T, N>& window, const T* samples, size_t count) {
+  if (count > N) {
+    gz_window_clear(window);
+    window.added += count - N;
+    samples += count - N;
+    count = N;
+  }
+  for (size_t i = 0; i < count; i++) {
+    gz_window_add_sample(window, samples[i]);
+  }
+}
+
+/**
+ * @return 0 when there is no sample
+ */
+template <typename T, uint16_t N>
+inline T gz_window_min(const gz_window_minmax_t<T, N>& window) {
+  return window.minFront != window.minBack ? window.mins[window.minFront & (N - 1)].value : 0;
+}
+
+template <typename T, uint16_t N>
+inline T gz_window_max(const gz_window_minmax_t<T, N>& window) {
+  return window.maxFront != window.maxBack ? window.maxs[window.maxFront & (N - 1)].value : 0;
+}
+
+/*****************************************************/
+/* Section: Mean and variance (Welford)              */
+/*****************************************************/
+
+/**
+ * @brief Mean and variance of every sample since the last clear, numerically stable
+ */
+typedef struct {
+  uint64_t count;
+  double mean;
+  double m2;                      // sum of the squared differences to the mean
+} gz_welford_t;
+
+inline void gz_welford_clear(gz_welford_t& welford) {
+  welford.count = 0;
+  welford.mean = 0;
+  welford.m2 = 0;
+}
+
+template <typename T>
+inline void gz_welford_add_sample(gz_welford_t& welford, T sample) {
+  double delta = (double)sample - welford.mean;
+  welford.count++;
+  welford.mean += delta / welford.count;
+  welford.m2 += delta * ((double)sample - welford.mean);
+}
+
+/**
+ * @brief Mean and squared differences of the batch in two passes, merged in (Chan et al.)
+ */
+template <typename T>
+inline void gz_welford_add_samples(gz_welford_t& welford, const T* samples, size_t count) {
+  if (!count) {
+    return;
+  }
+  double mean = (double)gz_window_reduce_sum(samples, count) / count;
+  double m2 = 0;
+  for (size_t i = 0; i < count; i++) {
+    double delta = (double)samples[i] - mean;
+    m2 += delta * delta;
+  }
+  uint64_t total = welford.count + count;
+  double delta = mean - welford.mean;
+  welford.mean += delta * count / total;
+  welford.m2 += m2 + delta * delta * ((double)welford.count * count / total);
+  welford.count = total;
+}
+
+/**
+ * @brief Sample variance, 0 under 2 samples
+ */
+inline double gz_welford_variance(const gz_welford_t& welford) {
+  return welford.count > 1 ? welford.m2 / (welford.count - 1) : 0.0;
+}
+
+inline double gz_welford_stddev(const gz_welford_t& welford) {
+  return sqrt(gz_welford_variance(welford));
+}
+
+/*****************************************************/
+/* Section: Exponential moving average               */
+/*****************************************************/
+
+typedef struct {
+  double alpha;                   // weight of a new sample
+  double value;
+  bool isSet;                     // the first sample sets the value
+} gz_ema_t;
+
+/**
+ * @param alpha in (0, 1], see gz_ema_alpha()
+ */
+inline void gz_ema_init(gz_ema_t& ema, double alpha) {
+  ema.alpha = alpha;
+  ema.value = 0;
+  ema.isSet = false;
+}
+
+/**
+ * @brief The alpha whose samples have the age of an N sample moving average
+ */
+inline double gz_ema_alpha(uint32_t window) {
+  return 2.0 / (window + 1.0);
+}
+
+template <typename T>
+inline void gz_ema_add_sample(gz_ema_t& ema, T sample) {
+  if (!ema.isSet) {
+    ema.value = sample;
+    ema.isSet = true;
+    return;
+  }
+  ema.value += ema.alpha * ((double)sample - ema.value);
+}
+
+/**
+ * @brief Each value depends on the previous one, a plain loop
+ */
+template <typename T>
+inline void gz_ema_add_samples(gz_ema_t& ema, const T* samples, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    gz_ema_add_sample(ema, samples[i]);
+  }
+}
+
+#endif // GZ_WINDOW_H
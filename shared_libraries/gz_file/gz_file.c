@@ -21,6 +21,11 @@
 #endif
 #include <string.h>
 #include "gz_file.h"
+#ifndef CY8C6116BZI_F54
+#include "gz_pool.h"
+
+static gz_pool_t* _filePool = NULL;
+#endif
 
 static bool _fileExtPresent(const char* fileName, const char* fileExtension) {
   if (fileName && fileExtension) {
@@ -130,7 +135,10 @@ GZFile * gzfopen(const char *path, const char *mode) {
   if (fp == NULL) {
     return NULL;
   }
-  GZFile *gzfile = malloc(sizeof(GZFile));
+  GZFile *gzfile = _filePool ? gz_pool_alloc(_filePool) : NULL;
+  if (gzfile == NULL) {
+    gzfile = malloc(sizeof(GZFile));
+  }
   if (gzfile) {
     gzfile->fp = fp;
     gzfile->path = path;
@@ -138,6 +146,10 @@ GZFile * gzfopen(const char *path, const char *mode) {
   return gzfile;
 }
 
+void gz_file_set_pool(struct gz_pool* pool) {
+  _filePool = pool;
+}
+
 int gzfclose(GZFile *gzfp) {
   int r = EOF;
   if (gzfp == NULL) {
@@ -151,7 +163,11 @@ int gzfclose(GZFile *gzfp) {
   }
   gzfp->fp = NULL;
   gzfp->path = NULL;
-  free(gzfp);
+  if (gz_pool_owns(_filePool, gzfp)) {
+    gz_pool_free(_filePool, gzfp);
+  } else {
+    free(gzfp);
+  }
   return 0;
 }
 
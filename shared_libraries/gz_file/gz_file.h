@@ -22,6 +22,8 @@ extern "C" {
 #include "gz_std_types.h"
 #include <stdio.h>
 
+struct gz_pool;
+
 typedef struct {
   FILE *fp;
   const char *path;
@@ -75,6 +77,13 @@ int gz_file_search(const char* targetString, const char* searchDir, const char*
  */
 GZFile * gzfopen(const char *path, const char *mode);
 
+/**
+ * @brief Takes the GZFile structs of gzfopen() from a gz_pool (blocks of at least sizeof(GZFile)), the heap is
+ * still used when it is exhausted. gzfclose() gives them back either way
+ * @param pool NULL to go back to the heap
+ */
+void gz_file_set_pool(struct gz_pool* pool);
+
 /**
  * @brief Closes a GZFile
  * @param gzfp The GZFile to close
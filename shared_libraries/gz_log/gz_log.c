@@ -1,49 +1,762 @@
 /**
  * @file gz_log.c
- * @brief 
+ * @brief
  * @version 0.1
  * @date 2022-09-02
- * 
+ *
  * @copyright Copyright (c) Goal Zero 2022
  */
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
 #include "gz_log.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-static int _min_log_level = GZ_LOG_LEVEL_INFO;
+#define GZ_LOG_LINE_MAX       2048        // formatted line, longer ones are cut
+#define GZ_LOG_BATCH_SIZE     (64 * 1024) // written with a single fwrite()
+#define GZ_LOG_FLUSH_PERIOD_MS 10         // writer sleep once the rings are empty, a caller wakes it at half a ring
+#define GZ_LOG_SPEC_MAX       32          // rebuilt conversion specification, e.g. "%-08.3ll"
+#define GZ_LOG_CACHE_LINE     64
+
 static const char *_level_strings[] = {
   "ALL", "DEBUG", "INFO", "WARNING", "ERROR"
 };
+static const char *_level_names[] = {
+  "all", "debug", "info", "warn", "error"
+};
+Gz_Log_Module_t __gz_log_global_module = { "global", GZ_LOG_LEVEL_INFO, GZ_LOG_LEVEL_INFO, NULL };
+static Gz_Log_Module_t* _modules = NULL; // registered by their constructor, before main()
+static FILE* _output = NULL; // stdout
 
-void __gz_log(const char* file, const char* func, int line, int level, const char* format, ...) {
-  if (level < _min_log_level) {
-    return;
+/* Section: async mode */
+
+/**
+ * @brief Captured call, followed by its arguments in 8 byte slots. A string is its length then its characters
+ * (null terminated, padded to 8)
+ */
+typedef struct {
+  uint32_t size;        // header and arguments, multiple of 8. 0: nothing more before the end of the ring
+  uint8_t level;
+  uint8_t isTruncated;  // GZ_LOG_RECORD_MAX reached, the arguments stop early
+  int32_t line;
+  uint64_t timestamp;
+  const char* file;
+  const char* func;
+  const char* format;
+} _Gz_Log_Record_t;
+
+/**
+ * @brief Single producer (the owning thread), single consumer (the writer thread). head and tail only grow
+ */
+typedef struct _Gz_Log_Ring {
+  uint64_t tail __attribute__((aligned(GZ_LOG_CACHE_LINE)));
+  uint64_t queued;
+  uint64_t dropped;
+  uint64_t blocked;
+  bool isProducing;     // its thread saw _isAsync and has not finished putting its record
+  uint64_t head __attribute__((aligned(GZ_LOG_CACHE_LINE)));
+  uint64_t drainLimit;  // tail seen at the start of the writer pass
+  uint64_t written;
+  uint8_t* buffer;
+  bool isFree;          // its thread exited, the next new thread takes it over
+  struct _Gz_Log_Ring* next;
+} _Gz_Log_Ring_t;
+
+/**
+ * @brief Parsed conversion specification, from the '%' to the conversion character
+ */
+typedef struct {
+  const char* start;
+  const char* lengthStart;  // length modifier, or conversion character
+  const char* end;
+  bool isWidthStar;
+  bool isPrecisionStar;
+  int precision;            // -1 when there is none
+  char length;              // 0, 'H' hh, 'h', 'l', 'q' ll, 'j', 'z', 't', 'L'
+  char conversion;          // 0 if unknown
+} _Gz_Log_Spec_t;
+
+static Gz_Log_Full_Policy_t _policy = GZ_LOG_FULL_DROP;
+static bool _isAsync = false;
+static bool _isWriterRunning = false;
+static bool _isWriterIdle = false;
+static uint64_t _writerPasses = 0;
+static _Gz_Log_Ring_t* _rings = NULL;
+static __thread _Gz_Log_Ring_t* _threadRing = NULL;
+static pthread_t _writerThread;
+static pthread_mutex_t _writerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _writerWake = PTHREAD_COND_INITIALIZER;
+static pthread_once_t _ringKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t _ringKey;
+static char _batch[GZ_LOG_BATCH_SIZE];
+
+static FILE* _gz_log_output(void) {
+  return _output ? _output : stdout;
+}
+
+static uint64_t _gz_log_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static const char* _gz_log_parse_spec(const char* p, _Gz_Log_Spec_t* spec) {
+  spec->start = p++;
+  spec->isWidthStar = false;
+  spec->isPrecisionStar = false;
+  spec->precision = -1;
+  spec->length = 0;
+  while (*p && strchr("-+ #0'", *p)) {
+    p++;
+  }
+  if (*p == '*') {
+    spec->isWidthStar = true;
+    p++;
+  }
+  while (*p >= '0' && *p <= '9') {
+    p++;
+  }
+  if (*p == '.') {
+    p++;
+    spec->precision = 0;
+    if (*p == '*') {
+      spec->isPrecisionStar = true;
+      p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+      spec->precision = spec->precision * 10 + (*p++ - '0');
+    }
+  }
+  spec->lengthStart = p;
+  switch (*p) {
+    case 'h':
+      spec->length = p[1] == 'h' ? 'H' : 'h';
+      p += spec->length == 'H' ? 2 : 1;
+      break;
+    case 'l':
+      spec->length = p[1] == 'l' ? 'q' : 'l';
+      p += spec->length == 'q' ? 2 : 1;
+      break;
+    case 'q':
+    case 'j':
+    case 'z':
+    case 't':
+    case 'L':
+      spec->length = *p++;
+      break;
+    default:
+      break;
+  }
+  spec->conversion = *p && strchr("diuoxXcfFeEgGaAspn", *p) ? *p : 0;
+  spec->end = *p ? p + 1 : p;
+  return spec->end;
+}
+
+static bool _gz_log_push(uint8_t* args, size_t* used, size_t room, const void* value, size_t size) {
+  size_t padded = (size + 7) & ~(size_t)7;
+  if (*used + padded > room) {
+    return false;
+  }
+  memcpy(args + *used, value, size);
+  *used += padded;
+  return true;
+}
+
+static bool _gz_log_push_string(uint8_t* args, size_t* used, size_t room, const char* string, int precision) {
+  if (!string) {
+    string = "(null)";
+  }
+  size_t limit = precision >= 0 && precision < GZ_LOG_STRING_MAX ? (size_t)precision : GZ_LOG_STRING_MAX;
+  size_t length = strnlen(string, limit);
+  if (*used + 8 + length + 1 > room) {
+    if (*used + 16 > room) {
+      return false;
+    }
+    length = room - *used - 8 - 1; // cut to what is left
+  }
+  uint64_t header = length;
+  memcpy(args + *used, &header, sizeof(header));
+  memcpy(args + *used + 8, string, length);
+  args[*used + 8 + length] = '\0';
+  *used += 8 + ((length + 1 + 7) & ~(size_t)7);
+  return true;
+}
+
+/**
+ * @brief Copies the arguments the format refers to. Integers are converted to 64 bits the way printf() would
+ * convert them, floating point to double
+ * @return bytes used, `room` at most
+ */
+static size_t _gz_log_capture(uint8_t* args, size_t room, const char* format, va_list arg, uint8_t* isTruncated) {
+  size_t used = 0;
+  _Gz_Log_Spec_t spec;
+  for (const char* p = strchr(format, '%'); p; p = strchr(p, '%')) {
+    if (p[1] == '%') {
+      p += 2;
+      continue;
+    }
+    p = _gz_log_parse_spec(p, &spec);
+    if (!spec.conversion) {
+      continue;
+    }
+    int64_t value = 0;
+    double real = 0;
+    bool isPushed = true;
+    if (spec.isWidthStar) {
+      value = va_arg(arg, int);
+      isPushed = _gz_log_push(args, &used, room, &value, sizeof(value));
+    }
+    if (spec.isPrecisionStar && isPushed) {
+      value = va_arg(arg, int);
+      spec.precision = value < 0 ? -1 : (int)value;
+      isPushed = _gz_log_push(args, &used, room, &value, sizeof(value));
+    }
+    if (!isPushed) {
+      *isTruncated = 1;
+      return used;
+    }
+    switch (spec.conversion) {
+      case 'd':
+      case 'i':
+        switch (spec.length) {
+          case 'H': value = (signed char)va_arg(arg, int); break;
+          case 'h': value = (short)va_arg(arg, int); break;
+          case 'l': value = va_arg(arg, long); break;
+          case 'q': value = va_arg(arg, long long); break;
+          case 'j': value = va_arg(arg, intmax_t); break;
+          case 'z': value = (ssize_t)va_arg(arg, size_t); break;
+          case 't': value = va_arg(arg, ptrdiff_t); break;
+          default: value = va_arg(arg, int); break;
+        }
+        isPushed = _gz_log_push(args, &used, room, &value, sizeof(value));
+        break;
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+        switch (spec.length) {
+          case 'H': value = (unsigned char)va_arg(arg, unsigned); break;
+          case 'h': value = (unsigned short)va_arg(arg, unsigned); break;
+          case 'l': value = va_arg(arg, unsigned long); break;
+          case 'q': value = va_arg(arg, unsigned long long); break;
+          case 'j': value = va_arg(arg, uintmax_t); break;
+          case 'z': value = va_arg(arg, size_t); break;
+          case 't': value = va_arg(arg, ptrdiff_t); break;
+          default: value = va_arg(arg, unsigned); break;
+        }
+        isPushed = _gz_log_push(args, &used, room, &value, sizeof(value));
+        break;
+      case 'c':
+        value = va_arg(arg, int);
+        isPushed = _gz_log_push(args, &used, room, &value, sizeof(value));
+        break;
+      case 's':
+        isPushed = _gz_log_push_string(args, &used, room, va_arg(arg, const char*), spec.precision);
+        break;
+      case 'p':
+        value = (int64_t)(intptr_t)va_arg(arg, void*);
+        isPushed = _gz_log_push(args, &used, room, &value, sizeof(value));
+        break;
+      case 'n':
+        (void)va_arg(arg, void*); // nothing to store into once formatted later
+        break;
+      default:
+        real = spec.length == 'L' ? (double)va_arg(arg, long double) : va_arg(arg, double);
+        isPushed = _gz_log_push(args, &used, room, &real, sizeof(real));
+        break;
+    }
+    if (!isPushed) {
+      *isTruncated = 1;
+      return used;
+    }
+  }
+  return used;
+}
+
+static void _gz_log_ring_release(void* ring) {
+  __atomic_store_n(&((_Gz_Log_Ring_t*)ring)->isFree, true, __ATOMIC_RELEASE);
+}
+
+static void _gz_log_ring_key_create(void) {
+  pthread_key_create(&_ringKey, _gz_log_ring_release);
+}
+
+/**
+ * @brief Ring of the calling thread, the one of an exited thread when there is one
+ */
+static _Gz_Log_Ring_t* _gz_log_thread_ring(void) {
+  if (_threadRing) {
+    return _threadRing;
+  }
+  _Gz_Log_Ring_t* ring;
+  for (ring = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+    bool isFree = true;
+    if (__atomic_load_n(&ring->isFree, __ATOMIC_RELAXED) &&
+        __atomic_compare_exchange_n(&ring->isFree, &isFree, false, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+  if (!ring) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, GZ_LOG_CACHE_LINE, sizeof(_Gz_Log_Ring_t))) {
+      return NULL;
+    }
+    ring = (_Gz_Log_Ring_t*)memory;
+    memset(ring, 0, sizeof(*ring));
+    ring->buffer = (uint8_t*)malloc(GZ_LOG_RING_SIZE);
+    if (!ring->buffer) {
+      free(ring);
+      return NULL;
+    }
+    ring->next = __atomic_load_n(&_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&_rings, &ring->next, ring, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    }
+  }
+  pthread_setspecific(_ringKey, ring);
+  _threadRing = ring;
+  return ring;
+}
+
+static void _gz_log_wake_writer(void) {
+  pthread_mutex_lock(&_writerLock);
+  pthread_cond_signal(&_writerWake);
+  pthread_mutex_unlock(&_writerLock);
+}
+
+/**
+ * @brief Copies a record at the tail, a record never wraps: the end of the ring is skipped instead
+ * @return false when there is no room
+ */
+static bool _gz_log_ring_put(_Gz_Log_Ring_t* ring, const void* record, uint32_t size) {
+  uint64_t tail = ring->tail;
+  uint32_t offset = (uint32_t)(tail & (GZ_LOG_RING_SIZE - 1));
+  uint32_t contiguous = GZ_LOG_RING_SIZE - offset;
+  uint32_t needed = size + (contiguous < size ? contiguous : 0);
+  if (tail + needed - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > GZ_LOG_RING_SIZE) {
+    return false;
+  }
+  if (contiguous < size) {
+    memset(ring->buffer + offset, 0, sizeof(uint32_t));
+    tail += contiguous;
+    offset = 0;
+  }
+  memcpy(ring->buffer + offset, record, size);
+  __atomic_store_n(&ring->tail, tail + size, __ATOMIC_RELEASE);
+  return true;
+}
+
+static void _gz_log_async(_Gz_Log_Ring_t* ring, const char* file, const char* func, int line, int level,
+                          const char* format, va_list arg) {
+  uint64_t record[GZ_LOG_RECORD_MAX / sizeof(uint64_t)];
+  _Gz_Log_Record_t* header = (_Gz_Log_Record_t*)record;
+  header->level = (uint8_t)level;
+  header->isTruncated = 0;
+  header->line = line;
+  header->timestamp = _gz_log_now();
+  header->file = file;
+  header->func = func;
+  header->format = format;
+  header->size = (uint32_t)(sizeof(*header) + _gz_log_capture((uint8_t*)record + sizeof(*header),
+                                                              sizeof(record) - sizeof(*header), format, arg,
+                                                              &header->isTruncated));
+  bool isBlocked = false;
+  while (!_gz_log_ring_put(ring, record, header->size)) {
+    if (_policy == GZ_LOG_FULL_DROP || !__atomic_load_n(&_isWriterRunning, __ATOMIC_ACQUIRE)) {
+      __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+      return;
+    }
+    if (!isBlocked) {
+      isBlocked = true;
+      __atomic_store_n(&ring->blocked, ring->blocked + 1, __ATOMIC_RELAXED);
+    }
+    _gz_log_wake_writer();
+    sched_yield();
+  }
+  __atomic_store_n(&ring->queued, ring->queued + 1, __ATOMIC_RELAXED);
+  // Waking the writer for every message would cost a system call per message, it is woken only when the ring
+  // fills up and writes batches on its period otherwise
+  if (ring->tail - __atomic_load_n(&ring->head, __ATOMIC_RELAXED) > GZ_LOG_RING_SIZE / 2 &&
+      __atomic_load_n(&_isWriterIdle, __ATOMIC_RELAXED) && __atomic_exchange_n(&_isWriterIdle, false, __ATOMIC_ACQ_REL)) {
+    _gz_log_wake_writer();
+  }
+}
+
+/**
+ * @brief Next record of the ring the writer has not consumed yet, up to its drain limit
+ */
+static const _Gz_Log_Record_t* _gz_log_ring_peek(_Gz_Log_Ring_t* ring) {
+  while (ring->head < ring->drainLimit) {
+    uint32_t offset = (uint32_t)(ring->head & (GZ_LOG_RING_SIZE - 1));
+    const _Gz_Log_Record_t* record = (const _Gz_Log_Record_t*)(ring->buffer + offset);
+    if (record->size) {
+      return record;
+    }
+    __atomic_store_n(&ring->head, ring->head + (GZ_LOG_RING_SIZE - offset), __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+static void _gz_log_append(char* line, size_t* length, size_t room, const char* text, size_t size) {
+  if (size > room - 1 - *length) {
+    size = room - 1 - *length;
+  }
+  memcpy(line + *length, text, size);
+  *length += size;
+}
+
+/**
+ * @brief Replays the format of a record with its captured arguments, one snprintf() per conversion
+ * @return length of the line, without the null terminator
+ */
+static size_t _gz_log_format(char* line, size_t room, const _Gz_Log_Record_t* record) {
+  const uint8_t* args = (const uint8_t*)(record + 1);
+  size_t argsSize = record->size - sizeof(*record);
+  size_t used = 0;
+  int length = 0;
+  if (record->level == GZ_LOG_LEVEL_DEBUG) {
+    length = snprintf(line, room, "%s-%s()-%d-", record->file, record->func, record->line);
+  }
+  length += snprintf(line + length, room - length, "%s: ", _level_strings[record->level]);
+  size_t lineLength = (size_t)length < room ? (size_t)length : room - 1;
+  const char* p = record->format;
+  _Gz_Log_Spec_t spec;
+  while (*p) {
+    const char* percent = strchr(p, '%');
+    if (!percent) {
+      _gz_log_append(line, &lineLength, room, p, strlen(p));
+      break;
+    }
+    _gz_log_append(line, &lineLength, room, p, percent - p);
+    if (percent[1] == '%') {
+      _gz_log_append(line, &lineLength, room, "%", 1);
+      p = percent + 2;
+      continue;
+    }
+    p = _gz_log_parse_spec(percent, &spec);
+    if (!spec.conversion) {
+      _gz_log_append(line, &lineLength, room, percent, p - percent);
+      continue;
+    }
+    if (spec.conversion == 'n') {
+      continue;
+    }
+    // Rebuilt with the '*' replaced by their values and the integers widened to 64 bits
+    char specText[GZ_LOG_SPEC_MAX];
+    size_t specLength = 0;
+    size_t slots = (spec.isWidthStar ? 1 : 0) + (spec.isPrecisionStar ? 1 : 0) + 1;
+    if (used + slots * sizeof(uint64_t) > argsSize) {
+      _gz_log_append(line, &lineLength, room, "...", 3);
+      break;
+    }
+    for (const char* s = spec.start; s < spec.lengthStart && specLength < GZ_LOG_SPEC_MAX - 16; s++) {
+      int64_t star;
+      if (*s == '*') {
+        memcpy(&star, args + used, sizeof(star));
+        used += sizeof(star);
+        if (s[-1] == '.' && star < 0) {
+          specLength--; // negative precision: as if there was none
+          continue;
+        }
+        specLength += snprintf(specText + specLength, GZ_LOG_SPEC_MAX - specLength, "%d", (int)star);
+      } else {
+        specText[specLength++] = *s;
+      }
+    }
+    int64_t value;
+    double real;
+    size_t roomLeft = room - lineLength;
+    int written = 0;
+    memcpy(&value, args + used, sizeof(value));
+    switch (spec.conversion) {
+      case 's':
+        specText[specLength++] = 's';
+        specText[specLength] = '\0';
+        written = snprintf(line + lineLength, roomLeft, specText, (const char*)(args + used + 8));
+        used += 8 + (((size_t)value + 1 + 7) & ~(size_t)7);
+        break;
+      case 'c':
+      case 'p':
+        specText[specLength++] = spec.conversion;
+        specText[specLength] = '\0';
+        written = spec.conversion == 'c' ? snprintf(line + lineLength, roomLeft, specText, (int)value)
+                                         : snprintf(line + lineLength, roomLeft, specText, (void*)(intptr_t)value);
+        used += sizeof(value);
+        break;
+      case 'd':
+      case 'i':
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+        specText[specLength++] = 'l';
+        specText[specLength++] = 'l';
+        specText[specLength++] = spec.conversion;
+        specText[specLength] = '\0';
+        written = snprintf(line + lineLength, roomLeft, specText, (long long)value);
+        used += sizeof(value);
+        break;
+      default:
+        memcpy(&real, args + used, sizeof(real));
+        specText[specLength++] = spec.conversion;
+        specText[specLength] = '\0';
+        written = snprintf(line + lineLength, roomLeft, specText, real);
+        used += sizeof(real);
+        break;
+    }
+    lineLength += (size_t)written < roomLeft ? (size_t)written : roomLeft - 1;
+  }
+  return lineLength;
+}
+
+/**
+ * @brief One writer pass: every record queued when it starts, merged across the rings in time order
+ * @return number of records written
+ */
+static uint32_t _gz_log_drain(void) {
+  _Gz_Log_Ring_t* rings = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE);
+  for (_Gz_Log_Ring_t* ring = rings; ring; ring = ring->next) {
+    ring->drainLimit = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  }
+  FILE* output = _gz_log_output();
+  size_t batchLength = 0;
+  uint32_t count = 0;
+  while (true) {
+    _Gz_Log_Ring_t* oldest = NULL;
+    const _Gz_Log_Record_t* record = NULL;
+    for (_Gz_Log_Ring_t* ring = rings; ring; ring = ring->next) {
+      const _Gz_Log_Record_t* next = _gz_log_ring_peek(ring);
+      if (next && (!record || next->timestamp < record->timestamp)) {
+        oldest = ring;
+        record = next;
+      }
+    }
+    if (!record) {
+      break;
+    }
+    if (GZ_LOG_BATCH_SIZE - batchLength < GZ_LOG_LINE_MAX) {
+      fwrite(_batch, 1, batchLength, output);
+      batchLength = 0;
+    }
+    batchLength += _gz_log_format(_batch + batchLength, GZ_LOG_LINE_MAX, record);
+    __atomic_store_n(&oldest->head, oldest->head + record->size, __ATOMIC_RELEASE);
+    __atomic_store_n(&oldest->written, oldest->written + 1, __ATOMIC_RELAXED);
+    count++;
+  }
+  if (batchLength) {
+    fwrite(_batch, 1, batchLength, output);
+  }
+  if (count) {
+    fflush(output);
+  }
+  return count;
+}
+
+/**
+ * @brief A ring is more than half full: the callers produce faster than the writer period drains
+ */
+static bool _gz_log_is_behind(void) {
+  for (_Gz_Log_Ring_t* ring = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+    if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - ring->head > GZ_LOG_RING_SIZE / 2) {
+      return true;
+    }
   }
+  return false;
+}
+
+static void* _gz_log_writer(void* context) {
+  (void)context;
+  while (__atomic_load_n(&_isWriterRunning, __ATOMIC_ACQUIRE)) {
+    _gz_log_drain();
+    __atomic_add_fetch(&_writerPasses, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&_writerLock);
+    __atomic_store_n(&_isWriterIdle, true, __ATOMIC_SEQ_CST);
+    if (!_gz_log_is_behind() && __atomic_load_n(&_isWriterRunning, __ATOMIC_ACQUIRE)) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += GZ_LOG_FLUSH_PERIOD_MS * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait(&_writerWake, &_writerLock, &deadline);
+    }
+    __atomic_store_n(&_isWriterIdle, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&_writerLock);
+  }
+  _gz_log_drain();
+  return NULL;
+}
+
+static void _gz_log_at_exit(void) {
+  gz_log_async_stop();
+}
+
+/* Section: API */
+
+void __gz_log(const char* file, const char* func, int line, int level, const char* format, ...) {
   va_list arg;
 
   va_start (arg, format);
+  _Gz_Log_Ring_t* ring;
+  if (__atomic_load_n(&_isAsync, __ATOMIC_ACQUIRE) && (ring = _gz_log_thread_ring()) != NULL) {
+    // Checked again once flagged: either gz_log_async_stop() waits for this record or this call sees it stopping
+    __atomic_store_n(&ring->isProducing, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_isAsync, __ATOMIC_SEQ_CST)) {
+      _gz_log_async(ring, file, func, line, level, format, arg);
+      __atomic_store_n(&ring->isProducing, false, __ATOMIC_RELEASE);
+      va_end(arg);
+      return;
+    }
+    __atomic_store_n(&ring->isProducing, false, __ATOMIC_RELAXED);
+  }
+  FILE* output = _gz_log_output();
+  flockfile(output); // one line at a time between threads
   if (level == GZ_LOG_LEVEL_DEBUG) {
-    printf("%s-", file);
-    printf("%s()-", func);
-    printf("%d-", line);
+    fprintf(output, "%s-%s()-%d-", file, func, line);
   }
-  printf("%s: ", _level_strings[level]);
-  vprintf(format, arg);
+  fprintf(output, "%s: ", _level_strings[level]);
+  vfprintf(output, format, arg);
+  funlockfile(output);
   va_end(arg);
 }
 
-void gz_log_set_level(int level) {
+static int _gz_log_clamp(int level) {
   if (level > GZ_LOG_LEVEL_ERROR) {
-    _min_log_level = GZ_LOG_LEVEL_ERROR;
+    return GZ_LOG_LEVEL_ERROR;
   } else if (level < GZ_LOG_LEVEL_ALL) {
-    _min_log_level = GZ_LOG_LEVEL_ALL;
-  } else {
-    _min_log_level = level;
+    return GZ_LOG_LEVEL_ALL;
+  }
+  return level;
+}
+
+void __gz_log_register_module(Gz_Log_Module_t* module) {
+  module->minLevel = module->level == GZ_LOG_LEVEL_GLOBAL ? __gz_log_global_module.minLevel : module->level;
+  module->next = _modules;
+  _modules = module;
+}
+
+void gz_log_set_level(int level) {
+  level = _gz_log_clamp(level);
+  __gz_log_global_module.level = level;
+  __gz_log_global_module.minLevel = level;
+  for (Gz_Log_Module_t* module = _modules; module; module = module->next) {
+    if (module->level == GZ_LOG_LEVEL_GLOBAL) {
+      module->minLevel = level;
+    }
+  }
+}
+
+int gz_log_get_level(void) {
+  return __gz_log_global_module.level;
+}
+
+int gz_log_set_module_level(const char* module, int level) {
+  int count = 0;
+  for (Gz_Log_Module_t* entry = _modules; entry; entry = entry->next) {
+    if (strcmp(entry->name, module)) {
+      continue;
+    }
+    entry->level = level == GZ_LOG_LEVEL_GLOBAL ? GZ_LOG_LEVEL_GLOBAL : _gz_log_clamp(level);
+    entry->minLevel = level == GZ_LOG_LEVEL_GLOBAL ? __gz_log_global_module.minLevel : entry->level;
+    count++;
+  }
+  return count;
+}
+
+const Gz_Log_Module_t* gz_log_get_modules(void) {
+  return _modules;
+}
+
+const char* gz_log_level_name(int level) {
+  return _level_names[_gz_log_clamp(level)];
+}
+
+int gz_log_level_from_name(const char* name) {
+  for (int level = GZ_LOG_LEVEL_ALL; level <= GZ_LOG_LEVEL_ERROR; level++) {
+    if (!strcasecmp(name, _level_names[level])) {
+      return level;
+    }
+  }
+  return -1;
+}
+
+void gz_log_set_output(FILE* output) {
+  gz_log_flush();
+  _output = output;
+}
+
+int gz_log_async_start(Gz_Log_Full_Policy_t policy) {
+  static bool isAtExitSet = false;
+  _policy = policy;
+  if (_isAsync) {
+    return 0;
+  }
+  pthread_once(&_ringKeyOnce, _gz_log_ring_key_create);
+  __atomic_store_n(&_isWriterRunning, true, __ATOMIC_RELEASE);
+  if (pthread_create(&_writerThread, NULL, _gz_log_writer, NULL)) {
+    __atomic_store_n(&_isWriterRunning, false, __ATOMIC_RELEASE);
+    return -1;
+  }
+  if (!isAtExitSet) {
+    isAtExitSet = true;
+    atexit(_gz_log_at_exit);
+  }
+  __atomic_store_n(&_isAsync, true, __ATOMIC_RELEASE);
+  return 0;
+}
+
+void gz_log_async_stop(void) {
+  if (!_isAsync) {
+    return;
+  }
+  __atomic_store_n(&_isAsync, false, __ATOMIC_SEQ_CST);
+  // Callers that saw _isAsync before it changed are still putting their record, the writer must still be
+  // running (a blocked caller waits on it) and its last pass must come after them
+  for (_Gz_Log_Ring_t* ring = __atomic_load_n(&_rings, __ATOMIC_SEQ_CST); ring; ring = ring->next) {
+    while (__atomic_load_n(&ring->isProducing, __ATOMIC_SEQ_CST)) {
+      sched_yield();
+    }
+  }
+  __atomic_store_n(&_isWriterRunning, false, __ATOMIC_RELEASE);
+  _gz_log_wake_writer();
+  pthread_join(_writerThread, NULL); // its last pass writes what is left
+}
+
+void gz_log_flush(void) {
+  if (!__atomic_load_n(&_isAsync, __ATOMIC_ACQUIRE)) {
+    fflush(_gz_log_output());
+    return;
+  }
+  // The second pass that ends after this point started after it
+  uint64_t passes = __atomic_load_n(&_writerPasses, __ATOMIC_ACQUIRE);
+  while (__atomic_load_n(&_writerPasses, __ATOMIC_ACQUIRE) < passes + 2 &&
+         __atomic_load_n(&_isWriterRunning, __ATOMIC_ACQUIRE)) {
+    _gz_log_wake_writer();
+    sched_yield();
+  }
+}
+
+void gz_log_get_stats(Gz_Log_Stats_t* stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (_Gz_Log_Ring_t* ring = __atomic_load_n(&_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+    stats->queued += __atomic_load_n(&ring->queued, __ATOMIC_RELAXED);
+    stats->written += __atomic_load_n(&ring->written, __ATOMIC_RELAXED);
+    stats->dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    stats->blocked += __atomic_load_n(&ring->blocked, __ATOMIC_RELAXED);
+    stats->threads++;
   }
 }
 
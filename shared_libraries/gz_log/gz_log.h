@@ -9,27 +9,14 @@
 
 #ifndef _GZ_LOG_H
 #define _GZ_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-///\todo add mutex lock/unlock
-#define GZ_LOG_DEBUG(...) {\
-	__gz_log(__FILE__, __FUNCTION__, __LINE__, GZ_LOG_LEVEL_DEBUG, __VA_ARGS__);\
-}
-#define GZ_LOG_ALL(...) {\
-	__gz_log(__FILE__, __FUNCTION__, __LINE__, GZ_LOG_LEVEL_ALL, __VA_ARGS__);\
-}
-#define GZ_LOG_INFO(...) {\
-	__gz_log(__FILE__, __FUNCTION__, __LINE__, GZ_LOG_LEVEL_INFO, __VA_ARGS__);\
-}
-#define GZ_LOG_WARN(...) {\
-	__gz_log(__FILE__, __FUNCTION__, __LINE__, GZ_LOG_LEVEL_WARNING, __VA_ARGS__);\
-}
-#define GZ_LOG_ERROR(...) {\
-	__gz_log(__FILE__, __FUNCTION__, __LINE__, GZ_LOG_LEVEL_ERROR, __VA_ARGS__);\
-}
-
 typedef enum {
   GZ_LOG_LEVEL_ALL = 0,
   GZ_LOG_LEVEL_DEBUG = 1,
@@ -38,10 +25,146 @@ typedef enum {
   GZ_LOG_LEVEL_ERROR = 4
 } Gz_Log_Level_t;
 
+#define GZ_LOG_LEVEL_GLOBAL (-1) // gz_log_set_module_level(): the module follows gz_log_set_level() again
+
+/**
+ * Calls under GZ_LOG_COMPILE_LEVEL are compiled out, their arguments are never evaluated (release builds
+ * keep INFO and above, see the Makefile). The others check the level of their module inline, before the
+ * arguments are evaluated. A source file makes its own module by defining GZ_LOG_MODULE before the include:
+ *   #define GZ_LOG_MODULE "uart"
+ *   #include "gz_log.h"
+ */
+#ifndef GZ_LOG_COMPILE_LEVEL
+#define GZ_LOG_COMPILE_LEVEL 0 // GZ_LOG_LEVEL_ALL
+#endif
+
+typedef struct Gz_Log_Module {
+  const char* name;
+  int minLevel;               // checked by the macros
+  int level;                  // GZ_LOG_LEVEL_GLOBAL, or set by gz_log_set_module_level()
+  struct Gz_Log_Module* next;
+} Gz_Log_Module_t;
+
+extern Gz_Log_Module_t __gz_log_global_module;
+void __gz_log_register_module(Gz_Log_Module_t* module);
+
+#ifdef GZ_LOG_MODULE
+static Gz_Log_Module_t __gz_log_module = { GZ_LOG_MODULE, GZ_LOG_LEVEL_INFO, GZ_LOG_LEVEL_GLOBAL, NULL };
+__attribute__((constructor)) static void __gz_log_module_init(void) {
+  __gz_log_register_module(&__gz_log_module);
+}
+#define GZ_LOG_MODULE_LEVEL (__gz_log_module.minLevel)
+#else
+#define GZ_LOG_MODULE_LEVEL (__gz_log_global_module.minLevel)
+#endif
+
+#define __GZ_LOG_ON(level, ...) {\
+	if ((level) >= GZ_LOG_MODULE_LEVEL) {\
+		__gz_log(__FILE__, __FUNCTION__, __LINE__, level, __VA_ARGS__);\
+	}\
+}
+#define __GZ_LOG_OFF(level, ...) {\
+	if (0) {\
+		__gz_log(__FILE__, __FUNCTION__, __LINE__, level, __VA_ARGS__);\
+	}\
+}
+
+#if GZ_LOG_COMPILE_LEVEL <= 0
+#define GZ_LOG_ALL(...) __GZ_LOG_ON(GZ_LOG_LEVEL_ALL, __VA_ARGS__)
+#else
+#define GZ_LOG_ALL(...) __GZ_LOG_OFF(GZ_LOG_LEVEL_ALL, __VA_ARGS__)
+#endif
+#if GZ_LOG_COMPILE_LEVEL <= 1
+#define GZ_LOG_DEBUG(...) __GZ_LOG_ON(GZ_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define GZ_LOG_DEBUG(...) __GZ_LOG_OFF(GZ_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
+#if GZ_LOG_COMPILE_LEVEL <= 2
+#define GZ_LOG_INFO(...) __GZ_LOG_ON(GZ_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define GZ_LOG_INFO(...) __GZ_LOG_OFF(GZ_LOG_LEVEL_INFO, __VA_ARGS__)
+#endif
+#if GZ_LOG_COMPILE_LEVEL <= 3
+#define GZ_LOG_WARN(...) __GZ_LOG_ON(GZ_LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define GZ_LOG_WARN(...) __GZ_LOG_OFF(GZ_LOG_LEVEL_WARN, __VA_ARGS__)
+#endif
+#define GZ_LOG_ERROR(...) __GZ_LOG_ON(GZ_LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#define GZ_LOG_RING_SIZE    (64 * 1024) // bytes per logging thread in async mode, power of 2
+#define GZ_LOG_RECORD_MAX   512         // captured arguments of one call, longer strings are cut
+#define GZ_LOG_STRING_MAX   256         // characters kept of a %s argument
+
+/**
+ * @brief What a caller does when the ring of its thread is full (async mode)
+ */
+typedef enum {
+  GZ_LOG_FULL_DROP,   // the message is lost and counted
+  GZ_LOG_FULL_BLOCK,  // the caller waits for the writer thread to make room
+} Gz_Log_Full_Policy_t;
+
+typedef struct {
+  uint64_t queued;    // messages captured by the callers
+  uint64_t written;   // formatted by the writer thread
+  uint64_t dropped;   // lost on a full ring, GZ_LOG_FULL_DROP
+  uint64_t blocked;   // callers that had to wait, GZ_LOG_FULL_BLOCK
+  uint32_t threads;   // rings allocated, one per thread that logged
+} Gz_Log_Stats_t;
+
+/**
+ * @brief Level of every module not set by gz_log_set_module_level()
+ */
 void gz_log_set_level(int level);
 
+int gz_log_get_level(void);
+
+/**
+ * @brief Level of the source files of a module, GZ_LOG_LEVEL_GLOBAL to follow gz_log_set_level() again
+ * @return number of source files of the module, 0 if there is none
+ */
+int gz_log_set_module_level(const char* module, int level);
+
+/**
+ * @brief Registered modules, one entry per source file. Walk with `next`
+ */
+const Gz_Log_Module_t* gz_log_get_modules(void);
+
+const char* gz_log_level_name(int level);
+
+/**
+ * @brief "all", "debug", "info", "warn" or "error", any case
+ * @return the level, -1 if unknown
+ */
+int gz_log_level_from_name(const char* name);
+
+/**
+ * @brief Where the lines go, stdout by default
+ */
+void gz_log_set_output(FILE* output);
+
+/**
+ * @brief Async mode: a call only captures the format pointer, its arguments (strings copied) and a timestamp
+ * into a lock-free ring of the calling thread, a background thread merges the rings in time order, formats
+ * and writes in batches. The format must be a string literal, it is read after the call returns.
+ * Pending messages are written on gz_log_async_stop() and at exit()
+ * @return 0 on success (or already started), -1 if the writer thread could not be created
+ */
+int gz_log_async_start(Gz_Log_Full_Policy_t policy);
+
+/**
+ * @brief Writes what is pending and goes back to formatting on the caller's thread
+ */
+void gz_log_async_stop(void);
+
+/**
+ * @brief Returns once every message queued before the call has been written
+ */
+void gz_log_flush(void);
+
+void gz_log_get_stats(Gz_Log_Stats_t* stats);
+
 /**
- * @brief: not intended for direct use. Use macro functions instead:
+ * @brief: not intended for direct use, the level is checked by the macros. Use macro functions instead:
  * - GZ_LOG_ALL
  * - GZ_LOG_DEBUG
  * - GZ_LOG_INFO
@@ -0,0 +1,197 @@
+/**
+ * @file gz_trace.c
+ *
+ * @copyright Copyright (c) Goal Zero 2022
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "gz_trace.h"
+#include "gz_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GZ_TRACE_PATH_MAX     256
+#define FNV_OFFSET_BASIS      2166136261u
+#define FNV_PRIME             16777619u
+
+static pthread_mutex_t _traceLock = PTHREAD_MUTEX_INITIALIZER;
+static bool _isOpen = false;
+static bool _isHashing = false;
+static char _path[GZ_TRACE_PATH_MAX];
+static uint32_t _capacity = 0;
+static uint8_t _fileCount = 0;
+static uint16_t _fileIndex = 0;
+static uint32_t _sequence = 0;
+static uint64_t _startRealtime_ns = 0;
+static uint64_t _startMonotonic_ns = 0;
+static gz_trace_file_header_t* _header = NULL; // the mapped file
+static gz_trace_record_t* _records = NULL;
+static size_t _mapSize = 0;
+static gz_trace_stats_t _stats;
+
+static uint64_t _gz_trace_now(clockid_t clock) {
+  struct timespec now;
+  clock_gettime(clock, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint32_t _gz_trace_hash(const uint8_t* data, uint16_t length) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (uint16_t i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+/**
+ * @brief Creates the current file at its full size and maps it
+ */
+static int _gz_trace_map(void) {
+  int fd = open(_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    GZ_LOG_ERROR("gz_trace: cannot open %s\n", _path);
+    return -1;
+  }
+  size_t size = sizeof(gz_trace_file_header_t) + (size_t)_capacity * sizeof(gz_trace_record_t);
+  void* map = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd); // the mapping keeps the file
+  if (map == MAP_FAILED) {
+    GZ_LOG_ERROR("gz_trace: cannot map %s\n", _path);
+    return -1;
+  }
+  _mapSize = size;
+  _header = (gz_trace_file_header_t*)map;
+  _records = (gz_trace_record_t*)(_header + 1);
+  memcpy(_header->magic, GZ_TRACE_MAGIC, sizeof(_header->magic));
+  _header->version = GZ_TRACE_VERSION;
+  _header->headerSize = sizeof(gz_trace_file_header_t);
+  _header->recordSize = sizeof(gz_trace_record_t);
+  _header->fileIndex = _fileIndex;
+  _header->capacity = _capacity;
+  _header->count = 0;
+  _header->startRealtime_ns = _startRealtime_ns;
+  _header->startMonotonic_ns = _startMonotonic_ns;
+  return 0;
+}
+
+/**
+ * @brief Unmaps the current file, truncated to the records it holds
+ */
+static void _gz_trace_unmap(void) {
+  if (!_header) {
+    return;
+  }
+  size_t used = sizeof(gz_trace_file_header_t) + (size_t)_header->count * sizeof(gz_trace_record_t);
+  munmap(_header, _mapSize);
+  _header = NULL;
+  _records = NULL;
+  if (used < _mapSize && truncate(_path, (off_t)used) != 0) {
+    GZ_LOG_WARN("gz_trace: cannot truncate %s\n", _path);
+  }
+}
+
+static void _gz_trace_rotate(void) {
+  char from[GZ_TRACE_PATH_MAX + 4];
+  char to[GZ_TRACE_PATH_MAX + 4];
+  _gz_trace_unmap();
+  for (int i = _fileCount - 1; i > 0; i--) {
+    if (i > 1) {
+      snprintf(from, sizeof(from), "%s.%d", _path, i - 1);
+    } else {
+      snprintf(from, sizeof(from), "%s", _path);
+    }
+    snprintf(to, sizeof(to), "%s.%d", _path, i);
+    rename(from, to); // the oldest one is replaced
+  }
+  if (_fileCount == 1) {
+    unlink(_path);
+  }
+  _fileIndex++;
+  _stats.rotations++;
+  if (_gz_trace_map() < 0) {
+    _stats.failures++;
+    __atomic_store_n(&_isOpen, false, __ATOMIC_RELEASE);
+  }
+}
+
+int gz_trace_open(const char* path, uint32_t recordsPerFile, uint8_t fileCount) {
+  if (strlen(path) >= GZ_TRACE_PATH_MAX) {
+    return -1;
+  }
+  gz_trace_close();
+  pthread_mutex_lock(&_traceLock);
+  strcpy(_path, path);
+  _capacity = recordsPerFile ? recordsPerFile : GZ_TRACE_DEFAULT_RECORDS;
+  _fileCount = !fileCount ? GZ_TRACE_DEFAULT_FILES : (fileCount > GZ_TRACE_MAX_FILES ? GZ_TRACE_MAX_FILES : fileCount);
+  _fileIndex = 0;
+  _sequence = 0;
+  _startRealtime_ns = _gz_trace_now(CLOCK_REALTIME);
+  _startMonotonic_ns = _gz_trace_now(CLOCK_MONOTONIC);
+  memset(&_stats, 0, sizeof(_stats));
+  int rv = _gz_trace_map();
+  __atomic_store_n(&_isOpen, rv == 0, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&_traceLock);
+  return rv;
+}
+
+void gz_trace_close(void) {
+  pthread_mutex_lock(&_traceLock);
+  __atomic_store_n(&_isOpen, false, __ATOMIC_RELEASE);
+  _gz_trace_unmap();
+  pthread_mutex_unlock(&_traceLock);
+}
+
+bool gz_trace_is_open(void) {
+  return __atomic_load_n(&_isOpen, __ATOMIC_ACQUIRE);
+}
+
+void gz_trace_set_payload_hash(bool isEnabled) {
+  _isHashing = isEnabled;
+}
+
+void gz_trace_emit(gz_trace_record_t* record, const void* payload) {
+  if (!__atomic_load_n(&_isOpen, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  record->timestamp_ns = _gz_trace_now(CLOCK_MONOTONIC);
+  record->flags &= ~GZ_TRACE_FLAG_HASH;
+  record->payloadHash = 0;
+  if (_isHashing && payload) {
+    record->payloadHash = _gz_trace_hash((const uint8_t*)payload, record->length);
+    record->flags |= GZ_TRACE_FLAG_HASH;
+  }
+  memset(record->reserved, 0, sizeof(record->reserved));
+  pthread_mutex_lock(&_traceLock);
+  if (_isOpen && _header->count == _capacity) {
+    _gz_trace_rotate();
+  }
+  if (_isOpen) {
+    record->sequence = _sequence++;
+    _records[_header->count] = *record;
+    _header->count++; // after the record: a reader never sees a half written one
+    _stats.records++;
+  }
+  pthread_mutex_unlock(&_traceLock);
+}
+
+void gz_trace_get_stats(gz_trace_stats_t* stats) {
+  pthread_mutex_lock(&_traceLock);
+  *stats = _stats;
+  pthread_mutex_unlock(&_traceLock);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,102 @@
+/**
+ * @file gz_trace.h
+ * @brief Binary trace sink: fixed-size records of frame events, cheap enough to stay on in production
+ *
+ * Records go straight into a memory-mapped file, no formatting and no write() per record. When the file is
+ * full it is rotated: path -> path.1 -> ... -> path.<fileCount - 1>, the oldest one is deleted.
+ * trace_decode turns the files back into text or CSV.
+ *
+ * File layout (little endian):
+ *   gz_trace_file_header_t
+ *   gz_trace_record_t[capacity], the first `count` are written
+ *
+ * @copyright Copyright (c) Goal Zero 2022
+ */
+
+#ifndef _GZ_TRACE_H
+#define _GZ_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GZ_TRACE_MAGIC                "GZTR"
+#define GZ_TRACE_VERSION              1
+#define GZ_TRACE_DEFAULT_RECORDS      (64 * 1024) // per file, 2 MB
+#define GZ_TRACE_DEFAULT_FILES        4
+#define GZ_TRACE_MAX_FILES            10
+
+#define GZ_TRACE_FLAG_CRC_OK          0x01
+#define GZ_TRACE_FLAG_HASH            0x02        // payloadHash is set
+
+typedef struct __attribute__ ((packed)) {
+  char magic[4];                  // GZ_TRACE_MAGIC
+  uint16_t version;
+  uint16_t headerSize;            // records start right after
+  uint16_t recordSize;            // sizeof(gz_trace_record_t)
+  uint16_t fileIndex;             // 0 for the first file of the trace, +1 on every rotation
+  uint32_t capacity;              // records the file holds
+  uint32_t count;                 // records written, the file may have been cut short by a crash
+  uint32_t reserved;
+  uint64_t startRealtime_ns;      // wall clock when the trace started, for humans
+  uint64_t startMonotonic_ns;     // monotonic clock at the same time, records use the same clock
+} gz_trace_file_header_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint64_t timestamp_ns;          // CLOCK_MONOTONIC
+  uint32_t sequence;              // across the rotated files
+  uint16_t eventId;               // defined by the application, e.g. yapi_trace_event_t
+  uint16_t port;                  // file descriptor or connection the frame went through
+  uint8_t command;
+  uint8_t messageType;
+  uint8_t senderId;
+  uint8_t targetId;
+  uint16_t length;                // payload bytes
+  uint16_t crc;                   // as carried by the frame
+  uint8_t flags;                  // GZ_TRACE_FLAG_*
+  uint8_t reserved[3];
+  uint32_t payloadHash;           // FNV-1a of the payload when enabled
+} gz_trace_record_t;
+
+typedef struct {
+  uint64_t records;
+  uint32_t rotations;
+  uint32_t failures;              // rotations that could not map a new file, tracing stopped
+} gz_trace_stats_t;
+
+/**
+ * @brief Starts tracing into `path`, replaced if it exists
+ * @param recordsPerFile 0 for GZ_TRACE_DEFAULT_RECORDS
+ * @param fileCount files kept, current one included, 0 for GZ_TRACE_DEFAULT_FILES
+ * @return 0 on success, -1 otherwise
+ */
+int gz_trace_open(const char* path, uint32_t recordsPerFile, uint8_t fileCount);
+
+/**
+ * @brief Stops tracing, the current file is truncated to what was written
+ */
+void gz_trace_close(void);
+
+bool gz_trace_is_open(void);
+
+/**
+ * @brief Hashes the payload of the following records, off by default
+ */
+void gz_trace_set_payload_hash(bool isEnabled);
+
+/**
+ * @brief Appends a record, thread safe. timestamp_ns, sequence and payloadHash are filled here, the
+ * payload is only read when hashing is on. Does nothing when tracing is off
+ */
+void gz_trace_emit(gz_trace_record_t* record, const void* payload);
+
+void gz_trace_get_stats(gz_trace_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,63 +1,248 @@
 /**
  * @file gz_memory.c
  * @author your name (you@domain.com)
- * @brief 
+ * @brief Allocation tracker behind DEBUG_MEMORY_LEAKS. Live allocations are kept in an open addressing table
+ * indexed by the pointer (linear probing, backward shift deletion), so malloc/free cost the same with ten or
+ * a million live blocks. The table grows, nothing goes untracked unless the tracker itself runs out of memory.
+ * Every allocation is also accounted to its call site.
  * @version 0.1
  * @date 2023-09-09
- * 
+ *
  * @reference https://www.equestionanswers.com/c/memory-leak-detect-and-trace.php
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
+ *
  */
 
 #ifdef __cplusplus  // Provide C++ Compatibility
 extern "C" {
 #endif /* __cplusplus */
 
-#ifndef CY8C6116BZI_F54
-#include "frozen.h"
-#include "gz_mos_platform.h"
-#else
+#if defined(CY8C6116BZI_F54)
 #define __STDC_WANT_LIB_EXT2__ 1
 #include "cy_pdl.h"
 #include "cyhal.h"
 #include "cybsp.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#elif defined(PLATFORM_linux)
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#else
+#include "frozen.h"
+#include "gz_mos_platform.h"
 #endif
 #include "gz_memory_private.h"
+#ifdef GZ_MEMORY_JSON_ASPRINTF
 #include "gz_string.h"
+#endif /* GZ_MEMORY_JSON_ASPRINTF */
 
 enum {
   DEBUG_CHARS_TO_PRINT = 25
 };
 
-static gz_memory_node_t _mem_node[GZ_MEMORY_MAX_PTRS];
-static uint32_t _mem_node_count = 0;
+#define GZ_MEMORY_NO_SITE     UINT32_MAX
+#define GZ_MEMORY_HASH_FACTOR 0x9E3779B97F4A7C15ULL // Fibonacci hashing
 
-void* gz_memory_malloc(size_t size,
-                   char * file_name,
-                   int line,
-                   char * function) {
-  int i = 0;
-  void *pointer = malloc(size);
+#ifdef CY8C6116BZI_F54
+#define GZ_MEMORY_LOCK()      uint32_t _interruptState = Cy_SysLib_EnterCriticalSection()
+#define GZ_MEMORY_UNLOCK()    Cy_SysLib_ExitCriticalSection(_interruptState)
+#else
+static pthread_mutex_t _mem_lock = PTHREAD_MUTEX_INITIALIZER;
+#define GZ_MEMORY_LOCK()      pthread_mutex_lock(&_mem_lock)
+#define GZ_MEMORY_UNLOCK()    pthread_mutex_unlock(&_mem_lock)
+#endif /* CY8C6116BZI_F54 */
+
+static gz_memory_node_t* _mem_nodes = NULL;
+static uint32_t _mem_node_capacity = 0;
+static gz_memory_site_t* _sites = NULL;       // in order of first allocation, indexes never change
+static uint32_t _site_capacity = 0;
+static uint32_t* _site_index = NULL;          // open addressing on file and line, index + 1 in _sites, 0: free
+static uint32_t _site_index_capacity = 0;
+static gz_memory_stats_t _stats;
+
+static inline uint32_t _gz_memory_hash(uint64_t key, uint32_t capacity) {
+  return (uint32_t)((key * GZ_MEMORY_HASH_FACTOR) >> 32) & (capacity - 1);
+}
+
+static inline uint32_t _gz_memory_node_hash(const void* pointer, uint32_t capacity) {
+  return _gz_memory_hash((uintptr_t)pointer >> 3, capacity); // the allocator aligns to at least 8
+}
 
-  for (i = 0; i < GZ_MEMORY_MAX_PTRS; i++) {
-    if (_mem_node[i].flag == 0) {
-      _mem_node[i].flag = 1;
-      _mem_node[i].mem_pointer = pointer;
-      _mem_node[i].file_name = file_name;
-      _mem_node[i].function = function;
-      _mem_node[i].line = line;
-      _mem_node[i].size = size;
-      if (_mem_node_count < GZ_MEMORY_MAX_PTRS) {
-        _mem_node_count++;
+/**
+ * @brief Doubles the node table, or creates it
+ * @return false when out of memory, the table is left as is
+ */
+static bool _gz_memory_grow_nodes(void) {
+  uint32_t capacity = _mem_node_capacity ? _mem_node_capacity * 2 : GZ_MEMORY_INITIAL_NODES;
+  gz_memory_node_t* nodes = (gz_memory_node_t*)calloc(capacity, sizeof(gz_memory_node_t));
+  if (!nodes) {
+    return false;
+  }
+  for (uint32_t i = 0; i < _mem_node_capacity; i++) {
+    if (_mem_nodes[i].mem_pointer) {
+      uint32_t slot = _gz_memory_node_hash(_mem_nodes[i].mem_pointer, capacity);
+      while (nodes[slot].mem_pointer) {
+        slot = (slot + 1) & (capacity - 1);
       }
-      break;
+      nodes[slot] = _mem_nodes[i];
+    }
+  }
+  free(_mem_nodes);
+  _mem_nodes = nodes;
+  _mem_node_capacity = capacity;
+  _stats.capacity = capacity;
+  return true;
+}
+
+/**
+ * @brief Call site of an allocation, created on its first one
+ * @return its index in _sites, GZ_MEMORY_NO_SITE when out of memory
+ */
+static uint32_t _gz_memory_site(const char* file_name, int line, const char* function) {
+  // __FILE__ is a literal: one pointer per file in practice, comparing it is enough
+  uint64_t key = (uintptr_t)file_name ^ ((uint64_t)line << 40);
+  if (_site_index_capacity) {
+    uint32_t slot = _gz_memory_hash(key, _site_index_capacity);
+    while (_site_index[slot]) {
+      gz_memory_site_t* site = &_sites[_site_index[slot] - 1];
+      if (site->file_name == file_name && site->line == line) {
+        return _site_index[slot] - 1;
+      }
+      slot = (slot + 1) & (_site_index_capacity - 1);
+    }
+  }
+  if (_stats.sites == _site_capacity) {
+    uint32_t capacity = _site_capacity ? _site_capacity * 2 : GZ_MEMORY_INITIAL_SITES;
+    gz_memory_site_t* sites = (gz_memory_site_t*)realloc(_sites, capacity * sizeof(gz_memory_site_t));
+    uint32_t* index = (uint32_t*)calloc(capacity * 2, sizeof(uint32_t));
+    if (!sites || !index) {
+      free(index);
+      if (sites) {
+        _sites = sites;
+      }
+      return GZ_MEMORY_NO_SITE;
+    }
+    for (uint32_t i = 0; i < _stats.sites; i++) {
+      uint64_t siteKey = (uintptr_t)sites[i].file_name ^ ((uint64_t)sites[i].line << 40);
+      uint32_t slot = _gz_memory_hash(siteKey, capacity * 2);
+      while (index[slot]) {
+        slot = (slot + 1) & (capacity * 2 - 1);
+      }
+      index[slot] = i + 1;
+    }
+    free(_site_index);
+    _sites = sites;
+    _site_capacity = capacity;
+    _site_index = index;
+    _site_index_capacity = capacity * 2; // never more than half full
+  }
+  uint32_t slot = _gz_memory_hash(key, _site_index_capacity);
+  while (_site_index[slot]) {
+    slot = (slot + 1) & (_site_index_capacity - 1);
+  }
+  gz_memory_site_t* site = &_sites[_stats.sites];
+  memset(site, 0, sizeof(*site));
+  site->file_name = file_name;
+  site->line = line;
+  site->function = function;
+  _site_index[slot] = ++_stats.sites;
+  return _stats.sites - 1;
+}
+
+/**
+ * @brief Adds a live allocation, called locked
+ * @return false when the table can not take it
+ */
+static bool _gz_memory_insert(void* pointer, size_t size, uint32_t site) {
+  if (site == GZ_MEMORY_NO_SITE ||
+      ((_stats.count + 1) * 2 > _mem_node_capacity && !_gz_memory_grow_nodes() &&
+       _stats.count + 1 >= _mem_node_capacity)) { // keep at least one free slot, the probes end on it
+    _stats.untracked++;
+    return false;
+  }
+  uint32_t slot = _gz_memory_node_hash(pointer, _mem_node_capacity);
+  while (_mem_nodes[slot].mem_pointer) {
+    slot = (slot + 1) & (_mem_node_capacity - 1);
+  }
+  _mem_nodes[slot].mem_pointer = pointer;
+  _mem_nodes[slot].size = size;
+  _mem_nodes[slot].site = site;
+  _stats.count++;
+  _stats.bytes += size;
+  if (_stats.bytes > _stats.peak_bytes) {
+    _stats.peak_bytes = _stats.bytes;
+  }
+  _sites[site].count++;
+  _sites[site].bytes += size;
+  if (_sites[site].bytes > _sites[site].peak_bytes) {
+    _sites[site].peak_bytes = _sites[site].bytes;
+  }
+  return true;
+}
+
+/**
+ * @brief Removes a live allocation, called locked
+ * @return false if the pointer is not tracked
+ */
+static bool _gz_memory_remove(const void* pointer, gz_memory_node_t* node) {
+  if (!_mem_node_capacity) {
+    return false;
+  }
+  uint32_t mask = _mem_node_capacity - 1;
+  uint32_t slot = _gz_memory_node_hash(pointer, _mem_node_capacity);
+  while (_mem_nodes[slot].mem_pointer != pointer) {
+    if (!_mem_nodes[slot].mem_pointer) {
+      return false;
     }
+    slot = (slot + 1) & mask;
   }
+  *node = _mem_nodes[slot];
+  _sites[node->site].count--;
+  _sites[node->site].bytes -= node->size;
+  _stats.count--;
+  _stats.bytes -= node->size;
+  // Backward shift: the following nodes of the cluster move up if the hole is on their probe path
+  uint32_t hole = slot;
+  for (uint32_t next = (hole + 1) & mask; _mem_nodes[next].mem_pointer; next = (next + 1) & mask) {
+    uint32_t home = _gz_memory_node_hash(_mem_nodes[next].mem_pointer, _mem_node_capacity);
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      _mem_nodes[hole] = _mem_nodes[next];
+      hole = next;
+    }
+  }
+  _mem_nodes[hole].mem_pointer = NULL;
+  return true;
+}
+
+static void _gz_memory_track(void* pointer, size_t size, const char* file_name, int line, const char* function) {
+  if (!pointer) {
+    return;
+  }
+  GZ_MEMORY_LOCK();
+  uint32_t site = _gz_memory_site(file_name, line, function);
+  if (_gz_memory_insert(pointer, size, site)) {
+    _stats.total_count++;
+    _sites[site].total_count++;
+  }
+  GZ_MEMORY_UNLOCK();
+}
 
+static const char* _gz_memory_preview(const char* pointer) {
+  return strnlen(pointer, DEBUG_CHARS_TO_PRINT) ? pointer : "non empty";
+}
+
+void* gz_memory_malloc(size_t size,
+                   char * file_name,
+                   int line,
+                   char * function) {
+  void *pointer = malloc(size);
+  _gz_memory_track(pointer, size, file_name, line, function);
   return pointer;
 }
 
@@ -66,24 +251,8 @@ void* gz_memory_calloc(size_t num,
                    char * file_name,
                    int line,
                    char * function) {
-  int i = 0;
   void *pointer = calloc(num, size);
-
-  for (i = 0; i < GZ_MEMORY_MAX_PTRS; i++) {
-    if (_mem_node[i].flag == 0) {
-      _mem_node[i].flag = 1;
-      _mem_node[i].mem_pointer = pointer;
-      _mem_node[i].file_name = file_name;
-      _mem_node[i].function = function;
-      _mem_node[i].line = line;
-      _mem_node[i].size = (num * size);
-      if (_mem_node_count < GZ_MEMORY_MAX_PTRS) {
-        _mem_node_count++;
-      }
-      break;
-    }
-  }
-
+  _gz_memory_track(pointer, num * size, file_name, line, function);
   return pointer;
 }
 
@@ -92,165 +261,120 @@ void* gz_memory_realloc(void * ptr,
                    char * file_name,
                    int line,
                    char * function) {
-  void *temp_ptr = ptr;
+  gz_memory_node_t node;
+  bool isTracked = false;
+  if (ptr) {
+    GZ_MEMORY_LOCK();
+    isTracked = _gz_memory_remove(ptr, &node);
+    if (!isTracked) {
+      _stats.unknown_frees++;
+    }
+    GZ_MEMORY_UNLOCK();
+  }
 
   void *pointer = realloc(ptr, size);
 
-  // If realloc does not move the original pointer location, we only need to update the size of the allocated memory at that location.
-  // If realloc does move the original pointer location, we need to clear the previous location as realloc has freed it, and then update the new location with the new size.
-  if (pointer == ptr) {
-    for (int i = 0; i < GZ_MEMORY_MAX_PTRS; i++) {
-      if (_mem_node[i].mem_pointer == ptr) {
-        _mem_node[i].file_name = file_name;
-        _mem_node[i].function = function;
-        _mem_node[i].line = line;
-        _mem_node[i].size = size;
-        break;
-      }
-    }
-  } else {
-    for (int i = 0; i < GZ_MEMORY_MAX_PTRS; i++) {
-      if (_mem_node[i].mem_pointer == temp_ptr) {
-        _mem_node[i].flag = 0;
-        _mem_node[i].mem_pointer = NULL;
-        _mem_node[i].file_name = 0;
-        _mem_node[i].function = 0;
-        _mem_node[i].line = 0;
-        _mem_node[i].size = 0;
-        break;
-      }
-    }
-    for (int i = 0; i < GZ_MEMORY_MAX_PTRS; i++) {
-      if (_mem_node[i].flag == 0) {
-        _mem_node[i].flag = 1;
-        _mem_node[i].mem_pointer = pointer;
-        _mem_node[i].file_name = file_name;
-        _mem_node[i].function = function;
-        _mem_node[i].line = line;
-        _mem_node[i].size = size;
-        break;
-      }
-    }
+  // Moved or not, the block is now accounted to this call. On failure the original one is still allocated,
+  // unless the size was 0 and realloc freed it
+  if (pointer) {
+    _gz_memory_track(pointer, size, file_name, line, function);
+  } else if (size && isTracked) {
+    GZ_MEMORY_LOCK();
+    _gz_memory_insert(ptr, node.size, node.site);
+    GZ_MEMORY_UNLOCK();
   }
 
   return pointer;
 }
 
 void gz_memory_free(void * mem_pointer) {
-  int i = 0;
-
-  for (i = 0; i < GZ_MEMORY_MAX_PTRS; i++) {
-    if (_mem_node[i].mem_pointer == mem_pointer) {
-      _mem_node[i].flag = 0;
-      _mem_node[i].mem_pointer = NULL;
-      _mem_node[i].file_name = 0;
-      _mem_node[i].function = 0;
-      _mem_node[i].line = 0;
-      _mem_node[i].size = 0;
-      free(mem_pointer);
-      if (_mem_node_count) {
-        _mem_node_count--;
-      }
-      break;
+  gz_memory_node_t node;
+  if (mem_pointer) {
+    GZ_MEMORY_LOCK();
+    if (!_gz_memory_remove(mem_pointer, &node)) {
+      _stats.unknown_frees++;
     }
+    GZ_MEMORY_UNLOCK();
   }
+  free(mem_pointer);
 }
 
 void gz_memory_show_mem_stat(void) {
-  int i = 0;
-  int ret = 0;
-
-  printf("Number of memory nodes not freed: %d\r\n", _mem_node_count);
-  for (i = 0; i < GZ_MEMORY_MAX_PTRS; i++) {
-    if (_mem_node[i].flag == 1) {
-      printf("0x%p of %d bytes allocated"
-              " from %s:%d in %s() is not freed. First few chars of mem are: %s\r\n",
-              _mem_node[i].mem_pointer,
-              _mem_node[i].size,
-              _mem_node[i].file_name,
-              _mem_node[i].line,
-              _mem_node[i].function,
-              prnstr(_mem_node[i].mem_pointer, DEBUG_CHARS_TO_PRINT, "non empty"));
-      ret = 1;
+  GZ_MEMORY_LOCK();
+  printf("Number of memory nodes not freed: %u (%u bytes, peak %u bytes, %u untracked)\r\n", _stats.count,
+         (unsigned)_stats.bytes, (unsigned)_stats.peak_bytes, _stats.untracked);
+  for (uint32_t i = 0; i < _mem_node_capacity; i++) {
+    if (_mem_nodes[i].mem_pointer) {
+      const gz_memory_site_t* site = &_sites[_mem_nodes[i].site];
+      printf("%p of %u bytes allocated"
+              " from %s:%d in %s() is not freed. First few chars of mem are: %.*s\r\n",
+              _mem_nodes[i].mem_pointer,
+              (unsigned)_mem_nodes[i].size,
+              site->file_name,
+              site->line,
+              site->function,
+              DEBUG_CHARS_TO_PRINT,
+              _gz_memory_preview((const char*)_mem_nodes[i].mem_pointer));
+    }
+  }
+  for (uint32_t i = 0; i < _stats.sites; i++) {
+    if (_sites[i].count) {
+      printf("%s:%d in %s(): %u blocks, %u bytes not freed, peak %u bytes, %llu allocations\r\n",
+             _sites[i].file_name, _sites[i].line, _sites[i].function, _sites[i].count, (unsigned)_sites[i].bytes,
+             (unsigned)_sites[i].peak_bytes, (unsigned long long)_sites[i].total_count);
     }
   }
 
-  if (ret == 0) {
+  if (_stats.count == 0) {
     printf("no memory leaks detected!\n");
   }
+  GZ_MEMORY_UNLOCK();
+}
+
+void gz_memory_get_stats(gz_memory_stats_t * stats) {
+  GZ_MEMORY_LOCK();
+  *stats = _stats;
+  GZ_MEMORY_UNLOCK();
+}
+
+uint32_t gz_memory_get_sites(gz_memory_site_t * sites, uint32_t max_sites) {
+  GZ_MEMORY_LOCK();
+  uint32_t count = _stats.sites;
+  if (sites && count) {
+    memcpy(sites, _sites, (count < max_sites ? count : max_sites) * sizeof(gz_memory_site_t));
+  }
+  GZ_MEMORY_UNLOCK();
+  return count;
 }
 
 int gz_memory_asprintf(char* file_name, int line, char* function, char** strp, const char *fmt, ...) {
-  int i = 0;
-  int ret = -1;
   va_list ap;
   int size = 0;
 
   va_start(ap, fmt);
   size = vasprintf(strp, fmt, ap);
+  va_end(ap);
 
-  if (size == -1) {
-    va_end(ap);
-    return size;
+  if (size != -1) {
+    _gz_memory_track(*strp, size + 1, file_name, line, function);
   }
-
-  for (i = 0; i < GZ_MEMORY_MAX_PTRS; i++) {
-    if (_mem_node[i].flag == 0) {
-      _mem_node[i].flag = 1;
-      _mem_node[i].mem_pointer = *strp;
-      _mem_node[i].file_name = file_name;
-      _mem_node[i].function = function;
-      _mem_node[i].line = line;
-      _mem_node[i].size = size;
-      ret = 0;
-      if (_mem_node_count < GZ_MEMORY_MAX_PTRS) {
-        _mem_node_count++;
-      }
-      break;
-    }
-  }
-
-  va_end(ap);
   return size;
 }
 
-#ifndef CY8C6116BZI_F54
+#ifdef GZ_MEMORY_JSON_ASPRINTF
 char* gz_memory_json_asprintf(char* file_name, int line, char* function, const char *fmt, ...) {
-  int i = 0;
-  int ret = -1;
   va_list ap;
-  int size = 0;
 
   va_start(ap, fmt);
   char *str = json_vasprintf(fmt, ap);
+  va_end(ap);
 
   if (strisset(str)) {
-    size = strlen(str);
-  } else {
-    va_end(ap);
-    return str;
-  }
-
-  for (i = 0; i < GZ_MEMORY_MAX_PTRS; i++) {
-    if (_mem_node[i].flag == 0) {
-      _mem_node[i].flag = 1;
-      _mem_node[i].mem_pointer = str;
-      _mem_node[i].file_name = file_name;
-      _mem_node[i].function = function;
-      _mem_node[i].line = line;
-      _mem_node[i].size = size;
-      ret = 0;
-      if (_mem_node_count < GZ_MEMORY_MAX_PTRS) {
-        _mem_node_count++;
-      }
-      break;
-    }
+    _gz_memory_track(str, strlen(str) + 1, file_name, line, function);
   }
-
-  va_end(ap);
   return str;
 }
-#endif /* CY8C6116BZI_F54 */
+#endif /* GZ_MEMORY_JSON_ASPRINTF */
 
 #ifdef __cplusplus
 }
@@ -5,22 +5,50 @@
 extern "C" {
 #endif /* __cplusplus */
 
-#ifndef CY8C6116BZI_F54
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(CY8C6116BZI_F54) && !defined(PLATFORM_linux)
+#define GZ_MEMORY_JSON_ASPRINTF // frozen's json_vasprintf, Mongoose OS builds only
 #include "frozen.h"
-#endif /* CY8C6116BZI_F54 */
+#endif /* !CY8C6116BZI_F54 && !PLATFORM_linux */
+
+#define GZ_MEMORY_INITIAL_NODES 256 // power of two, the table doubles when half full
+#define GZ_MEMORY_INITIAL_SITES 64  // same for the call sites
 
-#define GZ_MEMORY_MAX_PTRS 1024
+/**
+ * @brief A live allocation, slot of the open addressing table indexed by the pointer
+ */
+typedef struct {
+  void * mem_pointer; // NULL: free slot
+  size_t size;
+  uint32_t site;      // index of its call site
+} gz_memory_node_t;
 
+/**
+ * @brief Allocations aggregated per call site (file and line of the malloc/calloc/realloc/asprintf)
+ */
 typedef struct {
-  void * mem_pointer;
-  char * file_name;
-  char * function;
+  const char * file_name;
+  const char * function;
   int line;
-  int size;
-  int flag;
-} gz_memory_node_t ;
+  uint32_t count;             // live allocations
+  size_t bytes;               // live bytes
+  size_t peak_bytes;
+  uint64_t total_count;       // allocations since the start
+} gz_memory_site_t;
 
-gz_memory_node_t mem_node[GZ_MEMORY_MAX_PTRS];
+typedef struct {
+  uint32_t count;             // live allocations
+  size_t bytes;               // live bytes
+  size_t peak_bytes;
+  uint64_t total_count;       // allocations since the start
+  uint32_t untracked;         // allocations not recorded, the tracker itself ran out of memory
+  uint32_t unknown_frees;     // frees of pointers the tracker never saw
+  uint32_t capacity;          // slots of the table
+  uint32_t sites;
+} gz_memory_stats_t;
 
 void* gz_memory_malloc(size_t size,
                    char * file_name,
@@ -41,13 +69,24 @@ void* gz_memory_realloc(void * ptr,
 
 void gz_memory_free(void * mem_pointer);
 
+/**
+ * @brief Prints the allocations not freed, then the call sites still holding memory
+ */
 void gz_memory_show_mem_stat(void);
 
+void gz_memory_get_stats(gz_memory_stats_t * stats);
+
+/**
+ * @brief Copies up to max_sites call sites, in order of first allocation
+ * @return number of call sites, may be more than max_sites
+ */
+uint32_t gz_memory_get_sites(gz_memory_site_t * sites, uint32_t max_sites);
+
 int gz_memory_asprintf(char* file_name, int line, char* function, char** strp, const char *fmt, ...);
 
-#ifndef CY8C6116BZI_F54
+#ifdef GZ_MEMORY_JSON_ASPRINTF
 char* gz_memory_json_asprintf(char* file_name, int line, char* function, const char *fmt, ...);
-#endif /* CY8C6116BZI_F54 */
+#endif /* GZ_MEMORY_JSON_ASPRINTF */
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,290 @@
+/**
+ * @file gz_pool.c
+ * @brief Fixed-size block pools and bump arena, see gz_pool.h
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifdef __cplusplus  // Provide C++ Compatibility
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef CY8C6116BZI_F54
+#include "cy_pdl.h"
+#endif /* CY8C6116BZI_F54 */
+#include "gz_pool.h"
+
+#define GZ_POOL_ALIGN(size)   (((size) + GZ_POOL_ALIGNMENT - 1) & ~(size_t)(GZ_POOL_ALIGNMENT - 1))
+
+#ifdef CY8C6116BZI_F54
+#define GZ_POOL_LOCK(pool)    uint32_t _interruptState = Cy_SysLib_EnterCriticalSection()
+#define GZ_POOL_UNLOCK(pool)  Cy_SysLib_ExitCriticalSection(_interruptState)
+#else
+#define GZ_POOL_LOCK(pool)    pthread_mutex_lock(&(pool)->lock)
+#define GZ_POOL_UNLOCK(pool)  pthread_mutex_unlock(&(pool)->lock)
+
+/**
+ * @brief Blocks a thread keeps for one pool, linked through the blocks themselves
+ */
+typedef struct {
+  gz_pool_t* pool;
+  gz_pool_block_t* blocks;
+  uint32_t count;
+} _Gz_Pool_Cache_t;
+
+static __thread _Gz_Pool_Cache_t _caches[GZ_POOL_THREAD_CACHES];
+static pthread_once_t _cacheKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t _cacheKey; // its destructor gives the blocks back when the thread exits
+#endif /* CY8C6116BZI_F54 */
+
+/**
+ * @brief Takes up to count blocks of the free list, called locked
+ * @return the first one, linked to the others
+ */
+static gz_pool_block_t* _gz_pool_take(gz_pool_t* pool, uint32_t count, uint32_t* taken) {
+  gz_pool_block_t* first = pool->free_list;
+  gz_pool_block_t* last = NULL;
+  *taken = 0;
+  for (gz_pool_block_t* block = first; block && *taken < count; block = block->next) {
+    last = block;
+    (*taken)++;
+  }
+  if (!last) {
+    pool->failures++;
+    return NULL;
+  }
+  pool->free_list = last->next;
+  last->next = NULL;
+  pool->used += *taken;
+  if (pool->used > pool->high_water) {
+    pool->high_water = pool->used;
+  }
+  return first;
+}
+
+/**
+ * @brief Puts back a list of count blocks, called locked
+ */
+static void _gz_pool_give(gz_pool_t* pool, gz_pool_block_t* first, gz_pool_block_t* last, uint32_t count) {
+  last->next = pool->free_list;
+  pool->free_list = first;
+  pool->used -= count;
+}
+
+#ifndef CY8C6116BZI_F54
+static void _gz_pool_cache_flush(_Gz_Pool_Cache_t* cache, uint32_t count) {
+  gz_pool_block_t* first = cache->blocks;
+  gz_pool_block_t* last = first;
+  for (uint32_t i = 1; i < count; i++) {
+    last = last->next;
+  }
+  cache->blocks = last->next;
+  cache->count -= count;
+  GZ_POOL_LOCK(cache->pool);
+  _gz_pool_give(cache->pool, first, last, count);
+  GZ_POOL_UNLOCK(cache->pool);
+}
+
+static void _gz_pool_cache_release(void* caches) {
+  for (uint8_t i = 0; i < GZ_POOL_THREAD_CACHES; i++) {
+    if (_caches[i].count) {
+      _gz_pool_cache_flush(&_caches[i], _caches[i].count);
+    }
+    _caches[i].pool = NULL;
+  }
+}
+
+static void _gz_pool_cache_key_create(void) {
+  pthread_key_create(&_cacheKey, _gz_pool_cache_release);
+}
+
+/**
+ * @brief Cache of the calling thread for the pool, created on first use
+ * @return NULL if the thread already caches GZ_POOL_THREAD_CACHES other pools
+ */
+static _Gz_Pool_Cache_t* _gz_pool_cache(gz_pool_t* pool) {
+  for (uint8_t i = 0; i < GZ_POOL_THREAD_CACHES; i++) {
+    if (_caches[i].pool == pool) {
+      return &_caches[i];
+    }
+  }
+  for (uint8_t i = 0; i < GZ_POOL_THREAD_CACHES; i++) {
+    if (!_caches[i].pool) {
+      pthread_once(&_cacheKeyOnce, _gz_pool_cache_key_create);
+      pthread_setspecific(_cacheKey, _caches); // any non NULL value, for the destructor to run
+      _caches[i].pool = pool;
+      return &_caches[i];
+    }
+  }
+  return NULL;
+}
+#endif /* CY8C6116BZI_F54 */
+
+int gz_pool_init(gz_pool_t* pool, size_t blockSize, uint32_t blockCount, void* buffer, uint32_t flags) {
+  if (!pool || !blockCount) {
+    return -1;
+  }
+  memset(pool, 0, sizeof(*pool));
+  pool->block_size = GZ_POOL_ALIGN(blockSize < sizeof(gz_pool_block_t) ? sizeof(gz_pool_block_t) : blockSize);
+  pool->block_count = blockCount;
+  pool->memory = (uint8_t*)buffer;
+  if (!pool->memory) {
+    pool->memory = (uint8_t*)malloc(pool->block_size * blockCount);
+    if (!pool->memory) {
+      return -1;
+    }
+    pool->is_owner = true;
+  }
+  for (uint32_t i = blockCount; i-- > 0;) { // the first block on top
+    gz_pool_block_t* block = (gz_pool_block_t*)(pool->memory + i * pool->block_size);
+    block->next = pool->free_list;
+    pool->free_list = block;
+  }
+#ifndef CY8C6116BZI_F54
+  pool->flags = flags;
+  pthread_mutex_init(&pool->lock, NULL);
+#endif /* CY8C6116BZI_F54 */
+  return 0;
+}
+
+void gz_pool_destroy(gz_pool_t* pool) {
+  if (!pool || !pool->memory) {
+    return;
+  }
+#ifndef CY8C6116BZI_F54
+  gz_pool_flush_thread_cache(pool);
+  for (uint8_t i = 0; i < GZ_POOL_THREAD_CACHES; i++) {
+    if (_caches[i].pool == pool) {
+      _caches[i].pool = NULL;
+    }
+  }
+  pthread_mutex_destroy(&pool->lock);
+#endif /* CY8C6116BZI_F54 */
+  if (pool->is_owner) {
+    free(pool->memory);
+  }
+  memset(pool, 0, sizeof(*pool));
+}
+
+void* gz_pool_alloc(gz_pool_t* pool) {
+  uint32_t taken;
+#ifndef CY8C6116BZI_F54
+  _Gz_Pool_Cache_t* cache = (pool->flags & GZ_POOL_FLAG_THREAD_CACHE) ? _gz_pool_cache(pool) : NULL;
+  if (cache) {
+    if (!cache->count) {
+      GZ_POOL_LOCK(pool);
+      cache->blocks = _gz_pool_take(pool, GZ_POOL_THREAD_CACHE_BLOCKS / 2, &taken);
+      GZ_POOL_UNLOCK(pool);
+      cache->count = taken;
+      if (!taken) {
+        return NULL;
+      }
+    }
+    gz_pool_block_t* block = cache->blocks;
+    cache->blocks = block->next;
+    cache->count--;
+    return block;
+  }
+#endif /* CY8C6116BZI_F54 */
+  GZ_POOL_LOCK(pool);
+  void* block = _gz_pool_take(pool, 1, &taken);
+  GZ_POOL_UNLOCK(pool);
+  return block;
+}
+
+void gz_pool_free(gz_pool_t* pool, void* block) {
+  if (!block) {
+    return;
+  }
+  gz_pool_block_t* freed = (gz_pool_block_t*)block;
+#ifndef CY8C6116BZI_F54
+  _Gz_Pool_Cache_t* cache = (pool->flags & GZ_POOL_FLAG_THREAD_CACHE) ? _gz_pool_cache(pool) : NULL;
+  if (cache) {
+    freed->next = cache->blocks;
+    cache->blocks = freed;
+    if (++cache->count == GZ_POOL_THREAD_CACHE_BLOCKS) {
+      _gz_pool_cache_flush(cache, GZ_POOL_THREAD_CACHE_BLOCKS / 2);
+    }
+    return;
+  }
+#endif /* CY8C6116BZI_F54 */
+  GZ_POOL_LOCK(pool);
+  _gz_pool_give(pool, freed, freed, 1);
+  GZ_POOL_UNLOCK(pool);
+}
+
+bool gz_pool_owns(const gz_pool_t* pool, const void* block) {
+  const uint8_t* address = (const uint8_t*)block;
+  return pool && pool->memory && address >= pool->memory &&
+         address < pool->memory + pool->block_size * pool->block_count;
+}
+
+void gz_pool_flush_thread_cache(gz_pool_t* pool) {
+#ifndef CY8C6116BZI_F54
+  for (uint8_t i = 0; i < GZ_POOL_THREAD_CACHES; i++) {
+    if (_caches[i].pool == pool && _caches[i].count) {
+      _gz_pool_cache_flush(&_caches[i], _caches[i].count);
+    }
+  }
+#endif /* CY8C6116BZI_F54 */
+}
+
+void gz_pool_get_stats(gz_pool_t* pool, gz_pool_stats_t* stats) {
+  GZ_POOL_LOCK(pool);
+  stats->block_size = pool->block_size;
+  stats->block_count = pool->block_count;
+  stats->used = pool->used;
+  stats->high_water = pool->high_water;
+  stats->failures = pool->failures;
+  GZ_POOL_UNLOCK(pool);
+}
+
+int gz_arena_init(gz_arena_t* arena, void* buffer, size_t size) {
+  if (!arena || !size) {
+    return -1;
+  }
+  memset(arena, 0, sizeof(*arena));
+  arena->memory = (uint8_t*)buffer;
+  if (!arena->memory) {
+    arena->memory = (uint8_t*)malloc(size);
+    if (!arena->memory) {
+      return -1;
+    }
+    arena->is_owner = true;
+  }
+  arena->size = size;
+  return 0;
+}
+
+void gz_arena_destroy(gz_arena_t* arena) {
+  if (arena && arena->is_owner) {
+    free(arena->memory);
+  }
+  if (arena) {
+    memset(arena, 0, sizeof(*arena));
+  }
+}
+
+void* gz_arena_alloc(gz_arena_t* arena, size_t size) {
+  size = GZ_POOL_ALIGN(size);
+  if (size > arena->size - arena->offset) {
+    arena->failures++;
+    return NULL;
+  }
+  void* pointer = arena->memory + arena->offset;
+  arena->offset += size;
+  if (arena->offset > arena->high_water) {
+    arena->high_water = arena->offset;
+  }
+  return pointer;
+}
+
+void gz_arena_reset(gz_arena_t* arena) {
+  arena->offset = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
@@ -0,0 +1,129 @@
+/**
+ * @file gz_pool.h
+ * @brief Heap-free allocation for long running code: fixed-size block pools and a bump arena
+ *
+ * A pool hands out blocks of one size from a single buffer, alloc and free are O(1) (intrusive free list)
+ * and never fragment the heap. On Linux a pool may also keep a few blocks per thread, alloc/free then take no
+ * lock. The arena allocates anything from one buffer and is freed all at once with gz_arena_reset().
+ * The buffer is given by the caller (static, for the small-RAM targets) or allocated once at init.
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef GZ_POOL_H
+#define GZ_POOL_H
+
+#ifdef __cplusplus  // Provide C++ Compatibility
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifndef CY8C6116BZI_F54
+#include <pthread.h>
+#endif /* CY8C6116BZI_F54 */
+
+#define GZ_POOL_ALIGNMENT             8   // block sizes and arena allocations are rounded up to it
+#define GZ_POOL_THREAD_CACHE_BLOCKS   32  // per thread and pool, half of it moves at once from/to the pool
+#define GZ_POOL_THREAD_CACHES         4   // pools a thread caches blocks of, the others take the lock
+
+#define GZ_POOL_BUFFER_SIZE(blockSize, blockCount) \
+  ((((blockSize) + GZ_POOL_ALIGNMENT - 1) & ~(size_t)(GZ_POOL_ALIGNMENT - 1)) * (blockCount))
+
+typedef enum {
+  GZ_POOL_FLAG_NONE = 0,
+  GZ_POOL_FLAG_THREAD_CACHE = 0x01, // Linux only, ignored elsewhere
+} gz_pool_flag_t;
+
+typedef struct gz_pool_block {
+  struct gz_pool_block* next;
+} gz_pool_block_t;
+
+typedef struct gz_pool {
+  uint8_t* memory;
+  size_t block_size;
+  uint32_t block_count;
+  uint32_t flags;             // gz_pool_flag_t
+  bool is_owner;              // memory allocated by gz_pool_init()
+  gz_pool_block_t* free_list;
+  uint32_t used;              // blocks not in the free list: given out or in a thread cache
+  uint32_t high_water;
+  uint32_t failures;          // gz_pool_alloc() with every block used
+#ifndef CY8C6116BZI_F54
+  pthread_mutex_t lock;
+#endif /* CY8C6116BZI_F54 */
+} gz_pool_t;
+
+typedef struct {
+  size_t block_size;
+  uint32_t block_count;
+  uint32_t used;              // thread caches included
+  uint32_t high_water;
+  uint32_t failures;
+} gz_pool_stats_t;
+
+typedef struct {
+  uint8_t* memory;
+  size_t size;
+  size_t offset;              // used bytes
+  size_t high_water;
+  uint32_t failures;          // gz_arena_alloc() that did not fit
+  bool is_owner;
+} gz_arena_t;
+
+/**
+ * @param buffer GZ_POOL_BUFFER_SIZE(blockSize, blockCount) bytes aligned to GZ_POOL_ALIGNMENT, NULL to allocate it
+ * @param flags gz_pool_flag_t
+ * @return 0 on success, -1 otherwise
+ */
+int gz_pool_init(gz_pool_t* pool, size_t blockSize, uint32_t blockCount, void* buffer, uint32_t flags);
+
+/**
+ * @brief Frees the buffer if the pool allocated it. The threads that cached blocks must be done with the pool
+ */
+void gz_pool_destroy(gz_pool_t* pool);
+
+/**
+ * @return a block of block_size bytes, NULL when every block is used
+ */
+void* gz_pool_alloc(gz_pool_t* pool);
+
+void gz_pool_free(gz_pool_t* pool, void* block);
+
+/**
+ * @brief Whether block comes from this pool, for the callers falling back to the heap when it is exhausted
+ */
+bool gz_pool_owns(const gz_pool_t* pool, const void* block);
+
+/**
+ * @brief Gives the blocks cached by the calling thread back to the pool, done anyway when the thread exits
+ */
+void gz_pool_flush_thread_cache(gz_pool_t* pool);
+
+void gz_pool_get_stats(gz_pool_t* pool, gz_pool_stats_t* stats);
+
+/**
+ * @param buffer size bytes aligned to GZ_POOL_ALIGNMENT, NULL to allocate it
+ * @return 0 on success, -1 otherwise
+ */
+int gz_arena_init(gz_arena_t* arena, void* buffer, size_t size);
+
+void gz_arena_destroy(gz_arena_t* arena);
+
+/**
+ * @brief Not thread safe, an arena has one owner
+ * @return size bytes aligned to GZ_POOL_ALIGNMENT, NULL if they do not fit
+ */
+void* gz_arena_alloc(gz_arena_t* arena, size_t size);
+
+/**
+ * @brief Frees everything allocated from the arena at once
+ */
+void gz_arena_reset(gz_arena_t* arena);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* GZ_POOL_H */
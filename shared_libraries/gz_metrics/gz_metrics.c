@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "gz_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GZ_METRICS_SUB_BUCKETS        (1 << GZ_METRICS_HISTOGRAM_SUB_BITS)
+#define GZ_METRICS_EXACT_LIMIT        (2 * GZ_METRICS_SUB_BUCKETS)  // values below have a bucket each
+#define GZ_METRICS_SLOT_COUNT         0 // histogram slots, then its buckets and the overflow
+#define GZ_METRICS_SLOT_SUM           1
+#define GZ_METRICS_SLOT_MAX           2
+#define GZ_METRICS_SLOT_BUCKETS       3
+#define GZ_METRICS_LINE_LENGTH        256
+
+typedef struct {
+  char name[GZ_METRICS_NAME_LENGTH];
+  const char* help;
+  const char* label;
+  gz_metric_type_t type;
+  uint16_t slot;                  // first slot in the shards
+  uint16_t size;                  // entries of a family, 1 otherwise
+  gz_metrics_label_cb_t labelCb;
+  gz_metrics_read_cb_t read;      // collector, no slot
+  void* context;
+  int64_t gauge;
+  int64_t baseline;               // collector counter value at the last reset
+} _Gz_Metric_t;
+
+/**
+ * @brief The values of a thread: only its owner writes them, any thread reads them
+ */
+typedef struct {
+  uint64_t slots[GZ_METRICS_MAX_SLOTS];
+  bool isOwned;
+} _Gz_Metrics_Shard_t;
+
+typedef struct {
+  gz_metrics_write_cb_t write;
+  void* context;
+} _Gz_Metrics_Writer_t;
+
+static _Gz_Metric_t _metrics[GZ_METRICS_MAX_METRICS];
+static int _metricCount = 0;      // published with a release store once the metric is filled in
+static uint16_t _slotCount = 0;
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER; // registration, reset and dumps
+
+static _Gz_Metrics_Shard_t* _shards[GZ_METRICS_MAX_THREADS]; // created on demand, never freed
+static _Gz_Metrics_Shard_t _sharedShard;                     // the threads beyond, atomic adds
+static uint64_t _baseline[GZ_METRICS_MAX_SLOTS];             // slot values at the last reset
+static pthread_key_t _shardKey;
+static pthread_once_t _shardKeyOnce = PTHREAD_ONCE_INIT;
+static __thread _Gz_Metrics_Shard_t* _localShard = NULL;
+
+/*****************************************************/
+/* Section: Shards                                   */
+/*****************************************************/
+
+static void _gz_metrics_release_shard(void* shard) {
+  // Its counts stay, the next thread claiming it adds to them
+  __atomic_store_n(&((_Gz_Metrics_Shard_t*)shard)->isOwned, false, __ATOMIC_RELEASE);
+  _localShard = NULL;
+}
+
+static void _gz_metrics_create_key(void) {
+  pthread_key_create(&_shardKey, _gz_metrics_release_shard);
+}
+
+/**
+ * @brief First update of a thread: a released shard, else a new one, else the shared one
+ */
+static _Gz_Metrics_Shard_t* _gz_metrics_claim_shard(void) {
+  int savedErrno = errno; // callers check errno after the syscall they count
+  pthread_once(&_shardKeyOnce, _gz_metrics_create_key);
+  _Gz_Metrics_Shard_t* shard = &_sharedShard;
+  for (int i = 0; i < GZ_METRICS_MAX_THREADS; i++) {
+    _Gz_Metrics_Shard_t* candidate = __atomic_load_n(&_shards[i], __ATOMIC_ACQUIRE);
+    if (candidate == NULL) {
+      candidate = (_Gz_Metrics_Shard_t*)calloc(1, sizeof(_Gz_Metrics_Shard_t));
+      if (candidate == NULL) {
+        break;
+      }
+      candidate->isOwned = true;
+      _Gz_Metrics_Shard_t* expected = NULL;
+      if (__atomic_compare_exchange_n(&_shards[i], &expected, candidate, false, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE)) {
+        shard = candidate;
+        break;
+      }
+      free(candidate); // another thread took the place, its shard is owned
+      continue;
+    }
+    bool isOwned = false;
+    if (__atomic_compare_exchange_n(&candidate->isOwned, &isOwned, true, false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_RELAXED)) {
+      shard = candidate;
+      break;
+    }
+  }
+  if (shard != &_sharedShard) {
+    pthread_setspecific(_shardKey, shard);
+  }
+  _localShard = shard;
+  errno = savedErrno;
+  return shard;
+}
+
+static inline _Gz_Metrics_Shard_t* _gz_metrics_shard(void) {
+  _Gz_Metrics_Shard_t* shard = _localShard;
+  return shard ? shard : _gz_metrics_claim_shard();
+}
+
+static inline void _gz_metrics_slot_add(_Gz_Metrics_Shard_t* shard, uint32_t slot, uint64_t value) {
+  if (shard == &_sharedShard) {
+    __atomic_fetch_add(&shard->slots[slot], value, __ATOMIC_RELAXED);
+  } else {
+    // Single writer: no locked instruction, readers see the old or the new value
+    __atomic_store_n(&shard->slots[slot], __atomic_load_n(&shard->slots[slot], __ATOMIC_RELAXED) + value,
+                     __ATOMIC_RELAXED);
+  }
+}
+
+static inline void _gz_metrics_slot_max(_Gz_Metrics_Shard_t* shard, uint32_t slot, uint64_t value) {
+  uint64_t current = __atomic_load_n(&shard->slots[slot], __ATOMIC_RELAXED);
+  if (shard == &_sharedShard) {
+    while (value > current && !__atomic_compare_exchange_n(&shard->slots[slot], &current, value, true,
+                                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+  } else if (value > current) {
+    __atomic_store_n(&shard->slots[slot], value, __ATOMIC_RELAXED);
+  }
+}
+
+static uint64_t _gz_metrics_slot_sum(uint32_t slot) {
+  uint64_t sum = __atomic_load_n(&_sharedShard.slots[slot], __ATOMIC_RELAXED);
+  for (int i = 0; i < GZ_METRICS_MAX_THREADS; i++) {
+    _Gz_Metrics_Shard_t* shard = __atomic_load_n(&_shards[i], __ATOMIC_ACQUIRE);
+    if (shard != NULL) {
+      sum += __atomic_load_n(&shard->slots[slot], __ATOMIC_RELAXED);
+    }
+  }
+  return sum;
+}
+
+static uint64_t _gz_metrics_slot_value(uint32_t slot) {
+  return _gz_metrics_slot_sum(slot) - __atomic_load_n(&_baseline[slot], __ATOMIC_RELAXED);
+}
+
+static uint64_t _gz_metrics_slot_max_value(uint32_t slot) {
+  uint64_t max = __atomic_load_n(&_sharedShard.slots[slot], __ATOMIC_RELAXED);
+  for (int i = 0; i < GZ_METRICS_MAX_THREADS; i++) {
+    _Gz_Metrics_Shard_t* shard = __atomic_load_n(&_shards[i], __ATOMIC_ACQUIRE);
+    if (shard != NULL) {
+      uint64_t value = __atomic_load_n(&shard->slots[slot], __ATOMIC_RELAXED);
+      max = value > max ? value : max;
+    }
+  }
+  return max;
+}
+
+/*****************************************************/
+/* Section: Registration                             */
+/*****************************************************/
+
+static int _gz_metrics_register(const char* name, const char* help, gz_metric_type_t type, const char* label,
+                                uint16_t size, gz_metrics_label_cb_t labelCb, gz_metrics_read_cb_t read,
+                                void* context) {
+  if (name == NULL || strlen(name) >= GZ_METRICS_NAME_LENGTH || size == 0) {
+    return -1;
+  }
+  uint16_t slots = 0;
+  if (read == NULL) {
+    slots = type == GZ_METRIC_HISTOGRAM ? GZ_METRICS_HISTOGRAM_SLOTS : type == GZ_METRIC_COUNTER ? size : 0;
+  }
+  int id = -1;
+  pthread_mutex_lock(&_lock);
+  for (int i = 0; i < _metricCount; i++) {
+    if (strcmp(_metrics[i].name, name) == 0) {
+      // Registered again, the same metric or a conflict
+      bool isSame = _metrics[i].type == type && _metrics[i].size == size &&
+                    (_metrics[i].read == NULL) == (read == NULL);
+      pthread_mutex_unlock(&_lock);
+      return isSame ? i : -1;
+    }
+  }
+  if (_metricCount < GZ_METRICS_MAX_METRICS && _slotCount + slots <= GZ_METRICS_MAX_SLOTS) {
+    id = _metricCount;
+    _Gz_Metric_t* metric = &_metrics[id];
+    memset(metric, 0, sizeof(*metric));
+    strcpy(metric->name, name);
+    metric->help = help;
+    metric->label = label;
+    metric->type = type;
+    metric->slot = _slotCount;
+    metric->size = size;
+    metric->labelCb = labelCb;
+    metric->read = read;
+    metric->context = context;
+    _slotCount += slots;
+    __atomic_store_n(&_metricCount, id + 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&_lock);
+  return id;
+}
+
+int gz_metrics_counter(const char* name, const char* help) {
+  return _gz_metrics_register(name, help, GZ_METRIC_COUNTER, NULL, 1, NULL, NULL, NULL);
+}
+
+int gz_metrics_counter_family(const char* name, const char* help, const char* label, uint16_t size,
+                              gz_metrics_label_cb_t labelCb) {
+  if (label == NULL) {
+    return -1;
+  }
+  return _gz_metrics_register(name, help, GZ_METRIC_COUNTER, label, size, labelCb, NULL, NULL);
+}
+
+int gz_metrics_gauge(const char* name, const char* help) {
+  return _gz_metrics_register(name, help, GZ_METRIC_GAUGE, NULL, 1, NULL, NULL, NULL);
+}
+
+int gz_metrics_histogram(const char* name, const char* help) {
+  return _gz_metrics_register(name, help, GZ_METRIC_HISTOGRAM, NULL, 1, NULL, NULL, NULL);
+}
+
+int gz_metrics_collector(const char* name, const char* help, gz_metric_type_t type, gz_metrics_read_cb_t read,
+                         void* context) {
+  if (read == NULL || type == GZ_METRIC_HISTOGRAM) {
+    return -1;
+  }
+  return _gz_metrics_register(name, help, type, NULL, 1, NULL, read, context);
+}
+
+/**
+ * @return NULL unless id is a registered metric of that type updated by the caller
+ */
+static inline _Gz_Metric_t* _gz_metrics_find(int id, gz_metric_type_t type) {
+  if ((unsigned)id >= (unsigned)__atomic_load_n(&_metricCount, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  _Gz_Metric_t* metric = &_metrics[id];
+  return metric->type == type && metric->read == NULL ? metric : NULL;
+}
+
+/*****************************************************/
+/* Section: Updates                                  */
+/*****************************************************/
+
+void gz_metrics_add(int id, uint64_t value) {
+  _Gz_Metric_t* metric = _gz_metrics_find(id, GZ_METRIC_COUNTER);
+  if (metric != NULL) {
+    _gz_metrics_slot_add(_gz_metrics_shard(), metric->slot, value);
+  }
+}
+
+void gz_metrics_add_at(int id, uint16_t index, uint64_t value) {
+  _Gz_Metric_t* metric = _gz_metrics_find(id, GZ_METRIC_COUNTER);
+  if (metric != NULL && index < metric->size) {
+    _gz_metrics_slot_add(_gz_metrics_shard(), metric->slot + index, value);
+  }
+}
+
+void gz_metrics_set(int id, int64_t value) {
+  _Gz_Metric_t* metric = _gz_metrics_find(id, GZ_METRIC_GAUGE);
+  if (metric != NULL) {
+    __atomic_store_n(&metric->gauge, value, __ATOMIC_RELAXED);
+  }
+}
+
+uint16_t gz_metrics_histogram_index(uint64_t value) {
+  if (value < GZ_METRICS_EXACT_LIMIT) {
+    return (uint16_t)value;
+  }
+  if (value >> GZ_METRICS_HISTOGRAM_MAX_BITS) {
+    return GZ_METRICS_HISTOGRAM_BUCKETS;
+  }
+  // The top SUB_BITS + 1 bits: SUB_BUCKETS buckets per power of two
+  int shift = 63 - __builtin_clzll(value) - GZ_METRICS_HISTOGRAM_SUB_BITS;
+  return (uint16_t)(shift * GZ_METRICS_SUB_BUCKETS + (value >> shift));
+}
+
+uint64_t gz_metrics_histogram_upper(uint16_t index) {
+  if (index < GZ_METRICS_EXACT_LIMIT) {
+    return index;
+  }
+  if (index >= GZ_METRICS_HISTOGRAM_BUCKETS) {
+    return UINT64_MAX;
+  }
+  int shift = index / GZ_METRICS_SUB_BUCKETS - 1;
+  uint64_t mantissa = GZ_METRICS_SUB_BUCKETS + index % GZ_METRICS_SUB_BUCKETS;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+void gz_metrics_record(int id, uint64_t value) {
+  _Gz_Metric_t* metric = _gz_metrics_find(id, GZ_METRIC_HISTOGRAM);
+  if (metric == NULL) {
+    return;
+  }
+  _Gz_Metrics_Shard_t* shard = _gz_metrics_shard();
+  _gz_metrics_slot_add(shard, metric->slot + GZ_METRICS_SLOT_COUNT, 1);
+  _gz_metrics_slot_add(shard, metric->slot + GZ_METRICS_SLOT_SUM, value);
+  _gz_metrics_slot_max(shard, metric->slot + GZ_METRICS_SLOT_MAX, value);
+  _gz_metrics_slot_add(shard, metric->slot + GZ_METRICS_SLOT_BUCKETS + gz_metrics_histogram_index(value), 1);
+}
+
+/*****************************************************/
+/* Section: Reads                                    */
+/*****************************************************/
+
+static int64_t _gz_metrics_value(const _Gz_Metric_t* metric) {
+  if (metric->read != NULL) {
+    int64_t value = metric->read(metric->context);
+    return metric->type == GZ_METRIC_COUNTER ? value - __atomic_load_n(&metric->baseline, __ATOMIC_RELAXED) : value;
+  }
+  if (metric->type == GZ_METRIC_GAUGE) {
+    return __atomic_load_n(&metric->gauge, __ATOMIC_RELAXED);
+  }
+  uint64_t sum = 0;
+  for (uint16_t i = 0; i < metric->size; i++) {
+    sum += _gz_metrics_slot_value(metric->slot + i);
+  }
+  return (int64_t)sum;
+}
+
+int64_t gz_metrics_get(int id) {
+  if ((unsigned)id >= (unsigned)__atomic_load_n(&_metricCount, __ATOMIC_ACQUIRE) ||
+      _metrics[id].type == GZ_METRIC_HISTOGRAM) {
+    return 0;
+  }
+  return _gz_metrics_value(&_metrics[id]);
+}
+
+int64_t gz_metrics_get_at(int id, uint16_t index) {
+  _Gz_Metric_t* metric = _gz_metrics_find(id, GZ_METRIC_COUNTER);
+  if (metric == NULL || index >= metric->size) {
+    return 0;
+  }
+  return (int64_t)_gz_metrics_slot_value(metric->slot + index);
+}
+
+static void _gz_metrics_read_histogram(const _Gz_Metric_t* metric, gz_metrics_histogram_t* histogram) {
+  histogram->count = 0;
+  for (uint16_t i = 0; i < GZ_METRICS_HISTOGRAM_BUCKETS; i++) {
+    histogram->buckets[i] = _gz_metrics_slot_value(metric->slot + GZ_METRICS_SLOT_BUCKETS + i);
+    histogram->count += histogram->buckets[i];
+  }
+  histogram->overflow = _gz_metrics_slot_value(metric->slot + GZ_METRICS_SLOT_BUCKETS + GZ_METRICS_HISTOGRAM_BUCKETS);
+  histogram->count += histogram->overflow;
+  // Count from the buckets, read after them: the quantiles always add up
+  histogram->sum = _gz_metrics_slot_value(metric->slot + GZ_METRICS_SLOT_SUM);
+  histogram->max = _gz_metrics_slot_max_value(metric->slot + GZ_METRICS_SLOT_MAX);
+}
+
+bool gz_metrics_get_histogram(int id, gz_metrics_histogram_t* histogram) {
+  _Gz_Metric_t* metric = _gz_metrics_find(id, GZ_METRIC_HISTOGRAM);
+  if (metric == NULL || histogram == NULL) {
+    return false;
+  }
+  _gz_metrics_read_histogram(metric, histogram);
+  return true;
+}
+
+uint64_t gz_metrics_histogram_quantile(const gz_metrics_histogram_t* histogram, double quantile) {
+  if (histogram->count == 0) {
+    return 0;
+  }
+  quantile = quantile < 0 ? 0 : quantile > 1 ? 1 : quantile;
+  uint64_t rank = (uint64_t)(quantile * histogram->count + 0.999999);
+  rank = rank ? rank : 1;
+  uint64_t seen = 0;
+  for (uint16_t i = 0; i < GZ_METRICS_HISTOGRAM_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint64_t upper = gz_metrics_histogram_upper(i);
+      return upper < histogram->max ? upper : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+void gz_metrics_reset(void) {
+  pthread_mutex_lock(&_lock);
+  for (int id = 0; id < _metricCount; id++) {
+    _Gz_Metric_t* metric = &_metrics[id];
+    if (metric->read != NULL) {
+      if (metric->type == GZ_METRIC_COUNTER) {
+        __atomic_store_n(&metric->baseline, metric->read(metric->context), __ATOMIC_RELAXED);
+      }
+      continue;
+    }
+    uint16_t slots = metric->type == GZ_METRIC_HISTOGRAM ? GZ_METRICS_HISTOGRAM_SLOTS :
+                     metric->type == GZ_METRIC_COUNTER ? metric->size : 0;
+    for (uint16_t i = 0; i < slots; i++) {
+      uint32_t slot = metric->slot + i;
+      if (metric->type == GZ_METRIC_HISTOGRAM && i == GZ_METRICS_SLOT_MAX) {
+        // Not a sum, cleared in place: a maximum racing with it may be lost
+        __atomic_store_n(&_sharedShard.slots[slot], 0, __ATOMIC_RELAXED);
+        for (int s = 0; s < GZ_METRICS_MAX_THREADS; s++) {
+          _Gz_Metrics_Shard_t* shard = __atomic_load_n(&_shards[s], __ATOMIC_ACQUIRE);
+          if (shard != NULL) {
+            __atomic_store_n(&shard->slots[slot], 0, __ATOMIC_RELAXED);
+          }
+        }
+        continue;
+      }
+      __atomic_store_n(&_baseline[slot], _gz_metrics_slot_sum(slot), __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+uint64_t gz_metrics_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*****************************************************/
+/* Section: Dump                                     */
+/*****************************************************/
+
+static void _gz_metrics_printf(_Gz_Metrics_Writer_t* writer, const char* format, ...) {
+  char line[GZ_METRICS_LINE_LENGTH];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (length > 0) {
+    writer->write(writer->context, line, length < (int)sizeof(line) ? (size_t)length : sizeof(line) - 1);
+  }
+}
+
+static const char* _gz_metrics_type_name(gz_metric_type_t type) {
+  return type == GZ_METRIC_COUNTER ? "counter" : type == GZ_METRIC_GAUGE ? "gauge" : "histogram";
+}
+
+static void _gz_metrics_dump_family(_Gz_Metrics_Writer_t* writer, const _Gz_Metric_t* metric, bool isText) {
+  for (uint16_t i = 0; i < metric->size; i++) {
+    uint64_t value = _gz_metrics_slot_value(metric->slot + i);
+    if (value == 0) {
+      continue;
+    }
+    char label[32];
+    if (metric->labelCb != NULL) {
+      metric->labelCb(i, label, sizeof(label));
+    } else {
+      snprintf(label, sizeof(label), "%u", i);
+    }
+    char name[GZ_METRICS_NAME_LENGTH + 2 * sizeof(label) + 8];
+    snprintf(name, sizeof(name), "%.*s{%.31s=\"%s\"}", GZ_METRICS_NAME_LENGTH - 1, metric->name, metric->label, label);
+    _gz_metrics_printf(writer, isText ? "%-48s %llu\n" : "%s %llu\n", name, (unsigned long long)value);
+  }
+}
+
+static void _gz_metrics_dump_histogram(_Gz_Metrics_Writer_t* writer, const _Gz_Metric_t* metric, bool isText) {
+  static gz_metrics_histogram_t histogram; // too big for a thread stack, dumps hold _lock
+  _gz_metrics_read_histogram(metric, &histogram);
+  if (isText) {
+    _gz_metrics_printf(writer, "%-48s count[%llu] mean[%.1f] p50[%llu] p90[%llu] p99[%llu] max[%llu]\n", metric->name,
+                       (unsigned long long)histogram.count,
+                       histogram.count ? (double)histogram.sum / histogram.count : 0.0,
+                       (unsigned long long)gz_metrics_histogram_quantile(&histogram, 0.5),
+                       (unsigned long long)gz_metrics_histogram_quantile(&histogram, 0.9),
+                       (unsigned long long)gz_metrics_histogram_quantile(&histogram, 0.99),
+                       (unsigned long long)histogram.max);
+    return;
+  }
+  // A bucket per power of two: the same series on every scrape, the quantiles of the text dump are finer
+  uint64_t cumulative = 0;
+  uint16_t index = 0;
+  for (int bits = 0; bits <= GZ_METRICS_HISTOGRAM_MAX_BITS; bits++) {
+    uint64_t le = (1ULL << bits) - 1;
+    while (index < GZ_METRICS_HISTOGRAM_BUCKETS && gz_metrics_histogram_upper(index) <= le) {
+      cumulative += histogram.buckets[index++];
+    }
+    _gz_metrics_printf(writer, "%s_bucket{le=\"%llu\"} %llu\n", metric->name, (unsigned long long)le,
+                       (unsigned long long)cumulative);
+  }
+  _gz_metrics_printf(writer, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %llu\n%s_count %llu\n", metric->name,
+                     (unsigned long long)histogram.count, metric->name, (unsigned long long)histogram.sum,
+                     metric->name, (unsigned long long)histogram.count);
+}
+
+void gz_metrics_dump(gz_metrics_format_t format, gz_metrics_write_cb_t write, void* context) {
+  if (write == NULL) {
+    return;
+  }
+  _Gz_Metrics_Writer_t writer = { write, context };
+  bool isText = format == GZ_METRICS_FORMAT_TEXT;
+  pthread_mutex_lock(&_lock);
+  for (int id = 0; id < _metricCount; id++) {
+    const _Gz_Metric_t* metric = &_metrics[id];
+    if (!isText) {
+      if (metric->help != NULL) {
+        _gz_metrics_printf(&writer, "# HELP %s %s\n", metric->name, metric->help);
+      }
+      _gz_metrics_printf(&writer, "# TYPE %s %s\n", metric->name, _gz_metrics_type_name(metric->type));
+    }
+    if (metric->type == GZ_METRIC_HISTOGRAM) {
+      _gz_metrics_dump_histogram(&writer, metric, isText);
+    } else if (metric->label != NULL) {
+      _gz_metrics_dump_family(&writer, metric, isText);
+    } else {
+      _gz_metrics_printf(&writer, isText ? "%-48s %lld\n" : "%s %lld\n", metric->name,
+                         (long long)_gz_metrics_value(metric));
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
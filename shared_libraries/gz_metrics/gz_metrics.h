@@ -0,0 +1,169 @@
+/**
+ * @file gz_metrics.h
+ * @brief Process wide metrics registry: counters, gauges and latency histograms cheap enough for hot paths,
+ * dumped as text for humans or as the Prometheus text format
+ *
+ * Counters and histograms are sharded per thread: a thread only ever writes its own copy of the values, a
+ * relaxed load and store, no lock and no locked instruction. Reads add the shards up, so they see every
+ * completed update but not a consistent snapshot across metrics. A thread gets its shard at its first update,
+ * the shard of an exited thread goes to the next new one with its counts. Beyond GZ_METRICS_MAX_THREADS
+ * threads updates go to a shared shard with atomic adds.
+ *
+ * Histograms are log-linear (HDR style): exact below 2^(SUB_BITS + 1), then 2^SUB_BITS buckets per power of
+ * two, a 1/2^SUB_BITS relative error. Values of 2^GZ_METRICS_HISTOGRAM_MAX_BITS and more are counted apart, as
+ * the overflow. Quantiles are computed at read time.
+ *
+ * Metrics are registered once by name and used through the returned id. Registering a name again returns the
+ * same id, so modules register where they start without coordinating. Id -1 (registration failed) is ignored
+ * by every update, the hot path never checks. Names are copied, help and label strings are kept: pass literals.
+ * Host only: uses __thread and pthread keys.
+ *
+ * @copyright Copyright (c) Goal Zero 2022
+ */
+
+#ifndef _GZ_METRICS_H
+#define _GZ_METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GZ_METRICS_MAX_METRICS          64
+#define GZ_METRICS_MAX_THREADS          16
+#define GZ_METRICS_MAX_SLOTS            4096  // 64 bit values per shard: 1 per counter, size per family,
+                                              // GZ_METRICS_HISTOGRAM_SLOTS per histogram
+#define GZ_METRICS_NAME_LENGTH          48
+#define GZ_METRICS_HISTOGRAM_SUB_BITS   4
+#define GZ_METRICS_HISTOGRAM_MAX_BITS   40    // 18 minutes in ns
+#define GZ_METRICS_HISTOGRAM_BUCKETS \
+  ((GZ_METRICS_HISTOGRAM_MAX_BITS - GZ_METRICS_HISTOGRAM_SUB_BITS + 1) << GZ_METRICS_HISTOGRAM_SUB_BITS)
+#define GZ_METRICS_HISTOGRAM_SLOTS      (GZ_METRICS_HISTOGRAM_BUCKETS + 4) // overflow, count, sum, max
+
+typedef enum {
+  GZ_METRIC_COUNTER,
+  GZ_METRIC_GAUGE,
+  GZ_METRIC_HISTOGRAM,
+} gz_metric_type_t;
+
+typedef enum {
+  GZ_METRICS_FORMAT_TEXT,         // a line per metric, histograms as count, mean and quantiles
+  GZ_METRICS_FORMAT_PROMETHEUS,   // text exposition format 0.0.4
+} gz_metrics_format_t;
+
+/**
+ * @brief Value of a metric kept elsewhere (a stats struct of a module), read at dump time
+ */
+typedef int64_t (*gz_metrics_read_cb_t)(void* context);
+
+/**
+ * @brief Writes the label value of a family entry, e.g. a command name for its index
+ */
+typedef void (*gz_metrics_label_cb_t)(uint16_t index, char* label, size_t size);
+
+/**
+ * @brief Receives the dump, a line or a few at a time
+ */
+typedef void (*gz_metrics_write_cb_t)(void* context, const char* text, size_t length);
+
+typedef struct {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t overflow;              // values past the last bucket, in count too
+  uint64_t buckets[GZ_METRICS_HISTOGRAM_BUCKETS];
+} gz_metrics_histogram_t;
+
+/**
+ * @return the id of the counter, -1 when the registry is full or the name is taken by another type
+ */
+int gz_metrics_counter(const char* name, const char* help);
+
+/**
+ * @brief size counters under one name, told apart by a label: name{label="value"}. Only the non zero ones are
+ * dumped
+ * @param labelCb formats the label value of an index, NULL for the index itself
+ */
+int gz_metrics_counter_family(const char* name, const char* help, const char* label, uint16_t size,
+                              gz_metrics_label_cb_t labelCb);
+
+/**
+ * @brief A single value set by whoever owns it, not sharded
+ */
+int gz_metrics_gauge(const char* name, const char* help);
+
+/**
+ * @brief Name it after the unit recorded, e.g. yapi_tx_latency_us
+ */
+int gz_metrics_histogram(const char* name, const char* help);
+
+/**
+ * @brief A counter or a gauge read from read(context) at dump time, for stats a module already keeps
+ */
+int gz_metrics_collector(const char* name, const char* help, gz_metric_type_t type, gz_metrics_read_cb_t read,
+                         void* context);
+
+void gz_metrics_add(int id, uint64_t value);
+
+static inline void gz_metrics_inc(int id) {
+  gz_metrics_add(id, 1);
+}
+
+/**
+ * @brief Adds to the index entry of a family, indexes out of the family are ignored
+ */
+void gz_metrics_add_at(int id, uint16_t index, uint64_t value);
+
+void gz_metrics_set(int id, int64_t value);
+
+void gz_metrics_record(int id, uint64_t value);
+
+/**
+ * @return the counter (family: every entry) or gauge value, 0 for an unknown id
+ */
+int64_t gz_metrics_get(int id);
+
+int64_t gz_metrics_get_at(int id, uint16_t index);
+
+/**
+ * @return false when id is not a histogram
+ */
+bool gz_metrics_get_histogram(int id, gz_metrics_histogram_t* histogram);
+
+/**
+ * @param quantile in [0, 1]
+ * @return the upper bound of the bucket holding it, at most the maximum recorded, 0 when empty
+ */
+uint64_t gz_metrics_histogram_quantile(const gz_metrics_histogram_t* histogram, double quantile);
+
+/**
+ * @brief Bucket of a value, and the largest value of a bucket. GZ_METRICS_HISTOGRAM_BUCKETS is the overflow,
+ * its upper bound UINT64_MAX
+ */
+uint16_t gz_metrics_histogram_index(uint64_t value);
+uint64_t gz_metrics_histogram_upper(uint16_t index);
+
+/**
+ * @brief Counters, histograms and counter collectors start again from 0, gauges keep their value. Updates
+ * racing with the reset land on either side
+ */
+void gz_metrics_reset(void);
+
+/**
+ * @brief write is called with the registry lock held: registrations and resets wait for it, no blocking I/O there
+ */
+void gz_metrics_dump(gz_metrics_format_t format, gz_metrics_write_cb_t write, void* context);
+
+/**
+ * @brief CLOCK_MONOTONIC, for the durations recorded
+ */
+uint64_t gz_metrics_now_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _GZ_METRICS_H
@@ -1,6 +1,6 @@
 /** @file gz_observer.c
 * 
-* @brief helpers to implement observer pattern using singled linked list
+* @brief helpers to implement observer pattern using singled linked list, and the copy-on-write registry
 *
 * Authors:
 * - Quang Nguyen <quang.nguyen@goalzero.com>
@@ -10,10 +10,72 @@
 * All rights reserved.
 */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "gz_observer.h"
+#include "gz_pool.h"
+#ifdef CY8C6116BZI_F54
+#include "cy_pdl.h"
+#else
+#include <semaphore.h>
+#include <time.h>
+#endif /* CY8C6116BZI_F54 */
+
+#ifdef CY8C6116BZI_F54
+#define GZ_OBSERVER_LOCK(registry)      uint32_t _interruptState = Cy_SysLib_EnterCriticalSection()
+#define GZ_OBSERVER_TRYLOCK(registry)   uint32_t _interruptState = Cy_SysLib_EnterCriticalSection(); if (1)
+#define GZ_OBSERVER_UNLOCK(registry)    Cy_SysLib_ExitCriticalSection(_interruptState)
+#else
+#define GZ_OBSERVER_LOCK(registry)      pthread_mutex_lock(&(registry)->lock)
+#define GZ_OBSERVER_TRYLOCK(registry)   if (pthread_mutex_trylock(&(registry)->lock) == 0)
+#define GZ_OBSERVER_UNLOCK(registry)    pthread_mutex_unlock(&(registry)->lock)
+#endif /* CY8C6116BZI_F54 */
+
+typedef struct {
+  gz_observer_cb_t callback;        // either this one
+  gz_observer_ctx_cb_t ctxCallback; // or this one with its context
+  void *context;
+  int8_t priority;
+} _Gz_Observer_Entry_t;
+
+/**
+ * @brief Observers of a registry at one point in time, never modified once published
+ */
+typedef struct gz_observer_snapshot {
+  struct gz_observer_snapshot* nextRetired_ptr;
+  uint32_t count;
+  _Gz_Observer_Entry_t entries[1]; // count of them
+} gz_observer_snapshot_t;
+
+static gz_pool_t* _nodePool = NULL;
+
+static inline void _gz_observer_entry_call(const _Gz_Observer_Entry_t* entry, void *context_ptr) {
+  if (entry->ctxCallback != NULL) {
+    entry->ctxCallback(entry->context, context_ptr);
+  } else {
+    entry->callback(context_ptr);
+  }
+}
+
+static gz_observer_node_t* _gz_observer_node_alloc(void) {
+  gz_observer_node_t* node = _nodePool ? (gz_observer_node_t*)gz_pool_alloc(_nodePool) : NULL;
+  if (node) {
+    memset(node, 0, sizeof(gz_observer_node_t));
+    return node;
+  }
+  return (gz_observer_node_t*)calloc(1, sizeof(gz_observer_node_t));
+}
+
+static void _gz_observer_node_free(gz_observer_node_t* node) {
+  if (gz_pool_owns(_nodePool, node)) {
+    gz_pool_free(_nodePool, node);
+  } else {
+    free(node);
+  }
+}
 
 static int _gz_observer_count(gz_observer_node_t* observerHead_ptr) {
   int count = 0;
@@ -32,7 +94,7 @@ void gz_observer_destroy(gz_observer_node_t **observerHead_ptr) {
   gz_observer_node_t *currentObserver_ptr = *(observerHead_ptr);
   while (currentObserver_ptr != NULL) {
     gz_observer_node_t *nextObserver_ptr = currentObserver_ptr->nextObserver_ptr;
-    free(currentObserver_ptr);
+    _gz_observer_node_free(currentObserver_ptr);
     currentObserver_ptr = nextObserver_ptr;
   }
   *observerHead_ptr = NULL;
@@ -45,7 +107,7 @@ int gz_observer_add_to_list(gz_observer_node_t **observerHead_ptr, gz_observer_c
   if (cb == NULL) {
     return _gz_observer_count(*(observerHead_ptr));
   }
-  gz_observer_node_t *newObserver_ptr = (gz_observer_node_t*)calloc(1, sizeof(gz_observer_node_t));
+  gz_observer_node_t *newObserver_ptr = _gz_observer_node_alloc();
   if (newObserver_ptr == NULL) {
     // Failed to allocate memory
     return -1;
@@ -76,7 +138,7 @@ int gz_observer_remove_from_list(gz_observer_node_t **observerHead_ptr, gz_obser
         prevObserver_ptr->nextObserver_ptr = currentObserver_ptr->nextObserver_ptr;
       }
       // Remove the observer
-      free(currentObserver_ptr);
+      _gz_observer_node_free(currentObserver_ptr);
       uint8_t count = _gz_observer_count(*(observerHead_ptr));
       if (count == 0) {
         // No more observer, set the head to NULL
@@ -91,6 +153,10 @@ int gz_observer_remove_from_list(gz_observer_node_t **observerHead_ptr, gz_obser
   return _gz_observer_count(*(observerHead_ptr));
 }
 
+void gz_observer_set_pool(struct gz_pool* pool) {
+  _nodePool = pool;
+}
+
 void gz_observer_notify(gz_observer_node_t* observerHead_ptr, void *context_ptr) {
   gz_observer_node_t *currentObserver_ptr = observerHead_ptr;
   while (currentObserver_ptr != NULL) {
@@ -98,3 +164,635 @@ void gz_observer_notify(gz_observer_node_t* observerHead_ptr, void *context_ptr)
     currentObserver_ptr = currentObserver_ptr->nextObserver_ptr;
   }
 }
+
+static gz_observer_snapshot_t* _gz_observer_snapshot_alloc(uint32_t count) {
+  size_t size = sizeof(gz_observer_snapshot_t) + (count ? count - 1 : 0) * sizeof(_Gz_Observer_Entry_t);
+  gz_observer_snapshot_t* snapshot_ptr = (gz_observer_snapshot_t*)malloc(size);
+  if (snapshot_ptr != NULL) {
+    snapshot_ptr->nextRetired_ptr = NULL;
+    snapshot_ptr->count = count;
+  }
+  return snapshot_ptr;
+}
+
+/**
+ * @brief Frees the retired snapshots if no notify is in progress: a notify starting now reads the current
+ * one. Called locked
+ */
+static void _gz_observer_reclaim(gz_observer_registry_t* registry) {
+  if (__atomic_load_n(&registry->readers, __ATOMIC_SEQ_CST) != 0) {
+    return;
+  }
+  gz_observer_snapshot_t* retired_ptr = registry->retired_ptr;
+  __atomic_store_n(&registry->retired_ptr, NULL, __ATOMIC_RELAXED);
+  while (retired_ptr != NULL) {
+    gz_observer_snapshot_t* next_ptr = retired_ptr->nextRetired_ptr;
+    free(retired_ptr);
+    retired_ptr = next_ptr;
+  }
+}
+
+/**
+ * @brief Publishes a new snapshot, the current one is retired. Called locked
+ */
+static int _gz_observer_publish(gz_observer_registry_t* registry, gz_observer_snapshot_t* snapshot_ptr) {
+  gz_observer_snapshot_t* old_ptr = registry->snapshot_ptr;
+  __atomic_store_n(&registry->snapshot_ptr, snapshot_ptr, __ATOMIC_SEQ_CST);
+  if (old_ptr != NULL) {
+    old_ptr->nextRetired_ptr = registry->retired_ptr;
+    __atomic_store_n(&registry->retired_ptr, old_ptr, __ATOMIC_RELAXED);
+  }
+  _gz_observer_reclaim(registry);
+  return snapshot_ptr ? (int)snapshot_ptr->count : 0;
+}
+
+static int _gz_observer_registry_add(gz_observer_registry_t* registry, const _Gz_Observer_Entry_t* entry) {
+  if (registry == NULL || (entry->callback == NULL && entry->ctxCallback == NULL)) {
+    return -1;
+  }
+  GZ_OBSERVER_LOCK(registry);
+  const gz_observer_snapshot_t* current_ptr = registry->snapshot_ptr;
+  uint32_t count = current_ptr ? current_ptr->count : 0;
+  gz_observer_snapshot_t* snapshot_ptr = _gz_observer_snapshot_alloc(count + 1);
+  if (snapshot_ptr == NULL) {
+    GZ_OBSERVER_UNLOCK(registry);
+    return -1;
+  }
+  uint32_t position = 0;
+  while (position < count && current_ptr->entries[position].priority >= entry->priority) {
+    position++;
+  }
+  if (position) {
+    memcpy(&snapshot_ptr->entries[0], &current_ptr->entries[0], position * sizeof(_Gz_Observer_Entry_t));
+  }
+  snapshot_ptr->entries[position] = *entry;
+  if (count > position) {
+    memcpy(&snapshot_ptr->entries[position + 1], &current_ptr->entries[position],
+           (count - position) * sizeof(_Gz_Observer_Entry_t));
+  }
+  int rv = _gz_observer_publish(registry, snapshot_ptr);
+  GZ_OBSERVER_UNLOCK(registry);
+  return rv;
+}
+
+static int _gz_observer_registry_remove(gz_observer_registry_t* registry, const _Gz_Observer_Entry_t* entry) {
+  if (registry == NULL) {
+    return -1;
+  }
+  GZ_OBSERVER_LOCK(registry);
+  const gz_observer_snapshot_t* current_ptr = registry->snapshot_ptr;
+  uint32_t count = current_ptr ? current_ptr->count : 0;
+  uint32_t position = 0;
+  while (position < count && (current_ptr->entries[position].callback != entry->callback ||
+                              current_ptr->entries[position].ctxCallback != entry->ctxCallback ||
+                              current_ptr->entries[position].context != entry->context)) {
+    position++;
+  }
+  if (position == count) {
+    // Not found
+    GZ_OBSERVER_UNLOCK(registry);
+    return count;
+  }
+  gz_observer_snapshot_t* snapshot_ptr = NULL;
+  if (count > 1) {
+    snapshot_ptr = _gz_observer_snapshot_alloc(count - 1);
+    if (snapshot_ptr == NULL) {
+      GZ_OBSERVER_UNLOCK(registry);
+      return -1;
+    }
+    memcpy(&snapshot_ptr->entries[0], &current_ptr->entries[0], position * sizeof(_Gz_Observer_Entry_t));
+    memcpy(&snapshot_ptr->entries[position], &current_ptr->entries[position + 1],
+           (count - position - 1) * sizeof(_Gz_Observer_Entry_t));
+  }
+  int rv = _gz_observer_publish(registry, snapshot_ptr);
+  GZ_OBSERVER_UNLOCK(registry);
+  return rv;
+}
+
+void gz_observer_registry_init(gz_observer_registry_t* registry) {
+  registry->snapshot_ptr = NULL;
+  registry->retired_ptr = NULL;
+  registry->readers = 0;
+#ifndef CY8C6116BZI_F54
+  pthread_mutex_init(&registry->lock, NULL);
+#endif /* CY8C6116BZI_F54 */
+}
+
+void gz_observer_registry_destroy(gz_observer_registry_t* registry) {
+  if (registry == NULL) {
+    return;
+  }
+  GZ_OBSERVER_LOCK(registry);
+  _gz_observer_publish(registry, NULL);
+  GZ_OBSERVER_UNLOCK(registry);
+}
+
+int gz_observer_registry_add(gz_observer_registry_t* registry, gz_observer_cb_t cb, int8_t priority) {
+  _Gz_Observer_Entry_t entry = { cb, NULL, NULL, priority };
+  return _gz_observer_registry_add(registry, &entry);
+}
+
+int gz_observer_registry_add_ctx(gz_observer_registry_t* registry, gz_observer_ctx_cb_t cb, void *context, int8_t priority) {
+  _Gz_Observer_Entry_t entry = { NULL, cb, context, priority };
+  return _gz_observer_registry_add(registry, &entry);
+}
+
+int gz_observer_registry_remove(gz_observer_registry_t* registry, gz_observer_cb_t cb) {
+  _Gz_Observer_Entry_t entry = { cb, NULL, NULL, 0 };
+  return _gz_observer_registry_remove(registry, &entry);
+}
+
+int gz_observer_registry_remove_ctx(gz_observer_registry_t* registry, gz_observer_ctx_cb_t cb, void *context) {
+  _Gz_Observer_Entry_t entry = { NULL, cb, context, 0 };
+  return _gz_observer_registry_remove(registry, &entry);
+}
+
+int gz_observer_registry_count(gz_observer_registry_t* registry) {
+  if (registry == NULL) {
+    return -1;
+  }
+  GZ_OBSERVER_LOCK(registry);
+  int count = registry->snapshot_ptr ? (int)registry->snapshot_ptr->count : 0;
+  GZ_OBSERVER_UNLOCK(registry);
+  return count;
+}
+
+void gz_observer_registry_notify(gz_observer_registry_t* registry, void *context_ptr) {
+  if (registry == NULL || __atomic_load_n(&registry->snapshot_ptr, __ATOMIC_RELAXED) == NULL) {
+    return;
+  }
+  // Counted before reading the snapshot: a writer seeing no reader knows nobody holds the one it replaced
+  __atomic_add_fetch(&registry->readers, 1, __ATOMIC_SEQ_CST);
+  const gz_observer_snapshot_t* snapshot_ptr = __atomic_load_n(&registry->snapshot_ptr, __ATOMIC_SEQ_CST);
+  for (uint32_t i = 0; snapshot_ptr != NULL && i < snapshot_ptr->count; i++) {
+    _gz_observer_entry_call(&snapshot_ptr->entries[i], context_ptr);
+  }
+  if (__atomic_sub_fetch(&registry->readers, 1, __ATOMIC_SEQ_CST) == 0 &&
+      __atomic_load_n(&registry->retired_ptr, __ATOMIC_RELAXED) != NULL) {
+    // Last reader out frees what was replaced meanwhile, unless a writer is at it
+    GZ_OBSERVER_TRYLOCK(registry) {
+      _gz_observer_reclaim(registry);
+      GZ_OBSERVER_UNLOCK(registry);
+    }
+  }
+}
+
+#ifndef CY8C6116BZI_F54
+/* Section: async notification */
+
+#define GZ_OBSERVER_CACHE_LINE  64
+
+typedef enum {
+  _GZ_OBSERVER_IDLE,    // mailbox empty
+  _GZ_OBSERVER_QUEUED,  // in the runnable list
+  _GZ_OBSERVER_RUNNING, // its callback runs on a worker
+} _Gz_Observer_State_t;
+
+/**
+ * @brief An event, in the queue or in a mailbox, followed by eventSize bytes of data. In the queue, sequence
+ * tells whether the cell is free for the producer of a position or holds its event for the workers
+ * (Vyukov's bounded queue)
+ */
+typedef struct {
+  uint32_t sequence;
+  uint32_t size;
+  uint64_t posted_ns;
+} _Gz_Observer_Event_t;
+
+typedef struct {
+  _Gz_Observer_Entry_t entry;
+  bool isUsed;
+  bool isRemoved;       // freed by the worker holding it
+  uint8_t state;        // _Gz_Observer_State_t
+  uint8_t depth;
+  uint8_t head;         // oldest waiting event of the mailbox
+  uint8_t waiting;
+  uint8_t* mailbox;     // depth events
+  uint64_t delivered;
+  uint64_t coalesced;
+  uint64_t lastLag_ns;
+  uint64_t maxLag_ns;
+  uint64_t totalLag_ns;
+  uint64_t maxRun_ns;
+} _Gz_Observer_Async_Observer_t;
+
+struct gz_observer_async {
+  uint32_t tail __attribute__((aligned(GZ_OBSERVER_CACHE_LINE))); // next position of the producers
+  uint64_t posted;
+  uint64_t dropped;
+  uint32_t idleWorkers __attribute__((aligned(GZ_OBSERVER_CACHE_LINE)));
+  bool isWakePending;   // a producer posted wake, cleared by the worker it woke
+  sem_t wake;           // producers never take the lock, sem_post does not block
+  pthread_mutex_t lock __attribute__((aligned(GZ_OBSERVER_CACHE_LINE))); // everything below, workers and writers
+  pthread_cond_t idleCond;
+  uint32_t head;        // next position of the workers
+  uint32_t mask;
+  size_t eventSize;
+  size_t cellSize;
+  uint8_t* cells;
+  bool isRunning;
+  uint8_t workers;
+  pthread_t* threads;
+  uint32_t running;     // callbacks in progress
+  uint32_t observerCount;
+  _Gz_Observer_Async_Observer_t observers[GZ_OBSERVER_ASYNC_MAX_OBSERVERS];
+  uint8_t runnable[GZ_OBSERVER_ASYNC_MAX_OBSERVERS]; // observers with waiting events, each at most once
+  uint8_t runnableHead;
+  uint8_t runnableCount;
+  uint64_t delivered;
+  uint64_t coalesced;
+  uint32_t queueHighWater;
+};
+
+static uint64_t _gz_observer_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static inline _Gz_Observer_Event_t* _gz_observer_cell(gz_observer_async_t* async, uint32_t position) {
+  return (_Gz_Observer_Event_t*)(async->cells + (position & async->mask) * async->cellSize);
+}
+
+static inline _Gz_Observer_Event_t* _gz_observer_mailbox(gz_observer_async_t* async,
+                                                         _Gz_Observer_Async_Observer_t* observer, uint8_t index) {
+  return (_Gz_Observer_Event_t*)(observer->mailbox + (index % observer->depth) * async->cellSize);
+}
+
+static void _gz_observer_event_copy(_Gz_Observer_Event_t* to, const _Gz_Observer_Event_t* from) {
+  to->size = from->size;
+  to->posted_ns = from->posted_ns;
+  memcpy(to + 1, from + 1, from->size);
+}
+
+/**
+ * @brief Whether the next event is still to be produced. Seq_cst, pairs with the producer storing the event
+ * then reading idleWorkers: either the worker going idle sees the event or the producer sees the worker idle
+ */
+static bool _gz_observer_async_is_empty(gz_observer_async_t* async) {
+  return __atomic_load_n(&_gz_observer_cell(async, async->head)->sequence, __ATOMIC_SEQ_CST) != async->head + 1;
+}
+
+static void _gz_observer_async_push_runnable(gz_observer_async_t* async, uint8_t index) {
+  async->runnable[(async->runnableHead + async->runnableCount) % GZ_OBSERVER_ASYNC_MAX_OBSERVERS] = index;
+  async->runnableCount++;
+  async->observers[index].state = _GZ_OBSERVER_QUEUED;
+}
+
+static void _gz_observer_async_release(_Gz_Observer_Async_Observer_t* observer) {
+  free(observer->mailbox);
+  memset(observer, 0, sizeof(*observer));
+}
+
+/**
+ * @brief Puts an event in the mailbox of an observer, the newest waiting one is replaced when it is full.
+ * The replaced event keeps its time: lag is measured from the oldest event the observer has not seen
+ */
+static void _gz_observer_async_post(gz_observer_async_t* async, uint8_t index, const _Gz_Observer_Event_t* event) {
+  _Gz_Observer_Async_Observer_t* observer = &async->observers[index];
+  if (observer->waiting == observer->depth) {
+    _Gz_Observer_Event_t* last = _gz_observer_mailbox(async, observer, observer->head + observer->waiting - 1);
+    uint64_t posted_ns = last->posted_ns;
+    _gz_observer_event_copy(last, event);
+    last->posted_ns = posted_ns;
+    observer->coalesced++;
+    async->coalesced++;
+    return;
+  }
+  _gz_observer_event_copy(_gz_observer_mailbox(async, observer, observer->head + observer->waiting), event);
+  observer->waiting++;
+  if (observer->state == _GZ_OBSERVER_IDLE) {
+    _gz_observer_async_push_runnable(async, index);
+  }
+}
+
+/**
+ * @brief Moves the queued events to the mailboxes, at most a queue worth so new events can not keep a worker
+ * away from the callbacks. Called locked
+ */
+static void _gz_observer_async_dispatch(gz_observer_async_t* async) {
+  for (uint32_t count = 0; count <= async->mask && !_gz_observer_async_is_empty(async); count++) {
+    uint32_t queued = __atomic_load_n(&async->tail, __ATOMIC_RELAXED) - async->head;
+    if (queued > async->queueHighWater) {
+      async->queueHighWater = queued;
+    }
+    _Gz_Observer_Event_t* cell = _gz_observer_cell(async, async->head);
+    for (uint8_t i = 0; i < GZ_OBSERVER_ASYNC_MAX_OBSERVERS; i++) {
+      if (async->observers[i].isUsed && !async->observers[i].isRemoved) {
+        _gz_observer_async_post(async, i, cell);
+      }
+    }
+    __atomic_store_n(&cell->sequence, async->head + async->mask + 1, __ATOMIC_RELEASE);
+    async->head++;
+  }
+}
+
+/**
+ * @brief Runs the next observer with waiting events, lock released during its callback. Called locked
+ */
+static void _gz_observer_async_run(gz_observer_async_t* async, _Gz_Observer_Event_t* event) {
+  uint8_t index = async->runnable[async->runnableHead];
+  async->runnableHead = (async->runnableHead + 1) % GZ_OBSERVER_ASYNC_MAX_OBSERVERS;
+  async->runnableCount--;
+  _Gz_Observer_Async_Observer_t* observer = &async->observers[index];
+  if (observer->isRemoved) {
+    _gz_observer_async_release(observer);
+    return;
+  }
+  _gz_observer_event_copy(event, _gz_observer_mailbox(async, observer, observer->head));
+  observer->head = (observer->head + 1) % observer->depth;
+  observer->waiting--;
+  observer->state = _GZ_OBSERVER_RUNNING;
+  async->running++;
+  _Gz_Observer_Entry_t entry = observer->entry;
+  if (async->runnableCount && __atomic_load_n(&async->idleWorkers, __ATOMIC_RELAXED)) {
+    sem_post(&async->wake); // more observers to run than this worker
+  }
+  pthread_mutex_unlock(&async->lock);
+
+  uint64_t start_ns = _gz_observer_now_ns();
+  _gz_observer_entry_call(&entry, event + 1);
+  uint64_t end_ns = _gz_observer_now_ns();
+
+  pthread_mutex_lock(&async->lock);
+  async->running--;
+  async->delivered++;
+  uint64_t lag_ns = start_ns > event->posted_ns ? start_ns - event->posted_ns : 0;
+  observer->delivered++;
+  observer->lastLag_ns = lag_ns;
+  observer->totalLag_ns += lag_ns;
+  if (lag_ns > observer->maxLag_ns) {
+    observer->maxLag_ns = lag_ns;
+  }
+  if (end_ns - start_ns > observer->maxRun_ns) {
+    observer->maxRun_ns = end_ns - start_ns;
+  }
+  if (observer->isRemoved) {
+    _gz_observer_async_release(observer);
+  } else if (observer->waiting) {
+    _gz_observer_async_push_runnable(async, index);
+  } else {
+    observer->state = _GZ_OBSERVER_IDLE;
+  }
+}
+
+static void* _gz_observer_async_worker(void* context) {
+  gz_observer_async_t* async = (gz_observer_async_t*)context;
+  _Gz_Observer_Event_t* event = (_Gz_Observer_Event_t*)malloc(async->cellSize);
+  pthread_mutex_lock(&async->lock);
+  while (async->isRunning) {
+    _gz_observer_async_dispatch(async);
+    if (async->runnableCount) {
+      _gz_observer_async_run(async, event);
+      continue;
+    }
+    __atomic_add_fetch(&async->idleWorkers, 1, __ATOMIC_SEQ_CST);
+    if (_gz_observer_async_is_empty(async) && async->isRunning) {
+      if (!async->running) {
+        pthread_cond_broadcast(&async->idleCond);
+      }
+      pthread_mutex_unlock(&async->lock);
+      sem_wait(&async->wake);
+      __atomic_store_n(&async->isWakePending, false, __ATOMIC_SEQ_CST);
+      pthread_mutex_lock(&async->lock);
+    }
+    __atomic_sub_fetch(&async->idleWorkers, 1, __ATOMIC_SEQ_CST);
+  }
+  pthread_mutex_unlock(&async->lock);
+  free(event);
+  return NULL;
+}
+
+static void _gz_observer_async_stop(gz_observer_async_t* async, uint8_t started) {
+  pthread_mutex_lock(&async->lock);
+  async->isRunning = false;
+  pthread_mutex_unlock(&async->lock);
+  for (uint8_t i = 0; i < started; i++) {
+    sem_post(&async->wake);
+  }
+  for (uint8_t i = 0; i < started; i++) {
+    pthread_join(async->threads[i], NULL);
+  }
+}
+
+static void _gz_observer_async_free(gz_observer_async_t* async) {
+  for (uint8_t i = 0; i < GZ_OBSERVER_ASYNC_MAX_OBSERVERS; i++) {
+    if (async->observers[i].isUsed) {
+      _gz_observer_async_release(&async->observers[i]);
+    }
+  }
+  sem_destroy(&async->wake);
+  pthread_cond_destroy(&async->idleCond);
+  pthread_mutex_destroy(&async->lock);
+  free(async->threads);
+  free(async->cells);
+  free(async);
+}
+
+gz_observer_async_t* gz_observer_async_create(size_t eventSize, uint32_t queueSize, uint8_t workers) {
+  if (!queueSize || !workers || eventSize > UINT32_MAX) {
+    return NULL;
+  }
+  void* memory = NULL;
+  if (posix_memalign(&memory, GZ_OBSERVER_CACHE_LINE, sizeof(gz_observer_async_t))) {
+    return NULL;
+  }
+  gz_observer_async_t* async = (gz_observer_async_t*)memory;
+  memset(async, 0, sizeof(*async));
+  uint32_t size = 2;
+  while (size < queueSize) {
+    size <<= 1;
+  }
+  async->mask = size - 1;
+  async->eventSize = eventSize;
+  async->cellSize = (sizeof(_Gz_Observer_Event_t) + eventSize + 7) & ~(size_t)7;
+  async->cells = (uint8_t*)malloc(size * async->cellSize);
+  async->threads = (pthread_t*)calloc(workers, sizeof(pthread_t));
+  sem_init(&async->wake, 0, 0);
+  pthread_mutex_init(&async->lock, NULL);
+  pthread_cond_init(&async->idleCond, NULL);
+  if (!async->cells || !async->threads) {
+    _gz_observer_async_free(async);
+    return NULL;
+  }
+  for (uint32_t i = 0; i < size; i++) {
+    _gz_observer_cell(async, i)->sequence = i;
+  }
+  async->isRunning = true;
+  for (async->workers = 0; async->workers < workers; async->workers++) {
+    if (pthread_create(&async->threads[async->workers], NULL, _gz_observer_async_worker, async) != 0) {
+      _gz_observer_async_stop(async, async->workers);
+      _gz_observer_async_free(async);
+      return NULL;
+    }
+  }
+  return async;
+}
+
+void gz_observer_async_destroy(gz_observer_async_t* async) {
+  if (async == NULL) {
+    return;
+  }
+  gz_observer_async_flush(async);
+  _gz_observer_async_stop(async, async->workers);
+  _gz_observer_async_free(async);
+}
+
+static int _gz_observer_async_add(gz_observer_async_t* async, const _Gz_Observer_Entry_t* entry, uint8_t depth) {
+  if (async == NULL || (entry->callback == NULL && entry->ctxCallback == NULL) || !depth ||
+      depth > GZ_OBSERVER_ASYNC_MAX_DEPTH) {
+    return -1;
+  }
+  uint8_t* mailbox = (uint8_t*)malloc(depth * async->cellSize);
+  if (mailbox == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock(&async->lock);
+  for (uint8_t i = 0; i < GZ_OBSERVER_ASYNC_MAX_OBSERVERS; i++) {
+    _Gz_Observer_Async_Observer_t* observer = &async->observers[i];
+    if (!observer->isUsed) {
+      observer->entry = *entry;
+      observer->isUsed = true;
+      observer->depth = depth;
+      observer->mailbox = mailbox;
+      int count = ++async->observerCount;
+      pthread_mutex_unlock(&async->lock);
+      return count;
+    }
+  }
+  pthread_mutex_unlock(&async->lock);
+  free(mailbox);
+  return -1;
+}
+
+static int _gz_observer_async_remove(gz_observer_async_t* async, const _Gz_Observer_Entry_t* entry) {
+  if (async == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock(&async->lock);
+  for (uint8_t i = 0; i < GZ_OBSERVER_ASYNC_MAX_OBSERVERS; i++) {
+    _Gz_Observer_Async_Observer_t* observer = &async->observers[i];
+    if (!observer->isUsed || observer->isRemoved || observer->entry.callback != entry->callback ||
+        observer->entry.ctxCallback != entry->ctxCallback || observer->entry.context != entry->context) {
+      continue;
+    }
+    if (observer->state == _GZ_OBSERVER_IDLE) {
+      _gz_observer_async_release(observer);
+    } else {
+      // Queued or running: the worker popping it frees it
+      observer->isRemoved = true;
+      observer->waiting = 0;
+    }
+    async->observerCount--;
+    break;
+  }
+  int count = async->observerCount;
+  pthread_mutex_unlock(&async->lock);
+  return count;
+}
+
+int gz_observer_async_add(gz_observer_async_t* async, gz_observer_cb_t cb, uint8_t depth) {
+  _Gz_Observer_Entry_t entry = { cb, NULL, NULL, 0 };
+  return _gz_observer_async_add(async, &entry, depth);
+}
+
+int gz_observer_async_add_ctx(gz_observer_async_t* async, gz_observer_ctx_cb_t cb, void *context, uint8_t depth) {
+  _Gz_Observer_Entry_t entry = { NULL, cb, context, 0 };
+  return _gz_observer_async_add(async, &entry, depth);
+}
+
+int gz_observer_async_remove(gz_observer_async_t* async, gz_observer_cb_t cb) {
+  _Gz_Observer_Entry_t entry = { cb, NULL, NULL, 0 };
+  return _gz_observer_async_remove(async, &entry);
+}
+
+int gz_observer_async_remove_ctx(gz_observer_async_t* async, gz_observer_ctx_cb_t cb, void *context) {
+  _Gz_Observer_Entry_t entry = { NULL, cb, context, 0 };
+  return _gz_observer_async_remove(async, &entry);
+}
+
+int gz_observer_async_notify(gz_observer_async_t* async, const void* data, size_t size) {
+  if (async == NULL || size > async->eventSize) {
+    return -1;
+  }
+  uint32_t position = __atomic_load_n(&async->tail, __ATOMIC_RELAXED);
+  _Gz_Observer_Event_t* cell;
+  for (;;) {
+    cell = _gz_observer_cell(async, position);
+    int32_t difference = (int32_t)(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - position);
+    if (difference == 0) {
+      if (__atomic_compare_exchange_n(&async->tail, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // Full, the workers are a queue behind
+      __atomic_add_fetch(&async->dropped, 1, __ATOMIC_RELAXED);
+      return -1;
+    } else {
+      position = __atomic_load_n(&async->tail, __ATOMIC_RELAXED);
+    }
+  }
+  cell->size = (uint32_t)size;
+  cell->posted_ns = _gz_observer_now_ns();
+  memcpy(cell + 1, data, size);
+  __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&async->posted, 1, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&async->idleWorkers, __ATOMIC_SEQ_CST) &&
+      !__atomic_exchange_n(&async->isWakePending, true, __ATOMIC_ACQ_REL)) {
+    sem_post(&async->wake);
+  }
+  return 0;
+}
+
+void gz_observer_async_flush(gz_observer_async_t* async) {
+  if (async == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&async->lock);
+  while (!_gz_observer_async_is_empty(async) || async->runnableCount || async->running) {
+    pthread_cond_wait(&async->idleCond, &async->lock);
+  }
+  pthread_mutex_unlock(&async->lock);
+}
+
+void gz_observer_async_get_stats(gz_observer_async_t* async, gz_observer_async_stats_t* stats) {
+  pthread_mutex_lock(&async->lock);
+  stats->posted = __atomic_load_n(&async->posted, __ATOMIC_RELAXED);
+  stats->dropped = __atomic_load_n(&async->dropped, __ATOMIC_RELAXED);
+  stats->delivered = async->delivered;
+  stats->coalesced = async->coalesced;
+  stats->queueSize = async->mask + 1;
+  stats->queueHighWater = async->queueHighWater;
+  stats->observers = async->observerCount;
+  stats->workers = async->workers;
+  pthread_mutex_unlock(&async->lock);
+}
+
+uint32_t gz_observer_async_get_lags(gz_observer_async_t* async, gz_observer_async_lag_t* lags, uint32_t max) {
+  uint32_t count = 0;
+  pthread_mutex_lock(&async->lock);
+  for (uint8_t i = 0; i < GZ_OBSERVER_ASYNC_MAX_OBSERVERS; i++) {
+    const _Gz_Observer_Async_Observer_t* observer = &async->observers[i];
+    if (!observer->isUsed || observer->isRemoved) {
+      continue;
+    }
+    if (count < max) {
+      gz_observer_async_lag_t* lag = &lags[count];
+      lag->callback = observer->entry.callback;
+      lag->ctxCallback = observer->entry.ctxCallback;
+      lag->context = observer->entry.context;
+      lag->depth = observer->depth;
+      lag->waiting = observer->waiting;
+      lag->delivered = observer->delivered;
+      lag->coalesced = observer->coalesced;
+      lag->lastLag_ns = observer->lastLag_ns;
+      lag->maxLag_ns = observer->maxLag_ns;
+      lag->totalLag_ns = observer->totalLag_ns;
+      lag->maxRun_ns = observer->maxRun_ns;
+    }
+    count++;
+  }
+  pthread_mutex_unlock(&async->lock);
+  return count;
+}
+#endif /* CY8C6116BZI_F54 */
@@ -1,6 +1,9 @@
 /** @file gz_observer.h
 * 
-* @brief helpers to implement observer pattern using singled linked list
+* @brief helpers to implement observer pattern using singled linked list, and gz_observer_registry_t: observers
+* in a contiguous array replaced copy-on-write on every change, so notify takes no lock and can run on any
+* thread while others add or remove observers. On Linux, gz_observer_async_t delivers notifications from worker
+* threads instead of the notifying one
 *
 * Authors:
 * - Quang Nguyen <quang.nguyen@goalzero.com>
@@ -17,8 +20,45 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stdint.h>
+#ifndef CY8C6116BZI_F54
+#include <pthread.h>
+#include <stddef.h>
+#endif /* CY8C6116BZI_F54 */
+
+#define GZ_OBSERVER_ASYNC_MAX_OBSERVERS 16  // per gz_observer_async_t
+#define GZ_OBSERVER_ASYNC_MAX_DEPTH     64  // events an async observer can be behind before they coalesce
+
 typedef void (*gz_observer_cb_t)(void *);
 
+/**
+ * @brief Observer with its own context, given back on every notification
+ */
+typedef void (*gz_observer_ctx_cb_t)(void *context, void *data);
+
+struct gz_observer_snapshot;
+
+/**
+ * @brief Copy-on-write observer registry. Writers (add/remove) are serialized and publish a new snapshot;
+ * the old one is freed once no notify can still be reading it
+ */
+typedef struct {
+  struct gz_observer_snapshot* snapshot_ptr;  // current observers, NULL when there is none
+  struct gz_observer_snapshot* retired_ptr;   // replaced snapshots waiting for their readers to leave
+  uint32_t readers;                           // notify calls in progress
+#ifndef CY8C6116BZI_F54
+  pthread_mutex_t lock;
+#endif /* CY8C6116BZI_F54 */
+} gz_observer_registry_t;
+
+#ifndef CY8C6116BZI_F54
+#define GZ_OBSERVER_REGISTRY_INITIALIZER { NULL, NULL, 0, PTHREAD_MUTEX_INITIALIZER }
+#else
+#define GZ_OBSERVER_REGISTRY_INITIALIZER { NULL, NULL, 0 }
+#endif /* CY8C6116BZI_F54 */
+
+struct gz_pool;
+
 typedef struct gz_observer_node {
   gz_observer_cb_t callback;
   struct gz_observer_node* nextObserver_ptr;
@@ -46,6 +86,13 @@ int gz_observer_add_to_list(gz_observer_node_t**, gz_observer_cb_t cb);
  * **/
 int gz_observer_remove_from_list(gz_observer_node_t**, gz_observer_cb_t cb);
 
+/**
+ * @brief Takes the nodes of every list from a gz_pool (blocks of at least sizeof(gz_observer_node_t)) rather
+ * than the heap, the heap is still used when it is exhausted. Set before adding the first observer
+ * @param pool: NULL to go back to the heap
+ * **/
+void gz_observer_set_pool(struct gz_pool* pool);
+
 /**
  * @brief Notify all observers
  * @param gz_observer_node_t: pointer to the head of the observers
@@ -53,6 +100,130 @@ int gz_observer_remove_from_list(gz_observer_node_t**, gz_observer_cb_t cb);
  * **/
 void gz_observer_notify(gz_observer_node_t*, void* context);
 
+/**
+ * @brief Initialize a registry, same as GZ_OBSERVER_REGISTRY_INITIALIZER
+ * **/
+void gz_observer_registry_init(gz_observer_registry_t*);
+
+/**
+ * @brief Free every observer, no notify may be running
+ * **/
+void gz_observer_registry_destroy(gz_observer_registry_t*);
+
+/**
+ * @brief Add an observer, this doesn't check for duplicates. Safe from a callback of the same registry
+ * @param priority: higher ones are notified first, same priority in order of addition
+ * @return int: number of observers in the registry, -1 on failure
+ * **/
+int gz_observer_registry_add(gz_observer_registry_t*, gz_observer_cb_t cb, int8_t priority);
+int gz_observer_registry_add_ctx(gz_observer_registry_t*, gz_observer_ctx_cb_t cb, void *context, int8_t priority);
+
+/**
+ * @brief Remove the first observer found with this callback (and context)
+ * @return int: number of observers in the registry, -1 on failure
+ * **/
+int gz_observer_registry_remove(gz_observer_registry_t*, gz_observer_cb_t cb);
+int gz_observer_registry_remove_ctx(gz_observer_registry_t*, gz_observer_ctx_cb_t cb, void *context);
+
+int gz_observer_registry_count(gz_observer_registry_t*);
+
+/**
+ * @brief Notify every observer of the current snapshot, lock-free. Observers added or removed meanwhile
+ * take effect on the next notify
+ * @param context: data passed to the observers
+ * **/
+void gz_observer_registry_notify(gz_observer_registry_t*, void* context);
+
+#ifndef CY8C6116BZI_F54
+/**
+ * @brief Deferred notification: notify copies the event into a bounded lock-free queue and returns, worker
+ * threads move it to the mailbox of every observer and run the callbacks. The notifying thread never waits for
+ * an observer, a full queue drops the event instead. An observer runs on one worker at a time and sees its
+ * events in order; when it falls `depth` events behind, the newest one replaces the last waiting in its mailbox
+ * (coalesced), so a slow observer gets the latest state rather than an ever growing backlog
+ */
+typedef struct gz_observer_async gz_observer_async_t;
+
+typedef struct {
+  uint64_t posted;            // events queued by notify
+  uint64_t dropped;           // events lost, the queue was full
+  uint64_t delivered;         // callbacks run
+  uint64_t coalesced;         // events replaced by a newer one in a mailbox
+  uint32_t queueSize;
+  uint32_t queueHighWater;
+  uint32_t observers;
+  uint8_t workers;
+} gz_observer_async_stats_t;
+
+/**
+ * @brief How far behind one observer is, lags are from notify to the start of its callback
+ */
+typedef struct {
+  gz_observer_cb_t callback;
+  gz_observer_ctx_cb_t ctxCallback;
+  void *context;
+  uint8_t depth;
+  uint32_t waiting;           // events in its mailbox
+  uint64_t delivered;
+  uint64_t coalesced;
+  uint64_t lastLag_ns;
+  uint64_t maxLag_ns;
+  uint64_t totalLag_ns;       // average lag: totalLag_ns / delivered
+  uint64_t maxRun_ns;         // slowest callback
+} gz_observer_async_lag_t;
+
+/**
+ * @brief Create an async notifier and start its workers
+ * @param eventSize: bytes copied per event, the largest notify size
+ * @param queueSize: events between notify and the workers, rounded up to a power of 2
+ * @param workers: threads running the callbacks
+ * @return NULL on failure
+ * **/
+gz_observer_async_t* gz_observer_async_create(size_t eventSize, uint32_t queueSize, uint8_t workers);
+
+/**
+ * @brief Deliver what is queued, stop the workers and free everything
+ * **/
+void gz_observer_async_destroy(gz_observer_async_t*);
+
+/**
+ * @brief Add an observer, safe from any thread including a callback
+ * @param depth: events kept for it, 1 to only ever deliver the latest, up to GZ_OBSERVER_ASYNC_MAX_DEPTH
+ * @return int: number of observers, -1 on failure
+ * **/
+int gz_observer_async_add(gz_observer_async_t*, gz_observer_cb_t cb, uint8_t depth);
+int gz_observer_async_add_ctx(gz_observer_async_t*, gz_observer_ctx_cb_t cb, void *context, uint8_t depth);
+
+/**
+ * @brief Remove the first observer found with this callback (and context), its waiting events are dropped.
+ * It may still be running on a worker when this returns
+ * @return int: number of observers, -1 on failure
+ * **/
+int gz_observer_async_remove(gz_observer_async_t*, gz_observer_cb_t cb);
+int gz_observer_async_remove_ctx(gz_observer_async_t*, gz_observer_ctx_cb_t cb, void *context);
+
+/**
+ * @brief Queue an event for every observer, lock-free and wait-free unless other threads notify at the same time
+ * @param data: size bytes copied, the observers get a pointer to their own copy
+ * @return 0 on success, -1 if dropped (queue full or size larger than eventSize)
+ * **/
+int gz_observer_async_notify(gz_observer_async_t*, const void* data, size_t size);
+
+/**
+ * @brief Wait until the queue and every mailbox are empty, the notifying threads being stopped.
+ * Not from a callback
+ * **/
+void gz_observer_async_flush(gz_observer_async_t*);
+
+void gz_observer_async_get_stats(gz_observer_async_t*, gz_observer_async_stats_t* stats);
+
+/**
+ * @brief Copy the lag metrics of up to max observers
+ * @return number of observers, may be more than max
+ * **/
+uint32_t gz_observer_async_get_lags(gz_observer_async_t*, gz_observer_async_lag_t* lags, uint32_t max);
+#endif /* CY8C6116BZI_F54 */
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -1,14 +1,105 @@
+#include <string.h>
+#include <stdbool.h>
 #include "gz_rand.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-static unsigned long int _randNext = 1;
+#ifdef CY8C6116BZI_F54
+#define GZ_RAND_THREAD_LOCAL      // no threads, a single default state
+#else
+#define GZ_RAND_THREAD_LOCAL __thread
+#endif
+
+#define GZ_RAND_GOLDEN_GAMMA 0x9E3779B97F4A7C15ULL
+
+static unsigned int _seed = 1;
+static uint32_t _seedGeneration = 1;  // the default states seeded before another gzrand_seed_uint() reseed
+static bool _isSeeded = false;
+static uint32_t _threadCount = 0;
 static gz_rand_seed_cb_t _seed_fn;
 
+static GZ_RAND_THREAD_LOCAL gz_xoshiro256_t _local;
+static GZ_RAND_THREAD_LOCAL uint32_t _localGeneration;  // 0 until the first number
+static GZ_RAND_THREAD_LOCAL uint32_t _localThread;      // from 1 in the order the threads asked first
+
+static inline uint64_t _gzrand_splitmix64(uint64_t* state) {
+  uint64_t z = (*state += GZ_RAND_GOLDEN_GAMMA);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+void gz_xoshiro256_seed(gz_xoshiro256_t* rng, uint64_t seed) {
+  for (int i = 0; i < 4; i++) {
+    rng->s[i] = _gzrand_splitmix64(&seed);
+  }
+}
+
+void gz_xoshiro256_jump(gz_xoshiro256_t* rng) {
+  static const uint64_t jump[] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL,
+                                   0x39ABDC4529B1661CULL };
+  uint64_t s[4] = { 0, 0, 0, 0 };
+  for (int i = 0; i < 4; i++) {
+    for (int bit = 0; bit < 64; bit++) {
+      if (jump[i] & (1ULL << bit)) {
+        s[0] ^= rng->s[0];
+        s[1] ^= rng->s[1];
+        s[2] ^= rng->s[2];
+        s[3] ^= rng->s[3];
+      }
+      gz_xoshiro256_next(rng);
+    }
+  }
+  memcpy(rng->s, s, sizeof(s));
+}
+
+void gz_xoshiro256_fill(gz_xoshiro256_t* rng, void* buffer, size_t size) {
+  uint8_t* bytes = (uint8_t*)buffer;
+  for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t)) {
+    uint64_t value = gz_xoshiro256_next(rng);
+    memcpy(bytes, &value, sizeof(value));
+  }
+  if (size) {
+    uint64_t value = gz_xoshiro256_next(rng);
+    memcpy(bytes, &value, size);
+  }
+}
+
+void gz_pcg32_seed(gz_pcg32_t* rng, uint64_t seed, uint64_t stream) {
+  rng->state = 0;
+  rng->inc = (stream << 1) | 1;
+  gz_pcg32_next(rng);
+  rng->state += seed;
+  gz_pcg32_next(rng);
+}
+
+void gz_pcg32_fill(gz_pcg32_t* rng, void* buffer, size_t size) {
+  uint8_t* bytes = (uint8_t*)buffer;
+  for (; size >= sizeof(uint32_t); size -= sizeof(uint32_t), bytes += sizeof(uint32_t)) {
+    uint32_t value = gz_pcg32_next(rng);
+    memcpy(bytes, &value, sizeof(value));
+  }
+  if (size) {
+    uint32_t value = gz_pcg32_next(rng);
+    memcpy(bytes, &value, size);
+  }
+}
+
+/**
+ * @brief The seeding thread (mix 0) replays the seed's sequence, the others add their number to it
+ */
+static void _gzrand_seed_local(unsigned int seed, uint32_t generation, uint64_t mix) {
+  gz_xoshiro256_seed(&_local, seed ^ (mix * GZ_RAND_GOLDEN_GAMMA));
+  _localGeneration = generation;
+}
+
 void gzrand_seed_uint(unsigned int seed) {
-  _randNext = seed;
+  __atomic_store_n(&_seed, seed, __ATOMIC_RELAXED);
+  uint32_t generation = __atomic_add_fetch(&_seedGeneration, 1, __ATOMIC_RELEASE);
+  _isSeeded = true;
+  _gzrand_seed_local(seed, generation, 0);
 }
 
 void gzrand_set_seed_fn(gz_rand_seed_cb_t seed_fn) {
@@ -21,19 +112,51 @@ void gzrand_reseed() {
   }
 }
 
+gz_xoshiro256_t* gzrand_local(void) {
+  uint32_t generation = __atomic_load_n(&_seedGeneration, __ATOMIC_ACQUIRE);
+  if (_localGeneration != generation) {
+    if (!_localThread) {
+      _localThread = __atomic_add_fetch(&_threadCount, 1, __ATOMIC_RELAXED);
+    }
+    _gzrand_seed_local(__atomic_load_n(&_seed, __ATOMIC_RELAXED), generation, _localThread);
+  }
+  return &_local;
+}
+
 int gzrand(void) {
-  _randNext = _randNext * 1103515245 + 12345;
-  return (unsigned int)(_randNext/65536) % 32768;
+  return (int)(gz_xoshiro256_next(gzrand_local()) >> 49);
 }
 
 int gzrand_in_range(int low, int high) {
-  if (low >= high) {
+  if (low > high) {
     return 0;
   }
-  if (_randNext == 1) { // if unseeded, seed now
+  if (!_isSeeded) { // if unseeded, seed now
     gzrand_reseed();
   }
-  return (gzrand() % (high - low + 1)) + low;
+  uint32_t range = (uint32_t)((int64_t)high - low + 1);
+  uint32_t offset = range ? gz_xoshiro256_bounded(gzrand_local(), range) : gzrand_u32(); // 0: all of int
+  return (int)((int64_t)low + offset);
+}
+
+uint32_t gzrand_u32(void) {
+  return gz_xoshiro256_next_u32(gzrand_local());
+}
+
+uint64_t gzrand_u64(void) {
+  return gz_xoshiro256_next(gzrand_local());
+}
+
+uint32_t gzrand_bounded(uint32_t range) {
+  return gz_xoshiro256_bounded(gzrand_local(), range);
+}
+
+double gzrand_double(void) {
+  return gz_xoshiro256_double(gzrand_local());
+}
+
+void gzrand_fill(void* buffer, size_t size) {
+  gz_xoshiro256_fill(gzrand_local(), buffer, size);
 }
 
 #ifdef __cplusplus
@@ -1,22 +1,140 @@
 #ifndef GZ_RAND_H
 #define GZ_RAND_H
 
+/**
+ * Pseudo random numbers, not for cryptography.
+ *
+ * Two generators with their state in an object, one per user and no lock:
+ *  - xoshiro256**: 64 bit outputs, 2^256 - 1 period, gz_xoshiro256_jump() splits it into independent streams
+ *  - PCG32: 32 bit outputs from 16 bytes of state, 2^63 streams selected at seed
+ *
+ * The gzrand* functions use a default xoshiro256** state per thread (a single one on the PSoC), seeded from
+ * gzrand_seed_uint(): the seeding thread gets the seed's sequence back, every other thread its own stream.
+ * Bounded numbers are unbiased (Lemire's multiply and reject).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct {
+  uint64_t s[4];
+} gz_xoshiro256_t;
+
+typedef struct {
+  uint64_t state;
+  uint64_t inc;                   // stream, always odd
+} gz_pcg32_t;
+
 typedef unsigned int (*gz_rand_seed_cb_t)(void);
 
 /**
- * @brief seeds the random number generator.
- * @param seed 
+ * @brief Expands a 64 bit seed into the state (splitmix64), any seed is fine
+ */
+void gz_xoshiro256_seed(gz_xoshiro256_t* rng, uint64_t seed);
+
+/**
+ * @brief Advances the state by 2^128 outputs: seed once, then jump once more for each stream handed out
+ */
+void gz_xoshiro256_jump(gz_xoshiro256_t* rng);
+
+/**
+ * @brief Fills size bytes with random ones
+ */
+void gz_xoshiro256_fill(gz_xoshiro256_t* rng, void* buffer, size_t size);
+
+/**
+ * @param stream generators seeded alike give unrelated sequences on different streams
+ */
+void gz_pcg32_seed(gz_pcg32_t* rng, uint64_t seed, uint64_t stream);
+
+void gz_pcg32_fill(gz_pcg32_t* rng, void* buffer, size_t size);
+
+static inline uint64_t gz_rand_rotl(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t gz_xoshiro256_next(gz_xoshiro256_t* rng) {
+  uint64_t* s = rng->s;
+  uint64_t result = gz_rand_rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = gz_rand_rotl(s[3], 45);
+  return result;
+}
+
+static inline uint32_t gz_pcg32_next(gz_pcg32_t* rng) {
+  uint64_t state = rng->state;
+  rng->state = state * 6364136223846793005ULL + rng->inc;
+  uint32_t xorShifted = (uint32_t)(((state >> 18) ^ state) >> 27);
+  uint32_t rotation = (uint32_t)(state >> 59);
+  return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+}
+
+/**
+ * @brief Maps a 32 bit random number into [0, range): multiply, reject the few low products that would make
+ * some results more likely. Reads another number from next(rng) only then
+ */
+#define GZ_RAND_BOUNDED(next, rng, range, result) \
+  do { \
+    uint64_t product_ = (uint64_t)(next(rng)) * (range); \
+    if ((uint32_t)product_ < (range)) { \
+      uint32_t threshold_ = (uint32_t)(0u - (range)) % (range); \
+      while ((uint32_t)product_ < threshold_) { \
+        product_ = (uint64_t)(next(rng)) * (range); \
+      } \
+    } \
+    (result) = (uint32_t)(product_ >> 32); \
+  } while (0)
+
+static inline uint32_t gz_xoshiro256_next_u32(gz_xoshiro256_t* rng) {
+  return (uint32_t)(gz_xoshiro256_next(rng) >> 32);
+}
+
+/**
+ * @return in [0, range), 0 when range is 0
+ */
+static inline uint32_t gz_xoshiro256_bounded(gz_xoshiro256_t* rng, uint32_t range) {
+  uint32_t result = 0;
+  if (range) {
+    GZ_RAND_BOUNDED(gz_xoshiro256_next_u32, rng, range, result);
+  }
+  return result;
+}
+
+static inline uint32_t gz_pcg32_bounded(gz_pcg32_t* rng, uint32_t range) {
+  uint32_t result = 0;
+  if (range) {
+    GZ_RAND_BOUNDED(gz_pcg32_next, rng, range, result);
+  }
+  return result;
+}
+
+/**
+ * @return uniform in [0, 1), 53 bits
+ */
+static inline double gz_xoshiro256_double(gz_xoshiro256_t* rng) {
+  return (double)(gz_xoshiro256_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief seeds the random number generator: the default state of the calling thread now, the other threads
+ * at their next number
+ * @param seed
  */
 void gzrand_seed_uint(unsigned int seed);
 
 /**
  * @brief Sets the seeding function to call if not yet
- * 
- * @param seed_fn 
+ *
+ * @param seed_fn
  */
 void gzrand_set_seed_fn(gz_rand_seed_cb_t seed_fn);
 
@@ -26,9 +144,14 @@ void gzrand_set_seed_fn(gz_rand_seed_cb_t seed_fn);
 void gzrand_reseed();
 
 /**
- * @brief returns a random number.
- * See gzsrand to seed the generator.
- * @return int 
+ * @brief The default state of the calling thread, for the gz_xoshiro256_* functions
+ */
+gz_xoshiro256_t* gzrand_local(void);
+
+/**
+ * @brief returns a random number in [0, 32767].
+ * See gzrand_seed_uint to seed the generator.
+ * @return int
  */
 int gzrand(void);
 
@@ -36,12 +159,28 @@ int gzrand(void);
  * @brief return random integer between given low, high
  * @param low
  * @param high
- * @return a random intenger between given low and high
+ * @return a random intenger between given low and high, both included, 0 if low > high
  */
 int gzrand_in_range(int low, int high);
 
+uint32_t gzrand_u32(void);
+
+uint64_t gzrand_u64(void);
+
+/**
+ * @return in [0, range), 0 when range is 0
+ */
+uint32_t gzrand_bounded(uint32_t range);
+
+/**
+ * @return uniform in [0, 1)
+ */
+double gzrand_double(void);
+
+void gzrand_fill(void* buffer, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
 
-#endif // GZ_MATH_H
+#endif // GZ_RAND_H
@@ -0,0 +1,397 @@
+/**
+ * @file gz_rollup.c
+ * @brief gz_rollup.h buckets
+ *
+ * gz_rollup_add_samples() reduces the min, max and sum of a 1 s run with vector kernels, the portable loop
+ * being the reference and taking the tails. x86: 64 bit compares need SSE4.2, that and AVX2 are compiled for
+ * their target only and picked at run time, plain loop otherwise. aarch64: NEON. Cortex-M: the loop.
+ * The integral stays a double sum in sample order, the same operations as gz_rollup_add_sample(): both give
+ * the same buckets, to the bit.
+ *
+ * @copyright Copyright (c) Goal Zero 2022
+ */
+
+#include <string.h>
+#include "gz_rollup.h"
+
+#if !defined(GZ_ROLLUP_NO_SIMD)
+#if defined(__x86_64__) && defined(__GNUC__)
+#define GZ_ROLLUP_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define GZ_ROLLUP_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static const int64_t _periods_ns[GZ_ROLLUP_LEVELS] = {
+  1000000000LL,
+  60 * 1000000000LL,
+  3600 * 1000000000LL,
+};
+
+static inline int64_t _gz_rollup_window(int64_t timestamp_ns, gz_rollup_level_t level) {
+  int64_t window = timestamp_ns / _periods_ns[level];
+  if (timestamp_ns % _periods_ns[level] < 0) {
+    window--;
+  }
+  return window * _periods_ns[level];
+}
+
+/**
+ * @brief Sums wrap past INT64_MAX, through uint64_t: defined, and the same whatever the order or the lanes
+ */
+static inline int64_t _gz_rollup_sum(int64_t sum, int64_t value) {
+  return (int64_t)((uint64_t)sum + (uint64_t)value);
+}
+
+static void _gz_rollup_merge(gz_rollup_bucket_t* into, const gz_rollup_bucket_t* bucket) {
+  if (!into->count) {
+    int64_t start_ns = into->start_ns;
+    *into = *bucket;
+    into->start_ns = start_ns;
+    return;
+  }
+  into->count += bucket->count;
+  into->min = bucket->min < into->min ? bucket->min : into->min;
+  into->max = bucket->max > into->max ? bucket->max : into->max;
+  into->sum = _gz_rollup_sum(into->sum, bucket->sum);
+  into->last = bucket->last;
+  into->integral_s += bucket->integral_s;
+}
+
+/**
+ * @brief Moves the open bucket of a level to its history and into the open bucket of the next level
+ */
+static void _gz_rollup_close(gz_rollup_t* rollup, gz_rollup_level_t level) {
+  gz_rollup_history_t* history = &rollup->levels[level];
+  if (rollup->historySize) {
+    history->buckets[history->head] = history->open;
+    history->head = (history->head + 1) % rollup->historySize;
+    if (history->count < rollup->historySize) {
+      history->count++;
+    }
+  }
+  if (rollup->cb) {
+    rollup->cb(rollup->context, level, &history->open);
+  }
+  if (level + 1 < GZ_ROLLUP_LEVELS) {
+    gz_rollup_bucket_t* next = &rollup->levels[level + 1].open;
+    if (!next->count) {
+      next->start_ns = _gz_rollup_window(history->open.start_ns, (gz_rollup_level_t)(level + 1));
+    }
+    _gz_rollup_merge(next, &history->open);
+  }
+  history->open.count = 0;
+}
+
+/**
+ * @brief Closes the buckets whose window ends before timestamp_ns, lowest level first. A level still open
+ * means the ones above are too
+ */
+static void _gz_rollup_advance(gz_rollup_t* rollup, int64_t timestamp_ns) {
+  for (int level = 0; level < GZ_ROLLUP_LEVELS; level++) {
+    const gz_rollup_bucket_t* open = &rollup->levels[level].open;
+    if (!open->count || open->start_ns == _gz_rollup_window(timestamp_ns, (gz_rollup_level_t)level)) {
+      break;
+    }
+    _gz_rollup_close(rollup, (gz_rollup_level_t)level);
+  }
+}
+
+/**
+ * @brief Adds a sample's value held for interval_ns, nothing past maxGap_ns. The one expression both paths use
+ */
+static inline void _gz_rollup_accumulate(double* integral_s, int64_t value, int64_t interval_ns, int64_t maxGap_ns) {
+  *integral_s += interval_ns <= maxGap_ns ? (double)value * interval_ns / 1e9 : 0.0;
+}
+
+/**
+ * @brief Integrates the previous sample up to timestamp_ns, into the bucket it is in
+ */
+static inline void _gz_rollup_integrate(gz_rollup_t* rollup, int64_t timestamp_ns) {
+  if (rollup->hasPrevious) {
+    _gz_rollup_accumulate(&rollup->levels[GZ_ROLLUP_1S].open.integral_s, rollup->previous,
+                          timestamp_ns - rollup->previous_ns, rollup->maxGap_ns);
+  }
+}
+
+/*****************************************************/
+/* Section: Run reductions                           */
+/*****************************************************/
+
+/**
+ * @brief Folds count values into *minimum, *maximum and *sum
+ */
+static void _gz_rollup_reduce_scalar(const int64_t* values, uint32_t count, int64_t* minimum, int64_t* maximum,
+                                     int64_t* sum) {
+  int64_t low = *minimum;
+  int64_t high = *maximum;
+  int64_t total = *sum;
+  for (uint32_t i = 0; i < count; i++) {
+    low = values[i] < low ? values[i] : low;
+    high = values[i] > high ? values[i] : high;
+    total = _gz_rollup_sum(total, values[i]);
+  }
+  *minimum = low;
+  *maximum = high;
+  *sum = total;
+}
+
+/**
+ * @brief Folds the lanes of vector accumulators into *minimum, *maximum and *sum
+ */
+static inline void _gz_rollup_reduce_lanes(const int64_t* lows, const int64_t* highs, const int64_t* totals,
+                                           size_t lanes, int64_t* minimum, int64_t* maximum, int64_t* sum) {
+  for (size_t lane = 0; lane < lanes; lane++) {
+    *minimum = lows[lane] < *minimum ? lows[lane] : *minimum;
+    *maximum = highs[lane] > *maximum ? highs[lane] : *maximum;
+    *sum = _gz_rollup_sum(*sum, totals[lane]);
+  }
+}
+
+#ifdef GZ_ROLLUP_X86
+
+__attribute__((target("sse4.2")))
+static void _gz_rollup_reduce_sse42(const int64_t* values, uint32_t count, int64_t* minimum, int64_t* maximum,
+                                    int64_t* sum) {
+  uint32_t i = 0;
+  if (count >= 2) {
+    __m128i low = _mm_loadu_si128((const __m128i*)values);
+    __m128i high = low;
+    __m128i total = low;
+    for (i = 2; i + 2 <= count; i += 2) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+      low = _mm_blendv_epi8(low, v, _mm_cmpgt_epi64(low, v));
+      high = _mm_blendv_epi8(high, v, _mm_cmpgt_epi64(v, high));
+      total = _mm_add_epi64(total, v);
+    }
+    int64_t lows[2], highs[2], totals[2];
+    _mm_storeu_si128((__m128i*)lows, low);
+    _mm_storeu_si128((__m128i*)highs, high);
+    _mm_storeu_si128((__m128i*)totals, total);
+    _gz_rollup_reduce_lanes(lows, highs, totals, 2, minimum, maximum, sum);
+  }
+  _gz_rollup_reduce_scalar(values + i, count - i, minimum, maximum, sum);
+}
+
+__attribute__((target("avx2")))
+static void _gz_rollup_reduce_avx2(const int64_t* values, uint32_t count, int64_t* minimum, int64_t* maximum,
+                                   int64_t* sum) {
+  uint32_t i = 0;
+  if (count >= 4) {
+    __m256i low = _mm256_loadu_si256((const __m256i*)values);
+    __m256i high = low;
+    __m256i total = low;
+    for (i = 4; i + 4 <= count; i += 4) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+      low = _mm256_blendv_epi8(low, v, _mm256_cmpgt_epi64(low, v));
+      high = _mm256_blendv_epi8(high, v, _mm256_cmpgt_epi64(v, high));
+      total = _mm256_add_epi64(total, v);
+    }
+    int64_t lows[4], highs[4], totals[4];
+    _mm256_storeu_si256((__m256i*)lows, low);
+    _mm256_storeu_si256((__m256i*)highs, high);
+    _mm256_storeu_si256((__m256i*)totals, total);
+    _gz_rollup_reduce_lanes(lows, highs, totals, 4, minimum, maximum, sum);
+  }
+  _gz_rollup_reduce_scalar(values + i, count - i, minimum, maximum, sum);
+}
+
+typedef enum {
+  _GZ_ROLLUP_SIMD_NONE,
+  _GZ_ROLLUP_SIMD_SSE42,
+  _GZ_ROLLUP_SIMD_AVX2,
+} _Gz_Rollup_Simd_t;
+
+static _Gz_Rollup_Simd_t _gz_rollup_simd(void) {
+  static int simd = -1;
+  if (simd < 0) {
+    __builtin_cpu_init();
+    simd = __builtin_cpu_supports("avx2") ? _GZ_ROLLUP_SIMD_AVX2 :
+           __builtin_cpu_supports("sse4.2") ? _GZ_ROLLUP_SIMD_SSE42 : _GZ_ROLLUP_SIMD_NONE;
+  }
+  return (_Gz_Rollup_Simd_t)simd;
+}
+
+#endif // GZ_ROLLUP_X86
+
+#ifdef GZ_ROLLUP_NEON
+
+static void _gz_rollup_reduce_neon(const int64_t* values, uint32_t count, int64_t* minimum, int64_t* maximum,
+                                   int64_t* sum) {
+  uint32_t i = 0;
+  if (count >= 2) {
+    int64x2_t low = vld1q_s64(values);
+    int64x2_t high = low;
+    int64x2_t total = low;
+    for (i = 2; i + 2 <= count; i += 2) {
+      int64x2_t v = vld1q_s64(values + i);
+      low = vbslq_s64(vcgtq_s64(low, v), v, low);
+      high = vbslq_s64(vcgtq_s64(v, high), v, high);
+      total = vaddq_s64(total, v);
+    }
+    int64_t lows[2] = { vgetq_lane_s64(low, 0), vgetq_lane_s64(low, 1) };
+    int64_t highs[2] = { vgetq_lane_s64(high, 0), vgetq_lane_s64(high, 1) };
+    int64_t totals[2] = { vgetq_lane_s64(total, 0), vgetq_lane_s64(total, 1) };
+    _gz_rollup_reduce_lanes(lows, highs, totals, 2, minimum, maximum, sum);
+  }
+  _gz_rollup_reduce_scalar(values + i, count - i, minimum, maximum, sum);
+}
+
+#endif // GZ_ROLLUP_NEON
+
+static void _gz_rollup_reduce(const int64_t* values, uint32_t count, int64_t* minimum, int64_t* maximum,
+                              int64_t* sum) {
+#if defined(GZ_ROLLUP_X86)
+  switch (_gz_rollup_simd()) {
+    case _GZ_ROLLUP_SIMD_AVX2:
+      _gz_rollup_reduce_avx2(values, count, minimum, maximum, sum);
+      return;
+    case _GZ_ROLLUP_SIMD_SSE42:
+      _gz_rollup_reduce_sse42(values, count, minimum, maximum, sum);
+      return;
+    default:
+      break;
+  }
+#elif defined(GZ_ROLLUP_NEON)
+  _gz_rollup_reduce_neon(values, count, minimum, maximum, sum);
+  return;
+#endif
+  _gz_rollup_reduce_scalar(values, count, minimum, maximum, sum);
+}
+
+/*****************************************************/
+/* Section: Public functions                         */
+/*****************************************************/
+
+void gz_rollup_init(gz_rollup_t* rollup, gz_rollup_bucket_t* history, uint16_t historySize, int64_t maxGap_ns,
+                    gz_rollup_cb_t cb, void* context) {
+  memset(rollup, 0, sizeof(gz_rollup_t));
+  for (int level = 0; level < GZ_ROLLUP_LEVELS; level++) {
+    rollup->levels[level].buckets = history ? &history[level * historySize] : NULL;
+  }
+  rollup->historySize = history ? historySize : 0;
+  rollup->maxGap_ns = maxGap_ns ? maxGap_ns : GZ_ROLLUP_DEFAULT_MAX_GAP_NS;
+  rollup->cb = cb;
+  rollup->context = context;
+}
+
+void gz_rollup_clear(gz_rollup_t* rollup) {
+  for (int level = 0; level < GZ_ROLLUP_LEVELS; level++) {
+    rollup->levels[level].head = 0;
+    rollup->levels[level].count = 0;
+    rollup->levels[level].open.count = 0;
+  }
+  rollup->hasPrevious = false;
+  rollup->rejected = 0;
+}
+
+bool gz_rollup_add_sample(gz_rollup_t* rollup, int64_t timestamp_ns, int64_t value) {
+  if (rollup->hasPrevious && timestamp_ns < rollup->previous_ns) {
+    rollup->rejected++;
+    return false;
+  }
+  _gz_rollup_integrate(rollup, timestamp_ns);
+  _gz_rollup_advance(rollup, timestamp_ns);
+  gz_rollup_bucket_t* open = &rollup->levels[GZ_ROLLUP_1S].open;
+  if (!open->count) {
+    open->start_ns = _gz_rollup_window(timestamp_ns, GZ_ROLLUP_1S);
+    open->min = value;
+    open->max = value;
+    open->sum = 0;
+    open->integral_s = 0;
+  }
+  open->count++;
+  open->min = value < open->min ? value : open->min;
+  open->max = value > open->max ? value : open->max;
+  open->sum = _gz_rollup_sum(open->sum, value);
+  open->last = value;
+  rollup->hasPrevious = true;
+  rollup->previous_ns = timestamp_ns;
+  rollup->previous = value;
+  return true;
+}
+
+uint32_t gz_rollup_add_samples(gz_rollup_t* rollup, const int64_t* timestamps, const int64_t* values, uint32_t count) {
+  uint32_t added = 0;
+  uint32_t i = 0;
+  while (i < count) {
+    // The first sample of a window goes the slow way: integral from the previous one, buckets to close
+    if (!gz_rollup_add_sample(rollup, timestamps[i], values[i])) {
+      i++;
+      continue;
+    }
+    int64_t end_ns = rollup->levels[GZ_ROLLUP_1S].open.start_ns + _periods_ns[GZ_ROLLUP_1S];
+    uint32_t runEnd = i + 1;
+    while (runEnd < count && timestamps[runEnd] < end_ns && timestamps[runEnd] >= timestamps[runEnd - 1]) {
+      runEnd++;
+    }
+    gz_rollup_bucket_t* open = &rollup->levels[GZ_ROLLUP_1S].open;
+    _gz_rollup_reduce(values + i + 1, runEnd - i - 1, &open->min, &open->max, &open->sum);
+    for (uint32_t k = i; k + 1 < runEnd; k++) {
+      _gz_rollup_accumulate(&open->integral_s, values[k], timestamps[k + 1] - timestamps[k], rollup->maxGap_ns);
+    }
+    open->count += runEnd - i - 1;
+    open->last = values[runEnd - 1];
+    rollup->previous_ns = timestamps[runEnd - 1];
+    rollup->previous = values[runEnd - 1];
+    added += runEnd - i;
+    i = runEnd;
+  }
+  return added;
+}
+
+void gz_rollup_flush(gz_rollup_t* rollup, int64_t until_ns) {
+  if (rollup->hasPrevious && until_ns > rollup->previous_ns) {
+    _gz_rollup_integrate(rollup, until_ns);
+  }
+  rollup->hasPrevious = false;
+  for (int level = 0; level < GZ_ROLLUP_LEVELS; level++) {
+    if (rollup->levels[level].open.count) {
+      _gz_rollup_close(rollup, (gz_rollup_level_t)level);
+    }
+  }
+}
+
+bool gz_rollup_get_open(const gz_rollup_t* rollup, gz_rollup_level_t level, gz_rollup_bucket_t* bucket) {
+  bucket->count = 0;
+  bucket->start_ns = 0;
+  for (int lower = level; lower >= 0; lower--) {
+    const gz_rollup_bucket_t* open = &rollup->levels[lower].open;
+    if (!open->count) {
+      continue;
+    }
+    if (!bucket->count) {
+      bucket->start_ns = _gz_rollup_window(open->start_ns, level);
+    }
+    _gz_rollup_merge(bucket, open);
+  }
+  return bucket->count != 0;
+}
+
+bool gz_rollup_get_closed(const gz_rollup_t* rollup, gz_rollup_level_t level, uint16_t index,
+                          gz_rollup_bucket_t* bucket) {
+  const gz_rollup_history_t* history = &rollup->levels[level];
+  if (index >= history->count) {
+    return false;
+  }
+  *bucket = history->buckets[(history->head + rollup->historySize - 1 - index) % rollup->historySize];
+  return true;
+}
+
+uint16_t gz_rollup_closed_count(const gz_rollup_t* rollup, gz_rollup_level_t level) {
+  return rollup->levels[level].count;
+}
+
+int64_t gz_rollup_period_ns(gz_rollup_level_t level) {
+  return _periods_ns[level];
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,133 @@
+/**
+ * @file gz_rollup.h
+ * @brief Streaming aggregation of one series into 1 s, 1 min and 1 h buckets: count, min, max, mean, last and
+ * the time integral of the value (energy when the series is a power)
+ *
+ * A sample only updates the open 1 s bucket. When a bucket's window ends it is merged into the open bucket of
+ * the next level and kept in that level's history, a ring of the latest closed buckets: a sample is O(1) and
+ * the memory is fixed at init, however long the series runs. The integral holds each sample's value until the
+ * next one (the interval goes to the bucket of its first sample), intervals longer than maxGap_ns are not
+ * integrated: the series was not sampled.
+ *
+ * Samples must come in time order, older ones are rejected. No lock, one owner per gz_rollup_t.
+ *
+ * @copyright Copyright (c) Goal Zero 2022
+ */
+
+#ifndef _GZ_ROLLUP_H
+#define _GZ_ROLLUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GZ_ROLLUP_LEVELS              3
+#define GZ_ROLLUP_DEFAULT_MAX_GAP_NS  (10 * 1000000000LL)
+
+typedef enum {
+  GZ_ROLLUP_1S,
+  GZ_ROLLUP_1MIN,
+  GZ_ROLLUP_1H,
+} gz_rollup_level_t;
+
+typedef struct {
+  int64_t start_ns;               // window start, a multiple of the level period
+  uint32_t count;
+  int64_t min;
+  int64_t max;
+  int64_t sum;                    // wraps past INT64_MAX
+  int64_t last;
+  double integral_s;              // value x seconds
+} gz_rollup_bucket_t;
+
+/**
+ * @brief Called with every bucket closed, before the next sample is added
+ */
+typedef void (*gz_rollup_cb_t)(void* context, gz_rollup_level_t level, const gz_rollup_bucket_t* bucket);
+
+typedef struct {
+  gz_rollup_bucket_t* buckets;    // historySize closed buckets, a ring
+  uint16_t head;                  // next written
+  uint16_t count;
+  gz_rollup_bucket_t open;        // count 0 when there is none
+} gz_rollup_history_t;
+
+typedef struct {
+  gz_rollup_history_t levels[GZ_ROLLUP_LEVELS];
+  uint16_t historySize;
+  int64_t maxGap_ns;
+  bool hasPrevious;
+  int64_t previous_ns;
+  int64_t previous;
+  uint32_t rejected;              // samples older than the previous one
+  gz_rollup_cb_t cb;
+  void* context;
+} gz_rollup_t;
+
+/**
+ * @param history GZ_ROLLUP_LEVELS * historySize buckets given by the caller, 1 s ones first
+ * @param maxGap_ns longest interval integrated, 0 for GZ_ROLLUP_DEFAULT_MAX_GAP_NS
+ * @param cb NULL when the history is enough
+ */
+void gz_rollup_init(gz_rollup_t* rollup, gz_rollup_bucket_t* history, uint16_t historySize, int64_t maxGap_ns,
+                    gz_rollup_cb_t cb, void* context);
+
+/**
+ * @brief Forgets every sample and bucket
+ */
+void gz_rollup_clear(gz_rollup_t* rollup);
+
+/**
+ * @return false if the sample is older than the previous one
+ */
+bool gz_rollup_add_sample(gz_rollup_t* rollup, int64_t timestamp_ns, int64_t value);
+
+/**
+ * @brief Same buckets as count gz_rollup_add_sample() calls, a 1 s window at a time: min, max and sum of a
+ * window in vector kernels (SSE4.2/AVX2, NEON, a plain loop elsewhere). Takes a gz_telemetry scan as it comes
+ * @return samples added
+ */
+uint32_t gz_rollup_add_samples(gz_rollup_t* rollup, const int64_t* timestamps, const int64_t* values, uint32_t count);
+
+/**
+ * @brief Closes the open buckets, the last sample's value is integrated up to until_ns. The series ends
+ * there: nothing is integrated between until_ns and the next sample
+ */
+void gz_rollup_flush(gz_rollup_t* rollup, int64_t until_ns);
+
+/**
+ * @brief The open bucket of a level, the samples not merged up yet included
+ * @return false when it is empty
+ */
+bool gz_rollup_get_open(const gz_rollup_t* rollup, gz_rollup_level_t level, gz_rollup_bucket_t* bucket);
+
+/**
+ * @brief A closed bucket of a level, 0 is the latest
+ * @return false past the history
+ */
+bool gz_rollup_get_closed(const gz_rollup_t* rollup, gz_rollup_level_t level, uint16_t index,
+                          gz_rollup_bucket_t* bucket);
+
+uint16_t gz_rollup_closed_count(const gz_rollup_t* rollup, gz_rollup_level_t level);
+
+int64_t gz_rollup_period_ns(gz_rollup_level_t level);
+
+static inline double gz_rollup_mean(const gz_rollup_bucket_t* bucket) {
+  return bucket->count ? (double)bucket->sum / bucket->count : 0.0;
+}
+
+/**
+ * @param unit_W watts per unit of the value, 0.1 for a power in dW
+ */
+static inline double gz_rollup_energy_Wh(const gz_rollup_bucket_t* bucket, double unit_W) {
+  return bucket->integral_s * unit_W / 3600.0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,711 @@
+/**
+ * @file gz_telemetry.c
+ *
+ * @copyright Copyright (c) Goal Zero 2022
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gz_telemetry.h"
+#include "gz_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GZ_TELEMETRY_PATH_MAX   256
+#define GZ_TELEMETRY_VARINT_MAX 10    // bytes of a 64 bit varint
+
+/**
+ * @brief A sealed chunk, the index is in time order
+ */
+typedef struct {
+  int64_t first_ns;
+  int64_t last_ns;
+  uint32_t count;
+  uint32_t offset;                // in its segment
+  uint16_t segment;
+} _Gz_Telemetry_Chunk_t;
+
+typedef struct {
+  uint8_t* map;
+  size_t mapSize;
+} _Gz_Telemetry_Segment_t;
+
+struct gz_telemetry {
+  pthread_mutex_t lock;
+  char path[GZ_TELEMETRY_PATH_MAX];
+  bool isWritable;
+  uint16_t columnCount;
+  gz_telemetry_column_desc_t columns[GZ_TELEMETRY_MAX_COLUMNS];
+  uint32_t recordSize;            // bytes of a sample as a record: timestamp and columns
+  int64_t chunk_ns;
+  size_t segmentSize;
+  _Gz_Telemetry_Segment_t* segments;
+  uint16_t segmentCount;
+  bool isSegmentOpen;             // the last segment is the one appended to
+  _Gz_Telemetry_Chunk_t* chunks;
+  uint32_t chunkCount;
+  uint32_t chunkCapacity;
+  int64_t* openTimes;             // current chunk, GZ_TELEMETRY_CHUNK_MAX_SAMPLES
+  int64_t* openValues;            // column after column, GZ_TELEMETRY_CHUNK_MAX_SAMPLES each
+  uint32_t openCount;
+  int64_t last_ns;                // latest sample, sealed or not
+  uint8_t* encoded;               // a sealed chunk before it is copied to its segment
+  gz_telemetry_stats_t stats;
+};
+
+static uint64_t _gz_telemetry_realtime_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static inline uint64_t _gz_telemetry_zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t _gz_telemetry_unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline uint8_t* _gz_telemetry_put_varint(uint8_t* out, uint64_t value) {
+  while (value >= 0x80) {
+    *out++ = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+/**
+ * @return the byte after the varint, NULL if it runs past end
+ */
+static inline const uint8_t* _gz_telemetry_get_varint(const uint8_t* in, const uint8_t* end, uint64_t* value) {
+  uint64_t result = 0;
+  for (uint8_t shift = 0; in < end && shift < 64; shift += 7) {
+    uint8_t byte = *in++;
+    result |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return in;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Reads a little endian field, sign extended when it is signed
+ */
+static int64_t _gz_telemetry_read_field(const uint8_t* field, uint8_t size, bool isSigned) {
+  uint64_t value = 0;
+  for (uint8_t i = 0; i < size; i++) {
+    value |= (uint64_t)field[i] << (8 * i);
+  }
+  if (isSigned && size < 8 && (value >> (8 * size - 1)) & 1) {
+    value |= ~0ULL << (8 * size);
+  }
+  return (int64_t)value;
+}
+
+/**
+ * @brief First value then the deltas, nothing more when they are all 0
+ */
+static uint8_t* _gz_telemetry_encode_values(uint8_t* out, const int64_t* values, uint32_t count) {
+  out = _gz_telemetry_put_varint(out, _gz_telemetry_zigzag(values[0]));
+  uint32_t i = 1;
+  while (i < count && values[i] == values[0]) {
+    i++;
+  }
+  if (i == count) {
+    return out;
+  }
+  for (i = 1; i < count; i++) {
+    out = _gz_telemetry_put_varint(out, _gz_telemetry_zigzag((int64_t)((uint64_t)values[i] - (uint64_t)values[i - 1])));
+  }
+  return out;
+}
+
+static bool _gz_telemetry_decode_values(const uint8_t* in, const uint8_t* end, int64_t* values, uint32_t count) {
+  uint64_t encoded;
+  if (!(in = _gz_telemetry_get_varint(in, end, &encoded))) {
+    return false;
+  }
+  values[0] = _gz_telemetry_unzigzag(encoded);
+  if (in == end) {
+    // Constant
+    for (uint32_t i = 1; i < count; i++) {
+      values[i] = values[0];
+    }
+    return true;
+  }
+  for (uint32_t i = 1; i < count; i++) {
+    if (!(in = _gz_telemetry_get_varint(in, end, &encoded))) {
+      return false;
+    }
+    values[i] = (int64_t)((uint64_t)values[i - 1] + (uint64_t)_gz_telemetry_unzigzag(encoded));
+  }
+  return true;
+}
+
+/**
+ * @brief First timestamp, first period, then the delta of each period to the previous one: nothing more
+ * when the period is regular
+ */
+static uint8_t* _gz_telemetry_encode_times(uint8_t* out, const int64_t* times, uint32_t count) {
+  out = _gz_telemetry_put_varint(out, _gz_telemetry_zigzag(times[0]));
+  if (count == 1) {
+    return out;
+  }
+  int64_t period = times[1] - times[0];
+  out = _gz_telemetry_put_varint(out, _gz_telemetry_zigzag(period));
+  uint32_t i = 2;
+  while (i < count && times[i] - times[i - 1] == period) {
+    i++;
+  }
+  if (i == count) {
+    return out;
+  }
+  for (i = 2; i < count; i++) {
+    int64_t delta = times[i] - times[i - 1];
+    out = _gz_telemetry_put_varint(out, _gz_telemetry_zigzag(delta - period));
+    period = delta;
+  }
+  return out;
+}
+
+static bool _gz_telemetry_decode_times(const uint8_t* in, const uint8_t* end, int64_t* times, uint32_t count) {
+  uint64_t encoded;
+  if (!(in = _gz_telemetry_get_varint(in, end, &encoded))) {
+    return false;
+  }
+  times[0] = _gz_telemetry_unzigzag(encoded);
+  if (count == 1) {
+    return true;
+  }
+  if (!(in = _gz_telemetry_get_varint(in, end, &encoded))) {
+    return false;
+  }
+  int64_t period = _gz_telemetry_unzigzag(encoded);
+  times[1] = times[0] + period;
+  bool isRegular = in == end;
+  for (uint32_t i = 2; i < count; i++) {
+    if (!isRegular) {
+      if (!(in = _gz_telemetry_get_varint(in, end, &encoded))) {
+        return false;
+      }
+      period += _gz_telemetry_unzigzag(encoded);
+    }
+    times[i] = times[i - 1] + period;
+  }
+  return true;
+}
+
+static size_t _gz_telemetry_header_size(uint16_t columnCount) {
+  return sizeof(gz_telemetry_segment_header_t) + columnCount * sizeof(gz_telemetry_column_desc_t);
+}
+
+static size_t _gz_telemetry_max_chunk_size(uint16_t columnCount) {
+  return sizeof(gz_telemetry_chunk_header_t) + (columnCount + 1) * sizeof(uint32_t) +
+         (size_t)(columnCount + 1) * GZ_TELEMETRY_CHUNK_MAX_SAMPLES * GZ_TELEMETRY_VARINT_MAX + sizeof(uint32_t);
+}
+
+static void _gz_telemetry_segment_path(const gz_telemetry_t* store, uint16_t index, char* path, size_t size) {
+  snprintf(path, size, "%s.%u", store->path, (unsigned)index);
+}
+
+static int _gz_telemetry_add_segment(gz_telemetry_t* store, uint8_t* map, size_t mapSize) {
+  _Gz_Telemetry_Segment_t* segments = (_Gz_Telemetry_Segment_t*)realloc(store->segments,
+                                                                      (store->segmentCount + 1) * sizeof(*segments));
+  if (!segments) {
+    return -1;
+  }
+  store->segments = segments;
+  store->segments[store->segmentCount].map = map;
+  store->segments[store->segmentCount].mapSize = mapSize;
+  store->segmentCount++;
+  store->stats.segments = store->segmentCount;
+  return 0;
+}
+
+static int _gz_telemetry_index_chunk(gz_telemetry_t* store, const gz_telemetry_chunk_header_t* chunk,
+                                     uint16_t segment, uint32_t offset) {
+  if (store->chunkCount == store->chunkCapacity) {
+    uint32_t capacity = store->chunkCapacity ? store->chunkCapacity * 2 : 64;
+    _Gz_Telemetry_Chunk_t* chunks = (_Gz_Telemetry_Chunk_t*)realloc(store->chunks, capacity * sizeof(*chunks));
+    if (!chunks) {
+      return -1;
+    }
+    store->chunks = chunks;
+    store->chunkCapacity = capacity;
+  }
+  _Gz_Telemetry_Chunk_t* entry = &store->chunks[store->chunkCount++];
+  entry->first_ns = chunk->first_ns;
+  entry->last_ns = chunk->last_ns;
+  entry->count = chunk->count;
+  entry->offset = offset;
+  entry->segment = segment;
+  store->stats.chunks = store->chunkCount;
+  store->stats.samples += chunk->count;
+  store->stats.storedBytes += chunk->size;
+  store->stats.rawBytes += (uint64_t)chunk->count * store->recordSize;
+  store->last_ns = chunk->last_ns;
+  return 0;
+}
+
+static void _gz_telemetry_set_record_size(gz_telemetry_t* store) {
+  store->recordSize = sizeof(int64_t);
+  for (uint16_t i = 0; i < store->columnCount; i++) {
+    store->recordSize += store->columns[i].size;
+  }
+}
+
+static bool _gz_telemetry_is_same_schema(const gz_telemetry_t* store, const gz_telemetry_column_desc_t* columns,
+                                         uint16_t columnCount) {
+  return columnCount == store->columnCount &&
+         memcmp(columns, store->columns, columnCount * sizeof(gz_telemetry_column_desc_t)) == 0;
+}
+
+/**
+ * @brief Maps an existing segment read-only and indexes its chunks
+ * @return 0 on success, 1 if there is no such segment, -1 if it can not be used
+ */
+static int _gz_telemetry_load_segment(gz_telemetry_t* store, uint16_t index, bool hasSchema) {
+  char path[GZ_TELEMETRY_PATH_MAX + 8];
+  _gz_telemetry_segment_path(store, index, path, sizeof(path));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 1;
+  }
+  struct stat status;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &status) == 0 && (size_t)status.st_size >= sizeof(gz_telemetry_segment_header_t)) {
+    map = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    GZ_LOG_ERROR("gz_telemetry: cannot map %s\n", path);
+    return -1;
+  }
+  const gz_telemetry_segment_header_t* header = (const gz_telemetry_segment_header_t*)map;
+  const gz_telemetry_column_desc_t* columns = (const gz_telemetry_column_desc_t*)((const uint8_t*)map + sizeof(*header));
+  size_t headerSize = _gz_telemetry_header_size(header->columnCount);
+  if (memcmp(header->magic, GZ_TELEMETRY_MAGIC, sizeof(header->magic)) || header->version != GZ_TELEMETRY_VERSION ||
+      header->columnCount > GZ_TELEMETRY_MAX_COLUMNS || header->headerSize != headerSize ||
+      header->used > (size_t)status.st_size || header->used < headerSize) {
+    GZ_LOG_ERROR("gz_telemetry: %s is not a telemetry segment\n", path);
+    munmap(map, status.st_size);
+    return -1;
+  }
+  if (!hasSchema) {
+    store->columnCount = header->columnCount;
+    memcpy(store->columns, columns, header->columnCount * sizeof(gz_telemetry_column_desc_t));
+    store->chunk_ns = header->chunk_ns;
+    _gz_telemetry_set_record_size(store);
+  } else if (!_gz_telemetry_is_same_schema(store, columns, header->columnCount)) {
+    GZ_LOG_ERROR("gz_telemetry: %s has other columns\n", path);
+    munmap(map, status.st_size);
+    return -1;
+  }
+  if (_gz_telemetry_add_segment(store, (uint8_t*)map, status.st_size) < 0) {
+    munmap(map, status.st_size);
+    return -1;
+  }
+  uint32_t offset = headerSize;
+  for (uint32_t i = 0; i < header->chunks && offset + sizeof(gz_telemetry_chunk_header_t) <= header->used; i++) {
+    const gz_telemetry_chunk_header_t* chunk = (const gz_telemetry_chunk_header_t*)((const uint8_t*)map + offset);
+    if (chunk->size > header->used - offset || chunk->size % sizeof(uint32_t) ||
+        chunk->size < sizeof(gz_telemetry_chunk_header_t) + (store->columnCount + 1) * sizeof(uint32_t) ||
+        !chunk->count || chunk->count > GZ_TELEMETRY_CHUNK_MAX_SAMPLES ||
+        chunk->first_ns < store->last_ns || _gz_telemetry_index_chunk(store, chunk, index, offset) < 0) {
+      GZ_LOG_WARN("gz_telemetry: %s cut at chunk %u\n", path, i);
+      break;
+    }
+    offset += chunk->size;
+  }
+  return 0;
+}
+
+/**
+ * @brief Creates the next segment at its full size, the previous one is truncated to what it holds
+ */
+static int _gz_telemetry_new_segment(gz_telemetry_t* store) {
+  char path[GZ_TELEMETRY_PATH_MAX + 8];
+  if (store->isSegmentOpen) {
+    const _Gz_Telemetry_Segment_t* last = &store->segments[store->segmentCount - 1];
+    _gz_telemetry_segment_path(store, store->segmentCount - 1, path, sizeof(path));
+    if (truncate(path, ((const gz_telemetry_segment_header_t*)last->map)->used) != 0) {
+      GZ_LOG_WARN("gz_telemetry: cannot truncate %s\n", path);
+    }
+    store->isSegmentOpen = false;
+  }
+  _gz_telemetry_segment_path(store, store->segmentCount, path, sizeof(path));
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    GZ_LOG_ERROR("gz_telemetry: cannot open %s\n", path);
+    return -1;
+  }
+  void* map = MAP_FAILED;
+  if (ftruncate(fd, (off_t)store->segmentSize) == 0) {
+    map = mmap(NULL, store->segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd); // the mapping keeps the file
+  if (map == MAP_FAILED || _gz_telemetry_add_segment(store, (uint8_t*)map, store->segmentSize) < 0) {
+    GZ_LOG_ERROR("gz_telemetry: cannot map %s\n", path);
+    if (map != MAP_FAILED) {
+      munmap(map, store->segmentSize);
+    }
+    return -1;
+  }
+  gz_telemetry_segment_header_t* header = (gz_telemetry_segment_header_t*)map;
+  memcpy(header->magic, GZ_TELEMETRY_MAGIC, sizeof(header->magic));
+  header->version = GZ_TELEMETRY_VERSION;
+  header->headerSize = _gz_telemetry_header_size(store->columnCount);
+  header->columnCount = store->columnCount;
+  header->segmentIndex = store->segmentCount - 1;
+  header->used = header->headerSize;
+  header->chunks = 0;
+  header->reserved = 0;
+  header->chunk_ns = store->chunk_ns;
+  header->createdRealtime_ns = _gz_telemetry_realtime_ns();
+  memcpy(header + 1, store->columns, store->columnCount * sizeof(gz_telemetry_column_desc_t));
+  store->isSegmentOpen = true;
+  return 0;
+}
+
+/**
+ * @brief Encodes the current chunk into its segment. Called locked
+ */
+static int _gz_telemetry_seal(gz_telemetry_t* store) {
+  if (!store->openCount) {
+    return 0;
+  }
+  uint32_t count = store->openCount;
+  gz_telemetry_chunk_header_t* chunk = (gz_telemetry_chunk_header_t*)store->encoded;
+  uint32_t* streamSizes = (uint32_t*)(chunk + 1);
+  uint8_t* start = (uint8_t*)(streamSizes + store->columnCount + 1);
+  uint8_t* out = _gz_telemetry_encode_times(start, store->openTimes, count);
+  streamSizes[0] = out - start;
+  for (uint16_t column = 0; column < store->columnCount; column++) {
+    uint8_t* stream = out;
+    out = _gz_telemetry_encode_values(out, &store->openValues[(size_t)column * GZ_TELEMETRY_CHUNK_MAX_SAMPLES], count);
+    streamSizes[column + 1] = out - stream;
+  }
+  // Padded so that the stream sizes of the next chunk are aligned
+  while ((out - store->encoded) % sizeof(uint32_t)) {
+    *out++ = 0;
+  }
+  chunk->size = out - store->encoded;
+  chunk->count = count;
+  chunk->first_ns = store->openTimes[0];
+  chunk->last_ns = store->openTimes[count - 1];
+
+  gz_telemetry_segment_header_t* header = store->isSegmentOpen ?
+    (gz_telemetry_segment_header_t*)store->segments[store->segmentCount - 1].map : NULL;
+  if (!header || header->used + chunk->size > store->segmentSize) {
+    if (_gz_telemetry_new_segment(store) < 0) {
+      return -1; // kept in memory, retried on the next seal
+    }
+    header = (gz_telemetry_segment_header_t*)store->segments[store->segmentCount - 1].map;
+  }
+  uint32_t offset = header->used;
+  memcpy((uint8_t*)header + offset, chunk, chunk->size);
+  header->chunks++;
+  header->used += chunk->size; // after the chunk: a reader never sees a half written one
+  store->openCount = 0;
+  store->stats.openSamples = 0;
+  store->stats.samples -= count; // counted when appended
+  return _gz_telemetry_index_chunk(store, chunk, store->segmentCount - 1, offset);
+}
+
+static void _gz_telemetry_free(gz_telemetry_t* store) {
+  for (uint16_t i = 0; i < store->segmentCount; i++) {
+    munmap(store->segments[i].map, store->segments[i].mapSize);
+  }
+  pthread_mutex_destroy(&store->lock);
+  free(store->segments);
+  free(store->chunks);
+  free(store->openTimes);
+  free(store->openValues);
+  free(store->encoded);
+  free(store);
+}
+
+gz_telemetry_t* gz_telemetry_open(const char* path, const gz_telemetry_column_t* columns, uint16_t columnCount,
+                                  int64_t chunk_ns) {
+  if (!path || strlen(path) >= GZ_TELEMETRY_PATH_MAX || (columns && (!columnCount || columnCount > GZ_TELEMETRY_MAX_COLUMNS))) {
+    return NULL;
+  }
+  gz_telemetry_t* store = (gz_telemetry_t*)calloc(1, sizeof(gz_telemetry_t));
+  if (!store) {
+    return NULL;
+  }
+  pthread_mutex_init(&store->lock, NULL);
+  strcpy(store->path, path);
+  store->last_ns = INT64_MIN;
+  store->chunk_ns = chunk_ns > 0 ? chunk_ns : GZ_TELEMETRY_DEFAULT_CHUNK_NS;
+  if (columns) {
+    store->isWritable = true;
+    store->columnCount = columnCount;
+    for (uint16_t i = 0; i < columnCount; i++) {
+      if (columns[i].size < 1 || columns[i].size > 8) {
+        _gz_telemetry_free(store);
+        return NULL;
+      }
+      strncpy(store->columns[i].name, columns[i].name, GZ_TELEMETRY_NAME_SIZE - 1);
+      store->columns[i].offset = columns[i].offset;
+      store->columns[i].size = columns[i].size;
+      store->columns[i].isSigned = columns[i].isSigned;
+    }
+    _gz_telemetry_set_record_size(store);
+  }
+  int rv = 0;
+  for (uint16_t index = 0; rv == 0; index++) {
+    rv = _gz_telemetry_load_segment(store, index, columns || index);
+  }
+  if (rv < 0 || (!columns && !store->segmentCount)) {
+    _gz_telemetry_free(store);
+    return NULL;
+  }
+  if (store->isWritable) {
+    size_t minimum = _gz_telemetry_header_size(store->columnCount) + _gz_telemetry_max_chunk_size(store->columnCount);
+    store->segmentSize = minimum > GZ_TELEMETRY_DEFAULT_SEGMENT_SIZE ? minimum : GZ_TELEMETRY_DEFAULT_SEGMENT_SIZE;
+    store->openTimes = (int64_t*)malloc(GZ_TELEMETRY_CHUNK_MAX_SAMPLES * sizeof(int64_t));
+    store->openValues = (int64_t*)malloc((size_t)store->columnCount * GZ_TELEMETRY_CHUNK_MAX_SAMPLES * sizeof(int64_t));
+    store->encoded = (uint8_t*)malloc(_gz_telemetry_max_chunk_size(store->columnCount));
+    if (!store->openTimes || !store->openValues || !store->encoded) {
+      _gz_telemetry_free(store);
+      return NULL;
+    }
+  }
+  return store;
+}
+
+void gz_telemetry_close(gz_telemetry_t* store) {
+  if (!store) {
+    return;
+  }
+  pthread_mutex_lock(&store->lock);
+  if (store->isWritable) {
+    _gz_telemetry_seal(store);
+  }
+  if (store->isSegmentOpen) {
+    char path[GZ_TELEMETRY_PATH_MAX + 8];
+    const _Gz_Telemetry_Segment_t* last = &store->segments[store->segmentCount - 1];
+    _gz_telemetry_segment_path(store, store->segmentCount - 1, path, sizeof(path));
+    if (truncate(path, ((const gz_telemetry_segment_header_t*)last->map)->used) != 0) {
+      GZ_LOG_WARN("gz_telemetry: cannot truncate %s\n", path);
+    }
+  }
+  pthread_mutex_unlock(&store->lock);
+  _gz_telemetry_free(store);
+}
+
+int gz_telemetry_append_values(gz_telemetry_t* store, int64_t timestamp_ns, const int64_t* values) {
+  if (!store || !store->isWritable) {
+    return -1;
+  }
+  pthread_mutex_lock(&store->lock);
+  if (timestamp_ns < store->last_ns) {
+    store->stats.rejected++;
+    pthread_mutex_unlock(&store->lock);
+    return -1;
+  }
+  if (store->openCount == GZ_TELEMETRY_CHUNK_MAX_SAMPLES ||
+      (store->openCount && timestamp_ns / store->chunk_ns != store->openTimes[0] / store->chunk_ns)) {
+    _gz_telemetry_seal(store);
+  }
+  if (store->openCount == GZ_TELEMETRY_CHUNK_MAX_SAMPLES) {
+    // The segment could not be written
+    store->stats.rejected++;
+    pthread_mutex_unlock(&store->lock);
+    return -1;
+  }
+  uint32_t index = store->openCount++;
+  store->openTimes[index] = timestamp_ns;
+  for (uint16_t column = 0; column < store->columnCount; column++) {
+    store->openValues[(size_t)column * GZ_TELEMETRY_CHUNK_MAX_SAMPLES + index] = values[column];
+  }
+  store->last_ns = timestamp_ns;
+  store->stats.samples++;
+  store->stats.openSamples = store->openCount;
+  pthread_mutex_unlock(&store->lock);
+  return 0;
+}
+
+int gz_telemetry_append(gz_telemetry_t* store, int64_t timestamp_ns, const void* record) {
+  if (!store || !record) {
+    return -1;
+  }
+  int64_t values[GZ_TELEMETRY_MAX_COLUMNS];
+  for (uint16_t column = 0; column < store->columnCount; column++) {
+    const gz_telemetry_column_desc_t* desc = &store->columns[column];
+    values[column] = _gz_telemetry_read_field((const uint8_t*)record + desc->offset, desc->size, desc->isSigned);
+  }
+  return gz_telemetry_append_values(store, timestamp_ns, values);
+}
+
+int gz_telemetry_flush(gz_telemetry_t* store) {
+  if (!store || !store->isWritable) {
+    return -1;
+  }
+  pthread_mutex_lock(&store->lock);
+  int rv = _gz_telemetry_seal(store);
+  pthread_mutex_unlock(&store->lock);
+  return rv;
+}
+
+/**
+ * @brief Passes the samples of times/values within [from_ns, to_ns] to cb
+ * @return samples passed
+ */
+static uint32_t _gz_telemetry_emit(const int64_t* times, const int64_t* values, uint32_t count, int64_t from_ns,
+                                   int64_t to_ns, gz_telemetry_scan_cb_t cb, void* context) {
+  uint32_t first = 0;
+  while (first < count && times[first] < from_ns) {
+    first++;
+  }
+  uint32_t end = count;
+  while (end > first && times[end - 1] > to_ns) {
+    end--;
+  }
+  if (end > first) {
+    cb(context, &times[first], &values[first], end - first);
+  }
+  return end - first;
+}
+
+int64_t gz_telemetry_scan(gz_telemetry_t* store, int column, int64_t from_ns, int64_t to_ns,
+                          gz_telemetry_scan_cb_t cb, void* context) {
+  if (!store || !cb || column < 0 || column >= store->columnCount) {
+    return -1;
+  }
+  int64_t times[GZ_TELEMETRY_CHUNK_MAX_SAMPLES];
+  int64_t values[GZ_TELEMETRY_CHUNK_MAX_SAMPLES];
+  int64_t total = 0;
+  pthread_mutex_lock(&store->lock);
+  // First chunk ending at or after from_ns
+  uint32_t low = 0;
+  uint32_t high = store->chunkCount;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (store->chunks[middle].last_ns < from_ns) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  for (uint32_t i = low; i < store->chunkCount && store->chunks[i].first_ns <= to_ns; i++) {
+    const _Gz_Telemetry_Chunk_t* entry = &store->chunks[i];
+    const uint8_t* base = store->segments[entry->segment].map + entry->offset;
+    const gz_telemetry_chunk_header_t* chunk = (const gz_telemetry_chunk_header_t*)base;
+    const uint32_t* streamSizes = (const uint32_t*)(chunk + 1);
+    const uint8_t* stream = (const uint8_t*)(streamSizes + store->columnCount + 1);
+    // Stream lengths come from the file: checked against the chunk before any pointer is made from them
+    uint64_t streamsSize = 0;
+    uint64_t columnOffset = 0;
+    for (int s = 0; s <= store->columnCount; s++) {
+      columnOffset = s == column + 1 ? streamsSize : columnOffset;
+      streamsSize += streamSizes[s];
+    }
+    const uint8_t* columnStream = stream + columnOffset;
+    if (streamsSize > (uint64_t)(base + chunk->size - stream) ||
+        !_gz_telemetry_decode_times(stream, stream + streamSizes[0], times, entry->count) ||
+        !_gz_telemetry_decode_values(columnStream, columnStream + streamSizes[column + 1], values, entry->count)) {
+      GZ_LOG_ERROR("gz_telemetry: corrupt chunk at %u in segment %u\n", entry->offset, entry->segment);
+      pthread_mutex_unlock(&store->lock);
+      return -1;
+    }
+    total += _gz_telemetry_emit(times, values, entry->count, from_ns, to_ns, cb, context);
+  }
+  if (store->openCount) {
+    total += _gz_telemetry_emit(store->openTimes, &store->openValues[(size_t)column * GZ_TELEMETRY_CHUNK_MAX_SAMPLES],
+                                store->openCount, from_ns, to_ns, cb, context);
+  }
+  pthread_mutex_unlock(&store->lock);
+  return total;
+}
+
+typedef struct {
+  int64_t* timestamps;
+  int64_t* values;
+  uint32_t max;
+  int64_t count;
+} _Gz_Telemetry_Query_t;
+
+static void _gz_telemetry_query_cb(void* context, const int64_t* timestamps, const int64_t* values, uint32_t count) {
+  _Gz_Telemetry_Query_t* query = (_Gz_Telemetry_Query_t*)context;
+  for (uint32_t i = 0; i < count && query->count + i < query->max; i++) {
+    if (query->timestamps) {
+      query->timestamps[query->count + i] = timestamps[i];
+    }
+    if (query->values) {
+      query->values[query->count + i] = values[i];
+    }
+  }
+  query->count += count;
+}
+
+int64_t gz_telemetry_query(gz_telemetry_t* store, int column, int64_t from_ns, int64_t to_ns,
+                           int64_t* timestamps, int64_t* values, uint32_t max) {
+  _Gz_Telemetry_Query_t query = { timestamps, values, max, 0 };
+  if (gz_telemetry_scan(store, column, from_ns, to_ns, _gz_telemetry_query_cb, &query) < 0) {
+    return -1;
+  }
+  return query.count;
+}
+
+int gz_telemetry_column_index(gz_telemetry_t* store, const char* name) {
+  for (uint16_t i = 0; store && name && i < store->columnCount; i++) {
+    if (strncmp(store->columns[i].name, name, GZ_TELEMETRY_NAME_SIZE) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+uint16_t gz_telemetry_column_count(gz_telemetry_t* store) {
+  return store ? store->columnCount : 0;
+}
+
+const char* gz_telemetry_column_name(gz_telemetry_t* store, int column) {
+  if (!store || column < 0 || column >= store->columnCount) {
+    return NULL;
+  }
+  return store->columns[column].name;
+}
+
+bool gz_telemetry_get_range(gz_telemetry_t* store, int64_t* first_ns, int64_t* last_ns) {
+  if (!store) {
+    return false;
+  }
+  pthread_mutex_lock(&store->lock);
+  bool hasSamples = store->chunkCount || store->openCount;
+  if (hasSamples) {
+    *first_ns = store->chunkCount ? store->chunks[0].first_ns : store->openTimes[0];
+    *last_ns = store->last_ns;
+  }
+  pthread_mutex_unlock(&store->lock);
+  return hasSamples;
+}
+
+void gz_telemetry_get_stats(gz_telemetry_t* store, gz_telemetry_stats_t* stats) {
+  if (!store) {
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+  pthread_mutex_lock(&store->lock);
+  *stats = store->stats;
+  pthread_mutex_unlock(&store->lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,165 @@
+/**
+ * @file gz_telemetry.h
+ * @brief Columnar time-series store: fixed-layout records (packed status structs) split into one integer
+ * series per field, compressed in time chunks and appended to memory-mapped segment files
+ *
+ * Samples of the current chunk stay in memory. A chunk is sealed when the time window of its first sample
+ * ends, when it holds GZ_TELEMETRY_CHUNK_MAX_SAMPLES or on flush/close. Each series is then delta encoded
+ * and zigzag varint packed, timestamps as delta of delta: a regular period or a constant field costs
+ * nothing past its first value. Segments are path.0, path.1... and are never rewritten; opening an existing
+ * store indexes its chunks and appends to a new segment.
+ *
+ * Segment layout (little endian):
+ *   gz_telemetry_segment_header_t
+ *   gz_telemetry_column_desc_t[columnCount]
+ *   chunks, up to `used` bytes: gz_telemetry_chunk_header_t, uint32_t streamSize[columnCount + 1],
+ *   the timestamp stream then one stream per column
+ *
+ * @copyright Copyright (c) Goal Zero 2022
+ */
+
+#ifndef _GZ_TELEMETRY_H
+#define _GZ_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GZ_TELEMETRY_MAGIC                "GZTS"
+#define GZ_TELEMETRY_VERSION              1
+#define GZ_TELEMETRY_MAX_COLUMNS          128
+#define GZ_TELEMETRY_NAME_SIZE            40
+#define GZ_TELEMETRY_CHUNK_MAX_SAMPLES    1024
+#define GZ_TELEMETRY_DEFAULT_CHUNK_NS     (60 * 1000000000LL) // time window of a chunk
+#define GZ_TELEMETRY_DEFAULT_SEGMENT_SIZE (4 * 1024 * 1024)   // per file, grown to fit the largest chunk
+
+/**
+ * @brief A field of the appended records, 1 to 8 bytes little endian
+ */
+typedef struct {
+  const char* name;
+  uint16_t offset;
+  uint8_t size;
+  bool isSigned;
+} gz_telemetry_column_t;
+
+typedef struct __attribute__ ((packed)) {
+  char magic[4];                  // GZ_TELEMETRY_MAGIC
+  uint16_t version;
+  uint16_t headerSize;            // column descriptors start right after
+  uint16_t columnCount;
+  uint16_t segmentIndex;
+  uint32_t used;                  // bytes of complete chunks, headers included
+  uint32_t chunks;
+  uint32_t reserved;
+  int64_t chunk_ns;
+  uint64_t createdRealtime_ns;
+} gz_telemetry_segment_header_t;
+
+typedef struct __attribute__ ((packed)) {
+  char name[GZ_TELEMETRY_NAME_SIZE];
+  uint16_t offset;
+  uint8_t size;
+  uint8_t isSigned;
+} gz_telemetry_column_desc_t;
+
+typedef struct __attribute__ ((packed)) {
+  uint32_t size;                  // bytes of the chunk, this header and the stream sizes included
+  uint32_t count;                 // samples
+  int64_t first_ns;
+  int64_t last_ns;
+} gz_telemetry_chunk_header_t;
+
+typedef struct {
+  uint64_t samples;
+  uint64_t rejected;              // appends older than the previous sample
+  uint64_t rawBytes;              // what the samples take as records: timestamp and column bytes
+  uint64_t storedBytes;           // sealed chunks, headers included
+  uint32_t chunks;
+  uint16_t segments;
+  uint32_t openSamples;           // in memory, not sealed yet
+} gz_telemetry_stats_t;
+
+typedef struct gz_telemetry gz_telemetry_t;
+
+/**
+ * @brief Receives the samples of one column chunk by chunk, in time order. Called with the store locked
+ */
+typedef void (*gz_telemetry_scan_cb_t)(void* context, const int64_t* timestamps, const int64_t* values, uint32_t count);
+
+/**
+ * @brief Opens the store at `path`, indexing the segments already there
+ * @param columns NULL to open an existing store read-only, its columns are then read from the files.
+ * Otherwise they must match the existing segments, if any
+ * @param chunk_ns time window of a chunk, 0 for GZ_TELEMETRY_DEFAULT_CHUNK_NS
+ * @return NULL on failure
+ */
+gz_telemetry_t* gz_telemetry_open(const char* path, const gz_telemetry_column_t* columns, uint16_t columnCount,
+                                  int64_t chunk_ns);
+
+/**
+ * @brief Seals the current chunk and closes the files
+ */
+void gz_telemetry_close(gz_telemetry_t* store);
+
+/**
+ * @brief Appends a record, each column read at its offset
+ * @param timestamp_ns not older than the previous sample
+ * @return 0 on success, -1 otherwise
+ */
+int gz_telemetry_append(gz_telemetry_t* store, int64_t timestamp_ns, const void* record);
+
+/**
+ * @brief Appends one value per column
+ */
+int gz_telemetry_append_values(gz_telemetry_t* store, int64_t timestamp_ns, const int64_t* values);
+
+/**
+ * @brief Seals the current chunk, its samples are then on file
+ */
+int gz_telemetry_flush(gz_telemetry_t* store);
+
+/**
+ * @brief Calls cb with the samples of a column in [from_ns, to_ns], the current chunk included.
+ * Only the chunks overlapping the range and only the requested column are decoded
+ * @return samples passed to cb, -1 on a bad column or a corrupt chunk
+ */
+int64_t gz_telemetry_scan(gz_telemetry_t* store, int column, int64_t from_ns, int64_t to_ns,
+                          gz_telemetry_scan_cb_t cb, void* context);
+
+/**
+ * @brief Copies up to max samples of a column in [from_ns, to_ns]
+ * @return samples in the range, may be more than max. -1 on failure
+ */
+int64_t gz_telemetry_query(gz_telemetry_t* store, int column, int64_t from_ns, int64_t to_ns,
+                           int64_t* timestamps, int64_t* values, uint32_t max);
+
+/**
+ * @return index of the column, -1 if there is none by this name
+ */
+int gz_telemetry_column_index(gz_telemetry_t* store, const char* name);
+
+uint16_t gz_telemetry_column_count(gz_telemetry_t* store);
+
+const char* gz_telemetry_column_name(gz_telemetry_t* store, int column);
+
+/**
+ * @brief Time span of the stored samples
+ * @return false when there is none
+ */
+bool gz_telemetry_get_range(gz_telemetry_t* store, int64_t* first_ns, int64_t* last_ns);
+
+/**
+ * @brief Zeroed when store is NULL
+ */
+void gz_telemetry_get_stats(gz_telemetry_t* store, gz_telemetry_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
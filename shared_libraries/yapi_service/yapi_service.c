@@ -14,6 +14,7 @@ extern "C" {
 #include "gz_hash/gz_hash.h" // TODO: we could allow dependency injection for this as well
 #else
 #include "../gz_hash/gz_hash.h" // TODO: we could allow dependency injection for this as well
+#include "../gz_observer/gz_observer.h"
 #endif
 #include <stdio.h>
 #include <string.h>
@@ -22,6 +23,24 @@ extern "C" {
 #define UNUSED(x) (void)(x)
 #endif
 
+/**
+ * @brief yapi_platform_log_debug() calls of the service, a byte per call frame dump included. Compiled out
+ * unless DEBUG (or -D YAPI_SERVICE_LOG_DEBUG=1): their arguments are not even evaluated
+ */
+#ifndef YAPI_SERVICE_LOG_DEBUG
+#ifdef DEBUG
+#define YAPI_SERVICE_LOG_DEBUG 1
+#else
+#define YAPI_SERVICE_LOG_DEBUG 0
+#endif
+#endif
+
+#define YAPI_LOG_DEBUG(...) do { \
+  if (YAPI_SERVICE_LOG_DEBUG) { \
+    yapi_platform_log_debug(__VA_ARGS__); \
+  } \
+} while (0)
+
 /**
  * @brief These enumed values describe the possible states of the yapi packet receiver state machine.
  * 
@@ -65,6 +84,14 @@ static yapi_packet_t* _pPacket = (yapi_packet_t*) &_processingBuff;
  */
 static yapi_service_recption_state_enum_t _processingState;
 
+/**
+ * @brief The payload length announced by the packet being received, and the index of its next byte in
+ * @ref _processingBuff. Reset with the state by @ref yapi_service_init
+ * 
+ */
+static uint8_t _processingPayloadLen;
+static uint16_t _processingIdx;
+
 /**
  * @brief The index of the receive buffer to the location of the next position for an incoming byte to
  * be written to. If the Head wraps around to the tail and another incoming byte is added, the Tail is 
@@ -83,6 +110,44 @@ volatile uint16_t _receiveBuffTail;
 
 static yapi_device_id_enum_t _yapiSelfDeviceId = __YAPI_DEVICE_UNKNOWN;
 
+#ifndef BOOTLOADER_BUILD
+/**
+ * @brief Observers notified with every received packet that passed the CRC check, see @ref yapi_service_add_rx_observer.
+ * Copy-on-write: observers are added from any thread while the dispatch notifies without a lock
+ * 
+ */
+static gz_observer_registry_t _rxObservers = GZ_OBSERVER_REGISTRY_INITIALIZER;
+
+#ifndef CY8C6116BZI_F54
+#define YAPI_SERVICE_RX_ASYNC_QUEUE   64  // packets between the parser and the async observers
+#define YAPI_SERVICE_RX_ASYNC_WORKERS 2
+
+/**
+ * @brief Observers run on worker threads, see @ref yapi_service_add_rx_observer_async. Created once, never freed
+ */
+static gz_observer_async_t* _rxAsync = NULL;
+#endif /* CY8C6116BZI_F54 */
+
+/**
+ * @brief Frame trace, see @ref yapi_service_set_trace_cb
+ */
+static yapi_trace_cb_t _traceCb = NULL;
+
+/**
+ * @brief Dispatch timing, see @ref yapi_service_set_dispatch_timing_cb
+ */
+static yapi_clock_cb_t _dispatchClock = NULL;
+static yapi_dispatch_timing_cb_t _dispatchTimingCb = NULL;
+
+/**
+ * @brief Receiver counters, see @ref yapi_service_get_rx_stats. Not kept in the bootloader
+ */
+static yapi_service_rx_stats_t _rxStats;
+#define YAPI_RX_STAT_ADD(field, count) (_rxStats.field += (count))
+#else
+#define YAPI_RX_STAT_ADD(field, count)
+#endif
+
 ///////////////////////////
 // YAPI CALLBACK FUNCTIONS: these should mirror the yapi_command_enum_t enumeration.
 ///////////////////////////
@@ -397,7 +462,9 @@ void yapi_service_init(yapi_device_id_enum_t deviceId, yapi_register_rx_byte_fun
   _receiveBuffHead = 0;
   _receiveBuffTail = 0;
   _processingState = YAPI_SERVICE_START_1;
-  yapi_platform_log_debug("DEBUG: yapi_service_init\n");
+  _processingPayloadLen = 0;
+  _processingIdx = 0;
+  YAPI_LOG_DEBUG("DEBUG: yapi_service_init\n");
   if (registerRxByteFunc) {
     if (_registerRxByteFunc) {
       _registerRxByteFunc(NULL); // De-register the current function
@@ -409,10 +476,12 @@ void yapi_service_init(yapi_device_id_enum_t deviceId, yapi_register_rx_byte_fun
   _yapiSelfDeviceId = deviceId;
 }
 
+yapi_device_id_enum_t yapi_service_get_self_device_id(void) {
+  return _yapiSelfDeviceId;
+}
+
 // TODO: add a timeout mechanism to set the processing state back to START_1 if we haven't received the expected number of bytes in a reasonable amount of time.
 void yapi_service_task_10ms(void* param) {
-  static uint8_t payloadLen;
-  static uint16_t processIdx = 0;
   uint8_t incomingByte;
 
   while (_receiveBuffTail != _receiveBuffHead) { // _receiveBuffHead can move as this loop is executing asynchronously as interrupts occur.
@@ -421,61 +490,73 @@ void yapi_service_task_10ms(void* param) {
     switch(_processingState) {
       case YAPI_SERVICE_START_1:
         if (incomingByte == YAPI_START_BYTE) {
-          _processingBuff[processIdx++] = incomingByte;
+          _processingBuff[_processingIdx++] = incomingByte;
           _processingState = YAPI_SERVICE_START_2;
+        } else {
+          YAPI_RX_STAT_ADD(bytesSkipped, 1);
         }
         break;
 
       case YAPI_SERVICE_START_2:
         if (incomingByte == YAPI_START_BYTE) {
-          _processingBuff[processIdx++] = incomingByte;
+          _processingBuff[_processingIdx++] = incomingByte;
           _processingState = YAPI_SERVICE_LENGTH;
         } else {
           _processingState = YAPI_SERVICE_START_1;
-          processIdx = 0;
+          _processingIdx = 0;
+          YAPI_RX_STAT_ADD(resyncs, 1);
+          YAPI_RX_STAT_ADD(bytesSkipped, 2);
         }
         break;
 
       case YAPI_SERVICE_LENGTH:
-        _processingBuff[processIdx++] = incomingByte;
-        payloadLen = incomingByte;
+        if (incomingByte > YAPI_DATA_SIZE) {
+          // Not a packet, header + payload + CRC would not fit in _processingBuff
+          _processingState = YAPI_SERVICE_START_1;
+          _processingIdx = 0;
+          YAPI_RX_STAT_ADD(resyncs, 1);
+          YAPI_RX_STAT_ADD(bytesSkipped, 3);
+          break;
+        }
+        _processingBuff[_processingIdx++] = incomingByte;
+        _processingPayloadLen = incomingByte;
         _processingState = YAPI_SERVICE_HEADER;
         break;
 
       case YAPI_SERVICE_HEADER:
-        _processingBuff[processIdx++] = incomingByte;
+        _processingBuff[_processingIdx++] = incomingByte;
 
-        if (processIdx == YAPI_HEADER_LENGTH) {
-          _processingState = (payloadLen > 0) ? YAPI_SERVICE_PAYLOAD : YAPI_SERVICE_CRC_1;
+        if (_processingIdx == YAPI_HEADER_LENGTH) {
+          _processingState = (_processingPayloadLen > 0) ? YAPI_SERVICE_PAYLOAD : YAPI_SERVICE_CRC_1;
         }
         break;
 
       case YAPI_SERVICE_PAYLOAD:  // It is useful to separate the payload and header processing for debugging.
-        _processingBuff[processIdx++] = incomingByte;
+        _processingBuff[_processingIdx++] = incomingByte;
 
-        if (processIdx == (payloadLen + YAPI_HEADER_LENGTH)) {
+        if (_processingIdx == (_processingPayloadLen + YAPI_HEADER_LENGTH)) {
           _processingState = YAPI_SERVICE_CRC_1;
         }
         break;
 
       case YAPI_SERVICE_CRC_1:
-        _processingBuff[processIdx++] = incomingByte;
+        _processingBuff[_processingIdx++] = incomingByte;
         _processingState = YAPI_SERVICE_CRC_2;
 
         break;
 
       case YAPI_SERVICE_CRC_2:
-        _processingBuff[processIdx++] = incomingByte;
+        _processingBuff[_processingIdx++] = incomingByte;
         _process_received_packet();
 
-        payloadLen = 0;
+        _processingPayloadLen = 0;
         _processingState = YAPI_SERVICE_START_1;
-        processIdx = 0;
+        _processingIdx = 0;
         break;
 
       default:
         _processingState = YAPI_SERVICE_START_1;
-        processIdx = 0;
+        _processingIdx = 0;
         break;
     }
   
@@ -496,6 +577,65 @@ yapi_ops_status_t yapi_service_register_cmd_cb(v_fp_yapi_ptr_t cb, yapi_command_
   return result;
 }
 
+#ifndef BOOTLOADER_BUILD
+int yapi_service_add_rx_observer(yapi_rx_observer_cb_t cb) {
+  return gz_observer_registry_add(&_rxObservers, cb, 0);
+}
+
+int yapi_service_remove_rx_observer(yapi_rx_observer_cb_t cb) {
+  return gz_observer_registry_remove(&_rxObservers, cb);
+}
+
+#ifndef CY8C6116BZI_F54
+static gz_observer_async_t* _yapi_service_rx_async(void) {
+  gz_observer_async_t* async = __atomic_load_n(&_rxAsync, __ATOMIC_ACQUIRE);
+  if (async == NULL) {
+    gz_observer_async_t* created = gz_observer_async_create(PROCESSING_BUFFER_LENGTH, YAPI_SERVICE_RX_ASYNC_QUEUE,
+                                                            YAPI_SERVICE_RX_ASYNC_WORKERS);
+    if (created != NULL && !__atomic_compare_exchange_n(&_rxAsync, &async, created, false, __ATOMIC_ACQ_REL,
+                                                        __ATOMIC_ACQUIRE)) {
+      // Another thread created it first
+      gz_observer_async_destroy(created);
+    } else {
+      async = created;
+    }
+  }
+  return async;
+}
+
+int yapi_service_add_rx_observer_async(yapi_rx_observer_cb_t cb, uint8_t depth) {
+  return gz_observer_async_add(_yapi_service_rx_async(), cb, depth);
+}
+
+int yapi_service_remove_rx_observer_async(yapi_rx_observer_cb_t cb) {
+  return gz_observer_async_remove(__atomic_load_n(&_rxAsync, __ATOMIC_ACQUIRE), cb);
+}
+
+struct gz_observer_async* yapi_service_get_rx_async(void) {
+  return __atomic_load_n(&_rxAsync, __ATOMIC_ACQUIRE);
+}
+#endif /* CY8C6116BZI_F54 */
+
+void yapi_service_set_trace_cb(yapi_trace_cb_t cb) {
+  _traceCb = cb;
+}
+
+void yapi_service_get_rx_stats(yapi_service_rx_stats_t* stats) {
+  if (stats != NULL) {
+    *stats = _rxStats;
+  }
+}
+
+void yapi_service_set_dispatch_timing_cb(yapi_clock_cb_t clock, yapi_dispatch_timing_cb_t cb) {
+  // Cleared first and set last, a clock is never taken back: the parser never sees a callback without one
+  _dispatchTimingCb = NULL;
+  if (clock != NULL) {
+    _dispatchClock = clock;
+  }
+  _dispatchTimingCb = clock != NULL ? cb : NULL;
+}
+#endif
+
 yapi_ops_status_t yapi_service_build_pkt(yapi_packet_t* pkt,
   yapi_device_id_enum_t senderId,
   yapi_device_id_enum_t targetId,
@@ -533,7 +673,7 @@ yapi_ops_status_t yapi_service_build_pkt(yapi_packet_t* pkt,
   crc = gz_crc16((uint8_t *) pkt, YAPI_HEADER_LENGTH + length);
 #endif
   memcpy(&(pkt->data[length]), &crc, sizeof(crc));
-  yapi_platform_log_debug("The computed CRC for the following msg is 0x%.4x", crc);
+  YAPI_LOG_DEBUG("The computed CRC for the following msg is 0x%.4x", crc);
   
   return YAPI_OPS_SUCCESS;
 }
@@ -547,15 +687,23 @@ yapi_ops_status_t yapi_service_send(yapi_packet_t* pkt) {
     return YAPI_OPS_FAIL;
   }
 
-  yapi_platform_log_debug("\nSending YAPI msg: 0x");
-  for (uint16_t i = 0; i < totalFrameLen; i++) {
-    yapi_platform_log_debug("%.2x ", pktCharPtr[i]);
+  if (YAPI_SERVICE_LOG_DEBUG) {
+    yapi_platform_log_debug("\nSending YAPI msg: 0x");
+    for (uint16_t i = 0; i < totalFrameLen; i++) {
+      yapi_platform_log_debug("%.2x ", pktCharPtr[i]);
+    }
+    yapi_platform_log_debug("\n\n");
   }
-  yapi_platform_log_debug("\n\n");
 
-  if (yapi_platform_transmit((uint8_t *) pkt, totalFrameLen) == totalFrameLen) {
+  bool isSent = yapi_platform_transmit((uint8_t *) pkt, totalFrameLen) == totalFrameLen;
+#ifndef BOOTLOADER_BUILD
+  if (_traceCb) {
+    _traceCb(isSent ? YAPI_TRACE_TX : YAPI_TRACE_TX_FAILED, pkt);
+  }
+#endif
+  if (isSent) {
+    YAPI_LOG_DEBUG("YAPI SERVICE message sent successfully");
     return YAPI_OPS_SUCCESS;
-    yapi_platform_log_debug("YAPI SERVICE message sent successfully");
   }
   yapi_platform_log_error("YAPI SERVICE FAILED TO SEND MESSAGE!");
 
@@ -799,13 +947,38 @@ void _process_received_packet(void) {
 #ifdef BOOTLOADER_BUILD
   if (received_crc == gz_crc16_size_optimized(&_processingBuff[0], packetLen)) {
 #else
-  if (received_crc == gz_crc16(&_processingBuff[0], packetLen)) {
+  bool isValid = received_crc == gz_crc16(&_processingBuff[0], packetLen);
+  if (isValid) {
+    _rxStats.frames++;
+  } else {
+    _rxStats.crcErrors++;
+  }
+  if (_traceCb) {
+    _traceCb(isValid ? YAPI_TRACE_RX : YAPI_TRACE_RX_CRC_ERROR, _pPacket);
+  }
+  if (isValid) {
+    yapi_dispatch_timing_cb_t timingCb = _dispatchTimingCb;
+    yapi_clock_cb_t clock = _dispatchClock;
+    uint64_t dispatchStart = timingCb != NULL ? clock() : 0;
 #endif
     // Call a specific YAPI callback.
     cb = _yapi_cmd_to_cb((yapi_command_enum_t) _pPacket->command); // Dereference NULL would crash the application if command not found
     if (cb != NULL && *cb != NULL) {
       (*(cb))(_pPacket);
     }
+#ifndef BOOTLOADER_BUILD
+    gz_observer_registry_notify(&_rxObservers, _pPacket);
+#ifndef CY8C6116BZI_F54
+    gz_observer_async_t* async = __atomic_load_n(&_rxAsync, __ATOMIC_ACQUIRE);
+    if (async != NULL) {
+      // Copied with its 2 CRC bytes, never blocks: a full queue drops the packet for the async observers only
+      gz_observer_async_notify(async, _pPacket, packetLen + 2);
+    }
+#endif /* CY8C6116BZI_F54 */
+    if (timingCb != NULL) {
+      timingCb(_pPacket, clock() - dispatchStart);
+    }
+#endif
   }
 }
 
@@ -816,6 +989,7 @@ void _receive_incoming_byte(uint8_t incomingByte) {
   // if the head has wrapped and caught up to the tail, the tail needs to also advance one to always stay behind the head
   if (_receiveBuffHead == _receiveBuffTail) {
     _receiveBuffTail = _receiveBuffTail == (RECEIVE_BUFFER_LENGTH - 1) ? 0 : _receiveBuffTail + 1;
+    YAPI_RX_STAT_ADD(overruns, 1);
   }
 }
 
@@ -988,6 +988,49 @@ typedef void (*v_fp_u8_t)(uint8_t byte);
 #define _V_FP_U8_T
 #endif
 
+/**
+ * @brief Receives every CRC-valid packet (as a @ref yapi_packet_t pointer) regardless of its command
+ */
+typedef void (*yapi_rx_observer_cb_t)(void* yapi_pkt);
+
+/**
+ * @brief Frame events of the service, and of the applications relaying frames, for binary tracing
+ */
+typedef enum {
+  YAPI_TRACE_RX = 1,              // received, CRC valid
+  YAPI_TRACE_RX_CRC_ERROR,        // received, CRC mismatch
+  YAPI_TRACE_TX,                  // taken by yapi_platform_transmit()
+  YAPI_TRACE_TX_FAILED,           // refused by yapi_platform_transmit()
+  YAPI_TRACE_TX_DROPPED,          // not sent, the receiver is congested
+} yapi_trace_event_t;
+
+/**
+ * @brief Receives every frame sent or received (CRC errors included), the packet is only valid during the call
+ */
+typedef void (*yapi_trace_cb_t)(yapi_trace_event_t event, const yapi_packet_t* yapi_pkt);
+
+/**
+ * @brief Receiver counters, see @ref yapi_service_get_rx_stats
+ */
+typedef struct {
+  uint32_t frames;                // CRC valid
+  uint32_t crcErrors;
+  uint32_t resyncs;               // a start signal or a length byte that was no frame, the parser looked again
+  uint32_t bytesSkipped;          // bytes outside of frames: line noise, partial frames
+  uint32_t overruns;              // bytes lost, the receive buffer was full
+} yapi_service_rx_stats_t;
+
+/**
+ * @brief A monotonic clock, in any unit
+ */
+typedef uint64_t (*yapi_clock_cb_t)(void);
+
+/**
+ * @brief Receives the time spent dispatching a packet: its command callback and the rx observers
+ * @param elapsed in the unit of the @ref yapi_clock_cb_t clock
+ */
+typedef void (*yapi_dispatch_timing_cb_t)(const yapi_packet_t* yapi_pkt, uint64_t elapsed);
+
 /**
  * @brief A pointer to a function that allows the YAPI service to register
  * its own Receive Byte callback
@@ -1079,6 +1122,11 @@ void yapi_platform_log_error(const char *fmt, ...);
  */
 void yapi_service_init(yapi_device_id_enum_t deviceId, yapi_register_rx_byte_func_t registerRxByteFunc);
 
+/**
+ * @brief Returns the device ID given to @ref yapi_service_init(), used as senderId of the packets we build
+ */
+yapi_device_id_enum_t yapi_service_get_self_device_id(void);
+
 /**
  * @brief 10ms function loop that should be called every 10ms
  * for buffer processing
@@ -1096,6 +1144,80 @@ void yapi_service_task_10ms(void* param);
  */
 yapi_ops_status_t yapi_service_register_cmd_cb(v_fp_yapi_ptr_t cb, yapi_command_enum_t cmd);
 
+#ifndef BOOTLOADER_BUILD
+/**
+ * @brief Adds an observer called with every received packet that passed the CRC check, after the
+ * command callback registered with @ref yapi_service_register_cmd_cb. Unlike command callbacks, any number
+ * of observers can watch the same command (request/response matching, logging, bridging...).
+ * The packet is only valid for the duration of the call.
+ * 
+ * @param cb The observer to add
+ * @return int The number of observers registered, -1 on failure
+ */
+int yapi_service_add_rx_observer(yapi_rx_observer_cb_t cb);
+
+/**
+ * @brief Removes an observer added with @ref yapi_service_add_rx_observer
+ * 
+ * @param cb The observer to remove
+ * @return int The number of observers still registered, -1 on failure
+ */
+int yapi_service_remove_rx_observer(yapi_rx_observer_cb_t cb);
+
+#ifndef CY8C6116BZI_F54
+struct gz_observer_async;
+
+/**
+ * @brief Adds an observer run on a worker thread of the service rather than on the parser thread, so a slow
+ * observer (file, console) never delays frame processing. It gets its own copy of the packet, which stays valid
+ * for the duration of the call. The workers start with the first async observer.
+ * 
+ * @param cb The observer to add
+ * @param depth Packets kept while it is busy, beyond that the newest replaces the last one kept
+ * @return int The number of async observers registered, -1 on failure
+ */
+int yapi_service_add_rx_observer_async(yapi_rx_observer_cb_t cb, uint8_t depth);
+
+/**
+ * @brief Removes an observer added with @ref yapi_service_add_rx_observer_async, it may still be running
+ * 
+ * @param cb The observer to remove
+ * @return int The number of async observers still registered, -1 on failure
+ */
+int yapi_service_remove_rx_observer_async(yapi_rx_observer_cb_t cb);
+
+/**
+ * @brief The notifier of the async observers, for gz_observer_async_get_stats() and gz_observer_async_get_lags()
+ * 
+ * @return NULL until the first async observer is added
+ */
+struct gz_observer_async* yapi_service_get_rx_async(void);
+#endif /* CY8C6116BZI_F54 */
+
+/**
+ * @brief Sets the callback traced frames go to, NULL to stop. Costs a NULL check per frame when unset
+ * 
+ * @param cb The trace callback
+ */
+void yapi_service_set_trace_cb(yapi_trace_cb_t cb);
+
+/**
+ * @brief Copies the receiver counters, counted since start. Read without a lock, each one is consistent on its own
+ * 
+ * @param stats The counters
+ */
+void yapi_service_get_rx_stats(yapi_service_rx_stats_t* stats);
+
+/**
+ * @brief Times the dispatch of every CRC valid packet with clock, NULL to stop. Costs a NULL check per frame
+ * when unset
+ * 
+ * @param clock The clock read before and after the dispatch
+ * @param cb The timing callback, called on the parser thread
+ */
+void yapi_service_set_dispatch_timing_cb(yapi_clock_cb_t clock, yapi_dispatch_timing_cb_t cb);
+#endif
+
 /**
  * @brief Given thre prescribed set of parameters, constructs a @ref yapi_packet_t packet and stores it in pkt.
  * 
@@ -19,7 +19,10 @@
 
 #include "cli.h"
 // #include "uart.h"
+#define GZ_LOG_MODULE "cli"
 #include "gz_log.h"
+#include "socket_server.h"
+#include "yapi_gateway.h"
 // #include "yapi_provision.h"
 
 #define BACK_SPACE              8
@@ -79,6 +82,8 @@ static bool _cli_process_command(_Cli_Command_Args_t);
 /* Definition of cli command */
 static bool _cli_help_executer(_Cli_Command_Args_t);
 static bool _exit(_Cli_Command_Args_t);
+static bool _stats(_Cli_Command_Args_t);
+static bool _log(_Cli_Command_Args_t);
 
 _Cli_Command_t _cli_commands[] = {
   {
@@ -91,6 +96,16 @@ _Cli_Command_t _cli_commands[] = {
     .description = "exit",
     .executer = _exit
   },  
+  {
+    .command = "stats",
+    .description = "stats - connections and traffic of the socket server and of the YAPI gateway, async log",
+    .executer = _stats
+  },
+  {
+    .command = "log",
+    .description = "log [[module] all|debug|info|warn|error|global] - log levels, per module when given (debug needs a DEBUG=1 build)",
+    .executer = _log
+  },
 };
 
 static void *_cli_thread(void *params) {
@@ -114,7 +129,7 @@ static _Cli_Command_Args_t _cli_string_parser(const char* line, const char* deli
   do {
     command_arg.command_args[command_arg.args_count] = strtok(NULL, delimiter);
     GZ_LOG_DEBUG("DEBUG - command_arg[%d]: %s\n", command_arg.args_count, command_arg.command_args[command_arg.args_count]);
-  } while(command_arg.command_args[command_arg.args_count] && command_arg.args_count++ < MAX_CMD_ARGUMENTS);
+  } while(command_arg.command_args[command_arg.args_count] && ++command_arg.args_count < MAX_CMD_ARGUMENTS);
   return command_arg;
 }
 
@@ -135,6 +150,60 @@ static bool _exit(_Cli_Command_Args_t command_arguments) {
   return true;
 }
 
+static bool _stats(_Cli_Command_Args_t command_arguments) {
+  socket_server_stats_t stats;
+  socket_server_get_stats(&stats);
+  printf("connections: active %u, peak %u, accepted %llu, closed %llu, dropped %llu\n", stats.active, stats.peakActive,
+         (unsigned long long)stats.accepted, (unsigned long long)stats.closed, (unsigned long long)stats.dropped);
+  printf("traffic: rx %llu bytes, tx %llu bytes\n", (unsigned long long)stats.rxBytes, (unsigned long long)stats.txBytes);
+  printf("backpressure: %u congested, %llu congestions, dropped %llu messages %llu bytes\n", stats.congested,
+         (unsigned long long)stats.congestions, (unsigned long long)stats.droppedMessages,
+         (unsigned long long)stats.droppedBytes);
+  printf("%s: %llu events in %llu wakeups, %llu syscalls\n", socket_server_backend_name(socket_server_get_backend()),
+         (unsigned long long)stats.events, (unsigned long long)stats.wakeups, (unsigned long long)stats.syscalls);
+  if (yapi_gateway_is_open()) {
+    yapi_gateway_stats_t gateway;
+    yapi_gateway_get_stats(&gateway);
+    printf("gateway: client frames %llu, uart frames %llu, invalid %llu, uart queue full %llu\n",
+           (unsigned long long)gateway.clientFrames, (unsigned long long)gateway.uartFrames,
+           (unsigned long long)gateway.invalidFrames, (unsigned long long)gateway.uartQueueFull);
+    printf("gateway: frames dropped for congested clients %llu, framing errors %llu\n",
+           (unsigned long long)gateway.droppedFrames, (unsigned long long)gateway.framingErrors);
+    printf("gateway: responses routed %llu, unrouted %llu, expired requests %llu, unsolicited fan-out %llu, %u subscriptions\n",
+           (unsigned long long)gateway.routedResponses, (unsigned long long)gateway.unroutedResponses,
+           (unsigned long long)gateway.expiredRequests, (unsigned long long)gateway.unsolicitedFanout, gateway.subscriptions);
+    printf("gateway: %u pending requests (peak %u), client pool %u used (peak %u), %u clients from the heap\n",
+           gateway.pendingRequests, gateway.pendingHighWater, gateway.clientPoolUsed, gateway.clientPoolHighWater,
+           gateway.clientPoolFailures);
+  }
+  Gz_Log_Stats_t log;
+  gz_log_get_stats(&log);
+  printf("log: queued %llu, written %llu, dropped %llu by %u threads\n", (unsigned long long)log.queued,
+         (unsigned long long)log.written, (unsigned long long)log.dropped, log.threads);
+  return true;
+}
+
+static bool _log(_Cli_Command_Args_t command_arguments) {
+  if (command_arguments.args_count == 0) {
+    printf("log: global %s\n", gz_log_level_name(gz_log_get_level()));
+    for (const Gz_Log_Module_t* module = gz_log_get_modules(); module; module = module->next) {
+      printf("log: %s %s%s\n", module->name, gz_log_level_name(module->minLevel),
+             module->level == GZ_LOG_LEVEL_GLOBAL ? " (global)" : "");
+    }
+    return true;
+  }
+  const char* levelName = command_arguments.command_args[command_arguments.args_count - 1];
+  int level = strcmp(levelName, "global") ? gz_log_level_from_name(levelName) : GZ_LOG_LEVEL_GLOBAL;
+  if (command_arguments.args_count == 1 && level >= GZ_LOG_LEVEL_ALL) {
+    gz_log_set_level(level);
+    return true;
+  }
+  if (command_arguments.args_count == 2 && (level >= GZ_LOG_LEVEL_ALL || level == GZ_LOG_LEVEL_GLOBAL)) {
+    return gz_log_set_module_level(command_arguments.command_args[0], level) > 0;
+  }
+  return false;
+}
+
 static bool _cli_process_command(_Cli_Command_Args_t command_arguments) {
   bool cmd_found = false;
   if (!command_arguments.command) {
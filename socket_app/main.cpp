@@ -5,42 +5,180 @@
 
 #include <pthread.h>
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <sys/time.h> // for timeval
-#include <netinet/in.h> // for sockaddr_in
-#include <arpa/inet.h> // for inet_ntop
 #include <errno.h> // for errno
 
 #include "cli.h"
 #include "gz_log.h"
+#include "gz_trace.h"
 #include "uart.h"
-// #include "yapi_manager.h"
+#include "socket_server.h"
+#include "socket_load.h"
+#include "yapi_gateway.h"
 
 #define SLEEP_S 1
 #define SLEEP_CS (SLEEP_S)*100
 #define SLEEP_UC (SLEEP_CS)*1000
 #define DEMO_UART 0
+#define LISTEN_BACKLOG          4096 // capped by net.core.somaxconn
+#define POLL_TIMEOUT_MS         1500
+#define GATEWAY_POLL_TIMEOUT_MS 100  // yapi_gateway_task() expires the requests left without response
+#define DEFAULT_BAUD_RATE       115200
+#define LOAD_HOST               "127.0.0.1"
+#define LOAD_MESSAGE_SIZE       64
+#define LOAD_DURATION_S         5
+#define LOAD_BACKEND_ALL        -1   // -B all: the load once per backend, in process
+
+static volatile bool _isServerRunning = true;
+
+/**
+ * @brief Echo server: whatever a client sends comes back to it
+ */
+static void _socket_rx_cb(int connFd, const uint8_t* data, size_t size) {
+  GZ_LOG_DEBUG("Received fd[%d] >> %.*s\n", connFd, (int)size, (const char*)data);
+  socket_server_send(connFd, data, size);
+}
+
+static void _socket_conn_cb(int connFd, bool isConnected) {
+  GZ_LOG_DEBUG("%s fd[%d]\n", isConnected ? "Connected" : "Disconnected", connFd);
+}
+
+/**
+ * @brief Serves the load generator from the same process
+ */
+static void* _socket_server_thread(void* params) {
+  while (_isServerRunning) {
+    socket_server_poll(100);
+  }
+  return NULL;
+}
+
+/**
+ * @brief -B: epoll, uring or auto
+ * @return the backend, LOAD_BACKEND_ALL for "all", -2 if unknown
+ */
+static int _socket_parse_backend(const char* name) {
+  if (!strcmp(name, "epoll")) {
+    return SOCKET_SERVER_BACKEND_EPOLL;
+  } else if (!strcmp(name, "uring") || !strcmp(name, "io_uring")) {
+    return SOCKET_SERVER_BACKEND_URING;
+  } else if (!strcmp(name, "auto")) {
+    return SOCKET_SERVER_BACKEND_AUTO;
+  } else if (!strcmp(name, "all")) {
+    return LOAD_BACKEND_ALL;
+  }
+  return -2;
+}
+
+/**
+ * @brief -L: connections/s, messages/s and echo latency against the echo server
+ */
+static int _socket_load(const char* host, uint16_t port, uint32_t connections, uint32_t messageSize, uint32_t duration_s) {
+  pthread_t serverThreadId;
+  bool isInProcess = host == NULL;
+  if (isInProcess) {
+    host = LOAD_HOST;
+    if (socket_server_open(port, LISTEN_BACKLOG, _socket_rx_cb, NULL) < 0) {
+      return 1;
+    }
+    _isServerRunning = true;
+    pthread_create(&serverThreadId, NULL, _socket_server_thread, NULL);
+    printf("Server backend: %s\n", socket_server_backend_name(socket_server_get_backend()));
+  }
+  socket_load_config_t config = { host, port, connections, messageSize, duration_s * 1000 };
+  socket_load_result_t result;
+  int status = socket_load_run(&config, &result);
+  if (isInProcess) {
+    _isServerRunning = false;
+    pthread_join(serverThreadId, NULL);
+  }
+  printf("Load %s:%d, %u connections, %u bytes messages\n", host, port, connections, messageSize);
+  printf("  connected %u, failed %u in %.3f s: %.0f connections/s\n", result.connected, result.failed,
+         result.connect_ns / 1e9, result.connectionsPerSecond);
+  if (!status) {
+    printf("  %llu messages echoed in %.3f s: %.0f messages/s, %.2f MB/s\n", (unsigned long long)result.messages,
+           result.messages_ns / 1e9, result.messagesPerSecond, result.bytes * 1e3 / result.messages_ns);
+    printf("  latency p50 %u us, p99 %u us\n", result.latencyP50_us, result.latencyP99_us);
+  }
+  if (isInProcess) {
+    socket_server_stats_t stats;
+    socket_server_get_stats(&stats);
+    printf("  server: peak %u connections, %llu events in %llu wakeups, %llu syscalls (%.3f per message)\n",
+           stats.peakActive, (unsigned long long)stats.events, (unsigned long long)stats.wakeups,
+           (unsigned long long)stats.syscalls, result.messages ? (double)stats.syscalls / result.messages : 0.0);
+    socket_server_close();
+  }
+  return status ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
   int option;
   char *sockName = NULL;
   char *port_s = NULL;
   int port_n = 23; // default socket port
   bool isRunning = true;
-  int maxFd = 0;
-  int connFd = 0; // Connection file descriptor - subject to change as more connections are accepted
+  uint32_t loadConnections = 0;
+  uint32_t loadMessageSize = LOAD_MESSAGE_SIZE;
+  uint32_t loadDuration_s = LOAD_DURATION_S;
+  const char* loadHost = NULL;
+  const char* uartName = NULL;
+  int baudRate = DEFAULT_BAUD_RATE;
+  int backend = SOCKET_SERVER_BACKEND_AUTO;
+  bool isFramed = false;
+  const char* traceName = NULL;
 
   // Process command line options
-  while ((option = getopt(argc, argv, "n:p:")) != -1) {
+  while ((option = getopt(argc, argv, "n:p:L:m:d:H:u:b:B:fs:t:")) != -1) {
       switch (option) {
           case 'n':
               sockName = optarg;
               break;
           case 'p':
               port_s = optarg;
+              port_n = atoi(port_s);
+              break;
+          case 'L':
+              loadConnections = strtoul(optarg, NULL, 10);
+              break;
+          case 'm':
+              loadMessageSize = strtoul(optarg, NULL, 10);
+              break;
+          case 'd':
+              loadDuration_s = strtoul(optarg, NULL, 10);
+              break;
+          case 'H':
+              loadHost = optarg;
+              break;
+          case 'u':
+              uartName = optarg;
+              break;
+          case 'b':
+              baudRate = atoi(optarg);
+              break;
+          case 'f':
+              isFramed = true;
+              break;
+          case 't':
+              traceName = optarg;
+              break;
+          case 's':
+              if (!strcmp(optarg, "drop")) {
+                  socket_server_set_backpressure(SOCKET_SERVER_SLOW_DROP, SOCKET_SERVER_TX_HIGH_WATERMARK,
+                                                 SOCKET_SERVER_TX_LOW_WATERMARK);
+              } else if (strcmp(optarg, "disconnect")) {
+                  fprintf(stderr, "Unknown slow consumer policy %s (disconnect, drop).\n", optarg);
+                  return 1;
+              }
+              break;
+          case 'B':
+              backend = _socket_parse_backend(optarg);
+              if (backend < LOAD_BACKEND_ALL) {
+                  fprintf(stderr, "Unknown backend %s (epoll, uring, auto, all).\n", optarg);
+                  return 1;
+              }
               break;
           case '?':
-              if (optopt == 'n') {
+              if (optopt == 'n' || optopt == 'p' || optopt == 'L' || optopt == 'm' || optopt == 'd' || optopt == 'H' ||
+                  optopt == 'u' || optopt == 'b' || optopt == 'B' || optopt == 's' || optopt == 't') {
                   fprintf(stderr, "Option -%c requires an argument.\n", optopt);
               } else {
                   fprintf(stderr, "Unknown option -%c.\n", optopt);
@@ -51,6 +189,34 @@ int main(int argc, char *argv[]) {
       }
   }
 
+#if DEBUG
+  gz_log_set_level(GZ_LOG_LEVEL_DEBUG);
+#else
+  gz_log_set_level(GZ_LOG_LEVEL_INFO);
+#endif
+  gz_log_async_start(GZ_LOG_FULL_DROP); // the serving loop never waits on the terminal
+  uint32_t fdLimit = socket_server_raise_fd_limit();
+  if (loadConnections) {
+    // Load generator: -L connections [-m message size] [-d seconds] [-H server address, in process server otherwise]
+    // [-B epoll/uring/auto/all, backend of the in process server]
+    if (fdLimit < loadConnections * (loadHost ? 1 : 2) + 16) {
+      fprintf(stderr, "Open files limited to %u, not enough for %u connections\n", fdLimit, loadConnections);
+      return 1;
+    }
+    if (backend != LOAD_BACKEND_ALL || loadHost) {
+      socket_server_set_backend(backend == LOAD_BACKEND_ALL ? SOCKET_SERVER_BACKEND_AUTO : (socket_server_backend_t)backend);
+      return _socket_load(loadHost, port_n, loadConnections, loadMessageSize, loadDuration_s);
+    }
+    socket_server_set_backend(SOCKET_SERVER_BACKEND_EPOLL);
+    int status = _socket_load(NULL, port_n, loadConnections, loadMessageSize, loadDuration_s);
+    socket_server_set_backend(SOCKET_SERVER_BACKEND_URING);
+    return _socket_load(NULL, port_n, loadConnections, loadMessageSize, loadDuration_s) | status;
+  }
+  if (backend == LOAD_BACKEND_ALL) {
+    backend = SOCKET_SERVER_BACKEND_AUTO;
+  }
+  socket_server_set_backend((socket_server_backend_t)backend);
+
   // Check if required options were provided
   if (sockName == NULL ) {
       fprintf(stderr, "Missing required options.\n");
@@ -62,99 +228,36 @@ int main(int argc, char *argv[]) {
   // Print the parsed options and their values
   printf("Option -n has value: %s\n", sockName);
 
-#if DEBUG
-  gz_log_set_level(GZ_LOG_LEVEL_DEBUG);
-#else
-  gz_log_set_level(GZ_LOG_LEVEL_INFO);
-#endif
   pthread_t cliThreadId = cli_thread_start(NULL);
-  int socketDomain = AF_INET; // Address Family IPv4 - UDP, TCP, etc. designate type of addresses that socket can communicate with
-  int socketType = SOCK_STREAM; // Socket TYPE - TCP, require an end-to-end connection. Must be connected before sending/receiving data
-  /* Alternative UDP */
-  // int socketType = SOCK_DGRAM; // Socket TYPE - UDP. recvfrom() and sendto() are used to receive and send data
-  /* Alternative UDP Ends */
-  int socketProto = 0; // Protocol - IP protocol
-
-  // Create a socket
-  int socketFd = socket(socketDomain, socketType, socketProto);
-  if (socketFd < 0) {
-    GZ_LOG_ERROR("Socket creation failed\n");
-    return 1;
-  }
-
-  // Create a socket address for binding
-  struct sockaddr_in sockaddr_v4;
-  sockaddr_v4.sin_family = socketDomain;
-  sockaddr_v4.sin_port = htons(port_n); // assign a port to bind the socket to. `htons` translate host byte order to network byte order
-  sockaddr_v4.sin_addr.s_addr = INADDR_ANY; // bind to any available interface. can also use inet_addr("0.0.0.0")
-  // Bind the socket to the address
-  int bindStatus = bind(socketFd, (struct sockaddr *)&sockaddr_v4, sizeof(sockaddr_v4));
-  if (bindStatus < 0) {
-    GZ_LOG_ERROR("Socket bind failed\n");
+  if (uartName) {
+    // Gateway: -u serial device [-b baud rate] [-f length-prefixed frames] [-t binary trace of the frames, read with
+    // trace_decode], every client gets a YAPI channel to the port
+    yapi_gateway_set_framing(isFramed);
+    if (traceName && gz_trace_open(traceName, GZ_TRACE_DEFAULT_RECORDS, GZ_TRACE_DEFAULT_FILES) < 0) {
+      return 1;
+    }
+    if (socket_server_open(port_n, LISTEN_BACKLOG, yapi_gateway_client_rx, yapi_gateway_client_conn) < 0 ||
+        yapi_gateway_open(uartName, baudRate) < 0) {
+      return 1;
+    }
+    printf("YAPI gateway port[%d] <-> (%s)%s\n", port_n, uartName, isFramed ? ", framed" : "");
+  } else if (socket_server_open(port_n, LISTEN_BACKLOG, _socket_rx_cb, _socket_conn_cb) < 0) {
     return 1;
   }
-  char ipaddress_s[INET_ADDRSTRLEN] = {'\0'};
-  inet_ntop(AF_INET, &(sockaddr_v4.sin_addr), ipaddress_s, INET_ADDRSTRLEN);
-  printf("Socket bind successful ip address[%s], port[%d]\n", ipaddress_s, port_n);
-
-  // Put the socket to a state that it listens for incoming connections
-  int listenStatus = listen(socketFd, 5); // 5 is the maximum number of connections that can be queued
-  fd_set readfds;
-  FD_ZERO(&readfds);
-  FD_SET(socketFd, &readfds);
-  maxFd = socketFd > maxFd ? socketFd : maxFd;
-  timeval timeout = { .tv_sec = 1, .tv_usec = 500000 }; // 1.5s
+  printf("Socket listening on port[%d] (%s), up to %u open files\n", port_n,
+         socket_server_backend_name(socket_server_get_backend()), fdLimit);
 
   while (isRunning) {
-    fd_set currFd = readfds;
-    int ret = select(maxFd + 1, &currFd, NULL, NULL, &timeout); // Polling the readfds for any activity
-    if (ret < 0) { // select Error
-      GZ_LOG_ERROR("Errno [%d]\n", errno);
-      continue;
-    } else if (ret == 0) { // select Timeout
-      GZ_LOG_DEBUG("Timeout\n");
-      continue;
-    } else { // select Success
-      GZ_LOG_INFO("We received something\n");
-      for (int activeFd = 0; activeFd < FD_SETSIZE; activeFd++) {
-        if (!FD_ISSET(activeFd, &currFd)) {
-          continue; // not this file descriptor
-        }
-        // Found the active fd
-        if(activeFd == socketFd) {
-          GZ_LOG_INFO("Accepting a new connection\n");
-          struct sockaddr_in client_address;
-          int client_len = sizeof(client_address);
-          int newFd = accept(socketFd, (struct sockaddr *)&client_address, (socklen_t *)&client_len);
-          if (newFd < 0) {
-            GZ_LOG_ERROR("Accept failed\n");
-            continue;
-          }
-          struct sockaddr_in tempsockaddr_v4 = (sockaddr_in)client_address;
-          char client_ipaddress_s[INET_ADDRSTRLEN] = {'\0'};
-          inet_ntop(AF_INET, &(tempsockaddr_v4.sin_addr), client_ipaddress_s, INET_ADDRSTRLEN);
-          GZ_LOG_INFO("Connection accepted ip address[%s], port[%d]\n", client_ipaddress_s, ntohs(tempsockaddr_v4.sin_port));
-          FD_SET(newFd, &readfds);
-          maxFd = newFd > maxFd ? newFd : maxFd;
-        } else { // Not socketFD, must be from a newFd
-          GZ_LOG_INFO("Data available on one of the newFd [%d]\n", activeFd);
-          char buffer[1024] = {'\0'};
-          int bytesRead = recv(activeFd, buffer, sizeof(buffer), 0);
-          if (bytesRead < 0) {
-            GZ_LOG_ERROR("Recv failed\n");
-            continue;
-          } else if (bytesRead == 0) {
-            GZ_LOG_INFO("Connection closed fd[%d]\n", activeFd);
-            close(activeFd);
-            FD_CLR(activeFd, &readfds);
-          } else {
-            GZ_LOG_INFO("Received  >> %s\n", buffer);
-          }
-        } // newFd is active
-      } // For activeFd
-    } // Select success
-    GZ_LOG_INFO("Hello from main\n");
+    if (socket_server_poll(uartName ? GATEWAY_POLL_TIMEOUT_MS : POLL_TIMEOUT_MS) < 0) {
+      break;
+    }
+    if (uartName) {
+      yapi_gateway_task();
+    }
   } // While isRunning
+  yapi_gateway_close();
+  socket_server_close();
+  gz_trace_close();
   pthread_join(cliThreadId, NULL);
   return 1;
-}
\ No newline at end of file
+}
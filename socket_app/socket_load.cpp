@@ -0,0 +1,264 @@
+/**
+ * socket_load.cpp
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <algorithm>
+
+#include "socket_load.h"
+#include "gz_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SOCKET_LOAD_CONNECT_WINDOW      256   // connects in progress at once, keeps the server backlog from overflowing
+#define SOCKET_LOAD_MAX_EVENTS          256
+#define SOCKET_LOAD_CONNECT_TIMEOUT_MS  5000  // without any progress
+
+typedef enum {
+  _SOCKET_LOAD_CONNECTING,
+  _SOCKET_LOAD_CONNECTED,
+  _SOCKET_LOAD_FAILED,
+} _Socket_Load_State_t;
+
+typedef struct {
+  int fd;
+  _Socket_Load_State_t state;
+  uint32_t txOffset;        // of the message being sent
+  uint32_t rxCount;         // echoed bytes of the message in flight
+  uint64_t sent_ns;         // when the message in flight started
+} _Socket_Load_Conn_t;
+
+static std::vector<uint32_t> _latencies_ns;
+
+static uint64_t _socket_load_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint32_t _socket_load_percentile_us(std::vector<uint32_t>& samples, uint32_t percent) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::vector<uint32_t>::iterator nth = samples.begin() + (samples.size() - 1) * percent / 100;
+  std::nth_element(samples.begin(), nth, samples.end());
+  return *nth / 1000;
+}
+
+static bool _socket_load_connect(int epollFd, const struct sockaddr_in* address, _Socket_Load_Conn_t* conn) {
+  conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (conn->fd < 0) {
+    return false;
+  }
+  int noDelay = 1;
+  setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  if (connect(conn->fd, (const struct sockaddr*)address, sizeof(*address)) < 0 && errno != EINPROGRESS) {
+    return false;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+  event.data.ptr = conn;
+  return epoll_ctl(epollFd, EPOLL_CTL_ADD, conn->fd, &event) == 0;
+}
+
+/**
+ * @brief Sends what is left of the current message
+ * @return false if the connection failed
+ */
+static bool _socket_load_send(_Socket_Load_Conn_t* conn, const uint8_t* message, uint32_t messageSize) {
+  while (conn->txOffset < messageSize) {
+    ssize_t sent = send(conn->fd, message + conn->txOffset, messageSize - conn->txOffset, MSG_NOSIGNAL);
+    if (sent < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    conn->txOffset += sent;
+  }
+  return true;
+}
+
+/**
+ * @brief Reads the echoes, starts the next message as soon as the current one is back
+ * @return false if the connection failed
+ */
+static bool _socket_load_receive(_Socket_Load_Conn_t* conn, const uint8_t* message, uint32_t messageSize,
+                                 bool isSending, socket_load_result_t* result) {
+  uint8_t buffer[SOCKET_LOAD_MAX_MESSAGE_SIZE];
+  while (1) {
+    ssize_t bytesRead = recv(conn->fd, buffer, sizeof(buffer), 0);
+    if (bytesRead <= 0) {
+      return bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+    }
+    result->bytes += bytesRead;
+    conn->rxCount += bytesRead;
+    if (conn->rxCount >= messageSize) {
+      uint64_t now = _socket_load_now_ns();
+      uint64_t latency = now - conn->sent_ns;
+      _latencies_ns.push_back(latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency);
+      conn->rxCount -= messageSize;
+      result->messages++;
+      if (isSending) {
+        conn->sent_ns = now;
+        conn->txOffset = 0;
+        if (!_socket_load_send(conn, message, messageSize)) {
+          return false;
+        }
+      }
+    }
+  }
+}
+
+static void _socket_load_fail(_Socket_Load_Conn_t* conn, socket_load_result_t* result) {
+  if (conn->state == _SOCKET_LOAD_CONNECTED) {
+    result->connected--;
+  }
+  conn->state = _SOCKET_LOAD_FAILED;
+  result->failed++;
+  close(conn->fd);
+  conn->fd = -1;
+}
+
+int socket_load_run(const socket_load_config_t* config, socket_load_result_t* result) {
+  memset(result, 0, sizeof(*result));
+  uint32_t messageSize = config->messageSize;
+  if (!messageSize || messageSize > SOCKET_LOAD_MAX_MESSAGE_SIZE) {
+    messageSize = SOCKET_LOAD_MAX_MESSAGE_SIZE;
+  }
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(config->port);
+  if (inet_pton(AF_INET, config->host, &address.sin_addr) != 1) {
+    GZ_LOG_ERROR("Invalid address [%s]\n", config->host);
+    return -1;
+  }
+  int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0) {
+    return -1;
+  }
+  std::vector<_Socket_Load_Conn_t> conns(config->connections);
+  std::vector<uint8_t> message(messageSize);
+  for (uint32_t i = 0; i < messageSize; i++) {
+    message[i] = 'a' + i % 26;
+  }
+  message[messageSize - 1] = '\n';
+  struct epoll_event events[SOCKET_LOAD_MAX_EVENTS];
+
+  // Connection phase
+  uint64_t start = _socket_load_now_ns();
+  uint32_t started = 0;
+  uint32_t inProgress = 0;
+  while (result->connected + result->failed < config->connections) {
+    while (started < config->connections && inProgress < SOCKET_LOAD_CONNECT_WINDOW) {
+      _Socket_Load_Conn_t* conn = &conns[started++];
+      conn->state = _SOCKET_LOAD_CONNECTING;
+      if (_socket_load_connect(epollFd, &address, conn)) {
+        inProgress++;
+      } else {
+        _socket_load_fail(conn, result);
+      }
+    }
+    int count = epoll_wait(epollFd, events, SOCKET_LOAD_MAX_EVENTS, SOCKET_LOAD_CONNECT_TIMEOUT_MS);
+    if (count <= 0) {
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      GZ_LOG_ERROR("Connection phase stalled, %u in progress\n", inProgress);
+      break;
+    }
+    for (int i = 0; i < count; i++) {
+      _Socket_Load_Conn_t* conn = (_Socket_Load_Conn_t*)events[i].data.ptr;
+      if (conn->state != _SOCKET_LOAD_CONNECTING) {
+        continue;
+      }
+      int error = 0;
+      socklen_t errorLen = sizeof(error);
+      getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &errorLen);
+      inProgress--;
+      if (error || (events[i].events & (EPOLLERR | EPOLLHUP))) {
+        _socket_load_fail(conn, result);
+      } else {
+        conn->state = _SOCKET_LOAD_CONNECTED;
+        result->connected++;
+      }
+    }
+  }
+  result->connect_ns = _socket_load_now_ns() - start;
+  result->connectionsPerSecond = result->connected * 1e9 / result->connect_ns;
+  if (!result->connected) {
+    close(epollFd);
+    for (uint32_t i = 0; i < started; i++) {
+      if (conns[i].fd >= 0) {
+        close(conns[i].fd);
+      }
+    }
+    return -1;
+  }
+
+  // Message phase, one message in flight per connection
+  _latencies_ns.clear();
+  _latencies_ns.reserve(1 << 20);
+  start = _socket_load_now_ns();
+  uint64_t deadline = start + (uint64_t)config->duration_ms * 1000000ULL;
+  for (uint32_t i = 0; i < started; i++) {
+    conns[i].sent_ns = start;
+    if (conns[i].state == _SOCKET_LOAD_CONNECTED && !_socket_load_send(&conns[i], message.data(), messageSize)) {
+      _socket_load_fail(&conns[i], result);
+    }
+  }
+  uint64_t now = start;
+  while (now < deadline) {
+    int count = epoll_wait(epollFd, events, SOCKET_LOAD_MAX_EVENTS, (int)((deadline - now) / 1000000ULL) + 1);
+    if (count < 0 && errno != EINTR) {
+      break;
+    }
+    now = _socket_load_now_ns();
+    for (int i = 0; i < count; i++) {
+      _Socket_Load_Conn_t* conn = (_Socket_Load_Conn_t*)events[i].data.ptr;
+      if (conn->state != _SOCKET_LOAD_CONNECTED) {
+        continue;
+      }
+      bool isOk = !(events[i].events & EPOLLERR);
+      if (isOk && (events[i].events & EPOLLOUT)) {
+        isOk = _socket_load_send(conn, message.data(), messageSize);
+      }
+      if (isOk && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP))) {
+        isOk = _socket_load_receive(conn, message.data(), messageSize, now < deadline, result);
+      }
+      if (!isOk) {
+        _socket_load_fail(conn, result);
+      }
+    }
+  }
+  result->messages_ns = _socket_load_now_ns() - start;
+
+  for (uint32_t i = 0; i < started; i++) {
+    if (conns[i].fd >= 0) {
+      close(conns[i].fd);
+    }
+  }
+  close(epollFd);
+  result->messagesPerSecond = result->messages * 1e9 / result->messages_ns;
+  result->latencyP50_us = _socket_load_percentile_us(_latencies_ns, 50);
+  result->latencyP99_us = _socket_load_percentile_us(_latencies_ns, 99);
+  std::vector<uint32_t>().swap(_latencies_ns);
+  return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,53 @@
+/**
+ * socket_load.h
+ *
+ * Load generator for the socket server: opens many connections to an echo server, then keeps one
+ * message in flight on each of them and counts the echoes.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef SOCKET_LOAD_H
+#define SOCKET_LOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SOCKET_LOAD_MAX_MESSAGE_SIZE    4096
+
+typedef struct {
+  const char* host;         // IPv4 address, e.g. "127.0.0.1"
+  uint16_t port;
+  uint32_t connections;
+  uint32_t messageSize;     // bytes per message, up to SOCKET_LOAD_MAX_MESSAGE_SIZE
+  uint32_t duration_ms;     // of the message phase
+} socket_load_config_t;
+
+typedef struct {
+  uint32_t connected;
+  uint32_t failed;
+  uint64_t connect_ns;      // until every connection is established (or failed)
+  uint64_t messages;        // echoed completely
+  uint64_t bytes;
+  uint64_t messages_ns;
+  double connectionsPerSecond;
+  double messagesPerSecond;
+  uint32_t latencyP50_us;   // send of a message to the end of its echo
+  uint32_t latencyP99_us;
+} socket_load_result_t;
+
+/**
+ * @brief Runs both phases, blocking
+ * @return 0 if at least one connection got established, -1 otherwise
+ */
+int socket_load_run(const socket_load_config_t* config, socket_load_result_t* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SOCKET_LOAD_H
@@ -0,0 +1,1036 @@
+/**
+ * socket_server.cpp
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <vector>
+
+#include "socket_server.h"
+#include "socket_uring.h"
+#define GZ_LOG_MODULE "socket_server"
+#include "gz_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define URING_BUFFER_GROUP      0
+#define URING_OP_MASK           0x7ULL // user_data: connection pointer (calloc'ed, aligned) | operation
+#define URING_OP_IGNORED        0      // cancel requests
+#define URING_OP_ACCEPT         1
+#define URING_OP_RECV           2
+#define URING_OP_SEND           3
+#define URING_OP_POLL_IN        4      // a non-blocking stream had nothing to read, read again once readable
+#define URING_OP_POLL_OUT       5
+#define URING_CLOSE_TIMEOUT_MS  100
+
+typedef struct {
+  int fd;
+  bool isStream;            // added with socket_server_attach(): read()/write(), its owner closes it
+  bool isClosing;           // dropped, closed at the end of the current socket_server_poll()
+  bool isCongested;         // reached the high watermark, refuses messages until under the low one
+  socket_server_rx_cb_t rxCb;
+  socket_server_conn_cb_t connCb;
+  uint8_t* txBuffer;        // pending output
+  size_t txOffset;          // first byte not sent yet
+  size_t txSize;
+  size_t txCapacity;
+  // io_uring backend
+  uint8_t* sendBuffer;      // output owned by the kernel until its send completes, swapped with txBuffer
+  size_t sendOffset;
+  size_t sendSize;
+  size_t sendCapacity;
+  uint8_t inflight;         // operations the kernel still holds, freed after the last one completes
+  bool isSendQueued;
+  bool isCancelled;
+  int fixedBuffer;          // registered buffer of a stream, -1 otherwise
+} _Socket_Conn_t;
+
+static socket_server_backend_t _backend = SOCKET_SERVER_BACKEND_AUTO;
+static socket_server_backend_t _activeBackend = SOCKET_SERVER_BACKEND_EPOLL;
+static int _listenFd = -1;
+static int _epollFd = -1;
+static bool _isAcceptPending = false; // out of fds, retried when a connection closes
+static socket_server_slow_policy_t _slowPolicy = SOCKET_SERVER_SLOW_DISCONNECT;
+static size_t _highWatermark = SOCKET_SERVER_TX_HIGH_WATERMARK;
+static size_t _lowWatermark = SOCKET_SERVER_TX_LOW_WATERMARK;
+static socket_server_rx_cb_t _rxCb = NULL;
+static socket_server_conn_cb_t _connCb = NULL;
+static std::vector<_Socket_Conn_t*> _connections; // indexed by fd
+static std::vector<_Socket_Conn_t*> _closing;     // closed at the end of the batch, events may still point to them
+static uint8_t _rxBuffer[SOCKET_SERVER_READ_SIZE];
+static socket_server_stats_t _stats;
+static socket_server_stats_t _publishedStats;
+static pthread_mutex_t _statsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static socket_uring_t _ring = { -1 };
+static bool _isAcceptArmed = false;
+static uint64_t _enterCallsSeen = 0;
+static std::vector<_Socket_Conn_t*> _sendQueue;   // output to submit with the next io_uring_enter()
+static std::vector<_Socket_Conn_t*> _draining;    // closed, the kernel still holds some of their operations
+static uint8_t _streamBuffers[SOCKET_SERVER_MAX_STREAMS][SOCKET_SERVER_READ_SIZE];
+static bool _isStreamBufferUsed[SOCKET_SERVER_MAX_STREAMS];
+
+static bool _socket_server_is_uring(void) {
+  return _activeBackend == SOCKET_SERVER_BACKEND_URING;
+}
+
+static _Socket_Conn_t* _socket_server_get_conn(int connFd) {
+  if (connFd < 0 || (size_t)connFd >= _connections.size()) {
+    return NULL;
+  }
+  return _connections[connFd];
+}
+
+static void _socket_server_add_conn(_Socket_Conn_t* conn) {
+  if ((size_t)conn->fd >= _connections.size()) {
+    _connections.resize(conn->fd + 1, NULL);
+  }
+  _connections[conn->fd] = conn;
+}
+
+static _Socket_Conn_t* _socket_server_new_conn(int fd, bool isStream, socket_server_rx_cb_t rxCb, socket_server_conn_cb_t connCb) {
+  _Socket_Conn_t* conn = (_Socket_Conn_t*)calloc(1, sizeof(_Socket_Conn_t));
+  conn->fd = fd;
+  conn->isStream = isStream;
+  conn->rxCb = rxCb;
+  conn->connCb = connCb;
+  conn->fixedBuffer = -1;
+  return conn;
+}
+
+static void _socket_server_free_conn(_Socket_Conn_t* conn) {
+  if (!conn->isStream) {
+    _stats.syscalls++;
+    close(conn->fd);
+  }
+  if (conn->fixedBuffer >= 0) {
+    _isStreamBufferUsed[conn->fixedBuffer] = false;
+  }
+  for (size_t i = 0; conn->isSendQueued && i < _sendQueue.size(); i++) {
+    if (_sendQueue[i] == conn) {
+      _sendQueue.erase(_sendQueue.begin() + i);
+      break;
+    }
+  }
+  free(conn->txBuffer);
+  free(conn->sendBuffer);
+  free(conn);
+}
+
+static void _socket_server_drop(_Socket_Conn_t* conn) {
+  if (!conn->isClosing) {
+    conn->isClosing = true;
+    _closing.push_back(conn);
+  }
+}
+
+static void _socket_uring_cancel(_Socket_Conn_t* conn);
+
+/**
+ * @brief Output not sent yet, queued or in flight
+ */
+static size_t _socket_server_pending(const _Socket_Conn_t* conn) {
+  return conn->txSize - conn->txOffset + conn->sendSize - conn->sendOffset;
+}
+
+/**
+ * @brief Some output went out, a congested connection takes messages again once under the low watermark
+ */
+static void _socket_server_sent(_Socket_Conn_t* conn, size_t size) {
+  _stats.txBytes += size;
+  if (conn->isCongested && _socket_server_pending(conn) <= _lowWatermark) {
+    conn->isCongested = false;
+    _stats.congested--;
+  }
+}
+
+/**
+ * @brief Out of the table, the memory goes once the kernel gave back every operation on it
+ */
+static void _socket_server_close_conn(_Socket_Conn_t* conn) {
+  _connections[conn->fd] = NULL;
+  if (!conn->isStream) {
+    _stats.closed++;
+    _stats.active--;
+  }
+  if (conn->isCongested) {
+    _stats.congested--;
+  }
+  if (!_socket_server_is_uring()) {
+    _stats.syscalls++;
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+  } else if (conn->inflight) {
+    _socket_uring_cancel(conn);
+    if (conn->isStream) {
+      socket_uring_enter(&_ring, 0, 0); // the owner may close it from the callback, cancel by fd before that
+    }
+  }
+  if (conn->connCb) {
+    conn->connCb(conn->fd, false);
+  }
+  if (_socket_server_is_uring() && conn->inflight) {
+    _draining.push_back(conn);
+  } else {
+    _socket_server_free_conn(conn);
+  }
+}
+
+/**
+ * @brief Skips the first `size` bytes of the pieces, *iov and *count are left on the first one not fully consumed
+ */
+static void _socket_server_iov_consume(struct iovec** iov, int* count, size_t size) {
+  while (*count && size >= (*iov)->iov_len) {
+    size -= (*iov)->iov_len;
+    (*iov)++;
+    (*count)--;
+  }
+  if (*count) {
+    (*iov)->iov_base = (uint8_t*)(*iov)->iov_base + size;
+    (*iov)->iov_len -= size;
+  }
+}
+
+/**
+ * @brief Keeps `size` bytes to send after the current output, compacting the buffer before growing it
+ */
+static bool _socket_server_queue(_Socket_Conn_t* conn, const uint8_t* data, size_t size) {
+  size_t pending = conn->txSize - conn->txOffset;
+  if (conn->txOffset) {
+    memmove(conn->txBuffer, conn->txBuffer + conn->txOffset, pending);
+    conn->txOffset = 0;
+    conn->txSize = pending;
+  }
+  if (conn->txSize + size > conn->txCapacity) {
+    size_t capacity = conn->txCapacity ? conn->txCapacity : SOCKET_SERVER_READ_SIZE;
+    while (capacity < conn->txSize + size) {
+      capacity *= 2;
+    }
+    uint8_t* buffer = (uint8_t*)realloc(conn->txBuffer, capacity);
+    if (!buffer) {
+      return false;
+    }
+    conn->txBuffer = buffer;
+    conn->txCapacity = capacity;
+  }
+  memcpy(conn->txBuffer + conn->txSize, data, size);
+  conn->txSize += size;
+  return true;
+}
+
+static void _socket_server_accepted(_Socket_Conn_t* conn) {
+  int noDelay = 1;
+  _stats.syscalls++;
+  setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  _socket_server_add_conn(conn);
+  _stats.accepted++;
+  _stats.active++;
+  if (_stats.active > _stats.peakActive) {
+    _stats.peakActive = _stats.active;
+  }
+  GZ_LOG_DEBUG("Connection accepted fd[%d]\n", conn->fd);
+  if (conn->connCb) {
+    conn->connCb(conn->fd, true);
+  }
+}
+
+/*****************************************************/
+/* Section: epoll backend                            */
+/*****************************************************/
+
+static ssize_t _socket_epoll_write(_Socket_Conn_t* conn, const void* data, size_t size) {
+  _stats.syscalls++;
+  return conn->isStream ? write(conn->fd, data, size) : send(conn->fd, data, size, MSG_NOSIGNAL);
+}
+
+static ssize_t _socket_epoll_writev(_Socket_Conn_t* conn, const struct iovec* iov, int count) {
+  _stats.syscalls++;
+  if (conn->isStream) {
+    return writev(conn->fd, iov, count);
+  }
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = (struct iovec*)iov;
+  msg.msg_iovlen = count;
+  return sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+}
+
+static ssize_t _socket_epoll_read(_Socket_Conn_t* conn, void* data, size_t size) {
+  _stats.syscalls++;
+  return conn->isStream ? read(conn->fd, data, size) : recv(conn->fd, data, size, 0);
+}
+
+static bool _socket_epoll_add(_Socket_Conn_t* conn) {
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.ptr = conn;
+  _stats.syscalls++;
+  if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, conn->fd, &event) < 0) {
+    GZ_LOG_ERROR("epoll_ctl add fd[%d] errno[%d]\n", conn->fd, errno);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Writes the pending output until the socket would block
+ * @return false if the connection failed
+ */
+static bool _socket_epoll_flush(_Socket_Conn_t* conn) {
+  while (conn->txOffset < conn->txSize) {
+    ssize_t sent = _socket_epoll_write(conn, conn->txBuffer + conn->txOffset, conn->txSize - conn->txOffset);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    conn->txOffset += sent;
+    _socket_server_sent(conn, sent);
+  }
+  conn->txOffset = 0;
+  conn->txSize = 0;
+  return true;
+}
+
+static void _socket_epoll_accept(void) {
+  _isAcceptPending = false;
+  while (1) {
+    _stats.syscalls++;
+    int connFd = accept4(_listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (connFd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno == EMFILE || errno == ENFILE) {
+        GZ_LOG_ERROR("Accept: out of file descriptors, %u connections\n", _stats.active);
+        _isAcceptPending = true;
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        GZ_LOG_ERROR("Accept failed errno[%d]\n", errno);
+      }
+      return; // drained
+    }
+    _Socket_Conn_t* conn = _socket_server_new_conn(connFd, false, _rxCb, _connCb);
+    if (!_socket_epoll_add(conn)) {
+      close(connFd);
+      free(conn);
+      continue;
+    }
+    _socket_server_accepted(conn);
+  }
+}
+
+/**
+ * @brief Edge-triggered: reads until the socket would block, or the peer is gone
+ * @return false if the connection has to be closed
+ */
+static bool _socket_epoll_receive(_Socket_Conn_t* conn) {
+  while (!conn->isClosing) {
+    ssize_t bytesRead = _socket_epoll_read(conn, _rxBuffer, sizeof(_rxBuffer));
+    if (bytesRead > 0) {
+      _stats.rxBytes += bytesRead;
+      if (conn->rxCb) {
+        conn->rxCb(conn->fd, _rxBuffer, bytesRead);
+      }
+    } else if (bytesRead == 0 && !conn->isStream) {
+      GZ_LOG_DEBUG("Connection closed fd[%d]\n", conn->fd);
+      return false;
+    } else if (bytesRead == 0 || errno == EAGAIN || errno == EWOULDBLOCK) { // a raw tty (VMIN 0) reads 0 when empty
+      return true;
+    } else if (errno != EINTR) {
+      GZ_LOG_DEBUG("Read failed fd[%d] errno[%d]\n", conn->fd, errno);
+      return false;
+    }
+  }
+  return false;
+}
+
+static int _socket_epoll_poll(int timeoutMs) {
+  struct epoll_event events[SOCKET_SERVER_MAX_EVENTS];
+  _stats.syscalls++;
+  int count = epoll_wait(_epollFd, events, SOCKET_SERVER_MAX_EVENTS, timeoutMs);
+  if (count < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    GZ_LOG_ERROR("epoll_wait errno[%d]\n", errno);
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    _Socket_Conn_t* conn = (_Socket_Conn_t*)events[i].data.ptr;
+    if (!conn) {
+      _socket_epoll_accept();
+      continue;
+    }
+    if (conn->isClosing) {
+      continue;
+    }
+    bool isOk = !(events[i].events & EPOLLERR);
+    if (isOk && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+      isOk = _socket_epoll_receive(conn); // also reads the last bytes before a hang up
+    }
+    if (isOk && (events[i].events & EPOLLOUT) && conn->txSize) {
+      isOk = _socket_epoll_flush(conn);
+    }
+    if (!isOk) {
+      _socket_server_drop(conn);
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief Writes the pieces until the socket would block, *iov and *count are left on what remains
+ */
+static ssize_t _socket_epoll_send(_Socket_Conn_t* conn, struct iovec** iov, int* count) {
+  size_t written = 0;
+  while (!conn->txSize && *count) {
+    ssize_t sent = *count == 1 ? _socket_epoll_write(conn, (*iov)->iov_base, (*iov)->iov_len)
+                               : _socket_epoll_writev(conn, *iov, *count);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK ? (ssize_t)written : -1;
+    }
+    _stats.txBytes += sent;
+    written += sent;
+    _socket_server_iov_consume(iov, count, sent);
+  }
+  return written;
+}
+
+/*****************************************************/
+/* Section: io_uring backend                         */
+/*****************************************************/
+
+static uint64_t _socket_uring_user_data(_Socket_Conn_t* conn, uint64_t op) {
+  return (uint64_t)(uintptr_t)conn | op;
+}
+
+static void _socket_uring_arm_accept(void) {
+  struct io_uring_sqe* sqe = socket_uring_get_sqe(&_ring);
+  if (!sqe) {
+    return; // next poll
+  }
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = _listenFd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = _socket_uring_user_data(NULL, URING_OP_ACCEPT);
+  _isAcceptArmed = true;
+}
+
+/**
+ * @brief Sockets: multishot receive into the provided buffers. Streams: one read into their registered buffer
+ */
+static void _socket_uring_arm_recv(_Socket_Conn_t* conn) {
+  struct io_uring_sqe* sqe = socket_uring_get_sqe(&_ring);
+  if (!sqe) {
+    _socket_server_drop(conn);
+    return;
+  }
+  sqe->fd = conn->fd;
+  if (conn->isStream) {
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->addr = (uint64_t)(uintptr_t)_streamBuffers[conn->fixedBuffer];
+    sqe->len = SOCKET_SERVER_READ_SIZE;
+    sqe->off = (uint64_t)-1; // not seekable, current position
+    sqe->buf_index = conn->fixedBuffer;
+  } else {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+  }
+  sqe->user_data = _socket_uring_user_data(conn, URING_OP_RECV);
+  conn->inflight++;
+}
+
+/**
+ * @brief io_uring gives EAGAIN back for O_NONBLOCK files (the serial ports), waits for them to be ready
+ */
+static void _socket_uring_arm_poll(_Socket_Conn_t* conn, uint32_t events, uint64_t op) {
+  struct io_uring_sqe* sqe = socket_uring_get_sqe(&_ring);
+  if (!sqe) {
+    _socket_server_drop(conn);
+    return;
+  }
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = conn->fd;
+  sqe->poll32_events = events;
+  sqe->user_data = _socket_uring_user_data(conn, op);
+  conn->inflight++;
+}
+
+static void _socket_uring_submit_send(_Socket_Conn_t* conn) {
+  struct io_uring_sqe* sqe = socket_uring_get_sqe(&_ring);
+  if (!sqe) {
+    _socket_server_drop(conn);
+    return;
+  }
+  sqe->fd = conn->fd;
+  sqe->addr = (uint64_t)(uintptr_t)(conn->sendBuffer + conn->sendOffset);
+  sqe->len = conn->sendSize - conn->sendOffset;
+  if (conn->isStream) {
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->off = (uint64_t)-1;
+  } else {
+    sqe->opcode = IORING_OP_SEND;
+    sqe->msg_flags = MSG_NOSIGNAL;
+  }
+  sqe->user_data = _socket_uring_user_data(conn, URING_OP_SEND);
+  conn->inflight++;
+}
+
+static void _socket_uring_queue_send(_Socket_Conn_t* conn) {
+  if (!conn->isSendQueued) {
+    conn->isSendQueued = true;
+    _sendQueue.push_back(conn);
+  }
+}
+
+/**
+ * @brief One send per connection with pending output, all of them go with the next io_uring_enter()
+ */
+static void _socket_uring_flush_sends(void) {
+  for (size_t i = 0; i < _sendQueue.size(); i++) {
+    _Socket_Conn_t* conn = _sendQueue[i];
+    conn->isSendQueued = false;
+    if (conn->isClosing || conn->sendSize || conn->txOffset == conn->txSize) {
+      continue; // the completion of the send in flight takes the rest
+    }
+    uint8_t* buffer = conn->sendBuffer;
+    size_t capacity = conn->sendCapacity;
+    conn->sendBuffer = conn->txBuffer;
+    conn->sendCapacity = conn->txCapacity;
+    conn->sendOffset = conn->txOffset;
+    conn->sendSize = conn->txSize;
+    conn->txBuffer = buffer;
+    conn->txCapacity = capacity;
+    conn->txOffset = 0;
+    conn->txSize = 0;
+    _socket_uring_submit_send(conn);
+  }
+  _sendQueue.clear();
+}
+
+static void _socket_uring_cancel(_Socket_Conn_t* conn) {
+  if (conn->isCancelled || !conn->inflight) {
+    return;
+  }
+  struct io_uring_sqe* sqe = socket_uring_get_sqe(&_ring);
+  if (!sqe) {
+    return; // retried by the next poll
+  }
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = conn->fd;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  sqe->user_data = _socket_uring_user_data(NULL, URING_OP_IGNORED);
+  conn->isCancelled = true;
+}
+
+static void _socket_uring_on_accept(const struct io_uring_cqe* cqe) {
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    _isAcceptArmed = false;
+  }
+  if (cqe->res < 0) {
+    if (cqe->res == -EMFILE || cqe->res == -ENFILE) {
+      GZ_LOG_ERROR("Accept: out of file descriptors, %u connections\n", _stats.active);
+      _isAcceptPending = true;
+    } else if (cqe->res != -ECANCELED && cqe->res != -ECONNABORTED && cqe->res != -EINTR) {
+      GZ_LOG_ERROR("Accept failed errno[%d]\n", -cqe->res);
+    }
+    return;
+  }
+  if (_listenFd < 0) {
+    close(cqe->res); // accepted while closing
+    return;
+  }
+  _Socket_Conn_t* conn = _socket_server_new_conn(cqe->res, false, _rxCb, _connCb);
+  _socket_server_accepted(conn);
+  _socket_uring_arm_recv(conn);
+}
+
+static void _socket_uring_on_recv(_Socket_Conn_t* conn, const struct io_uring_cqe* cqe) {
+  bool isArmed = (cqe->flags & IORING_CQE_F_MORE) != 0;
+  if (!isArmed) {
+    conn->inflight--;
+  }
+  if (cqe->res > 0) {
+    uint16_t bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    const uint8_t* data = conn->isStream ? _streamBuffers[conn->fixedBuffer] : socket_uring_buf(&_ring, bufferId);
+    _stats.rxBytes += cqe->res;
+    if (!conn->isClosing && conn->rxCb) {
+      conn->rxCb(conn->fd, data, cqe->res);
+    }
+  }
+  if (cqe->flags & IORING_CQE_F_BUFFER) {
+    socket_uring_buf_recycle(&_ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+  }
+  if (conn->isClosing || isArmed) {
+    return;
+  }
+  if (cqe->res == -EAGAIN || (cqe->res == 0 && conn->isStream)) { // a raw tty (VMIN 0) reads 0 when empty
+    _socket_uring_arm_poll(conn, POLLIN, URING_OP_POLL_IN);
+  } else if (cqe->res > 0 || cqe->res == -ENOBUFS) {
+    _socket_uring_arm_recv(conn); // one-shot stream read, or multishot stopped by the lack of buffers
+  } else {
+    GZ_LOG_DEBUG("Connection closed fd[%d] res[%d]\n", conn->fd, cqe->res);
+    _socket_server_drop(conn);
+  }
+}
+
+static void _socket_uring_on_send(_Socket_Conn_t* conn, const struct io_uring_cqe* cqe) {
+  conn->inflight--;
+  if (conn->isClosing) {
+    return;
+  }
+  if (cqe->res == -EAGAIN) {
+    _socket_uring_arm_poll(conn, POLLOUT, URING_OP_POLL_OUT);
+    return;
+  }
+  if (cqe->res < 0) {
+    GZ_LOG_DEBUG("Send failed fd[%d] errno[%d]\n", conn->fd, -cqe->res);
+    _socket_server_drop(conn);
+    return;
+  }
+  conn->sendOffset += cqe->res;
+  if (conn->sendOffset < conn->sendSize) {
+    _socket_server_sent(conn, cqe->res);
+    _socket_uring_submit_send(conn);
+    return;
+  }
+  conn->sendOffset = 0;
+  conn->sendSize = 0;
+  _socket_server_sent(conn, cqe->res);
+  if (conn->txSize) {
+    _socket_uring_queue_send(conn);
+  }
+}
+
+static void _socket_uring_on_poll(_Socket_Conn_t* conn, const struct io_uring_cqe* cqe, uint64_t op) {
+  conn->inflight--;
+  if (conn->isClosing) {
+    return;
+  }
+  if (cqe->res < 0 || (cqe->res & (POLLERR | POLLNVAL | POLLHUP))) {
+    _socket_server_drop(conn);
+  } else if (op == URING_OP_POLL_IN) {
+    _socket_uring_arm_recv(conn);
+  } else {
+    _socket_uring_submit_send(conn);
+  }
+}
+
+/**
+ * @brief Handles every completion available
+ * @return number of completions
+ */
+static int _socket_uring_complete(void) {
+  int count = 0;
+  struct io_uring_cqe* cqe;
+  while ((cqe = socket_uring_peek_cqe(&_ring)) != NULL) {
+    uint64_t op = cqe->user_data & URING_OP_MASK;
+    _Socket_Conn_t* conn = (_Socket_Conn_t*)(uintptr_t)(cqe->user_data & ~URING_OP_MASK);
+    switch (op) {
+      case URING_OP_ACCEPT:
+        _socket_uring_on_accept(cqe);
+        break;
+      case URING_OP_RECV:
+        _socket_uring_on_recv(conn, cqe);
+        break;
+      case URING_OP_SEND:
+        _socket_uring_on_send(conn, cqe);
+        break;
+      case URING_OP_POLL_IN: // Falling through
+      case URING_OP_POLL_OUT:
+        _socket_uring_on_poll(conn, cqe, op);
+        break;
+      default:
+        break;
+    }
+    socket_uring_cqe_seen(&_ring);
+    count++;
+  }
+  return count;
+}
+
+static void _socket_uring_release_drained(void) {
+  for (size_t i = _draining.size(); i-- > 0;) {
+    _Socket_Conn_t* conn = _draining[i];
+    if (conn->inflight) {
+      _socket_uring_cancel(conn); // in case the ring was full when it closed
+      continue;
+    }
+    _socket_server_free_conn(conn);
+    _draining.erase(_draining.begin() + i);
+  }
+}
+
+/**
+ * @brief The whole iteration is one io_uring_enter(): queued sends go in, completions come out
+ */
+static int _socket_uring_poll(int timeoutMs) {
+  socket_uring_buf_recycle_pending(&_ring);
+  _socket_uring_flush_sends();
+  if (!_isAcceptArmed && !_isAcceptPending) {
+    _socket_uring_arm_accept();
+  }
+  uint32_t minComplete = socket_uring_peek_cqe(&_ring) ? 0 : 1;
+  int rv = socket_uring_enter(&_ring, minComplete, timeoutMs);
+  if (rv < 0) {
+    GZ_LOG_ERROR("io_uring_enter errno[%d]\n", -rv);
+    return -1;
+  }
+  return _socket_uring_complete();
+}
+
+static int _socket_uring_open(void) {
+  int rv = socket_uring_init(&_ring, SOCKET_SERVER_URING_ENTRIES);
+  if (rv < 0) {
+    return rv;
+  }
+  struct iovec iovecs[SOCKET_SERVER_MAX_STREAMS];
+  for (uint8_t i = 0; i < SOCKET_SERVER_MAX_STREAMS; i++) {
+    iovecs[i].iov_base = _streamBuffers[i];
+    iovecs[i].iov_len = sizeof(_streamBuffers[i]);
+  }
+  rv = socket_uring_register_buffers(&_ring, iovecs, SOCKET_SERVER_MAX_STREAMS);
+  if (rv == 0) {
+    rv = socket_uring_provide_buffers(&_ring, URING_BUFFER_GROUP, SOCKET_SERVER_URING_BUFFERS, SOCKET_SERVER_READ_SIZE);
+  }
+  if (rv < 0) {
+    socket_uring_exit(&_ring);
+    return rv;
+  }
+  _isAcceptArmed = false;
+  _enterCallsSeen = 0;
+  return 0;
+}
+
+/**
+ * @brief The buffers can only go once the kernel gave back every operation using them
+ */
+static void _socket_uring_close(void) {
+  struct io_uring_sqe* sqe = _isAcceptArmed ? socket_uring_get_sqe(&_ring) : NULL;
+  if (sqe) {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = _socket_uring_user_data(NULL, URING_OP_ACCEPT); // the listening socket is already closed
+  }
+  int attempts = 10;
+  while ((_isAcceptArmed || !_draining.empty()) && attempts--) {
+    _socket_uring_release_drained();
+    socket_uring_enter(&_ring, 1, URING_CLOSE_TIMEOUT_MS);
+    _socket_uring_complete();
+  }
+  _socket_uring_release_drained();
+  if (!_draining.empty()) {
+    GZ_LOG_ERROR("io_uring: %u connections still busy\n", (uint32_t)_draining.size());
+  }
+  socket_uring_exit(&_ring);
+}
+
+/*****************************************************/
+/* Section: Public functions                         */
+/*****************************************************/
+
+uint32_t socket_server_raise_fd_limit(void) {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) < 0) {
+    return 0;
+  }
+  if (limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+  }
+  return limit.rlim_cur > UINT32_MAX ? UINT32_MAX : (uint32_t)limit.rlim_cur;
+}
+
+void socket_server_set_backpressure(socket_server_slow_policy_t policy, size_t highWatermark, size_t lowWatermark) {
+  _slowPolicy = policy;
+  _highWatermark = highWatermark;
+  _lowWatermark = lowWatermark < highWatermark ? lowWatermark : highWatermark;
+}
+
+void socket_server_set_backend(socket_server_backend_t backend) {
+  _backend = backend;
+}
+
+socket_server_backend_t socket_server_get_backend(void) {
+  return _activeBackend;
+}
+
+const char* socket_server_backend_name(socket_server_backend_t backend) {
+  switch (backend) {
+    case SOCKET_SERVER_BACKEND_EPOLL:
+      return "epoll";
+    case SOCKET_SERVER_BACKEND_URING:
+      return "io_uring";
+    default:
+      return "auto";
+  }
+}
+
+int socket_server_open(uint16_t port, int backlog, socket_server_rx_cb_t rxCb, socket_server_conn_cb_t connCb) {
+  memset(&_stats, 0, sizeof(_stats));
+  _isAcceptPending = false;
+  _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_listenFd < 0) {
+    GZ_LOG_ERROR("Socket creation failed\n");
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in sockaddr_v4;
+  memset(&sockaddr_v4, 0, sizeof(sockaddr_v4));
+  sockaddr_v4.sin_family = AF_INET;
+  sockaddr_v4.sin_port = htons(port);
+  sockaddr_v4.sin_addr.s_addr = INADDR_ANY;
+  if (bind(_listenFd, (struct sockaddr*)&sockaddr_v4, sizeof(sockaddr_v4)) < 0) {
+    GZ_LOG_ERROR("Socket bind failed port[%d] errno[%d]\n", port, errno);
+    socket_server_close();
+    return -1;
+  }
+  if (listen(_listenFd, backlog) < 0) {
+    GZ_LOG_ERROR("Socket listen failed errno[%d]\n", errno);
+    socket_server_close();
+    return -1;
+  }
+  _rxCb = rxCb;
+  _connCb = connCb;
+
+  _activeBackend = SOCKET_SERVER_BACKEND_EPOLL;
+  if (_backend != SOCKET_SERVER_BACKEND_EPOLL) {
+    int rv = _socket_uring_open();
+    if (rv == 0) {
+      _activeBackend = SOCKET_SERVER_BACKEND_URING;
+      return 0;
+    }
+    if (_backend == SOCKET_SERVER_BACKEND_URING) {
+      GZ_LOG_ERROR("io_uring not available errno[%d]\n", -rv);
+      socket_server_close();
+      return -1;
+    }
+    GZ_LOG_INFO("io_uring not available errno[%d], using epoll\n", -rv);
+  }
+  _epollFd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLET;
+  event.data.ptr = NULL; // NULL is the listening socket
+  if (_epollFd < 0 || epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &event) < 0) {
+    GZ_LOG_ERROR("epoll setup failed errno[%d]\n", errno);
+    socket_server_close();
+    return -1;
+  }
+  return 0;
+}
+
+int socket_server_poll(int timeoutMs) {
+  uint64_t closedBefore = _stats.closed;
+  int count = _socket_server_is_uring() ? _socket_uring_poll(timeoutMs) : _socket_epoll_poll(timeoutMs);
+  if (count < 0) {
+    return -1;
+  }
+  if (count) {
+    _stats.wakeups++;
+    _stats.events += count;
+  }
+  for (size_t i = 0; i < _closing.size(); i++) {
+    _socket_server_close_conn(_closing[i]);
+  }
+  _closing.clear();
+  if (_isAcceptPending && _stats.closed != closedBefore) {
+    if (_socket_server_is_uring()) {
+      _isAcceptPending = false; // armed again by the next poll
+    } else {
+      _socket_epoll_accept(); // the listening socket will not trigger again for the queued connections
+    }
+  }
+  if (_socket_server_is_uring()) {
+    _socket_uring_release_drained();
+    _stats.syscalls += _ring.enterCalls - _enterCallsSeen;
+    _enterCallsSeen = _ring.enterCalls;
+  }
+  pthread_mutex_lock(&_statsLock);
+  _publishedStats = _stats;
+  pthread_mutex_unlock(&_statsLock);
+  return count;
+}
+
+int socket_server_send(int connFd, const void* data, size_t size) {
+  struct iovec iov = { (void*)data, size };
+  return socket_server_sendv(connFd, &iov, 1);
+}
+
+int socket_server_sendv(int connFd, const struct iovec* iov, int count) {
+  _Socket_Conn_t* conn = _socket_server_get_conn(connFd);
+  if (!conn || conn->isClosing || count < 0 || count > SOCKET_SERVER_SENDV_MAX) {
+    return -1;
+  }
+  struct iovec pieces[SOCKET_SERVER_SENDV_MAX]; // consumed as they are written
+  size_t size = 0;
+  for (int i = 0; i < count; i++) {
+    pieces[i] = iov[i];
+    size += iov[i].iov_len;
+  }
+  if (conn->isCongested) {
+    _stats.droppedMessages++;
+    _stats.droppedBytes += size;
+    return SOCKET_SERVER_SEND_DROPPED;
+  }
+  struct iovec* remaining = pieces;
+  size_t written = 0;
+  if (!_socket_server_is_uring()) {
+    ssize_t sent = _socket_epoll_send(conn, &remaining, &count);
+    if (sent < 0) {
+      _socket_server_drop(conn);
+      return -1;
+    }
+    written = sent;
+  }
+  if (written == size) {
+    return 0;
+  }
+  if (_socket_server_pending(conn) + size - written > _highWatermark) {
+    _stats.congestions++;
+    if (!conn->isStream && _slowPolicy == SOCKET_SERVER_SLOW_DISCONNECT) {
+      GZ_LOG_ERROR("Slow consumer fd[%d], %u bytes pending, disconnecting\n", connFd, (uint32_t)_socket_server_pending(conn));
+      _stats.dropped++;
+      _socket_server_drop(conn);
+      return -1;
+    }
+    conn->isCongested = true;
+    _stats.congested++;
+    if (!written) { // the beginning of a message already sent has to be followed by its end
+      _stats.droppedMessages++;
+      _stats.droppedBytes += size;
+      return SOCKET_SERVER_SEND_DROPPED;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (!_socket_server_queue(conn, (const uint8_t*)remaining[i].iov_base, remaining[i].iov_len)) {
+      GZ_LOG_ERROR("Out of memory for the output of fd[%d]\n", connFd);
+      _stats.dropped++;
+      _socket_server_drop(conn);
+      return -1;
+    }
+  }
+  if (_socket_server_is_uring()) {
+    _socket_uring_queue_send(conn);
+  }
+  return 0;
+}
+
+bool socket_server_is_congested(int connFd) {
+  _Socket_Conn_t* conn = _socket_server_get_conn(connFd);
+  return conn && conn->isCongested;
+}
+
+void socket_server_disconnect(int connFd) {
+  _Socket_Conn_t* conn = _socket_server_get_conn(connFd);
+  if (conn) {
+    _socket_server_drop(conn);
+  }
+}
+
+int socket_server_attach(int fd, socket_server_rx_cb_t rxCb, socket_server_conn_cb_t closeCb) {
+  if (_socket_server_get_conn(fd)) {
+    return -1;
+  }
+  _Socket_Conn_t* conn = _socket_server_new_conn(fd, true, rxCb, closeCb);
+  if (_socket_server_is_uring()) {
+    for (int i = 0; i < SOCKET_SERVER_MAX_STREAMS && conn->fixedBuffer < 0; i++) {
+      if (!_isStreamBufferUsed[i]) {
+        _isStreamBufferUsed[i] = true;
+        conn->fixedBuffer = i;
+      }
+    }
+    if (conn->fixedBuffer < 0) {
+      GZ_LOG_ERROR("Attach fd[%d]: more than %d streams\n", fd, SOCKET_SERVER_MAX_STREAMS);
+      free(conn);
+      return -1;
+    }
+    _socket_server_add_conn(conn);
+    _socket_uring_arm_recv(conn);
+    return 0;
+  }
+  if (!_socket_epoll_add(conn)) {
+    free(conn);
+    return -1;
+  }
+  _socket_server_add_conn(conn);
+  return 0;
+}
+
+void socket_server_detach(int fd) {
+  _Socket_Conn_t* conn = _socket_server_get_conn(fd);
+  if (!conn || !conn->isStream) {
+    return;
+  }
+  conn->connCb = NULL; // its owner knows
+  if (!conn->isClosing) {
+    conn->isClosing = true;
+    _socket_server_close_conn(conn); // now, the owner closes it right after
+  } else {
+    for (size_t i = 0; i < _closing.size(); i++) {
+      if (_closing[i] == conn) {
+        _closing.erase(_closing.begin() + i);
+        break;
+      }
+    }
+    _socket_server_close_conn(conn);
+  }
+}
+
+void socket_server_close(void) {
+  _closing.clear();
+  for (size_t fd = 0; fd < _connections.size(); fd++) {
+    _Socket_Conn_t* conn = _connections[fd];
+    if (conn) {
+      conn->isClosing = true;
+      _socket_server_close_conn(conn);
+    }
+  }
+  _connections.clear();
+  _sendQueue.clear();
+  if (_listenFd >= 0) {
+    close(_listenFd);
+    _listenFd = -1;
+  }
+  if (_socket_server_is_uring() && _ring.fd >= 0) {
+    _socket_uring_close();
+  }
+  if (_epollFd >= 0) {
+    close(_epollFd);
+    _epollFd = -1;
+  }
+}
+
+void socket_server_get_stats(socket_server_stats_t* stats) {
+  pthread_mutex_lock(&_statsLock);
+  *stats = _publishedStats;
+  pthread_mutex_unlock(&_statsLock);
+}
+
+#ifdef __cplusplus
+}
+#endif
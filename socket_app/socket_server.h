@@ -0,0 +1,156 @@
+/**
+ * socket_server.h
+ *
+ * Single threaded TCP server. Every connection gets its own pending output buffer, thousands of clients
+ * are served without the FD_SETSIZE limit of select(). Two interchangeable backends:
+ *  - epoll: edge-triggered, non-blocking accept4/recv/send, one system call per operation
+ *  - io_uring: multishot accept and receive into provided buffers, sends submitted in batch, so
+ *    the whole loop iteration is one io_uring_enter(). Picked by default when the kernel supports it
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef SOCKET_SERVER_H
+#define SOCKET_SERVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SOCKET_SERVER_MAX_EVENTS        256         // epoll_wait batch
+#define SOCKET_SERVER_READ_SIZE         4096        // one recv() into the shared receive buffer
+#define SOCKET_SERVER_TX_HIGH_WATERMARK (64 * 1024) // pending output per connection before the slow consumer policy applies
+#define SOCKET_SERVER_TX_LOW_WATERMARK  (16 * 1024) // a congested connection takes messages again under it
+#define SOCKET_SERVER_MAX_STREAMS       4           // socket_server_attach(), each one owns a registered buffer
+#define SOCKET_SERVER_URING_ENTRIES     1024
+#define SOCKET_SERVER_URING_BUFFERS     1024        // provided receive buffers of SOCKET_SERVER_READ_SIZE bytes
+
+#define SOCKET_SERVER_SEND_DROPPED      1           // socket_server_send(): congested, the message was not queued
+#define SOCKET_SERVER_SENDV_MAX         4           // pieces of a socket_server_sendv() message
+
+typedef enum {
+  SOCKET_SERVER_BACKEND_AUTO,   // io_uring, epoll when the kernel does not support it
+  SOCKET_SERVER_BACKEND_EPOLL,
+  SOCKET_SERVER_BACKEND_URING,
+} socket_server_backend_t;
+
+/**
+ * @brief What happens to a client whose pending output reaches the high watermark
+ */
+typedef enum {
+  SOCKET_SERVER_SLOW_DISCONNECT, // closed
+  SOCKET_SERVER_SLOW_DROP,       // kept, its messages are dropped until the output is back under the low watermark
+} socket_server_slow_policy_t;
+
+/**
+ * @brief Bytes received on a connection, `data` is only valid during the call
+ */
+typedef void (*socket_server_rx_cb_t)(int connFd, const uint8_t* data, size_t size);
+
+/**
+ * @brief A connection was accepted (isConnected) or closed
+ */
+typedef void (*socket_server_conn_cb_t)(int connFd, bool isConnected);
+
+typedef struct {
+  uint64_t accepted;
+  uint64_t closed;
+  uint64_t dropped;         // slow consumers closed by the server
+  uint32_t congested;       // connections over the high watermark, not back under the low one yet
+  uint64_t congestions;     // times a connection reached the high watermark
+  uint64_t droppedMessages; // refused by socket_server_send() while congested
+  uint64_t droppedBytes;
+  uint32_t active;
+  uint32_t peakActive;
+  uint64_t rxBytes;
+  uint64_t txBytes;
+  uint64_t wakeups;         // epoll_wait returns with at least one event
+  uint64_t events;          // epoll events or io_uring completions
+  uint64_t syscalls;        // made by the loop, accept to close
+} socket_server_stats_t;
+
+/**
+ * @brief Raises RLIMIT_NOFILE to its hard limit
+ * @return the new soft limit
+ */
+uint32_t socket_server_raise_fd_limit(void);
+
+/**
+ * @brief Backend of the next socket_server_open()
+ */
+void socket_server_set_backend(socket_server_backend_t backend);
+
+/**
+ * @brief The backend in use, never AUTO once opened
+ */
+socket_server_backend_t socket_server_get_backend(void);
+
+const char* socket_server_backend_name(socket_server_backend_t backend);
+
+/**
+ * @brief Slow consumer policy and pending output watermarks (bytes) of the clients, attached streams always drop
+ */
+void socket_server_set_backpressure(socket_server_slow_policy_t policy, size_t highWatermark, size_t lowWatermark);
+
+/**
+ * @brief Binds INADDR_ANY:port and starts listening
+ * @return 0 on success, -1 otherwise
+ */
+int socket_server_open(uint16_t port, int backlog, socket_server_rx_cb_t rxCb, socket_server_conn_cb_t connCb);
+
+/**
+ * @brief Waits up to timeoutMs (-1 forever) for events and handles them: accepts, reads, flushes pending output
+ * @return number of events handled, -1 on error
+ */
+int socket_server_poll(int timeoutMs);
+
+/**
+ * @brief Writes to a connection, what the socket does not take now is kept and flushed when it is writable.
+ * Messages are never split: a congested connection refuses the whole message or gets closed
+ * @return 0 on success, SOCKET_SERVER_SEND_DROPPED if the message was refused, -1 if the connection is
+ * unknown or got closed
+ */
+int socket_server_send(int connFd, const void* data, size_t size);
+
+/**
+ * @brief socket_server_send() of a message in up to SOCKET_SERVER_SENDV_MAX pieces, e.g. a header and a payload
+ * sent without copying them together first. One writev/sendmsg, only what the socket does not take is copied
+ */
+int socket_server_sendv(int connFd, const struct iovec* iov, int count);
+
+/**
+ * @brief Over the high watermark and not back under the low one: producers can skip what is not essential
+ */
+bool socket_server_is_congested(int connFd);
+
+void socket_server_disconnect(int connFd);
+
+/**
+ * @brief Serves another non-blocking file descriptor (e.g. a serial port) from the same loop: received bytes
+ * go to rxCb, socket_server_send() writes to it. The server never closes it, closeCb is called when it fails
+ * @return 0 on success, -1 otherwise
+ */
+int socket_server_attach(int fd, socket_server_rx_cb_t rxCb, socket_server_conn_cb_t closeCb);
+
+void socket_server_detach(int fd);
+
+/**
+ * @brief Closes every connection and the listening socket
+ */
+void socket_server_close(void);
+
+/**
+ * @brief Snapshot of the counters, safe to call from another thread (e.g. the CLI)
+ */
+void socket_server_get_stats(socket_server_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SOCKET_SERVER_H
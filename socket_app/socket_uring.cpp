@@ -0,0 +1,228 @@
+/**
+ * socket_uring.cpp
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "socket_uring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROBE_OPS_COUNT       256
+
+static int _socket_uring_setup(uint32_t entries, struct io_uring_params* params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int _socket_uring_register(int fd, unsigned opcode, const void* arg, unsigned nrArgs) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+/**
+ * @brief Multishot receive came with the same kernel (6.0) as IORING_OP_SEND_ZC, the probe only knows opcodes
+ */
+static bool _socket_uring_has_multishot_recv(int fd) {
+  size_t probeSize = sizeof(struct io_uring_probe) + PROBE_OPS_COUNT * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, probeSize);
+  bool isSupported = false;
+  if (probe && _socket_uring_register(fd, IORING_REGISTER_PROBE, probe, PROBE_OPS_COUNT) == 0) {
+    isSupported = probe->last_op >= IORING_OP_SEND_ZC && (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+  }
+  free(probe);
+  return isSupported;
+}
+
+int socket_uring_init(socket_uring_t* ring, uint32_t entries) {
+  memset(ring, 0, sizeof(*ring));
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CLAMP;
+  params.cq_entries = entries * 4; // multishot operations complete many times per submission
+  params.flags |= IORING_SETUP_CQSIZE;
+  ring->fd = _socket_uring_setup(entries, &params);
+  if (ring->fd < 0) {
+    return -errno;
+  }
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG) ||
+      !_socket_uring_has_multishot_recv(ring->fd)) {
+    close(ring->fd);
+    return -EOPNOTSUPP;
+  }
+  size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ring->ringSize = sqSize > cqSize ? sqSize : cqSize;
+  ring->ringMemory = mmap(NULL, ring->ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                          ring->fd, IORING_OFF_SQES);
+  if (ring->ringMemory == MAP_FAILED || ring->sqes == MAP_FAILED) {
+    int error = errno;
+    socket_uring_exit(ring);
+    return -error;
+  }
+  uint8_t* base = (uint8_t*)ring->ringMemory;
+  ring->sqEntries = params.sq_entries;
+  ring->sqHead = (uint32_t*)(base + params.sq_off.head);
+  ring->sqTail = (uint32_t*)(base + params.sq_off.tail);
+  ring->sqMask = (uint32_t*)(base + params.sq_off.ring_mask);
+  ring->sqArray = (uint32_t*)(base + params.sq_off.array);
+  ring->cqHead = (uint32_t*)(base + params.cq_off.head);
+  ring->cqTail = (uint32_t*)(base + params.cq_off.tail);
+  ring->cqMask = (uint32_t*)(base + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+  for (uint32_t i = 0; i < ring->sqEntries; i++) {
+    ring->sqArray[i] = i; // SQE i always sits in slot i
+  }
+  ring->sqeTail = *ring->sqTail;
+  return 0;
+}
+
+void socket_uring_exit(socket_uring_t* ring) {
+  free(ring->buffers);
+  free(ring->recyclePending);
+  if (ring->sqes && ring->sqes != MAP_FAILED) {
+    munmap(ring->sqes, ring->sqesSize);
+  }
+  if (ring->ringMemory && ring->ringMemory != MAP_FAILED) {
+    munmap(ring->ringMemory, ring->ringSize);
+  }
+  if (ring->fd >= 0) {
+    close(ring->fd);
+  }
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
+
+struct io_uring_sqe* socket_uring_get_sqe(socket_uring_t* ring) {
+  if (ring->sqeTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries) {
+    socket_uring_enter(ring, 0, 0);
+    if (ring->sqeTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries) {
+      return NULL;
+    }
+  }
+  struct io_uring_sqe* sqe = &ring->sqes[ring->sqeTail & *ring->sqMask];
+  ring->sqeTail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int socket_uring_enter(socket_uring_t* ring, uint32_t minComplete, int timeoutMs) {
+  uint32_t toSubmit = ring->sqeTail - *ring->sqTail;
+  __atomic_store_n(ring->sqTail, ring->sqeTail, __ATOMIC_RELEASE);
+  if (!toSubmit && !minComplete) {
+    return 0;
+  }
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  arg.sigmask_sz = _NSIG / 8;
+  unsigned flags = 0;
+  if (minComplete) {
+    flags |= IORING_ENTER_GETEVENTS;
+    if (timeoutMs >= 0) {
+      ts.tv_sec = timeoutMs / 1000;
+      ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+      arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+  }
+  flags |= IORING_ENTER_EXT_ARG;
+  ring->enterCalls++;
+  int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, toSubmit, minComplete, flags, &arg, sizeof(arg));
+  if (submitted < 0) {
+    return errno == ETIME || errno == EINTR ? 0 : -errno;
+  }
+  return submitted;
+}
+
+struct io_uring_cqe* socket_uring_peek_cqe(socket_uring_t* ring) {
+  uint32_t head = *ring->cqHead;
+  if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &ring->cqes[head & *ring->cqMask];
+}
+
+void socket_uring_cqe_seen(socket_uring_t* ring) {
+  __atomic_store_n(ring->cqHead, *ring->cqHead + 1, __ATOMIC_RELEASE);
+}
+
+int socket_uring_register_buffers(socket_uring_t* ring, const struct iovec* iovecs, uint32_t count) {
+  return _socket_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iovecs, count) < 0 ? -errno : 0;
+}
+
+static void _socket_uring_prep_provide(struct io_uring_sqe* sqe, socket_uring_t* ring, uint16_t bufferId, uint32_t count) {
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = (int)count;
+  sqe->addr = (uint64_t)(uintptr_t)socket_uring_buf(ring, bufferId);
+  sqe->len = ring->bufferSize;
+  sqe->off = bufferId;
+  sqe->buf_group = ring->bufferGroup;
+}
+
+int socket_uring_provide_buffers(socket_uring_t* ring, uint16_t groupId, uint32_t count, uint32_t size) {
+  ring->buffers = (uint8_t*)malloc((size_t)count * size);
+  ring->recyclePending = (uint16_t*)malloc(count * sizeof(uint16_t));
+  if (!ring->buffers || !ring->recyclePending) {
+    return -ENOMEM; // freed by socket_uring_exit()
+  }
+  ring->bufferCount = count;
+  ring->bufferSize = size;
+  ring->bufferGroup = groupId;
+  struct io_uring_sqe* sqe = socket_uring_get_sqe(ring);
+  if (!sqe) {
+    return -EBUSY;
+  }
+  _socket_uring_prep_provide(sqe, ring, 0, count);
+  int rv = socket_uring_enter(ring, 1, -1);
+  struct io_uring_cqe* cqe = socket_uring_peek_cqe(ring);
+  if (rv < 0 || !cqe) {
+    return rv < 0 ? rv : -EIO;
+  }
+  rv = cqe->res < 0 ? cqe->res : 0;
+  socket_uring_cqe_seen(ring);
+  return rv;
+}
+
+uint8_t* socket_uring_buf(socket_uring_t* ring, uint16_t bufferId) {
+  return ring->buffers + (size_t)bufferId * ring->bufferSize;
+}
+
+static bool _socket_uring_buf_provide(socket_uring_t* ring, uint16_t bufferId) {
+  struct io_uring_sqe* sqe = socket_uring_get_sqe(ring);
+  if (!sqe) {
+    return false; // still full after submitting: the kernel has not consumed the entries yet
+  }
+  _socket_uring_prep_provide(sqe, ring, bufferId, 1);
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  return true;
+}
+
+void socket_uring_buf_recycle(socket_uring_t* ring, uint16_t bufferId) {
+  if (ring->recyclePendingCount || !_socket_uring_buf_provide(ring, bufferId)) {
+    ring->recyclePending[ring->recyclePendingCount++] = bufferId; // each buffer is pending at most once
+  }
+}
+
+void socket_uring_buf_recycle_pending(socket_uring_t* ring) {
+  uint32_t provided = 0;
+  while (provided < ring->recyclePendingCount && _socket_uring_buf_provide(ring, ring->recyclePending[provided])) {
+    provided++;
+  }
+  ring->recyclePendingCount -= provided;
+  memmove(ring->recyclePending, ring->recyclePending + provided, ring->recyclePendingCount * sizeof(uint16_t));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,105 @@
+/**
+ * socket_uring.h
+ *
+ * Thin io_uring wrapper on the raw system calls (no liburing): the submission/completion rings, fixed
+ * buffers and a group of provided buffers for multishot receive. Used by the io_uring backend of socket_server.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef SOCKET_URING_H
+#define SOCKET_URING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  int fd;
+  uint32_t sqEntries;
+  uint32_t* sqHead;
+  uint32_t* sqTail;
+  uint32_t* sqMask;
+  uint32_t* sqArray;
+  struct io_uring_sqe* sqes;
+  uint32_t sqeTail;         // SQEs handed out, published to the kernel by socket_uring_enter()
+  uint32_t* cqHead;
+  uint32_t* cqTail;
+  uint32_t* cqMask;
+  struct io_uring_cqe* cqes;
+  void* ringMemory;
+  size_t ringSize;
+  size_t sqesSize;
+  uint8_t* buffers;         // provided buffers, bufferCount * bufferSize bytes
+  uint32_t bufferCount;
+  uint32_t bufferSize;
+  uint16_t bufferGroup;
+  uint16_t* recyclePending; // buffers socket_uring_buf_recycle() found no free SQE for, bufferCount entries
+  uint32_t recyclePendingCount;
+  uint64_t enterCalls;
+} socket_uring_t;
+
+/**
+ * @brief Sets up the rings. Fails when the kernel lacks what the backend relies on (single mmap, wait with
+ * a timeout, multishot receive), the caller then falls back to epoll
+ * @return 0 on success, -errno otherwise
+ */
+int socket_uring_init(socket_uring_t* ring, uint32_t entries);
+
+void socket_uring_exit(socket_uring_t* ring);
+
+/**
+ * @brief Next free submission entry, zeroed. Submits what is queued when the ring is full
+ */
+struct io_uring_sqe* socket_uring_get_sqe(socket_uring_t* ring);
+
+/**
+ * @brief Submits the queued entries and waits up to timeoutMs (-1 forever) for minComplete completions
+ * @return number of entries submitted, -errno on error (a timeout is not an error)
+ */
+int socket_uring_enter(socket_uring_t* ring, uint32_t minComplete, int timeoutMs);
+
+/**
+ * @brief Next completion, NULL when there is none. Release it with socket_uring_cqe_seen()
+ */
+struct io_uring_cqe* socket_uring_peek_cqe(socket_uring_t* ring);
+
+void socket_uring_cqe_seen(socket_uring_t* ring);
+
+/**
+ * @brief Registers buffers for IORING_OP_READ_FIXED/WRITE_FIXED, indexes follow the iovec order
+ */
+int socket_uring_register_buffers(socket_uring_t* ring, const struct iovec* iovecs, uint32_t count);
+
+/**
+ * @brief Allocates `count` buffers of `size` bytes and provides them as group `groupId` for IOSQE_BUFFER_SELECT
+ * receives. IORING_OP_PROVIDE_BUFFERS rather than a registered buffer ring: the ring kept failing the
+ * selection with ENOBUFS on the kernels tried, the legacy group works everywhere multishot receive does
+ * @return 0 on success, -errno otherwise
+ */
+int socket_uring_provide_buffers(socket_uring_t* ring, uint16_t groupId, uint32_t count, uint32_t size);
+
+uint8_t* socket_uring_buf(socket_uring_t* ring, uint16_t bufferId);
+
+/**
+ * @brief Gives a buffer back to the group once its data has been consumed. Queued, it goes with the next
+ * socket_uring_enter() and completes silently. When the submission ring is full even after submitting, the
+ * buffer is put aside for socket_uring_buf_recycle_pending()
+ */
+void socket_uring_buf_recycle(socket_uring_t* ring, uint16_t bufferId);
+
+/**
+ * @brief Queues the buffers put aside by socket_uring_buf_recycle(), call it before each socket_uring_enter()
+ */
+void socket_uring_buf_recycle_pending(socket_uring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SOCKET_URING_H
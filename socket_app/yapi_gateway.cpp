@@ -0,0 +1,556 @@
+/**
+ * yapi_gateway.cpp
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <vector>
+
+#include "yapi_gateway.h"
+#include "socket_server.h"
+#include "yapi_service.h"
+#include "yapi_service_driver.h"
+#include "yapi_subscription.h"
+#include "uart.h"
+#include "gz_hash.h"
+#include "gz_log.h"
+#include "gz_trace.h"
+#include "gz_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YAPI_MSG_CLASS_MASK         0x0F // GET/SET/SUB
+#define YAPI_MSG_RESP_BITS          0x30 // RESP_OK/RESP_ERR
+#define YAPI_CRC_LENGTH             2
+#define CLIENT_BUFFER_SIZE          (2 * sizeof(yapi_packet_t)) // a partial frame plus what completes it
+#define FRAME_MIN_SIZE              (YAPI_HEADER_LENGTH + YAPI_CRC_LENGTH)
+#define FRAME_MAX_SIZE              (YAPI_HEADER_LENGTH + YAPI_DATA_SIZE + YAPI_CRC_LENGTH)
+
+typedef struct _Yapi_Gateway_Pending {
+  int connFd;
+  uint8_t deviceId;         // target of the request, sender of its response
+  uint8_t senderId;
+  uint8_t command;
+  uint8_t messageClass;
+  uint64_t deadline_ms;
+  struct _Yapi_Gateway_Pending* prev;
+  struct _Yapi_Gateway_Pending* next;
+} _Yapi_Gateway_Pending_t;
+
+typedef struct {
+  int connFd;
+  uint8_t deviceId;
+  uint8_t command;
+  uint8_t senderId;         // of the client's SUB request, used to disable the device stream
+  uint8_t priority;
+} _Yapi_Gateway_Sub_t;
+
+typedef struct {
+  uint8_t buffer[CLIENT_BUFFER_SIZE]; // reassembly of a frame split between two reads
+  size_t fill;
+} _Yapi_Gateway_Client_t;
+
+typedef void (*_Yapi_Gateway_Frame_cb_t)(int connFd, const yapi_packet_t* frame, uint16_t size);
+
+static int _uartFd = -1;
+static bool _isFramed = false;
+static uint8_t _uartBuffer[YAPI_GATEWAY_UART_BUFFER_SIZE]; // frames split between two reads
+static size_t _uartFill = 0;
+static std::vector<_Yapi_Gateway_Client_t*> _clients; // indexed by connection fd
+static _Yapi_Gateway_Pending_t* _pendingHead = NULL; // oldest first
+static _Yapi_Gateway_Pending_t* _pendingTail = NULL;
+static uint32_t _pendingCount = 0;
+// Per request and per connection blocks come from static pools, no heap traffic while serving
+static gz_pool_t _pendingPool;
+static uint8_t _pendingPoolBuffer[GZ_POOL_BUFFER_SIZE(sizeof(_Yapi_Gateway_Pending_t), YAPI_GATEWAY_MAX_PENDING)]
+  __attribute__((aligned(GZ_POOL_ALIGNMENT)));
+static gz_pool_t _clientPool;
+static uint8_t _clientPoolBuffer[GZ_POOL_BUFFER_SIZE(sizeof(_Yapi_Gateway_Client_t), YAPI_GATEWAY_CLIENT_POOL_BLOCKS)]
+  __attribute__((aligned(GZ_POOL_ALIGNMENT)));
+static bool _isPoolReady = false;
+static std::vector<_Yapi_Gateway_Sub_t> _subscriptions;
+static yapi_gateway_stats_t _stats;
+static yapi_gateway_stats_t _publishedStats;
+static pthread_mutex_t _statsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t _yapi_gateway_now_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void _yapi_gateway_pending_remove(_Yapi_Gateway_Pending_t* pending) {
+  if (pending->prev) {
+    pending->prev->next = pending->next;
+  } else {
+    _pendingHead = pending->next;
+  }
+  if (pending->next) {
+    pending->next->prev = pending->prev;
+  } else {
+    _pendingTail = pending->prev;
+  }
+  _pendingCount--;
+  gz_pool_free(&_pendingPool, pending);
+}
+
+/**
+ * @brief Finds the valid frames of data, in place, and hands them to frameCb
+ * @return bytes consumed, what is left is the beginning of a frame
+ */
+static size_t _yapi_gateway_scan(const uint8_t* data, size_t size, int connFd, _Yapi_Gateway_Frame_cb_t frameCb) {
+  size_t i = 0;
+  while (i < size) {
+    if (data[i] != YAPI_START_BYTE) {
+      i++;
+      continue;
+    }
+    if (size - i < 2) {
+      break;
+    }
+    if (data[i + 1] != YAPI_START_BYTE) {
+      i++;
+      continue;
+    }
+    if (size - i <= YAPI_LENGTH_IDX) {
+      break;
+    }
+    uint8_t length = data[i + YAPI_LENGTH_IDX];
+    if (length > YAPI_DATA_SIZE) {
+      _stats.invalidFrames++;
+      i++;
+      continue;
+    }
+    uint16_t frameSize = YAPI_HEADER_LENGTH + length + YAPI_CRC_LENGTH;
+    if (size - i < frameSize) {
+      break;
+    }
+    uint16_t crc = data[i + YAPI_HEADER_LENGTH + length] | (data[i + YAPI_HEADER_LENGTH + length + 1] << 8);
+    if (crc != gz_crc16(&data[i], YAPI_HEADER_LENGTH + length)) {
+      _stats.invalidFrames++;
+      i++; // resynchronize on the next start signal
+      continue;
+    }
+    frameCb(connFd, (const yapi_packet_t*)&data[i], frameSize);
+    i += frameSize;
+  }
+  return i;
+}
+
+/**
+ * @brief A length-prefixed message holds exactly one valid frame
+ */
+static bool _yapi_gateway_is_frame(const uint8_t* data, size_t size) {
+  if (size < FRAME_MIN_SIZE || data[0] != YAPI_START_BYTE || data[1] != YAPI_START_BYTE) {
+    return false;
+  }
+  size_t frameSize = (size_t)YAPI_HEADER_LENGTH + data[YAPI_LENGTH_IDX] + YAPI_CRC_LENGTH;
+  if (size != frameSize) {
+    return false;
+  }
+  uint16_t length = size - YAPI_CRC_LENGTH;
+  return (data[length] | (data[length + 1] << 8)) == gz_crc16(data, length);
+}
+
+/**
+ * @brief gz_trace record of a frame going through fd, the record is only built while a trace is open
+ */
+static void _yapi_gateway_trace(yapi_trace_event_t event, int fd, const void* frame) {
+  if (gz_trace_is_open()) {
+    yapi_service_driver_trace_frame(event, (uint16_t)fd, (const yapi_packet_t*)frame);
+  }
+}
+
+/**
+ * @brief Traces a socket_server_send() of a frame by its outcome
+ */
+static void _yapi_gateway_trace_send(int rv, int fd, const void* frame) {
+  yapi_trace_event_t event = YAPI_TRACE_TX;
+  if (rv == SOCKET_SERVER_SEND_DROPPED) {
+    event = YAPI_TRACE_TX_DROPPED;
+  } else if (rv) {
+    event = YAPI_TRACE_TX_FAILED;
+  }
+  _yapi_gateway_trace(event, fd, frame);
+}
+
+/**
+ * @brief To a client, behind its length prefix in framed mode. A congested client misses the frame
+ */
+static int _yapi_gateway_client_send(int connFd, const void* frame, uint16_t size) {
+  int rv;
+  if (_isFramed) {
+    uint8_t prefix[YAPI_GATEWAY_FRAME_PREFIX_SIZE] = { (uint8_t)(size & 0xFF), (uint8_t)(size >> 8) };
+    struct iovec message[2] = { { prefix, sizeof(prefix) }, { (void*)frame, size } };
+    rv = socket_server_sendv(connFd, message, 2);
+  } else {
+    rv = socket_server_send(connFd, frame, size);
+  }
+  if (rv == SOCKET_SERVER_SEND_DROPPED) {
+    _stats.droppedFrames++;
+  }
+  _yapi_gateway_trace_send(rv, connFd, frame);
+  return rv;
+}
+
+static bool _yapi_gateway_is_subscribed(int connFd, uint8_t deviceId, uint8_t command) {
+  for (size_t i = 0; i < _subscriptions.size(); i++) {
+    const _Yapi_Gateway_Sub_t& sub = _subscriptions[i];
+    if (sub.connFd == connFd && sub.deviceId == deviceId && sub.command == command) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint32_t _yapi_gateway_subscriber_count(uint8_t deviceId, uint8_t command) {
+  uint32_t count = 0;
+  for (size_t i = 0; i < _subscriptions.size(); i++) {
+    count += _subscriptions[i].deviceId == deviceId && _subscriptions[i].command == command;
+  }
+  return count;
+}
+
+/**
+ * @brief The last subscriber left: asks the device to stop the stream, nobody waits for the response
+ */
+static void _yapi_gateway_disable_stream(const _Yapi_Gateway_Sub_t& sub) {
+  yapi_subscription_request_t request = { 0, 0 };
+  yapi_packet_t pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  yapi_service_build_pkt(&pkt, (yapi_device_id_enum_t)sub.senderId, (yapi_device_id_enum_t)sub.deviceId,
+                         (yapi_command_enum_t)sub.command, YAPI_MSG_SUB_RQST, (yapi_message_priority_enum_t)sub.priority,
+                         NULL, (uint8_t*)&request, sizeof(request));
+  _yapi_gateway_trace_send(socket_server_send(_uartFd, &pkt, YAPI_HEADER_LENGTH + sizeof(request) + YAPI_CRC_LENGTH),
+                           _uartFd, &pkt);
+}
+
+/**
+ * @param isStreamDisabled the client's own SUB disable is on its way to the device
+ */
+static void _yapi_gateway_unsubscribe(int connFd, uint8_t deviceId, uint8_t command, bool isStreamDisabled) {
+  for (size_t i = 0; i < _subscriptions.size(); i++) {
+    _Yapi_Gateway_Sub_t sub = _subscriptions[i];
+    if (sub.connFd == connFd && sub.deviceId == deviceId && sub.command == command) {
+      _subscriptions.erase(_subscriptions.begin() + i);
+      if (!isStreamDisabled && !_yapi_gateway_subscriber_count(deviceId, command)) {
+        _yapi_gateway_disable_stream(sub);
+      }
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Answers a SUB disable the gateway keeps to itself because other clients still use the stream
+ */
+static void _yapi_gateway_answer_sub(int connFd, const yapi_packet_t* request) {
+  yapi_packet_t pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  yapi_service_build_pkt(&pkt, (yapi_device_id_enum_t)request->targetId, (yapi_device_id_enum_t)request->senderId,
+                         (yapi_command_enum_t)request->command, YAPI_MSG_SUB_RESP_OK,
+                         (yapi_message_priority_enum_t)request->messageData.priority, NULL, NULL, 0);
+  _yapi_gateway_client_send(connFd, &pkt, YAPI_HEADER_LENGTH + YAPI_CRC_LENGTH);
+}
+
+/**
+ * @brief A valid frame from a client: remembered for the response routing, then queued to the port
+ */
+static void _yapi_gateway_client_frame(int connFd, const yapi_packet_t* frame, uint16_t size) {
+  _stats.clientFrames++;
+  _yapi_gateway_trace(YAPI_TRACE_RX, connFd, frame);
+  uint8_t type = frame->messageData.type;
+  bool isRequest = !(type & YAPI_MSG_RESP_BITS);
+  if (isRequest && type == YAPI_MSG_SUB_RQST) {
+    bool isEnable = !frame->length || frame->data[0];
+    if (isEnable) {
+      if (!_yapi_gateway_is_subscribed(connFd, frame->targetId, frame->command)) {
+        _Yapi_Gateway_Sub_t sub = { connFd, frame->targetId, frame->command, frame->senderId, frame->messageData.priority };
+        _subscriptions.push_back(sub);
+      }
+    } else if (_yapi_gateway_subscriber_count(frame->targetId, frame->command) > 1) {
+      _yapi_gateway_unsubscribe(connFd, frame->targetId, frame->command, false);
+      _yapi_gateway_answer_sub(connFd, frame);
+      return;
+    } else {
+      _yapi_gateway_unsubscribe(connFd, frame->targetId, frame->command, true);
+    }
+  }
+  if (isRequest) {
+    if (_pendingCount == YAPI_GATEWAY_MAX_PENDING) {
+      _yapi_gateway_pending_remove(_pendingHead);
+      _stats.expiredRequests++;
+    }
+    _Yapi_Gateway_Pending_t* pending = (_Yapi_Gateway_Pending_t*)gz_pool_alloc(&_pendingPool);
+    if (pending) { // the pool holds YAPI_GATEWAY_MAX_PENDING
+      pending->connFd = connFd;
+      pending->deviceId = frame->targetId;
+      pending->senderId = frame->senderId;
+      pending->command = frame->command;
+      pending->messageClass = type & YAPI_MSG_CLASS_MASK;
+      pending->deadline_ms = _yapi_gateway_now_ms() + YAPI_GATEWAY_PENDING_TIMEOUT_MS;
+      pending->prev = _pendingTail;
+      pending->next = NULL;
+      if (_pendingTail) {
+        _pendingTail->next = pending;
+      } else {
+        _pendingHead = pending;
+      }
+      _pendingTail = pending;
+      _pendingCount++;
+    }
+  }
+  int rv = socket_server_send(_uartFd, frame, size);
+  if (rv != 0) {
+    _stats.uartQueueFull++;
+  }
+  _yapi_gateway_trace_send(rv, _uartFd, frame);
+}
+
+/**
+ * @brief A valid frame from the port, still in the UART buffer: sent as is to the clients it is for
+ */
+static void _yapi_gateway_uart_frame(int connFd, const yapi_packet_t* frame, uint16_t size) {
+  _stats.uartFrames++;
+  _yapi_gateway_trace(YAPI_TRACE_RX, _uartFd, frame);
+  uint8_t type = frame->messageData.type;
+  if (type == YAPI_MSG_UNSOLICITED) {
+    for (size_t i = 0; i < _subscriptions.size(); i++) {
+      const _Yapi_Gateway_Sub_t& sub = _subscriptions[i];
+      if (sub.deviceId == frame->senderId && sub.command == frame->command &&
+          _yapi_gateway_client_send(sub.connFd, frame, size) == 0) {
+        _stats.unsolicitedFanout++;
+      }
+    }
+    return;
+  }
+  if (!(type & YAPI_MSG_RESP_BITS)) {
+    _stats.unroutedResponses++; // a device request, there is no host side to answer it
+    return;
+  }
+  for (_Yapi_Gateway_Pending_t* it = _pendingHead; it; it = it->next) {
+    if (it->deviceId == frame->senderId && it->senderId == frame->targetId && it->command == frame->command &&
+        it->messageClass == (type & YAPI_MSG_CLASS_MASK)) {
+      _yapi_gateway_client_send(it->connFd, frame, size);
+      _yapi_gateway_pending_remove(it);
+      _stats.routedResponses++;
+      return;
+    }
+  }
+  _stats.unroutedResponses++;
+}
+
+/**
+ * @brief Bytes read from the port by the socket server loop, same reassembly as the clients
+ */
+static void _yapi_gateway_uart_rx(int fd, const uint8_t* data, size_t size) {
+  while (size) {
+    if (!_uartFill) {
+      size_t used = _yapi_gateway_scan(data, size, -1, _yapi_gateway_uart_frame);
+      memcpy(_uartBuffer, data + used, size - used); // less than a frame
+      _uartFill = size - used;
+      return;
+    }
+    size_t take = sizeof(_uartBuffer) - _uartFill < size ? sizeof(_uartBuffer) - _uartFill : size;
+    memcpy(_uartBuffer + _uartFill, data, take);
+    _uartFill += take;
+    data += take;
+    size -= take;
+    size_t used = _yapi_gateway_scan(_uartBuffer, _uartFill, -1, _yapi_gateway_uart_frame);
+    memmove(_uartBuffer, _uartBuffer + used, _uartFill - used);
+    _uartFill -= used;
+  }
+}
+
+static void _yapi_gateway_uart_closed(int fd, bool isConnected) {
+  GZ_LOG_ERROR("Serial port fd[%d] failed\n", fd);
+  uart_disconnect(fd);
+  _uartFd = -1;
+}
+
+int yapi_gateway_open(const char* device, int baudRate) {
+  if (!_isPoolReady) {
+    gz_pool_init(&_pendingPool, sizeof(_Yapi_Gateway_Pending_t), YAPI_GATEWAY_MAX_PENDING, _pendingPoolBuffer,
+                 GZ_POOL_FLAG_NONE);
+    gz_pool_init(&_clientPool, sizeof(_Yapi_Gateway_Client_t), YAPI_GATEWAY_CLIENT_POOL_BLOCKS, _clientPoolBuffer,
+                 GZ_POOL_FLAG_NONE);
+    _isPoolReady = true;
+  }
+  char deviceName[64];
+  snprintf(deviceName, sizeof(deviceName), "%s", device);
+  _uartFd = uart_connect(deviceName, baudRate);
+  if (_uartFd < 0) {
+    return -1;
+  }
+  if (socket_server_attach(_uartFd, _yapi_gateway_uart_rx, _yapi_gateway_uart_closed) < 0) {
+    uart_disconnect(_uartFd);
+    _uartFd = -1;
+    return -1;
+  }
+  memset(&_stats, 0, sizeof(_stats));
+  _uartFill = 0;
+  return 0;
+}
+
+void yapi_gateway_close(void) {
+  if (_uartFd >= 0) {
+    socket_server_detach(_uartFd);
+    uart_disconnect(_uartFd);
+    _uartFd = -1;
+  }
+}
+
+void yapi_gateway_set_framing(bool isFramed) {
+  _isFramed = isFramed;
+}
+
+bool yapi_gateway_is_open(void) {
+  return _uartFd >= 0;
+}
+
+/**
+ * @brief Length-prefixed messages: complete ones are handled in the receive buffer, the rest is reassembled
+ */
+static void _yapi_gateway_client_rx_framed(int connFd, _Yapi_Gateway_Client_t* client, const uint8_t* data, size_t size) {
+  while (size) {
+    const uint8_t* prefix = client->fill ? client->buffer : data;
+    size_t available = client->fill ? client->fill : size;
+    if (available < YAPI_GATEWAY_FRAME_PREFIX_SIZE) {
+      size_t take = YAPI_GATEWAY_FRAME_PREFIX_SIZE - client->fill < size ? YAPI_GATEWAY_FRAME_PREFIX_SIZE - client->fill : size;
+      memcpy(client->buffer + client->fill, data, take);
+      client->fill += take;
+      data += take;
+      size -= take;
+      continue;
+    }
+    uint16_t length = prefix[0] | (prefix[1] << 8);
+    if (length < FRAME_MIN_SIZE || length > FRAME_MAX_SIZE) {
+      GZ_LOG_ERROR("Client fd[%d]: bad message length %u, disconnecting\n", connFd, length);
+      _stats.framingErrors++;
+      client->fill = 0;
+      socket_server_disconnect(connFd);
+      return;
+    }
+    size_t messageSize = YAPI_GATEWAY_FRAME_PREFIX_SIZE + length;
+    const uint8_t* message = data;
+    if (!client->fill && size >= messageSize) {
+      data += messageSize; // complete in the receive buffer, no copy
+      size -= messageSize;
+    } else {
+      size_t take = messageSize - client->fill < size ? messageSize - client->fill : size;
+      memcpy(client->buffer + client->fill, data, take);
+      client->fill += take;
+      data += take;
+      size -= take;
+      if (client->fill < messageSize) {
+        return;
+      }
+      message = client->buffer;
+      client->fill = 0;
+    }
+    if (_yapi_gateway_is_frame(message + YAPI_GATEWAY_FRAME_PREFIX_SIZE, length)) {
+      _yapi_gateway_client_frame(connFd, (const yapi_packet_t*)(message + YAPI_GATEWAY_FRAME_PREFIX_SIZE), length);
+    } else {
+      _stats.invalidFrames++;
+    }
+  }
+}
+
+void yapi_gateway_client_rx(int connFd, const uint8_t* data, size_t size) {
+  if (connFd < 0 || (size_t)connFd >= _clients.size() || !_clients[connFd]) {
+    return;
+  }
+  _Yapi_Gateway_Client_t* client = _clients[connFd];
+  if (_isFramed) {
+    _yapi_gateway_client_rx_framed(connFd, client, data, size);
+    return;
+  }
+  while (size) {
+    if (!client->fill) { // frames not split between reads are handled in the receive buffer
+      size_t used = _yapi_gateway_scan(data, size, connFd, _yapi_gateway_client_frame);
+      memcpy(client->buffer, data + used, size - used); // less than a frame
+      client->fill = size - used;
+      return;
+    }
+    size_t take = sizeof(client->buffer) - client->fill < size ? sizeof(client->buffer) - client->fill : size;
+    memcpy(client->buffer + client->fill, data, take);
+    client->fill += take;
+    data += take;
+    size -= take;
+    size_t used = _yapi_gateway_scan(client->buffer, client->fill, connFd, _yapi_gateway_client_frame);
+    memmove(client->buffer, client->buffer + used, client->fill - used);
+    client->fill -= used;
+  }
+}
+
+void yapi_gateway_client_conn(int connFd, bool isConnected) {
+  if ((size_t)connFd >= _clients.size()) {
+    _clients.resize(connFd + 1, NULL);
+  }
+  if (isConnected) {
+    _Yapi_Gateway_Client_t* client = (_Yapi_Gateway_Client_t*)gz_pool_alloc(&_clientPool);
+    if (client) {
+      client->fill = 0;
+    } else {
+      client = (_Yapi_Gateway_Client_t*)calloc(1, sizeof(_Yapi_Gateway_Client_t));
+    }
+    _clients[connFd] = client;
+    return;
+  }
+  if (gz_pool_owns(&_clientPool, _clients[connFd])) {
+    gz_pool_free(&_clientPool, _clients[connFd]);
+  } else {
+    free(_clients[connFd]);
+  }
+  _clients[connFd] = NULL;
+  for (_Yapi_Gateway_Pending_t* it = _pendingHead; it;) {
+    _Yapi_Gateway_Pending_t* next = it->next;
+    if (it->connFd == connFd) {
+      _yapi_gateway_pending_remove(it);
+    }
+    it = next;
+  }
+  for (size_t i = _subscriptions.size(); i-- > 0;) {
+    if (_subscriptions[i].connFd == connFd) {
+      _yapi_gateway_unsubscribe(connFd, _subscriptions[i].deviceId, _subscriptions[i].command, false);
+    }
+  }
+}
+
+void yapi_gateway_task(void) {
+  uint64_t now_ms = _yapi_gateway_now_ms();
+  while (_pendingHead && _pendingHead->deadline_ms <= now_ms) {
+    _yapi_gateway_pending_remove(_pendingHead);
+    _stats.expiredRequests++;
+  }
+  _stats.subscriptions = _subscriptions.size();
+  _stats.pendingRequests = _pendingCount;
+  gz_pool_stats_t pool;
+  gz_pool_get_stats(&_pendingPool, &pool);
+  _stats.pendingHighWater = pool.high_water;
+  gz_pool_get_stats(&_clientPool, &pool);
+  _stats.clientPoolUsed = pool.used;
+  _stats.clientPoolHighWater = pool.high_water;
+  _stats.clientPoolFailures = pool.failures;
+  pthread_mutex_lock(&_statsLock);
+  _publishedStats = _stats;
+  pthread_mutex_unlock(&_statsLock);
+}
+
+void yapi_gateway_get_stats(yapi_gateway_stats_t* stats) {
+  pthread_mutex_lock(&_statsLock);
+  *stats = _publishedStats;
+  pthread_mutex_unlock(&_statsLock);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,93 @@
+/**
+ * yapi_gateway.h
+ *
+ * TCP to UART YAPI gateway: every TCP client of the socket server talks YAPI frames to the devices behind
+ * the serial port, as if it were connected to the port itself.
+ *
+ *  - client frames are validated (start signal, length, CRC) and queued to the port
+ *  - responses go back to the client whose request they answer: oldest pending request with the same
+ *    command and message class, sent to the response's sender by the response's target (yapi_client rules)
+ *  - UNSOLICITED frames go to every client that subscribed (SUB_RQST) to that device and command. The
+ *    device stream is disabled when its last subscriber leaves
+ *  - frames are sent to the clients straight from the UART read buffer, without an intermediate packet copy
+ *  - framed mode (yapi_gateway_set_framing()): every message, both ways, is a 2 bytes little endian length
+ *    followed by exactly one YAPI frame of that length. A client sending a length that cannot be a frame
+ *    is disconnected, nothing is resynchronized on start signals
+ *  - a client that does not keep up follows the socket server slow consumer policy: it is disconnected, or
+ *    misses frames until it catches up (socket_server_set_backpressure())
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_GATEWAY_H
+#define YAPI_GATEWAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YAPI_GATEWAY_UART_BUFFER_SIZE     4096
+#define YAPI_GATEWAY_MAX_PENDING          256   // requests waiting for their response, all clients
+#define YAPI_GATEWAY_PENDING_TIMEOUT_MS   5000
+#define YAPI_GATEWAY_FRAME_PREFIX_SIZE    2     // framed mode, length of the YAPI frame that follows
+#define YAPI_GATEWAY_CLIENT_POOL_BLOCKS   256   // client contexts taken from a static pool, the heap after that
+
+typedef struct {
+  uint64_t clientFrames;      // valid frames received from the clients
+  uint64_t invalidFrames;     // bad CRC or length, from either side
+  uint64_t uartFrames;        // valid frames received from the port
+  uint64_t routedResponses;
+  uint64_t unroutedResponses; // nobody waiting for it (timed out, client gone)
+  uint64_t unsolicitedFanout; // deliveries, one per subscribed client
+  uint64_t uartQueueFull;     // client frames dropped, the port output buffer was full
+  uint64_t droppedFrames;     // not sent to a congested client
+  uint64_t framingErrors;     // framed mode, clients disconnected for a bad message length
+  uint64_t expiredRequests;
+  uint32_t subscriptions;
+  uint32_t pendingRequests;
+  uint32_t pendingHighWater;
+  uint32_t clientPoolUsed;    // contexts of the connected clients in the pool
+  uint32_t clientPoolHighWater;
+  uint32_t clientPoolFailures; // contexts allocated from the heap, the pool was exhausted
+} yapi_gateway_stats_t;
+
+/**
+ * @brief Opens the serial port and serves it from the socket server loop (socket_server_open() first)
+ * @return 0 on success, -1 otherwise
+ */
+int yapi_gateway_open(const char* device, int baudRate);
+
+void yapi_gateway_close(void);
+
+/**
+ * @brief Length-prefixed messages with the clients rather than raw YAPI frames, before yapi_gateway_open()
+ */
+void yapi_gateway_set_framing(bool isFramed);
+
+bool yapi_gateway_is_open(void);
+
+/**
+ * @brief socket_server_rx_cb_t / socket_server_conn_cb_t to give to socket_server_open()
+ */
+void yapi_gateway_client_rx(int connFd, const uint8_t* data, size_t size);
+void yapi_gateway_client_conn(int connFd, bool isConnected);
+
+/**
+ * @brief Expires the requests left without response, call after every socket_server_poll()
+ */
+void yapi_gateway_task(void);
+
+/**
+ * @brief Snapshot of the counters, safe to call from another thread (e.g. the CLI)
+ */
+void yapi_gateway_get_stats(yapi_gateway_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YAPI_GATEWAY_H
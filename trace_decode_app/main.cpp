@@ -0,0 +1,157 @@
+/**
+ * trace_decode: prints the gz_trace files written by the apps (trace_start, socket -t) as text or CSV
+ *
+ * Every file of a rotated trace can be given at once, in any order: the records are merged by sequence.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include "gz_trace.h"
+#include "yapi_service.h"
+
+typedef enum {
+  DECODE_FORMAT_TEXT,
+  DECODE_FORMAT_CSV,
+} _Decode_Format_t;
+
+typedef struct {
+  gz_trace_record_t record;
+  uint64_t startRealtime_ns;
+  uint64_t startMonotonic_ns;
+} _Decode_Record_t;
+
+static void _decode_usage(const char *name) {
+  fprintf(stderr, "usage: %s [-f text|csv] file...\n", name);
+}
+
+static const char* _decode_event_name(uint16_t eventId) {
+  switch (eventId) {
+    case YAPI_TRACE_RX:
+      return "RX";
+    case YAPI_TRACE_RX_CRC_ERROR:
+      return "RX_CRC_ERROR";
+    case YAPI_TRACE_TX:
+      return "TX";
+    case YAPI_TRACE_TX_FAILED:
+      return "TX_FAILED";
+    case YAPI_TRACE_TX_DROPPED:
+      return "TX_DROPPED";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+static bool _decode_is_before(const _Decode_Record_t& a, const _Decode_Record_t& b) {
+  return a.record.sequence < b.record.sequence;
+}
+
+/**
+ * @brief Appends the records of a file. A file cut short (crash, copied while written) gives what it holds
+ * @return 0 on success, -1 if it is not a trace file
+ */
+static int _decode_read_file(const char* path, std::vector<_Decode_Record_t>& records) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return -1;
+  }
+  gz_trace_file_header_t header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, GZ_TRACE_MAGIC, sizeof(header.magic)) ||
+      header.version != GZ_TRACE_VERSION || header.headerSize < sizeof(header) ||
+      header.recordSize < sizeof(gz_trace_record_t)) {
+    fprintf(stderr, "%s: not a gz_trace version %d file\n", path, GZ_TRACE_VERSION);
+    fclose(file);
+    return -1;
+  }
+  fseek(file, header.headerSize, SEEK_SET);
+  std::vector<uint8_t> buffer(header.recordSize);
+  uint32_t count = 0;
+  while (count < header.count && fread(&buffer[0], header.recordSize, 1, file) == 1) {
+    _Decode_Record_t decoded;
+    memcpy(&decoded.record, &buffer[0], sizeof(decoded.record)); // newer versions only append fields
+    decoded.startRealtime_ns = header.startRealtime_ns;
+    decoded.startMonotonic_ns = header.startMonotonic_ns;
+    records.push_back(decoded);
+    count++;
+  }
+  if (count < header.count) {
+    fprintf(stderr, "%s: %u of %u records, the file is truncated\n", path, count, header.count);
+  }
+  fclose(file);
+  return 0;
+}
+
+static void _decode_print(const _Decode_Record_t& decoded, _Decode_Format_t format) {
+  const gz_trace_record_t& record = decoded.record;
+  uint64_t realtime_ns = decoded.startRealtime_ns + (record.timestamp_ns - decoded.startMonotonic_ns);
+  time_t seconds = realtime_ns / 1000000000ULL;
+  struct tm date;
+  char time_s[32];
+  localtime_r(&seconds, &date);
+  strftime(time_s, sizeof(time_s), "%Y-%m-%d %H:%M:%S", &date);
+  char hash_s[16] = "";
+  if (record.flags & GZ_TRACE_FLAG_HASH) {
+    snprintf(hash_s, sizeof(hash_s), "%08x", record.payloadHash);
+  }
+  if (format == DECODE_FORMAT_CSV) {
+    printf("%u,%s.%09llu,%s,%u,0x%02x,0x%02x,0x%02x,0x%02x,%u,0x%04x,%d,%s\n", record.sequence, time_s,
+           (unsigned long long)(realtime_ns % 1000000000ULL), _decode_event_name(record.eventId), record.port,
+           record.command, record.messageType, record.senderId, record.targetId, record.length, record.crc,
+           (record.flags & GZ_TRACE_FLAG_CRC_OK) ? 1 : 0, hash_s);
+  } else {
+    printf("%8u %s.%06llu %-12s port[%u] cmd[0x%02x] type[0x%02x] %02x->%02x len[%u] crc[0x%04x]%s%s%s%s\n",
+           record.sequence, time_s, (unsigned long long)(realtime_ns % 1000000000ULL / 1000),
+           _decode_event_name(record.eventId), record.port, record.command, record.messageType, record.senderId,
+           record.targetId, record.length, record.crc, (record.flags & GZ_TRACE_FLAG_CRC_OK) ? "" : " BAD_CRC",
+           hash_s[0] ? " hash[" : "", hash_s, hash_s[0] ? "]" : "");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int option;
+  _Decode_Format_t format = DECODE_FORMAT_TEXT;
+
+  while ((option = getopt(argc, argv, "f:")) != -1) {
+    switch (option) {
+      case 'f':
+        if (!strcmp(optarg, "csv")) {
+          format = DECODE_FORMAT_CSV;
+        } else if (strcmp(optarg, "text")) {
+          _decode_usage(argv[0]);
+          return 1;
+        }
+        break;
+      default:
+        _decode_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind == argc) {
+    _decode_usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<_Decode_Record_t> records;
+  int status = 0;
+  for (int i = optind; i < argc; i++) {
+    if (_decode_read_file(argv[i], records) < 0) {
+      status = 1;
+    }
+  }
+  std::stable_sort(records.begin(), records.end(), _decode_is_before);
+  if (format == DECODE_FORMAT_CSV) {
+    printf("sequence,time,event,port,command,type,sender,target,length,crc,crc_ok,payload_hash\n");
+  }
+  for (size_t i = 0; i < records.size(); i++) {
+    _decode_print(records[i], format);
+  }
+  return status;
+}
@@ -0,0 +1,206 @@
+/**
+ * main.cpp
+ *
+ * Standalone driver of the YAPI fuzz target, for when libFuzzer is not there (gcc):
+ *   yapi_fuzz -g corpus                 writes the seed corpus
+ *   yapi_fuzz corpus crash-1234         runs every file (directories: every file in them) once
+ *   yapi_fuzz -n 1000000 -s 7 corpus    then that many inputs mutated from them, reports execs/s
+ *
+ * The mutations are blind: coverage guidance comes with the libFuzzer build (make yapi_fuzz_app
+ * FUZZ_ENGINE=libfuzzer) or AFL++ (XX=afl-clang-fast++, afl-fuzz -i corpus -o findings -- ./yapi_fuzz @@).
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "yapi_fuzz.h"
+#include "gz_rand.h"
+
+#define FUZZ_MAX_INPUT  4096 // longest input the mutations build, files are read whole
+
+typedef std::vector<uint8_t> fuzz_input_t;
+
+static void _fuzz_usage(const char* name) {
+  fprintf(stderr, "usage: %s [-g corpus directory] [-n mutated runs] [-s seed] [files or directories...]\n", name);
+}
+
+static uint64_t _fuzz_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool _fuzz_read_file(const std::string& path, std::vector<fuzz_input_t>& inputs) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    fprintf(stderr, "cannot open %s\n", path.c_str());
+    return false;
+  }
+  // Sized from the file: a reproducer runs exactly as libFuzzer saw it
+  struct stat info;
+  if (fstat(fileno(file), &info) != 0) {
+    fprintf(stderr, "cannot stat %s\n", path.c_str());
+    fclose(file);
+    return false;
+  }
+  fuzz_input_t input(info.st_size);
+  input.resize(fread(input.data(), 1, input.size(), file));
+  fclose(file);
+  if (input.size() > FUZZ_MAX_INPUT) {
+    fprintf(stderr, "yapi_fuzz: %s is %zu bytes, past the %d of mutated inputs, run whole\n", path.c_str(),
+            input.size(), FUZZ_MAX_INPUT);
+  }
+  inputs.push_back(input);
+  return true;
+}
+
+static bool _fuzz_read(const char* path, std::vector<fuzz_input_t>& inputs) {
+  struct stat info;
+  if (stat(path, &info) || !S_ISDIR(info.st_mode)) {
+    return _fuzz_read_file(path, inputs);
+  }
+  DIR* directory = opendir(path);
+  if (!directory) {
+    return false;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(directory)) != NULL) {
+    std::string file = std::string(path) + "/" + entry->d_name;
+    if (entry->d_name[0] != '.' && !stat(file.c_str(), &info) && S_ISREG(info.st_mode)) {
+      _fuzz_read_file(file, inputs);
+    }
+  }
+  closedir(directory);
+  return true;
+}
+
+/**
+ * @brief 1 to 4 edits of a corpus input, weighted toward what breaks a frame: its length byte, bytes around
+ * the start signal, cuts and splices with another input
+ */
+static void _fuzz_mutate(gz_xoshiro256_t* rng, const std::vector<fuzz_input_t>& corpus, fuzz_input_t& input) {
+  input = corpus[gz_xoshiro256_bounded(rng, corpus.size())];
+  uint32_t edits = 1 + gz_xoshiro256_bounded(rng, 4);
+  for (uint32_t edit = 0; edit < edits; edit++) {
+    uint32_t position = input.empty() ? 0 : gz_xoshiro256_bounded(rng, input.size());
+    switch (gz_xoshiro256_bounded(rng, 7)) {
+      case 0:
+        if (!input.empty()) {
+          input[position] ^= 1 << gz_xoshiro256_bounded(rng, 8);
+        }
+        break;
+      case 1:
+        if (!input.empty()) {
+          input[position] = (uint8_t)gz_xoshiro256_next(rng);
+        }
+        break;
+      case 2:
+        if (input.size() > YAPI_LENGTH_IDX) {
+          input[YAPI_LENGTH_IDX] = (uint8_t)gz_xoshiro256_next(rng);
+        }
+        break;
+      case 3:
+        if (input.size() < FUZZ_MAX_INPUT) {
+          input.insert(input.begin() + position, (uint8_t)gz_xoshiro256_next(rng));
+        }
+        break;
+      case 4:
+        if (!input.empty()) {
+          input.erase(input.begin() + position, input.begin() + position + 1 +
+                                                gz_xoshiro256_bounded(rng, input.size() - position));
+        }
+        break;
+      case 5:
+        if (input.size() + 2 <= FUZZ_MAX_INPUT) {
+          uint8_t start[] = { YAPI_START_BYTE, YAPI_START_BYTE };
+          input.insert(input.begin() + position, start, start + sizeof(start));
+        }
+        break;
+      default: {
+        const fuzz_input_t& other = corpus[gz_xoshiro256_bounded(rng, corpus.size())];
+        if (!other.empty()) {
+          uint32_t from = gz_xoshiro256_bounded(rng, other.size());
+          uint32_t count = 1 + gz_xoshiro256_bounded(rng, other.size() - from);
+          input.resize(position);
+          input.insert(input.end(), other.begin() + from, other.begin() + from + count);
+          if (input.size() > FUZZ_MAX_INPUT) {
+            input.resize(FUZZ_MAX_INPUT);
+          }
+        }
+        break;
+      }
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int option;
+  const char* corpusDirectory = NULL;
+  uint64_t runs = 0;
+  uint64_t seed = 1;
+
+  while ((option = getopt(argc, argv, "g:n:s:")) != -1) {
+    switch (option) {
+      case 'g':
+        corpusDirectory = optarg;
+        break;
+      case 'n':
+        runs = strtoull(optarg, NULL, 0);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 0);
+        break;
+      default:
+        _fuzz_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  LLVMFuzzerInitialize(&argc, &argv);
+  if (corpusDirectory) {
+    mkdir(corpusDirectory, 0755);
+    int files = yapi_fuzz_write_corpus(corpusDirectory);
+    printf("yapi_fuzz: %d seed files in %s\n", files, corpusDirectory);
+    return files < 0 ? 1 : 0;
+  }
+
+  std::vector<fuzz_input_t> corpus;
+  for (int i = optind; i < argc; i++) {
+    if (!_fuzz_read(argv[i], corpus)) {
+      return 1;
+    }
+  }
+  uint64_t start = _fuzz_now_ns();
+  for (const fuzz_input_t& input : corpus) {
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+  }
+  if (runs && corpus.empty()) {
+    corpus.push_back(fuzz_input_t());
+  }
+  gz_xoshiro256_t rng;
+  gz_xoshiro256_seed(&rng, seed);
+  fuzz_input_t input;
+  for (uint64_t run = 0; run < runs; run++) {
+    _fuzz_mutate(&rng, corpus, input);
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+  }
+  double seconds = (_fuzz_now_ns() - start) / 1e9;
+
+  yapi_fuzz_stats_t stats;
+  yapi_fuzz_get_stats(&stats);
+  printf("yapi_fuzz: %llu execs in %.2f s, %.0f execs/s\n", (unsigned long long)stats.inputs, seconds,
+         seconds > 0 ? stats.inputs / seconds : 0.0);
+  printf("yapi_fuzz: frames[%llu] crc errors[%llu] decoded[%llu] checksum[%08x]\n",
+         (unsigned long long)stats.frames, (unsigned long long)stats.crcErrors, (unsigned long long)stats.decoded,
+         stats.checksum);
+  return 0;
+}
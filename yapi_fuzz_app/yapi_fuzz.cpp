@@ -0,0 +1,225 @@
+/**
+ * yapi_fuzz.cpp
+ *
+ * Fuzz target of the YAPI receive path: the input is a byte stream off the wire, pushed through the
+ * yapi_service receive state machine. Frames that pass the CRC go to a command callback registered for every
+ * command of yapi_codec.h, which decodes the payload both as request and response and reads every byte of
+ * the results, and to an rx observer and the trace callback.
+ *
+ * The same LLVMFuzzerTestOneInput() links against libFuzzer (FUZZ_ENGINE=libfuzzer) or the standalone driver
+ * of main.cpp, which AFL can run too.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "yapi_fuzz.h"
+#include "yapi_codec.h"
+
+static v_fp_u8_t _rxByte = NULL;
+static uint32_t _checksum = 0;
+static yapi_fuzz_stats_t _stats;
+
+/**
+ * @brief Reads every byte: sanitizers see an uninitialized or out of bounds one, the compiler cannot drop it
+ */
+static void _yapi_fuzz_fold(const void* data, size_t size) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < size; i++) {
+    _checksum = (_checksum << 5) + _checksum + bytes[i];
+  }
+}
+
+template <yapi_command_enum_t Command>
+static void _yapi_fuzz_decode(yapi_packet_t* packet) {
+  typename yapi_codec_traits<Command>::request_t request;
+  typename yapi_codec_traits<Command>::response_t response;
+  if (yapi_codec_decode_request<Command>(packet, &request)) {
+    _yapi_fuzz_fold(&request, sizeof(request));
+  }
+  if (yapi_codec_decode_response<Command>(packet, &response)) {
+    _yapi_fuzz_fold(&response, sizeof(response));
+  }
+  _stats.decoded++;
+}
+
+// Every command of yapi_codec.h, keep in sync with its YAPI_CODEC_MAP lines
+#define YAPI_FUZZ_COMMANDS(X) \
+  X(YAPI_CMD_HELLO) \
+  X(YAPI_CMD_PCU_OUTPUTS_STATUS) \
+  X(YAPI_CMD_PCU_INPUTS_STATUS) \
+  X(YAPI_CMD_PCU_SUMMARY_STATUS_FLAGS) \
+  X(YAPI_CMD_PCU_SUMMARY_STATUS) \
+  X(YAPI_CMD_PCU_CONFIGS) \
+  X(YAPI_CMD_PCU_PMICS_STATUS) \
+  X(YAPI_CMD_PCU_DEVICE) \
+  X(YAPI_CMD_PCU_PMICS_ACCUMULATED_ENERGY) \
+  X(YAPI_CMD_WMU_SUMMARY_STATUS) \
+  X(YAPI_CMD_WMU_CONFIGS) \
+  X(YAPI_CMD_WMU_POWER) \
+  X(YAP_CMD_INVERTER_SUMMARY_STATUS) \
+  X(YAPI_CMD_BMS_SUMMARY_STATUS) \
+  X(YAPI_CMD_TANK_SUMMARY_STATUS) \
+  X(YAPI_CMD_RVES_SUMMARY_STATUS) \
+  X(YAPI_CMD_FLASH_READ) \
+  X(YAPI_CMD_FLASH_WRITE) \
+  X(YAPI_CMD_FLASH_ERASE) \
+  X(YAPI_CMD_FLASH_VERIFY) \
+  X(YAPI_CMD_MODBUS_ENTER_BOOTLOADER) \
+  X(YAPI_CMD_MODBUS_SILENCE) \
+  X(YAPI_CMD_MOBUS_GET_BOOTINFO) \
+  X(YAPI_CMD_COMBINER_SUMMARY_STATUS) \
+  X(YAPI_CMD_SERIAL_WRITE) \
+  X(YAPI_CMD_SERIAL_READ) \
+  X(YAPI_CMD_WMU_SYSTEM_ID)
+
+static void _yapi_fuzz_rx_observer(void* data) {
+  const yapi_packet_t* packet = (const yapi_packet_t*)data;
+  // Header, payload and CRC as received
+  _yapi_fuzz_fold(packet, YAPI_HEADER_LENGTH + packet->length + sizeof(packet->crc));
+  _stats.frames++;
+}
+
+static void _yapi_fuzz_trace(yapi_trace_event_t event, const yapi_packet_t* packet) {
+  if (event == YAPI_TRACE_RX_CRC_ERROR) {
+    _stats.crcErrors++;
+  }
+  _yapi_fuzz_fold(packet, YAPI_HEADER_LENGTH);
+}
+
+static void _yapi_fuzz_register_rx(v_fp_u8_t rxByte) {
+  _rxByte = rxByte;
+}
+
+/*****************************************************/
+/* Section: yapi_platform, nothing is sent           */
+/*****************************************************/
+
+void yapi_platform_log_debug(const char* fmt, ...) {}
+void yapi_platform_log_info(const char* fmt, ...) {}
+void yapi_platform_log_warn(const char* fmt, ...) {}
+void yapi_platform_log_error(const char* fmt, ...) {}
+
+uint16_t yapi_platform_transmit(uint8_t* data, uint16_t len) {
+  return len;
+}
+
+uint16_t yapi_platform_transmit_blocking(uint8_t* data, uint16_t len) {
+  return len;
+}
+
+/*****************************************************/
+/* Section: Fuzz target                              */
+/*****************************************************/
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+  yapi_service_init(YAPI_DEVICE_EXTERNAL_PC, _yapi_fuzz_register_rx);
+#define YAPI_FUZZ_REGISTER(command) yapi_service_register_cmd_cb(_yapi_fuzz_decode<command>, command);
+  YAPI_FUZZ_COMMANDS(YAPI_FUZZ_REGISTER)
+#undef YAPI_FUZZ_REGISTER
+  yapi_service_add_rx_observer(_yapi_fuzz_rx_observer);
+  yapi_service_set_trace_cb(_yapi_fuzz_trace);
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  // Every input starts from an empty receiver, a crash replays from its input alone
+  yapi_service_init(YAPI_DEVICE_EXTERNAL_PC, NULL);
+  while (size) {
+    // One receive buffer at a time, a full one would drop bytes
+    size_t chunk = size < RECEIVE_BUFFER_LENGTH - 1 ? size : RECEIVE_BUFFER_LENGTH - 1;
+    for (size_t i = 0; i < chunk; i++) {
+      _rxByte(data[i]);
+    }
+    yapi_service_task_10ms(NULL);
+    data += chunk;
+    size -= chunk;
+  }
+  _stats.inputs++;
+  return 0;
+}
+
+/*****************************************************/
+/* Section: Seed corpus                              */
+/*****************************************************/
+
+static int _yapi_fuzz_write(const char* directory, const char* name, const void* data, size_t size) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", directory, name);
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    return -1;
+  }
+  size_t written = fwrite(data, 1, size, file);
+  fclose(file);
+  return written == size ? 0 : -1;
+}
+
+/**
+ * @brief A valid frame of the command with a response sized payload (a request sized one for the flash
+ * commands the host sends), bytes counting up from the command
+ */
+template <yapi_command_enum_t Command>
+static uint16_t _yapi_fuzz_frame(uint8_t* frame) {
+  typedef typename yapi_codec_traits<Command>::response_t response_t;
+  uint8_t length = yapi_codec_payload_size<response_t>::value;
+  if (std::is_same<response_t, yapi_codec_raw_t>::value) {
+    length = yapi_codec_payload_size<typename yapi_codec_traits<Command>::request_t>::value;
+  }
+  uint8_t payload[YAPI_DATA_SIZE];
+  for (uint8_t i = 0; i < length; i++) {
+    payload[i] = Command + i;
+  }
+  yapi_packet_t packet;
+  yapi_service_build_pkt(&packet, YAPI_DEVICE_PCU, YAPI_DEVICE_EXTERNAL_PC, Command, YAPI_MSG_GET_RESP_OK,
+                         YAPI_PRIORITY_LOW, NULL, payload, length);
+  uint16_t size = YAPI_HEADER_LENGTH + length + sizeof(packet.crc);
+  memcpy(frame, &packet, size);
+  return size;
+}
+
+int yapi_fuzz_write_corpus(const char* directory) {
+  static uint8_t stream[64 * sizeof(yapi_packet_t)];
+  size_t streamSize = 0;
+  int files = 0;
+  char name[64];
+  uint8_t frame[sizeof(yapi_packet_t)];
+  uint16_t size;
+#define YAPI_FUZZ_SEED(command) \
+  size = _yapi_fuzz_frame<command>(frame); \
+  snprintf(name, sizeof(name), "frame_%02x", command); \
+  if (_yapi_fuzz_write(directory, name, frame, size)) { \
+    return -1; \
+  } \
+  files++; \
+  memcpy(&stream[streamSize], frame, size); \
+  streamSize += size;
+  YAPI_FUZZ_COMMANDS(YAPI_FUZZ_SEED)
+#undef YAPI_FUZZ_SEED
+
+  // Every frame back to back, then one after line noise, one cut in its payload and one with a bad CRC
+  if (_yapi_fuzz_write(directory, "stream_all", stream, streamSize)) {
+    return -1;
+  }
+  uint8_t noisy[sizeof(yapi_packet_t) + 4] = { 0x00, YAPI_START_BYTE, 0x55, 0xFF };
+  size = _yapi_fuzz_frame<YAPI_CMD_PCU_SUMMARY_STATUS>(frame);
+  memcpy(&noisy[4], frame, size);
+  if (_yapi_fuzz_write(directory, "frame_after_noise", noisy, size + 4)) {
+    return -1;
+  }
+  if (_yapi_fuzz_write(directory, "frame_truncated", frame, size / 2)) {
+    return -1;
+  }
+  frame[size - 1] ^= 0xFF;
+  if (_yapi_fuzz_write(directory, "frame_bad_crc", frame, size)) {
+    return -1;
+  }
+  return files + 4;
+}
+
+void yapi_fuzz_get_stats(yapi_fuzz_stats_t* stats) {
+  *stats = _stats;
+  stats->checksum = _checksum;
+}
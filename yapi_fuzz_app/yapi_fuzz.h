@@ -0,0 +1,34 @@
+/**
+ * yapi_fuzz.h
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_FUZZ_H
+#define YAPI_FUZZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "yapi_service.h"
+
+typedef struct {
+  uint64_t inputs;
+  uint64_t frames;                // passed the CRC
+  uint64_t crcErrors;
+  uint64_t decoded;               // went through a command callback
+  uint32_t checksum;              // of every byte the callbacks read
+} yapi_fuzz_stats_t;
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+/**
+ * @brief Writes the seed corpus to an existing directory: a valid frame per command, all of them as one
+ * stream, a truncated frame and one with a bad CRC
+ * @return the number of files written, -1 on error
+ */
+int yapi_fuzz_write_corpus(const char* directory);
+
+void yapi_fuzz_get_stats(yapi_fuzz_stats_t* stats);
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "gz_log.h"
+#include "gz_rand.h"
+#include "yapi_sim_link.h"
+#include "yapi_sim_pcu.h"
+#include "yapi_sim_mppt.h"
+
+#define SIM_TICK_MS 1
+
+static volatile sig_atomic_t _isRunning = 1;
+
+static void _sim_stop(int signal) {
+  _isRunning = 0;
+}
+
+static void _sim_usage(const char *name) {
+  fprintf(stderr, "usage: %s [-l latency ms] [-j jitter ms] [-b baud rate] [-e bit error rate] [-d drop rate] [-s seed]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+  int option;
+  yapi_sim_impairments_t impairments;
+  memset(&impairments, 0, sizeof(impairments));
+  unsigned int seed = 1;
+
+  while ((option = getopt(argc, argv, "l:j:b:e:d:s:")) != -1) {
+    switch (option) {
+      case 'l':
+        impairments.latency_ms = atoi(optarg);
+        break;
+      case 'j':
+        impairments.jitter_ms = atoi(optarg);
+        break;
+      case 'b':
+        impairments.baudRate = atoi(optarg);
+        break;
+      case 'e':
+        impairments.bitErrorRate = atof(optarg);
+        break;
+      case 'd':
+        impairments.dropRate = atof(optarg);
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        _sim_usage(argv[0]);
+        return 1;
+    }
+  }
+
+#if DEBUG
+  gz_log_set_level(GZ_LOG_LEVEL_DEBUG);
+#else
+  gz_log_set_level(GZ_LOG_LEVEL_INFO);
+#endif
+  gz_log_async_start(GZ_LOG_FULL_DROP); // the serving loop never waits on the terminal
+  gzrand_seed_uint(seed); // impairments are reproducible for a given seed
+
+  char slaveName[64];
+  if (yapi_sim_link_open(&impairments, slaveName, sizeof(slaveName))) {
+    return 1;
+  }
+  yapi_sim_pcu_init();
+  yapi_sim_mppt_init();
+  printf("yapi_sim: PCU + MPPT bootloader on (%s)\n", slaveName);
+  printf("yapi_sim: latency[%u] ms jitter[%u] ms baud[%u] bit errors[%g] drops[%g] seed[%u]\n",
+         impairments.latency_ms, impairments.jitter_ms, impairments.baudRate, impairments.bitErrorRate, impairments.dropRate, seed);
+  fflush(stdout);
+
+  signal(SIGINT, _sim_stop);
+  signal(SIGTERM, _sim_stop);
+  while (_isRunning) {
+    yapi_sim_link_poll(SIM_TICK_MS);
+    yapi_sim_pcu_task();
+  }
+
+  yapi_sim_link_stats_t linkStats;
+  yapi_sim_mppt_stats_t flashStats;
+  yapi_sim_link_get_stats(&linkStats);
+  yapi_sim_mppt_get_stats(&flashStats);
+  printf("\nyapi_sim: rx[%llu] bytes, tx[%llu] bytes in [%u] frames, frames dropped[%u], bytes dropped[%u] corrupted[%u]\n",
+         (unsigned long long)linkStats.rxBytes, (unsigned long long)linkStats.txBytes, linkStats.txFrames,
+         linkStats.txFramesDropped, linkStats.droppedBytes, linkStats.corruptedBytes);
+  printf("yapi_sim: PCU published[%u], MPPT reads[%u] writes[%u] words[%u] pages erased[%u] verifies[%u] failed[%u] rejected[%u]\n",
+         yapi_sim_pcu_published_count(), flashStats.reads, flashStats.writes, flashStats.wordsWritten, flashStats.pagesErased,
+         flashStats.verifies, flashStats.verifyFailures, flashStats.rejected);
+  yapi_sim_link_close();
+  return 0;
+}
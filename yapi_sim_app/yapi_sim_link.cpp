@@ -0,0 +1,223 @@
+/**
+ * yapi_sim_link.cpp
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+
+#include "yapi_sim_link.h"
+#include "yapi_service.h"
+#include "gz_rand.h"
+#include "gz_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UNUSED(x)                     (void)(x)
+#define USEC_PER_MSEC                 1000ULL
+#define USEC_PER_SEC                  1000000ULL
+#define BITS_PER_UART_BYTE            10 // start + 8 data + stop
+
+typedef struct {
+  uint8_t data[sizeof(yapi_packet_t)];
+  uint16_t length;
+  uint16_t offset;
+  uint64_t due_us;
+} _Yapi_Sim_Frame_t;
+
+static int _masterFd = -1;
+static int _slaveFd = -1; // kept open so the pty survives host reconnects and stays in raw mode
+static yapi_sim_impairments_t _impairments;
+static yapi_sim_link_stats_t _stats;
+static v_fp_u8_t _rxByteCb = NULL;
+static _Yapi_Sim_Frame_t _txQueue[YAPI_SIM_TX_QUEUE_DEPTH];
+static uint16_t _txHead = 0;
+static uint16_t _txCount = 0;
+static uint64_t _busyUntil_us = 0;
+static uint64_t _lastWireEnd_us = 0;
+
+uint64_t yapi_sim_link_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Applies the byte impairments in place
+ * @return the new length
+ */
+static uint16_t _yapi_sim_impair(uint8_t* data, uint16_t length) {
+  uint16_t kept = 0;
+  for (uint16_t i = 0; i < length; i++) {
+    if (_impairments.dropRate > 0 && gzrand_double() < _impairments.dropRate) {
+      _stats.droppedBytes++;
+      continue;
+    }
+    data[kept] = data[i];
+    if (_impairments.bitErrorRate > 0 && gzrand_double() < _impairments.bitErrorRate) {
+      data[kept] ^= 1 << gzrand_in_range(0, 7);
+      _stats.corruptedBytes++;
+    }
+    kept++;
+  }
+  return kept;
+}
+
+static void _yapi_sim_register_rx_byte(v_fp_u8_t cb) {
+  _rxByteCb = cb;
+}
+
+/*****************************************************/
+/* Section: yapi_service platform                    */
+/*****************************************************/
+
+void yapi_platform_log_debug(const char *fmt, ...) {
+  UNUSED(fmt);
+}
+
+void yapi_platform_log_info(const char *fmt, ...) {
+  UNUSED(fmt);
+}
+
+void yapi_platform_log_warn(const char *fmt, ...) {
+  UNUSED(fmt);
+}
+
+void yapi_platform_log_error(const char *fmt, ...) {
+  UNUSED(fmt);
+}
+
+/**
+ * @brief Schedules the frame after the emulated latency, the device busy time and the previous frame
+ */
+uint16_t yapi_platform_transmit(uint8_t* data, uint16_t len) {
+  if (_masterFd < 0 || len > sizeof(_txQueue[0].data)) {
+    return 0;
+  }
+  if (_txCount == YAPI_SIM_TX_QUEUE_DEPTH) {
+    _stats.txFramesDropped++;
+    return 0;
+  }
+  _Yapi_Sim_Frame_t* frame = &_txQueue[(_txHead + _txCount) % YAPI_SIM_TX_QUEUE_DEPTH];
+  memcpy(frame->data, data, len);
+  frame->length = _yapi_sim_impair(frame->data, len);
+  frame->offset = 0;
+
+  uint64_t start_us = yapi_sim_link_now_us() + _impairments.latency_ms * USEC_PER_MSEC;
+  if (_impairments.jitter_ms) {
+    start_us += gzrand_in_range(0, _impairments.jitter_ms * USEC_PER_MSEC);
+  }
+  start_us = start_us < _busyUntil_us ? _busyUntil_us : start_us;
+  start_us = start_us < _lastWireEnd_us ? _lastWireEnd_us : start_us;
+  uint64_t wire_us = _impairments.baudRate ? (uint64_t)len * BITS_PER_UART_BYTE * USEC_PER_SEC / _impairments.baudRate : 0;
+  frame->due_us = start_us + wire_us; // the host sees the frame once its last byte is on the wire
+  _lastWireEnd_us = frame->due_us;
+  _txCount++;
+  _stats.txFrames++;
+  return len;
+}
+
+/*****************************************************/
+/* Section: Link                                     */
+/*****************************************************/
+
+int yapi_sim_link_open(const yapi_sim_impairments_t* impairments, char* slaveName, size_t slaveNameSize) {
+  _masterFd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (_masterFd < 0 || grantpt(_masterFd) || unlockpt(_masterFd)) {
+    GZ_LOG_ERROR("yapi_sim: cannot open a pseudo-terminal (%s)\n", strerror(errno));
+    return -1;
+  }
+  const char* name = ptsname(_masterFd);
+  _slaveFd = name ? open(name, O_RDWR | O_NOCTTY) : -1;
+  if (_slaveFd < 0) {
+    GZ_LOG_ERROR("yapi_sim: cannot open the pseudo-terminal slave (%s)\n", strerror(errno));
+    return -1;
+  }
+  // No echo/line discipline before the host configures the port
+  struct termios tty;
+  tcgetattr(_slaveFd, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(_slaveFd, TCSANOW, &tty);
+  snprintf(slaveName, slaveNameSize, "%s", name);
+
+  memcpy(&_impairments, impairments, sizeof(_impairments));
+  memset(&_stats, 0, sizeof(_stats));
+  yapi_service_init(YAPI_DEVICE_PCU, _yapi_sim_register_rx_byte);
+  return 0;
+}
+
+void yapi_sim_link_close(void) {
+  if (_slaveFd >= 0) {
+    close(_slaveFd);
+  }
+  if (_masterFd >= 0) {
+    close(_masterFd);
+  }
+  _slaveFd = _masterFd = -1;
+}
+
+static void _yapi_sim_flush_due(void) {
+  uint64_t now_us = yapi_sim_link_now_us();
+  while (_txCount && _txQueue[_txHead].due_us <= now_us) {
+    _Yapi_Sim_Frame_t* frame = &_txQueue[_txHead];
+    ssize_t written = frame->length > frame->offset ? write(_masterFd, frame->data + frame->offset, frame->length - frame->offset) : 0;
+    if (written < 0) {
+      return; // EAGAIN, the host is not draining the pty, retried on POLLOUT
+    }
+    frame->offset += written;
+    _stats.txBytes += written;
+    if (frame->offset < frame->length) {
+      return;
+    }
+    _txHead = (_txHead + 1) % YAPI_SIM_TX_QUEUE_DEPTH;
+    _txCount--;
+  }
+}
+
+void yapi_sim_link_poll(int timeoutMs) {
+  if (_txCount) {
+    uint64_t now_us = yapi_sim_link_now_us();
+    uint64_t due_us = _txQueue[_txHead].due_us;
+    int dueMs = due_us > now_us ? (int)((due_us - now_us + USEC_PER_MSEC - 1) / USEC_PER_MSEC) : 0;
+    timeoutMs = dueMs < timeoutMs ? dueMs : timeoutMs;
+  }
+  struct pollfd pfd = { .fd = _masterFd, .events = POLLIN, .revents = 0 };
+  if (_txCount && _txQueue[_txHead].offset) {
+    pfd.events |= POLLOUT;
+  }
+  if (poll(&pfd, 1, timeoutMs) > 0 && (pfd.revents & POLLIN)) {
+    uint8_t buffer[YAPI_SIM_READ_CHUNK_SIZE];
+    ssize_t readCount = read(_masterFd, buffer, sizeof(buffer));
+    if (readCount > 0) {
+      _stats.rxBytes += readCount;
+      uint16_t length = _yapi_sim_impair(buffer, readCount);
+      for (uint16_t i = 0; _rxByteCb && i < length; i++) {
+        _rxByteCb(buffer[i]);
+      }
+      yapi_service_task_10ms(NULL); // responses are queued from the command callbacks
+    }
+  }
+  _yapi_sim_flush_due();
+}
+
+void yapi_sim_link_set_busy_until_us(uint64_t busyUntil_us) {
+  _busyUntil_us = busyUntil_us;
+}
+
+void yapi_sim_link_get_stats(yapi_sim_link_stats_t* stats) {
+  memcpy(stats, &_stats, sizeof(yapi_sim_link_stats_t));
+}
+
+#ifdef __cplusplus
+}
+#endif
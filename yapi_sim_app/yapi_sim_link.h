@@ -0,0 +1,72 @@
+/**
+ * yapi_sim_link.h
+ *
+ * Device side of the simulator link: a pseudo-terminal the host apps connect to as if it were the Yeti UART,
+ * with configurable latency, jitter, baud rate pacing, bit errors and byte drops.
+ *
+ * The link provides the yapi_platform_* functions of yapi_service, hence the simulator does not link
+ * yapi_service_driver.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_SIM_LINK_H
+#define YAPI_SIM_LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YAPI_SIM_TX_QUEUE_DEPTH       256   // frames waiting for their due time
+#define YAPI_SIM_READ_CHUNK_SIZE      256   // below the yapi_service receive ring size
+
+typedef struct {
+  uint32_t latency_ms;      // added to every frame the simulator sends
+  uint32_t jitter_ms;       // uniformly random 0..jitter_ms added on top of the latency
+  uint32_t baudRate;        // frames take 10 bits per byte on the wire, 0 for no pacing
+  double bitErrorRate;      // probability per byte, both directions, of one flipped bit
+  double dropRate;          // probability per byte, both directions, of the byte being lost
+} yapi_sim_impairments_t;
+
+typedef struct {
+  uint64_t rxBytes;
+  uint64_t txBytes;
+  uint32_t txFrames;
+  uint32_t txFramesDropped; // queue full, the host is not reading
+  uint32_t droppedBytes;    // by the impairments
+  uint32_t corruptedBytes;  // by the impairments
+} yapi_sim_link_stats_t;
+
+/**
+ * @brief Opens the pseudo-terminal pair and initializes yapi_service on it
+ * @param slaveName receives the device path the host apps connect to
+ * @return 0 on success, -1 otherwise
+ */
+int yapi_sim_link_open(const yapi_sim_impairments_t* impairments, char* slaveName, size_t slaveNameSize);
+
+void yapi_sim_link_close(void);
+
+/**
+ * @brief Waits up to timeoutMs for host bytes, parses them (calling the registered command callbacks)
+ * and writes the frames that are due
+ */
+void yapi_sim_link_poll(int timeoutMs);
+
+/**
+ * @brief The emulated device is busy (e.g. programming flash) until then, its next frames are sent after it
+ */
+void yapi_sim_link_set_busy_until_us(uint64_t busyUntil_us);
+
+uint64_t yapi_sim_link_now_us(void);
+
+void yapi_sim_link_get_stats(yapi_sim_link_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YAPI_SIM_LINK_H
@@ -0,0 +1,166 @@
+/**
+ * yapi_sim_mppt.cpp
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include "yapi_codec.h" // C++ API, must stay outside of the extern "C" block
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#include "yapi_sim_mppt.h"
+#include "yapi_sim_link.h"
+#include "gz_hash.h"
+#include "gz_log.h"
+
+/*****************************************************/
+/* Section: Private variables                        */
+/*****************************************************/
+
+static uint8_t _flash[YAPI_SIM_MPPT_FLASH_SIZE];
+static yapi_sim_mppt_stats_t _stats;
+
+/*****************************************************/
+/* Section: Private functions                        */
+/*****************************************************/
+
+static bool _yapi_sim_mppt_is_request_for_us(yapi_packet_t* yapiPkt) {
+  return yapiPkt->targetId == YAPI_DEVICE_MPPT && !(yapiPkt->messageData.type & 0xF0);
+}
+
+static bool _yapi_sim_mppt_in_bounds(uint32_t addressOffset, uint32_t size) {
+  return addressOffset <= YAPI_SIM_MPPT_FLASH_SIZE && size <= YAPI_SIM_MPPT_FLASH_SIZE - addressOffset;
+}
+
+/**
+ * @brief Holds the next response until the emulated flash operation completes
+ */
+static void _yapi_sim_mppt_busy_for(uint64_t duration_us) {
+  yapi_sim_link_set_busy_until_us(yapi_sim_link_now_us() + duration_us);
+}
+
+static void _yapi_sim_mppt_send(yapi_packet_t* request, yapi_message_type_enum_t type, uint8_t* data, uint8_t length) {
+  yapi_service_build_send_ID(YAPI_DEVICE_MPPT, (yapi_device_id_enum_t)request->senderId, (yapi_command_enum_t)request->command,
+                             type, YAPI_PRIORITY_LOW, NULL, data, length);
+}
+
+static void _yapi_sim_mppt_flash_read_cb(yapi_packet_t* yapiPkt) {
+  if (!_yapi_sim_mppt_is_request_for_us(yapiPkt)) {
+    return;
+  }
+  yapi_flash_read_request_t request;
+  yapi_codec_decode_request<YAPI_CMD_FLASH_READ>(yapiPkt, &request);
+  uint32_t size = request.readSize * sizeof(uint32_t);
+  size = size > YAPI_DATA_SIZE ? YAPI_DATA_SIZE : size;
+  if (!_yapi_sim_mppt_in_bounds(request.addressOffset, size)) {
+    _stats.rejected++;
+    _yapi_sim_mppt_send(yapiPkt, YAPI_MSG_GET_RESP_ERR, NULL, 0);
+    return;
+  }
+  _stats.reads++;
+  _yapi_sim_mppt_send(yapiPkt, YAPI_MSG_GET_RESP_OK, _flash + request.addressOffset, size);
+}
+
+/**
+ * @brief Programming can only clear bits, like NOR flash: writing over unerased data shows up at verify
+ */
+static void _yapi_sim_mppt_flash_write_cb(yapi_packet_t* yapiPkt) {
+  if (!_yapi_sim_mppt_is_request_for_us(yapiPkt)) {
+    return;
+  }
+  yapi_flash_write_request_t request;
+  uint8_t header = yapi_codec_decode_request<YAPI_CMD_FLASH_WRITE>(yapiPkt, &request) ? sizeof(request) : 0;
+  uint32_t size = yapiPkt->length > header ? yapiPkt->length - header : 0;
+  yapi_flash_write_response_t response;
+  response.writtenWords = 0;
+  if (!header || yapiPkt->length < sizeof(request) || !_yapi_sim_mppt_in_bounds(request.addressOffset, size)) {
+    _stats.rejected++;
+    yapi_codec_send_response_from<YAPI_CMD_FLASH_WRITE>(YAPI_DEVICE_MPPT, (yapi_device_id_enum_t)yapiPkt->senderId,
+                                                        YAPI_MSG_SET_RESP_ERR, YAPI_PRIORITY_LOW, response);
+    return;
+  }
+  for (uint32_t i = 0; i < size; i++) {
+    _flash[request.addressOffset + i] &= yapiPkt->data[header + i];
+  }
+  response.writtenWords = (size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+  _stats.writes++;
+  _stats.wordsWritten += response.writtenWords;
+  _yapi_sim_mppt_busy_for((uint64_t)response.writtenWords * YAPI_SIM_MPPT_WORD_PROGRAM_US);
+  yapi_codec_send_response_from<YAPI_CMD_FLASH_WRITE>(YAPI_DEVICE_MPPT, (yapi_device_id_enum_t)yapiPkt->senderId,
+                                                      YAPI_MSG_SET_RESP_OK, YAPI_PRIORITY_LOW, response);
+}
+
+static void _yapi_sim_mppt_flash_erase_cb(yapi_packet_t* yapiPkt) {
+  if (!_yapi_sim_mppt_is_request_for_us(yapiPkt)) {
+    return;
+  }
+  yapi_flash_erase_request_t request;
+  yapi_codec_decode_request<YAPI_CMD_FLASH_ERASE>(yapiPkt, &request);
+  uint32_t firstPage = request.addressOffset / YAPI_SIM_MPPT_PAGE_SIZE;
+  uint32_t size = (uint32_t)request.numberOfPages * YAPI_SIM_MPPT_PAGE_SIZE;
+  if (!request.numberOfPages || !_yapi_sim_mppt_in_bounds(firstPage * YAPI_SIM_MPPT_PAGE_SIZE, size)) {
+    _stats.rejected++;
+    _yapi_sim_mppt_send(yapiPkt, YAPI_MSG_SET_RESP_ERR, NULL, 0);
+    return;
+  }
+  memset(_flash + firstPage * YAPI_SIM_MPPT_PAGE_SIZE, YAPI_SIM_MPPT_ERASED_BYTE, size);
+  _stats.pagesErased += request.numberOfPages;
+  _yapi_sim_mppt_busy_for((uint64_t)request.numberOfPages * YAPI_SIM_MPPT_PAGE_ERASE_US);
+  _yapi_sim_mppt_send(yapiPkt, YAPI_MSG_SET_RESP_OK, NULL, 0);
+}
+
+static void _yapi_sim_mppt_flash_verify_cb(yapi_packet_t* yapiPkt) {
+  if (!_yapi_sim_mppt_is_request_for_us(yapiPkt)) {
+    return;
+  }
+  yapi_flash_verify_request_t request;
+  yapi_codec_decode_request<YAPI_CMD_FLASH_VERIFY>(yapiPkt, &request);
+  yapi_flash_verify_response_t response;
+  response.crc16 = 0;
+  if (request.endAddressOffset < request.startAddressOffset ||
+      !_yapi_sim_mppt_in_bounds(request.startAddressOffset, request.endAddressOffset - request.startAddressOffset)) {
+    _stats.rejected++;
+    yapi_codec_send_response_from<YAPI_CMD_FLASH_VERIFY>(YAPI_DEVICE_MPPT, (yapi_device_id_enum_t)yapiPkt->senderId,
+                                                         YAPI_MSG_GET_RESP_ERR, YAPI_PRIORITY_LOW, response);
+    return;
+  }
+  // gz_crc16_seeded() takes 16 bit lengths, chained the same way the host computes the image CRC
+  for (uint32_t offset = request.startAddressOffset; offset < request.endAddressOffset; offset += UINT16_MAX) {
+    uint32_t size = request.endAddressOffset - offset;
+    size = size > UINT16_MAX ? UINT16_MAX : size;
+    response.crc16 = gz_crc16_seeded(_flash + offset, size, response.crc16);
+  }
+  _stats.verifies++;
+  bool isMatch = response.crc16 == request.crc16;
+  _stats.verifyFailures += !isMatch;
+  GZ_LOG_INFO("yapi_sim MPPT: verify [0x%X, 0x%X) crc[0x%04X] expected[0x%04X]\n",
+              request.startAddressOffset, request.endAddressOffset, response.crc16, request.crc16);
+  yapi_codec_send_response_from<YAPI_CMD_FLASH_VERIFY>(YAPI_DEVICE_MPPT, (yapi_device_id_enum_t)yapiPkt->senderId,
+                                                       isMatch ? YAPI_MSG_GET_RESP_OK : YAPI_MSG_GET_RESP_ERR,
+                                                       YAPI_PRIORITY_LOW, response);
+}
+
+/*****************************************************/
+/* Section: Public function definitions              */
+/*****************************************************/
+
+void yapi_sim_mppt_init(void) {
+  memset(_flash, YAPI_SIM_MPPT_ERASED_BYTE, sizeof(_flash));
+  memset(&_stats, 0, sizeof(_stats));
+  yapi_service_register_cmd_cb(_yapi_sim_mppt_flash_read_cb, YAPI_CMD_FLASH_READ);
+  yapi_service_register_cmd_cb(_yapi_sim_mppt_flash_write_cb, YAPI_CMD_FLASH_WRITE);
+  yapi_service_register_cmd_cb(_yapi_sim_mppt_flash_erase_cb, YAPI_CMD_FLASH_ERASE);
+  yapi_service_register_cmd_cb(_yapi_sim_mppt_flash_verify_cb, YAPI_CMD_FLASH_VERIFY);
+}
+
+void yapi_sim_mppt_get_stats(yapi_sim_mppt_stats_t* stats) {
+  memcpy(stats, &_stats, sizeof(yapi_sim_mppt_stats_t));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,43 @@
+/**
+ * yapi_sim_mppt.h
+ *
+ * Emulated MPPT bootloader: FLASH_READ/WRITE/ERASE/VERIFY on an in-memory flash, with page erase and word
+ * program times holding off the responses like the real part does.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_SIM_MPPT_H
+#define YAPI_SIM_MPPT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YAPI_SIM_MPPT_FLASH_SIZE            (256 * 1024)
+#define YAPI_SIM_MPPT_PAGE_SIZE             2048
+#define YAPI_SIM_MPPT_PAGE_ERASE_US         20000
+#define YAPI_SIM_MPPT_WORD_PROGRAM_US       50
+#define YAPI_SIM_MPPT_ERASED_BYTE           0xFF
+
+typedef struct {
+  uint32_t reads;
+  uint32_t writes;
+  uint32_t wordsWritten;
+  uint32_t pagesErased;
+  uint32_t verifies;
+  uint32_t verifyFailures;
+  uint32_t rejected;        // out of bounds or malformed requests
+} yapi_sim_mppt_stats_t;
+
+void yapi_sim_mppt_init(void);
+
+void yapi_sim_mppt_get_stats(yapi_sim_mppt_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YAPI_SIM_MPPT_H
@@ -0,0 +1,172 @@
+/**
+ * yapi_sim_pcu.cpp
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#include "yapi_codec.h" // C++ API, must stay outside of the extern "C" block
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "yapi_sim_pcu.h"
+#include "yapi_sim_link.h"
+#include "yapi_subscription.h"
+#include "gz_rand.h"
+#include "gz_log.h"
+
+/*****************************************************/
+/* Section: Private variables                        */
+/*****************************************************/
+
+#define SIM_PCU_STATE_PERIOD_US             1000000ULL
+#define SIM_PCU_MAC_ADDRESS                 "00:1b:63:84:45:e6"
+
+static yapi_y6g_pcu_summary_status_t _summary;
+static yapi_serial_number_read_response_t _deviceInfo;
+static bool _subEnabled = false;
+static uint16_t _subInterval_ms = 0;
+static uint64_t _subNext_us = 0;
+static yapi_device_id_enum_t _subTarget = YAPI_DEVICE_EXTERNAL_PC;
+static uint64_t _stateNext_us = 0;
+static uint32_t _published = 0;
+
+/*****************************************************/
+/* Section: Private functions                        */
+/*****************************************************/
+
+static bool _yapi_sim_pcu_is_request_for_us(yapi_packet_t* yapiPkt) {
+  return yapiPkt->targetId == YAPI_DEVICE_PCU && !(yapiPkt->messageData.type & 0xF0);
+}
+
+/**
+ * @brief Slow moving battery, fast moving power: a SUB consumer sees a few fields change per update
+ */
+static void _yapi_sim_pcu_evolve(uint64_t now_us) {
+  _summary.net_watts_w = gzrand_in_range(-300, 300);
+  _summary.net_amps_dA = _summary.net_watts_w * 10 / 13;
+  if (now_us < _stateNext_us) {
+    return;
+  }
+  _stateNext_us = now_us + SIM_PCU_STATE_PERIOD_US;
+  _summary.average_net_watts_w = (_summary.average_net_watts_w * 3 + _summary.net_watts_w) / 4;
+  int soc = _summary.soc + (_summary.average_net_watts_w > 0 ? 1 : -1);
+  _summary.soc = soc < 0 ? 0 : (soc > 100 ? 100 : soc);
+  _summary.capacity_remaining_wh = (uint32_t)_summary.capacity_wh * _summary.soc / 100;
+  _summary.battery_temp_C = 25 + gzrand_in_range(-1, 1);
+}
+
+static void _yapi_sim_pcu_serial_read_cb(yapi_packet_t* yapiPkt) {
+  if (!_yapi_sim_pcu_is_request_for_us(yapiPkt) || yapiPkt->messageData.type != YAPI_MSG_GET_RQST) {
+    return;
+  }
+  yapi_codec_send_response_from<YAPI_CMD_SERIAL_READ>(YAPI_DEVICE_PCU, (yapi_device_id_enum_t)yapiPkt->senderId,
+                                                      YAPI_MSG_GET_RESP_OK, YAPI_PRIORITY_HIGH, _deviceInfo);
+}
+
+static void _yapi_sim_pcu_serial_write_cb(yapi_packet_t* yapiPkt) {
+  if (!_yapi_sim_pcu_is_request_for_us(yapiPkt) || yapiPkt->messageData.type != YAPI_MSG_SET_RQST) {
+    return;
+  }
+  yapi_serial_number_write_request_t request;
+  yapi_codec_decode_request<YAPI_CMD_SERIAL_WRITE>(yapiPkt, &request);
+  request.serialString[sizeof(request.serialString) - 1] = '\0';
+  yapi_serial_number_write_response_t response;
+  if (!strlen(request.serialString)) {
+    response.code = YAPI_SERIAL_RESPONSE_FAIL_INVALID_FORMAT;
+  } else if (_deviceInfo.fieldEntryValid.serial_num_valid) {
+    response.code = YAPI_SERIAL_RESPONSE_FAIL_ALREADY_SET;
+  } else {
+    response.code = YAPI_SERIAL_RESPONSE_SUCCESS;
+    memcpy(_deviceInfo.serialNumberString, request.serialString, sizeof(_deviceInfo.serialNumberString));
+    _deviceInfo.fieldEntryValid.serial_num_valid = 1;
+    GZ_LOG_INFO("yapi_sim PCU: serial number set (%s)\n", _deviceInfo.serialNumberString);
+  }
+  yapi_codec_send_response_from<YAPI_CMD_SERIAL_WRITE>(YAPI_DEVICE_PCU, (yapi_device_id_enum_t)yapiPkt->senderId,
+                                                       response.code == YAPI_SERIAL_RESPONSE_SUCCESS ? YAPI_MSG_SET_RESP_OK : YAPI_MSG_SET_RESP_ERR,
+                                                       YAPI_PRIORITY_HIGH, response);
+}
+
+static void _yapi_sim_pcu_summary_status_cb(yapi_packet_t* yapiPkt) {
+  if (!_yapi_sim_pcu_is_request_for_us(yapiPkt)) {
+    return;
+  }
+  yapi_device_id_enum_t host = (yapi_device_id_enum_t)yapiPkt->senderId;
+  if (yapiPkt->messageData.type == YAPI_MSG_GET_RQST) {
+    yapi_codec_send_response_from<YAPI_CMD_PCU_SUMMARY_STATUS>(YAPI_DEVICE_PCU, host, YAPI_MSG_GET_RESP_OK, YAPI_PRIORITY_LOW, _summary);
+  } else if (yapiPkt->messageData.type == YAPI_MSG_SUB_RQST) {
+    yapi_subscription_request_t request;
+    yapi_codec_decode_as(yapiPkt->data, yapiPkt->length, &request);
+    _subEnabled = request.enable;
+    _subInterval_ms = request.interval_ms < YAPI_SIM_PCU_MIN_SUB_INTERVAL_MS ? YAPI_SIM_PCU_MIN_SUB_INTERVAL_MS : request.interval_ms;
+    _subNext_us = yapi_sim_link_now_us() + _subInterval_ms * 1000ULL;
+    _subTarget = host;
+    GZ_LOG_INFO("yapi_sim PCU: summary status SUB enable[%d] interval[%d] ms\n", _subEnabled, _subInterval_ms);
+    yapi_codec_send_response_from<YAPI_CMD_PCU_SUMMARY_STATUS>(YAPI_DEVICE_PCU, host, YAPI_MSG_SUB_RESP_OK, YAPI_PRIORITY_LOW, _summary);
+  }
+}
+
+static void _yapi_sim_pcu_hello_cb(yapi_packet_t* yapiPkt) {
+  if (!_yapi_sim_pcu_is_request_for_us(yapiPkt)) {
+    return;
+  }
+  yapi_codec_empty_t empty;
+  yapi_codec_send_response_from<YAPI_CMD_HELLO>(YAPI_DEVICE_PCU, (yapi_device_id_enum_t)yapiPkt->senderId,
+                                                (yapi_message_type_enum_t)(yapiPkt->messageData.type | YAPI_MSG_GET_RESP_OK),
+                                                YAPI_PRIORITY_LOW, empty);
+}
+
+/*****************************************************/
+/* Section: Public function definitions              */
+/*****************************************************/
+
+void yapi_sim_pcu_init(void) {
+  memset(&_summary, 0, sizeof(_summary));
+  _summary.soh = 100;
+  _summary.soc = 80;
+  _summary.capacity_wh = 4000;
+  _summary.capacity_remaining_wh = 3200;
+  _summary.battery_voltage_mV = 25600;
+  _summary.battery_temp_C = 25;
+  _summary.temp_sense_C = 24;
+
+  memset(&_deviceInfo, 0, sizeof(_deviceInfo));
+  snprintf(_deviceInfo.macAddress, sizeof(_deviceInfo.macAddress), "%s", SIM_PCU_MAC_ADDRESS);
+  _deviceInfo.fieldEntryValid.mac_address_valid = 1;
+  _deviceInfo.fieldEntryValid.fw_ver_pcu_valid = 1;
+  _deviceInfo.fieldEntryValid.fw_ver_mppt_valid = 1;
+  _deviceInfo.fwVersion_PCU = 100;
+  _deviceInfo.fwVersion_MPPT = 100;
+  _deviceInfo.hwVersion_PCU_WMU = 1;
+
+  yapi_service_register_cmd_cb(_yapi_sim_pcu_serial_read_cb, YAPI_CMD_SERIAL_READ);
+  yapi_service_register_cmd_cb(_yapi_sim_pcu_serial_write_cb, YAPI_CMD_SERIAL_WRITE);
+  yapi_service_register_cmd_cb(_yapi_sim_pcu_summary_status_cb, YAPI_CMD_PCU_SUMMARY_STATUS);
+  yapi_service_register_cmd_cb(_yapi_sim_pcu_hello_cb, YAPI_CMD_HELLO);
+}
+
+void yapi_sim_pcu_task(void) {
+  uint64_t now_us = yapi_sim_link_now_us();
+  if (!_subEnabled || now_us < _subNext_us) {
+    return;
+  }
+  _subNext_us += _subInterval_ms * 1000ULL;
+  if (_subNext_us < now_us) { // fell behind, do not burst
+    _subNext_us = now_us + _subInterval_ms * 1000ULL;
+  }
+  _yapi_sim_pcu_evolve(now_us);
+  yapi_codec_send_response_from<YAPI_CMD_PCU_SUMMARY_STATUS>(YAPI_DEVICE_PCU, _subTarget, YAPI_MSG_UNSOLICITED, YAPI_PRIORITY_LOW, _summary);
+  _published++;
+}
+
+uint32_t yapi_sim_pcu_published_count(void) {
+  return _published;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,36 @@
+/**
+ * yapi_sim_pcu.h
+ *
+ * Emulated PCU: serial number read/write and summary status GET/SUB streams.
+ *
+ * Author: Quang Nguyen <quang.nguyen@goalzero.com>
+ */
+
+#ifndef YAPI_SIM_PCU_H
+#define YAPI_SIM_PCU_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YAPI_SIM_PCU_MIN_SUB_INTERVAL_MS    10
+
+void yapi_sim_pcu_init(void);
+
+/**
+ * @brief Evolves the emulated state and publishes the subscribed streams that are due
+ */
+void yapi_sim_pcu_task(void);
+
+/**
+ * @brief Summary status frames published since start
+ */
+uint32_t yapi_sim_pcu_published_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YAPI_SIM_PCU_H